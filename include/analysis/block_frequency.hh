@@ -0,0 +1,254 @@
+#ifndef LEECH_JIT_INCLUDE_ANALYSIS_BLOCK_FREQUENCY_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_ANALYSIS_BLOCK_FREQUENCY_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "loop_analyzer.hh"
+
+namespace ljit
+{
+// Execution counts of the block's edges, in order of its successors
+using EdgeProfile =
+  std::unordered_map<const BasicBlock *, std::vector<std::uint64_t>>;
+
+// Edge counts of IfInstr blocks from the profile attached to the function
+[[nodiscard]] inline EdgeProfile makeEdgeProfile(const Function &func)
+{
+  EdgeProfile res;
+  const auto *const profile = func.getProfile();
+  if (profile == nullptr)
+    return res;
+
+  for (const auto &bb : func)
+  {
+    if (bb.empty() || bb.getLast().getInstType() != InstType::kIf)
+      continue;
+    if (const auto *const counts = profile->getBranchCounts(bb.getId());
+        counts != nullptr)
+      res[&bb] = {(*counts)[0], (*counts)[1]};
+  }
+  return res;
+}
+
+// Static block frequency estimation.
+// Branch probabilities come from the profile if it is given for the block,
+// otherwise from heuristics: staying in the loop is likely, going to the
+// return block is unlikely. Frequencies are propagated through the loop nest
+// from inner loops: probability of returning to the header multiplies
+// frequencies inside the loop by 1 / (1 - p). Entry block has frequency 1.
+class BlockFrequencyInfo final
+{
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+  using LoopInfo = Loops::LoopInfo;
+  using EdgeTy = std::pair<const BasicBlock *, const BasicBlock *>;
+
+public:
+  // Probability to stay in the loop
+  static constexpr double kLoopBranchProb = 0.875;
+  // Probability to go to the return block
+  static constexpr double kReturnProb = 0.25;
+  // Limit for the frequency of loop header relative to its preheader
+  static constexpr double kMaxLoopScale = 1024.;
+
+  explicit BlockFrequencyInfo(const GraphTy &graph,
+                              const EdgeProfile &profile = {})
+    : m_loops(graph)
+  {
+    const auto rpo = graph::depthFirstSearchReversePostOrder(graph);
+    for (std::size_t idx = 0; idx < rpo.size(); ++idx)
+      m_rpoIdx[rpo[idx]] = idx;
+
+    for (auto *const bb : rpo)
+      computeProbs(bb, profile);
+
+    for (const auto *const loop : m_loops.getLoopsInnerFirst())
+      propagate(rpo, loop);
+    propagate(rpo, nullptr);
+  }
+
+  // Uses the profile attached to the function if there is one
+  explicit BlockFrequencyInfo(const Function &func)
+    : BlockFrequencyInfo(func.makeBBGraph(), makeEdgeProfile(func))
+  {}
+
+  // Relative to the entry block, zero for unreachable ones
+  [[nodiscard]] double getFrequency(const BasicBlock *bb) const
+  {
+    const auto found = m_freqs.find(bb);
+    return found == m_freqs.end() ? 0. : found->second;
+  }
+
+  [[nodiscard]] double getProbability(const BasicBlock *src,
+                                      const BasicBlock *dst) const
+  {
+    const auto found = m_probs.find(src);
+    if (found == m_probs.end())
+      return 0.;
+    for (const auto &[succ, prob] : found->second)
+      if (succ == dst)
+        return prob;
+    return 0.;
+  }
+
+  [[nodiscard]] double getEdgeFrequency(const BasicBlock *src,
+                                        const BasicBlock *dst) const
+  {
+    return getFrequency(src) * getProbability(src, dst);
+  }
+
+private:
+  [[nodiscard]] bool contains(const LoopInfo *loop, BasicBlock *bb) const
+  {
+    for (const auto *cur = m_loops.getLoopInfo(bb); cur != nullptr;
+         cur = cur->getOuterLoop())
+      if (cur == loop)
+        return true;
+    return false;
+  }
+
+  [[nodiscard]] static bool isReturn(const BasicBlock *bb)
+  {
+    return !bb->empty() && bb->getLast().getInstType() == InstType::kRet;
+  }
+
+  // Share the probability between marked successors and the rest, returns
+  // false if the heuristic does not apply
+  static bool split(std::vector<std::pair<BasicBlock *, double>> &probs,
+                    const std::vector<bool> &marked, double prob)
+  {
+    const auto numMarked = static_cast<std::size_t>(
+      std::count(marked.begin(), marked.end(), true));
+    if (numMarked == 0 || numMarked == probs.size())
+      return false;
+
+    const auto numRest = probs.size() - numMarked;
+    for (std::size_t idx = 0; idx < probs.size(); ++idx)
+      probs[idx].second =
+        marked[idx] ? prob / static_cast<double>(numMarked)
+                    : (1. - prob) / static_cast<double>(numRest);
+    return true;
+  }
+
+  void computeProbs(BasicBlock *bb, const EdgeProfile &profile)
+  {
+    auto &probs = m_probs[bb];
+    for (auto *const succ : bb->getSucc())
+      if (std::none_of(probs.begin(), probs.end(),
+                       [succ](const auto &pair) { return pair.first == succ; }))
+        probs.emplace_back(succ, 1.);
+    if (probs.empty())
+      return;
+
+    for (auto &pair : probs)
+      pair.second = 1. / static_cast<double>(probs.size());
+
+    if (const auto found = profile.find(bb); found != profile.end())
+    {
+      const auto &counts = found->second;
+      const auto total =
+        std::accumulate(counts.begin(), counts.end(), std::uint64_t{0});
+      if (counts.size() == bb->numSucc() && total != 0)
+      {
+        for (auto &pair : probs)
+          pair.second = 0.;
+        for (std::size_t idx = 0; idx < counts.size(); ++idx)
+        {
+          auto *const succ = bb->getSucc()[idx];
+          std::find_if(probs.begin(), probs.end(), [succ](const auto &pair) {
+            return pair.first == succ;
+          })->second += static_cast<double>(counts[idx]) /
+                        static_cast<double>(total);
+        }
+        return;
+      }
+    }
+
+    std::vector<bool> marked(probs.size());
+    const auto *const loop = m_loops.getLoopInfo(bb);
+    if (loop != nullptr && !loop->isRoot() && loop->reducible())
+    {
+      std::transform(
+        probs.begin(), probs.end(), marked.begin(),
+        [&](const auto &pair) { return contains(loop, pair.first); });
+      if (split(probs, marked, kLoopBranchProb))
+        return;
+    }
+
+    std::transform(probs.begin(), probs.end(), marked.begin(),
+                   [](const auto &pair) { return isReturn(pair.first); });
+    split(probs, marked, kReturnProb);
+  }
+
+  [[nodiscard]] bool isBackEdge(const BasicBlock *src,
+                                const BasicBlock *dst) const
+  {
+    return m_rpoIdx.at(src) >= m_rpoIdx.at(dst);
+  }
+
+  // Frequencies relative to the loop header (or the entry for the whole
+  // function). Back edges to the header give its cyclic probability.
+  void propagate(const std::vector<BasicBlock *> &rpo, const LoopInfo *loop)
+  {
+    auto *const head = loop == nullptr ? rpo.front() : loop->getHeader();
+    m_cyclic[head] = 0.;
+
+    for (auto *const bb : rpo)
+    {
+      if (loop != nullptr && !contains(loop, bb))
+        continue;
+
+      double freq = 1.;
+      if (bb != head)
+      {
+        freq = 0.;
+        for (const auto *const pred : bb->getPred())
+          if (m_rpoIdx.count(pred) != 0 && !isBackEdge(pred, bb))
+            freq += m_edgeFreqs[EdgeTy{pred, bb}];
+      }
+
+      // Inner loops are already processed
+      if (const auto *const inner = m_loops.getLoopInfo(bb);
+          inner != loop && inner->getHeader() == bb && !inner->isRoot() &&
+          inner->reducible())
+      {
+        const auto cyclic =
+          std::min(m_cyclic[bb], 1. - 1. / kMaxLoopScale);
+        freq /= 1. - cyclic;
+      }
+      m_freqs[bb] = freq;
+
+      for (const auto &[succ, prob] : m_probs[bb])
+      {
+        if (loop != nullptr && succ == head)
+          m_cyclic[head] += freq * prob;
+        else
+          m_edgeFreqs[EdgeTy{bb, succ}] = freq * prob;
+      }
+    }
+  }
+
+  Loops m_loops;
+  std::unordered_map<const BasicBlock *, std::size_t> m_rpoIdx{};
+  std::unordered_map<const BasicBlock *,
+                     std::vector<std::pair<BasicBlock *, double>>>
+    m_probs{};
+  std::unordered_map<const BasicBlock *, double> m_freqs{};
+  std::unordered_map<const BasicBlock *, double> m_cyclic{};
+  std::map<EdgeTy, double> m_edgeFreqs{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_ANALYSIS_BLOCK_FREQUENCY_HH_INCLUDED */
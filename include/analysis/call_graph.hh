@@ -0,0 +1,163 @@
+#ifndef LEECH_JIT_INCLUDE_ANALYSIS_CALL_GRAPH_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_ANALYSIS_CALL_GRAPH_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+
+namespace ljit
+{
+// Call graph of the module.
+// Strongly connected components are built w/ Tarjan's algorithm, which emits
+// them in bottom-up order: callees go before their callers.
+class CallGraph final
+{
+public:
+  using SCC = std::vector<Function *>;
+
+private:
+  static constexpr auto kNoIdx = std::numeric_limits<std::size_t>::max();
+
+  struct Node final
+  {
+    std::vector<Call *> callSites{};
+    std::vector<Function *> callees{};
+    std::size_t sccId{kNoIdx};
+
+    // Tarjan's algorithm state
+    std::size_t index{kNoIdx};
+    std::size_t lowLink{};
+    bool onStack{false};
+  };
+
+  std::unordered_map<const Function *, Node> m_nodes{};
+  std::vector<SCC> m_sccs{};
+
+public:
+  explicit CallGraph(const Module &module)
+  {
+    for (const auto &func : module)
+      collectCalls(func.get());
+
+    std::size_t index = 0;
+    std::vector<Function *> stack;
+    for (const auto &func : module)
+      if (getNode(func.get()).index == kNoIdx)
+        visit(func.get(), index, stack);
+  }
+
+  [[nodiscard]] const auto &getCallSites(const Function *func) const
+  {
+    return getNode(func).callSites;
+  }
+
+  [[nodiscard]] const auto &getCallees(const Function *func) const
+  {
+    return getNode(func).callees;
+  }
+
+  // SCCs in bottom-up order
+  [[nodiscard]] const auto &getSCCs() const noexcept
+  {
+    return m_sccs;
+  }
+
+  [[nodiscard]] auto getSCCId(const Function *func) const
+  {
+    return getNode(func).sccId;
+  }
+
+  [[nodiscard]] bool isRecursive(const Function *func) const
+  {
+    const auto &callees = getCallees(func);
+    return m_sccs[getSCCId(func)].size() != 1 ||
+           std::find(callees.begin(), callees.end(), func) != callees.end();
+  }
+
+private:
+  [[nodiscard]] const Node &getNode(const Function *func) const
+  {
+    const auto found = m_nodes.find(func);
+    LJIT_ASSERT(found != m_nodes.end());
+    return found->second;
+  }
+
+  [[nodiscard]] Node &getNode(const Function *func)
+  {
+    const auto found = m_nodes.find(func);
+    LJIT_ASSERT(found != m_nodes.end());
+    return found->second;
+  }
+
+  void collectCalls(const Function *func)
+  {
+    auto &node = m_nodes[func];
+    // Function w/o body is only a declaration
+    if (func->size() == 0)
+      return;
+
+    graph::depthFirstSearchPreOrder(func->makeBBGraph(), [&](BasicBlock *bb) {
+      for (auto &inst : *bb)
+      {
+        if (inst.getInstType() != InstType::kCall)
+          continue;
+
+        auto &call = static_cast<Call &>(inst);
+        node.callSites.push_back(&call);
+
+        auto *const callee = call.getCallee();
+        if (std::find(node.callees.begin(), node.callees.end(), callee) ==
+            node.callees.end())
+          node.callees.push_back(callee);
+      }
+    });
+  }
+
+  void visit(Function *func, std::size_t &index, std::vector<Function *> &stack)
+  {
+    auto &node = getNode(func);
+    node.index = node.lowLink = index++;
+    node.onStack = true;
+    stack.push_back(func);
+
+    for (auto *const callee : node.callees)
+    {
+      auto &calleeNode = getNode(callee);
+      if (calleeNode.index == kNoIdx)
+      {
+        visit(callee, index, stack);
+        node.lowLink = std::min(node.lowLink, calleeNode.lowLink);
+      }
+      else if (calleeNode.onStack)
+        node.lowLink = std::min(node.lowLink, calleeNode.index);
+    }
+
+    if (node.lowLink != node.index)
+      return;
+
+    auto &scc = m_sccs.emplace_back();
+    Function *member = nullptr;
+    do
+    {
+      member = stack.back();
+      stack.pop_back();
+
+      auto &memberNode = getNode(member);
+      memberNode.onStack = false;
+      memberNode.sccId = m_sccs.size() - 1;
+      scc.push_back(member);
+    } while (member != func);
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_ANALYSIS_CALL_GRAPH_HH_INCLUDED */
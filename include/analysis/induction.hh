@@ -0,0 +1,319 @@
+#ifndef LEECH_JIT_INCLUDE_ANALYSIS_INDUCTION_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_ANALYSIS_INDUCTION_HH_INCLUDED
+
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common/common.hh"
+#include "ir/basic_block.hh"
+#include "ir/inst.hh"
+#include "loop_analyzer.hh"
+
+namespace ljit
+{
+// Basic induction variable: phi = phi(start, phi + step)
+struct InductionVar final
+{
+  Phi *phi{};
+  // Incoming value from outside of the loop
+  Value *start{};
+  // Incoming value from the back edge
+  BinOp *update{};
+  std::int64_t step{};
+};
+
+// Condition, which keeps execution inside the loop: iv <cmp> limit
+enum class ExitCmp
+{
+  kLess,
+  kLessEq,
+  kGreater,
+  kGreaterEq,
+  kNotEq,
+};
+
+struct LoopExitTest final
+{
+  const InductionVar *iv{};
+  Value *limit{};
+  ExitCmp cmp{};
+  IfInstr *branch{};
+  // Header's successor inside the loop
+  BasicBlock *body{};
+  BasicBlock *exit{};
+};
+
+class InductionAnalyzer final
+{
+public:
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+  using LoopInfo = typename Loops::LoopInfo;
+
+  explicit InductionAnalyzer(const Loops &loops)
+  {
+    for (const auto *loop : loops.getLoopsInnerFirst())
+      analyzeLoop(loop);
+  }
+
+  [[nodiscard]] const InductionVar *getIV(const Value *val) const
+  {
+    const auto found = m_ivs.find(val);
+    return found == m_ivs.end() ? nullptr : &found->second;
+  }
+
+  [[nodiscard]] const LoopExitTest *getExitTest(const LoopInfo *loop) const
+  {
+    const auto found = m_exits.find(loop);
+    return found == m_exits.end() ? nullptr : &found->second;
+  }
+
+  // Number of iterations of the counted loop w/ constant start and limit.
+  // It is exact if the loop is left only by the exit test.
+  [[nodiscard]] std::optional<std::uint64_t> getTripCount(
+    const LoopInfo *loop) const
+  {
+    const auto *const exit = getExitTest(loop);
+    if (exit == nullptr)
+      return std::nullopt;
+
+    const auto start = getConst(exit->iv->start);
+    const auto limit = getConst(exit->limit);
+    if (!start.has_value() || !limit.has_value())
+      return std::nullopt;
+
+    return computeTripCount(*start, *limit, exit->iv->step, exit->cmp,
+                            exit->iv->phi->getType());
+  }
+
+  // Returns nullopt for infinite loops and loops, where IV wraps around
+  [[nodiscard]] static std::optional<std::uint64_t> computeTripCount(
+    std::int64_t start, std::int64_t limit, std::int64_t step, ExitCmp cmp,
+    Type type)
+  {
+    if (step == 0 || step == std::numeric_limits<std::int64_t>::min())
+      return std::nullopt;
+
+    // Normalize to: iv goes up by step while iv < bound
+    std::int64_t dist{};
+    bool overflow = false;
+    switch (cmp)
+    {
+    case ExitCmp::kLess:
+    case ExitCmp::kLessEq: {
+      const bool enter = cmp == ExitCmp::kLess ? start < limit : start <= limit;
+      if (!enter)
+        return 0;
+      if (step < 0)
+        return std::nullopt;
+      overflow = __builtin_sub_overflow(limit, start, &dist);
+      if (cmp == ExitCmp::kLessEq)
+        overflow = overflow || __builtin_add_overflow(dist, 1, &dist);
+      break;
+    }
+    case ExitCmp::kGreater:
+    case ExitCmp::kGreaterEq: {
+      const bool enter =
+        cmp == ExitCmp::kGreater ? start > limit : start >= limit;
+      if (!enter)
+        return 0;
+      if (step > 0)
+        return std::nullopt;
+      overflow = __builtin_sub_overflow(start, limit, &dist);
+      if (cmp == ExitCmp::kGreaterEq)
+        overflow = overflow || __builtin_add_overflow(dist, 1, &dist);
+      break;
+    }
+    case ExitCmp::kNotEq: {
+      if (__builtin_sub_overflow(limit, start, &dist) || dist % step != 0 ||
+          dist / step < 0)
+        return std::nullopt;
+      // IV hits the limit exactly, so it cannot wrap
+      return static_cast<std::uint64_t>(dist / step);
+    }
+    default:
+      LJIT_UNREACHABLE("Unknown exit comparison");
+    }
+
+    if (overflow)
+      return std::nullopt;
+
+    const auto absStep = step < 0 ? -step : step;
+    const auto count = dist / absStep + (dist % absStep != 0 ? 1 : 0);
+
+    // Last update of IV should not wrap around
+    std::int64_t delta{};
+    std::int64_t last{};
+    if (__builtin_mul_overflow(count, step, &delta) ||
+        __builtin_add_overflow(start, delta, &last))
+      return std::nullopt;
+
+    const auto [min, max] = getTypeRange(type);
+    if (last < min || last > max)
+      return std::nullopt;
+
+    return static_cast<std::uint64_t>(count);
+  }
+
+  [[nodiscard]] bool isInvariant(const LoopInfo *loop, const Value *val) const
+  {
+    if (!val->isInst())
+      return true;
+
+    const auto &blocks = m_blocks.at(loop);
+    return blocks.find(static_cast<const Inst *>(val)->getBB()) ==
+           blocks.end();
+  }
+
+  [[nodiscard]] bool contains(const LoopInfo *loop, const BasicBlock *bb) const
+  {
+    const auto &blocks = m_blocks.at(loop);
+    return blocks.find(bb) != blocks.end();
+  }
+
+private:
+  void analyzeLoop(const LoopInfo *loop)
+  {
+    auto &blocks = m_blocks[loop];
+    for (auto *bb : loop->getLinearOrder())
+      blocks.insert(bb);
+
+    auto *const header = loop->getHeader();
+    for (auto &phiRef : header->collectInsts(InstType::kPhi))
+      tryAddIV(loop, static_cast<Phi &>(phiRef.get()));
+
+    if (auto exit = findExitTest(loop); exit.has_value())
+      m_exits.emplace(loop, *exit);
+  }
+
+  void tryAddIV(const LoopInfo *loop, Phi &phi)
+  {
+    if (phi.numEntries() != 2)
+      return;
+
+    const auto &fst = *phi.begin();
+    const auto &sec = *std::next(phi.begin());
+    const bool fstOut = !contains(loop, fst.bb);
+    const bool secOut = !contains(loop, sec.bb);
+    if (fstOut == secOut)
+      return;
+
+    auto *const start = fstOut ? fst.m_val : sec.m_val;
+    auto *const upd = fstOut ? sec.m_val : fst.m_val;
+    if (!upd->isInst() ||
+        static_cast<Inst *>(upd)->getInstType() != InstType::kBinOp)
+      return;
+
+    auto *const binop = static_cast<BinOp *>(upd);
+    const auto oper = binop->getOper();
+    const auto *const lhs = binop->getLeft();
+    const auto *const rhs = binop->getRight();
+
+    std::optional<std::int64_t> step;
+    if (oper == BinOp::Oper::kAdd && lhs == &phi)
+      step = getConst(rhs);
+    else if (oper == BinOp::Oper::kAdd && rhs == &phi)
+      step = getConst(lhs);
+    else if (oper == BinOp::Oper::kSub && lhs == &phi)
+    {
+      step = getConst(rhs);
+      if (step.has_value())
+        step = -*step;
+    }
+
+    if (!step.has_value() || *step == 0)
+      return;
+
+    m_ivs.emplace(&phi, InductionVar{&phi, start, binop, *step});
+  }
+
+  [[nodiscard]] std::optional<LoopExitTest> findExitTest(
+    const LoopInfo *loop) const
+  {
+    auto *const header = loop->getHeader();
+    if (header->empty() || header->getLast().getInstType() != InstType::kIf)
+      return std::nullopt;
+
+    auto *const branch = static_cast<IfInstr *>(&header->getLast());
+    auto *const trueBB = branch->getTrueBB();
+    auto *const falseBB = branch->getFalseBB();
+    const bool trueIn = contains(loop, trueBB);
+    if (trueIn == contains(loop, falseBB))
+      return std::nullopt;
+
+    auto *const cond = branch->getCond();
+    if (!cond->isInst() ||
+        static_cast<Inst *>(cond)->getInstType() != InstType::kBinOp)
+      return std::nullopt;
+
+    const auto *const cmp = static_cast<BinOp *>(cond);
+    const auto *lhsIV = getIV(cmp->getLeft());
+    const auto *rhsIV = getIV(cmp->getRight());
+    // Only IVs of this loop are interesting
+    if (lhsIV != nullptr && lhsIV->phi->getBB() != header)
+      lhsIV = nullptr;
+    if (rhsIV != nullptr && rhsIV->phi->getBB() != header)
+      rhsIV = nullptr;
+    if ((lhsIV == nullptr) == (rhsIV == nullptr))
+      return std::nullopt;
+
+    const bool ivLeft = lhsIV != nullptr;
+    auto *const limit = ivLeft ? cmp->getRight() : cmp->getLeft();
+    if (!isInvariant(loop, limit))
+      return std::nullopt;
+
+    ExitCmp exitCmp{};
+    switch (cmp->getOper())
+    {
+    case BinOp::Oper::kLE:
+      // iv < limit or limit < iv
+      if (ivLeft)
+        exitCmp = trueIn ? ExitCmp::kLess : ExitCmp::kGreaterEq;
+      else
+        exitCmp = trueIn ? ExitCmp::kGreater : ExitCmp::kLessEq;
+      break;
+    case BinOp::Oper::kEQ:
+      if (trueIn)
+        return std::nullopt;
+      exitCmp = ExitCmp::kNotEq;
+      break;
+    case BinOp::Oper::kAdd:
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kMul:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl:
+    case BinOp::Oper::kOr:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      return std::nullopt;
+    }
+
+    return LoopExitTest{ivLeft ? lhsIV : rhsIV,
+                        limit,
+                        exitCmp,
+                        branch,
+                        trueIn ? trueBB : falseBB,
+                        trueIn ? falseBB : trueBB};
+  }
+
+  [[nodiscard]] static std::optional<std::int64_t> getConst(const Value *val)
+  {
+    const auto *const cnst = tryRetrieveConst(val);
+    if (cnst == nullptr)
+      return std::nullopt;
+    return retrieveConstVal(cnst);
+  }
+
+  std::unordered_map<const Value *, InductionVar> m_ivs;
+  std::unordered_map<const LoopInfo *, LoopExitTest> m_exits;
+  std::unordered_map<const LoopInfo *, std::unordered_set<const BasicBlock *>>
+    m_blocks;
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_ANALYSIS_INDUCTION_HH_INCLUDED */
@@ -124,13 +124,14 @@ private:
 
   void processSucc(NodePtrTy bb, NodePtrTy succ, LiveSet &set) const
   {
-    auto foundIt = m_liveSets.find(succ);
-    if (foundIt == m_liveSets.end())
-      return;
-    auto &&succLiveSet = foundIt->second;
-
-    // Unite current set w/ successor's set
-    set.insert(succLiveSet.begin(), succLiveSet.end());
+    // Live set of the loop header is not ready yet for the back edge, but
+    // phi inputs from this block are still live at its end
+    if (auto foundIt = m_liveSets.find(succ); foundIt != m_liveSets.end())
+    {
+      // Unite current set w/ successor's set
+      auto &&succLiveSet = foundIt->second;
+      set.insert(succLiveSet.begin(), succLiveSet.end());
+    }
 
     for (const auto &inst : *succ)
     {
@@ -232,12 +233,18 @@ private:
     case InstType::kCast:
       consumeInput(static_cast<const Cast &>(inst).getSrc());
       break;
+    case InstType::kSelect:
+      std::for_each(inst.inputBegin(), inst.inputEnd(), consumeInput);
+      break;
     case InstType::kRet:
       consumeInput(static_cast<const Ret &>(inst).getVal());
       break;
     case InstType::kIf:
       consumeInput(static_cast<const IfInstr &>(inst).getCond());
       break;
+    case InstType::kSwitch:
+      consumeInput(static_cast<const Switch &>(inst).getVal());
+      break;
     case InstType::kCall:
       std::for_each(inst.inputBegin(), inst.inputEnd(), consumeInput);
       break;
@@ -250,6 +250,37 @@ public:
     return found->second;
   }
 
+  [[nodiscard]] const auto &getLoops() const noexcept
+  {
+    return m_loops;
+  }
+
+  // All reducible loops (w/o root one), inner loops go first
+  [[nodiscard]] std::vector<const LoopInfo *> getLoopsInnerFirst() const
+  {
+    std::vector<std::pair<std::size_t, const LoopInfo *>> withDepth;
+    for (const auto &loop : m_loops)
+    {
+      if (loop.isRoot() || !loop.reducible())
+        continue;
+
+      std::size_t depth = 0;
+      for (const auto *outer = loop.getOuterLoop(); outer != nullptr;
+           outer = outer->getOuterLoop())
+        ++depth;
+      withDepth.emplace_back(depth, &loop);
+    }
+
+    std::stable_sort(
+      withDepth.begin(), withDepth.end(),
+      [](const auto &lhs, const auto &rhs) { return lhs.first > rhs.first; });
+
+    std::vector<const LoopInfo *> res(withDepth.size());
+    std::transform(withDepth.begin(), withDepth.end(), res.begin(),
+                   [](const auto &pair) { return pair.second; });
+    return res;
+  }
+
 private:
   class Visitor final : public graph::DFSVisitor<GraphTy>
   {
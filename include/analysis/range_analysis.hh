@@ -0,0 +1,689 @@
+#ifndef LEECH_JIT_INCLUDE_ANALYSIS_RANGE_ANALYSIS_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_ANALYSIS_RANGE_ANALYSIS_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stack>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "graph/dom_tree.hh"
+#include "ir/basic_block.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Closed interval of signed integers, lo > hi stands for the empty one
+class Interval final
+{
+  std::int64_t m_lo{1};
+  std::int64_t m_hi{0};
+
+public:
+  constexpr Interval() = default;
+  constexpr Interval(std::int64_t lo, std::int64_t hi) : m_lo(lo), m_hi(hi)
+  {}
+
+  [[nodiscard]] static Interval makeFull(Type type)
+  {
+    if (type == Type::None)
+      return {};
+    const auto [tMin, tMax] = getTypeRange(type);
+    return {tMin, tMax};
+  }
+
+  [[nodiscard]] static constexpr Interval makeConst(std::int64_t val)
+  {
+    return {val, val};
+  }
+
+  [[nodiscard]] constexpr auto lo() const noexcept
+  {
+    return m_lo;
+  }
+
+  [[nodiscard]] constexpr auto hi() const noexcept
+  {
+    return m_hi;
+  }
+
+  [[nodiscard]] constexpr bool isEmpty() const noexcept
+  {
+    return m_lo > m_hi;
+  }
+
+  [[nodiscard]] constexpr bool isConst() const noexcept
+  {
+    return m_lo == m_hi;
+  }
+
+  [[nodiscard]] constexpr bool contains(std::int64_t val) const noexcept
+  {
+    return m_lo <= val && val <= m_hi;
+  }
+
+  [[nodiscard]] constexpr bool contains(const Interval &other) const noexcept
+  {
+    return other.isEmpty() || (m_lo <= other.m_lo && other.m_hi <= m_hi);
+  }
+
+  [[nodiscard]] constexpr Interval join(const Interval &other) const noexcept
+  {
+    if (isEmpty())
+      return other;
+    if (other.isEmpty())
+      return *this;
+    return {std::min(m_lo, other.m_lo), std::max(m_hi, other.m_hi)};
+  }
+
+  [[nodiscard]] constexpr Interval meet(const Interval &other) const noexcept
+  {
+    return {std::max(m_lo, other.m_lo), std::min(m_hi, other.m_hi)};
+  }
+
+  [[nodiscard]] constexpr bool operator==(const Interval &rhs) const noexcept
+  {
+    return (isEmpty() && rhs.isEmpty()) ||
+           (m_lo == rhs.m_lo && m_hi == rhs.m_hi);
+  }
+
+  [[nodiscard]] constexpr bool operator!=(const Interval &rhs) const noexcept
+  {
+    return !(*this == rhs);
+  }
+
+  void print(std::ostream &ost) const
+  {
+    if (isEmpty())
+      ost << "[]";
+    else
+      ost << '[' << m_lo << ", " << m_hi << ']';
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &ost, const Interval &interval)
+{
+  interval.print(ost);
+  return ost;
+}
+
+// Sparse value range analysis.
+// Uses of values dominated by IfInstr edge get refined copies of the values
+// (like pi-nodes of e-SSA, but kept inside of the analysis), then intervals
+// are propagated over def-use chains with widening at loop header phis,
+// followed by a couple of narrowing passes.
+class RangeAnalyzer final
+{
+  using GraphTy = BasicBlockGraph;
+  using Traits = GraphTraits<GraphTy>;
+  using NodePtrTy = typename Traits::node_pointer;
+
+  static constexpr std::size_t kNoNode =
+    std::numeric_limits<std::size_t>::max();
+  static constexpr std::size_t kMaxUpdates = 16;
+  static constexpr std::size_t kNarrowingPasses = 2;
+
+  // Constraint of refined value: val <rel> other
+  enum class Rel
+  {
+    kNone,
+    kLess,
+    kLessEq,
+    kGreater,
+    kGreaterEq,
+    kEq,
+    kNotEq,
+  };
+
+  struct Node final
+  {
+    // nullptr for refined values
+    const Inst *inst{};
+    Type type{};
+    Rel rel{};
+    // Resolved inputs; for refined value these are the value and the other
+    // side of condition (if any, zero is assumed otherwise)
+    std::vector<std::size_t> inputs{};
+    std::vector<std::size_t> users{};
+    Interval range{};
+    std::size_t numUpdates{};
+    bool widen{};
+  };
+
+  struct Constraint final
+  {
+    Value *val{};
+    Rel rel{};
+    Value *other{};
+  };
+
+public:
+  explicit RangeAnalyzer(const GraphTy &graph)
+  {
+    buildNodes(graph);
+    propagate();
+  }
+
+  // Range of the value valid at every its use
+  [[nodiscard]] Interval getRange(const Value *val) const
+  {
+    const auto found = m_ids.find(val);
+    if (found == m_ids.end())
+      return Interval::makeFull(val->getType());
+    return getNodeRange(found->second);
+  }
+
+  // Range of the instruction's input at this use
+  [[nodiscard]] Interval getInputRange(const Inst *inst, std::size_t idx) const
+  {
+    const auto found = m_ids.find(inst);
+    if (found == m_ids.end())
+      return Interval::makeFull(inst->inputAt(idx)->getType());
+
+    const auto &inputs = m_nodes[found->second].inputs;
+    if (idx >= inputs.size() || inputs[idx] == kNoNode)
+      return Interval::makeFull(inst->inputAt(idx)->getType());
+    return getNodeRange(inputs[idx]);
+  }
+
+private:
+  [[nodiscard]] Interval getNodeRange(std::size_t id) const
+  {
+    const auto &node = m_nodes[id];
+    // Unknown ranges (e.g. in unreachable code) are not trusted
+    if (node.range.isEmpty())
+      return Interval::makeFull(node.type);
+    return node.range;
+  }
+
+  void buildNodes(const GraphTy &graph)
+  {
+    const auto domTree = graph::buildDomTree(graph);
+    auto &&rpo = graph::depthFirstSearchReversePostOrder(graph);
+
+    for (auto *bb : rpo)
+      for (auto &inst : *bb)
+      {
+        m_ids.emplace(&inst, m_nodes.size());
+        m_nodes.push_back(
+          Node{&inst, inst.getType(), Rel::kNone, {}, {}, {}, 0, false});
+      }
+
+    // Loop headers are targets of back edges
+    for (auto *bb : rpo)
+    {
+      const bool isHeader =
+        std::any_of(bb->getPred().begin(), bb->getPred().end(),
+                    [&](BasicBlock *pred) {
+                      return domTree.isDominator(bb, pred);
+                    });
+      if (!isHeader)
+        continue;
+      for (auto &phi : bb->collectInsts(InstType::kPhi))
+        m_nodes[m_ids.at(&phi.get())].widen = true;
+    }
+
+    renameUses(graph, domTree);
+
+    for (std::size_t id = 0; id < m_nodes.size(); ++id)
+      for (auto inp : m_nodes[id].inputs)
+        if (inp != kNoNode)
+          m_nodes[inp].users.push_back(id);
+  }
+
+  // Walk dominator tree, resolving each use to the closest dominating
+  // refined copy of the value
+  void renameUses(const GraphTy &graph,
+                  const graph::DominatorTree<GraphTy> &domTree)
+  {
+    std::unordered_map<const Value *, std::vector<std::size_t>> stacks;
+    auto &&resolve = [&](const Value *val) {
+      const auto found = stacks.find(val);
+      if (found != stacks.end() && !found->second.empty())
+        return found->second.back();
+      const auto id = m_ids.find(val);
+      return id == m_ids.end() ? kNoNode : id->second;
+    };
+
+    // second == true means that node's scope should be closed
+    std::stack<std::pair<NodePtrTy, bool>> toVisit;
+    std::stack<std::vector<const Value *>> pushed;
+    toVisit.emplace(Traits::entryPoint(graph), false);
+
+    while (!toVisit.empty())
+    {
+      const auto [bb, leave] = toVisit.top();
+      toVisit.pop();
+
+      if (leave)
+      {
+        for (const auto *val : pushed.top())
+          stacks[val].pop_back();
+        pushed.pop();
+        continue;
+      }
+
+      toVisit.emplace(bb, true);
+      pushed.emplace();
+      for (const auto &cons : getConstraints(bb))
+      {
+        std::vector<std::size_t> inputs{resolve(cons.val)};
+        if (cons.other != nullptr)
+          inputs.push_back(resolve(cons.other));
+
+        m_order.push_back(m_nodes.size());
+        stacks[cons.val].push_back(m_nodes.size());
+        pushed.top().push_back(cons.val);
+        m_nodes.push_back(Node{nullptr, cons.val->getType(), cons.rel,
+                               std::move(inputs), {}, {}, 0, false});
+      }
+
+      for (auto &inst : *bb)
+      {
+        const auto id = m_ids.at(&inst);
+        m_order.push_back(id);
+        if (inst.getInstType() == InstType::kPhi)
+          continue;
+        auto &inputs = m_nodes[id].inputs;
+        std::transform(inst.inputBegin(), inst.inputEnd(),
+                       std::back_inserter(inputs), resolve);
+      }
+
+      for (auto *succ : bb->getSucc())
+        for (auto &phiRef : succ->collectInsts(InstType::kPhi))
+        {
+          const auto &phi = static_cast<const Phi &>(phiRef.get());
+          auto &inputs = m_nodes[m_ids.at(&phi)].inputs;
+          inputs.resize(phi.numEntries(), kNoNode);
+
+          std::size_t idx = 0;
+          for (const auto &entry : phi)
+          {
+            if (entry.bb == bb)
+              inputs[idx] = resolve(entry.m_val);
+            ++idx;
+          }
+        }
+
+      for (auto *dommed : domTree.getIDommed(bb))
+        toVisit.emplace(dommed, false);
+    }
+  }
+
+  // Facts known on entering the block from its only predecessor
+  [[nodiscard]] static std::vector<Constraint> getConstraints(NodePtrTy bb)
+  {
+    if (bb->numPred() != 1)
+      return {};
+
+    auto *const pred = bb->getPred().front();
+    if (pred->empty() || pred->getLast().getInstType() != InstType::kIf)
+      return {};
+
+    const auto &branch = static_cast<const IfInstr &>(pred->getLast());
+    if (branch.getTrueBB() == branch.getFalseBB())
+      return {};
+
+    const bool onTrue = branch.getTrueBB() == bb;
+    auto *const cond = branch.getCond();
+    std::vector<Constraint> res;
+    auto &&add = [&res](Value *val, Rel rel, Value *other) {
+      if (tryRetrieveConst(val) == nullptr)
+        res.push_back(Constraint{val, rel, other});
+    };
+
+    const auto *const cmp = static_cast<const Inst *>(cond);
+    if (cmp->getInstType() == InstType::kBinOp)
+    {
+      const auto &binop = static_cast<const BinOp &>(*cmp);
+      auto *const lhs = binop.getLeft();
+      auto *const rhs = binop.getRight();
+      switch (binop.getOper())
+      {
+      case BinOp::Oper::kLE:
+        add(lhs, onTrue ? Rel::kLess : Rel::kGreaterEq, rhs);
+        add(rhs, onTrue ? Rel::kGreater : Rel::kLessEq, lhs);
+        return res;
+      case BinOp::Oper::kEQ:
+        add(lhs, onTrue ? Rel::kEq : Rel::kNotEq, rhs);
+        add(rhs, onTrue ? Rel::kEq : Rel::kNotEq, lhs);
+        return res;
+      case BinOp::Oper::kAdd:
+      case BinOp::Oper::kSub:
+      case BinOp::Oper::kMul:
+      case BinOp::Oper::kDiv:
+      case BinOp::Oper::kShr:
+      case BinOp::Oper::kShl:
+      case BinOp::Oper::kOr:
+      case BinOp::Oper::kBoundsCheck:
+      default:
+        break;
+      }
+    }
+
+    // Compare with zero
+    add(cond, onTrue ? Rel::kNotEq : Rel::kEq, nullptr);
+    return res;
+  }
+
+  void propagate()
+  {
+    // Nodes are popped from the back, so start in dominator tree order
+    std::vector<std::size_t> worklist{m_order.rbegin(), m_order.rend()};
+    std::vector<bool> inList(m_nodes.size(), false);
+    for (auto id : worklist)
+      inList[id] = true;
+
+    while (!worklist.empty())
+    {
+      const auto id = worklist.back();
+      worklist.pop_back();
+      inList[id] = false;
+
+      auto &node = m_nodes[id];
+      auto res = node.range.join(eval(node));
+      if (res == node.range)
+        continue;
+
+      if (node.widen && !node.range.isEmpty())
+        res = widen(node.range, res, node.type);
+      if (++node.numUpdates > kMaxUpdates)
+        res = Interval::makeFull(node.type);
+
+      node.range = res;
+      for (auto user : node.users)
+        if (!inList[user])
+        {
+          inList[user] = true;
+          worklist.push_back(user);
+        }
+    }
+
+    for (std::size_t pass = 0; pass < kNarrowingPasses; ++pass)
+      for (auto id : m_order)
+      {
+        auto &node = m_nodes[id];
+        node.range = node.range.meet(eval(node));
+      }
+  }
+
+  [[nodiscard]] static Interval widen(const Interval &old, const Interval &cur,
+                                      Type type)
+  {
+    const auto full = Interval::makeFull(type);
+    return {cur.lo() < old.lo() ? full.lo() : old.lo(),
+            cur.hi() > old.hi() ? full.hi() : old.hi()};
+  }
+
+  [[nodiscard]] Interval inputRange(const Node &node, std::size_t idx) const
+  {
+    const auto id = node.inputs.at(idx);
+    return id == kNoNode ? Interval{} : m_nodes[id].range;
+  }
+
+  [[nodiscard]] Interval eval(const Node &node) const
+  {
+    if (node.inst == nullptr)
+    {
+      const auto other =
+        node.inputs.size() > 1 ? inputRange(node, 1) : Interval::makeConst(0);
+      return refine(inputRange(node, 0), node.rel, other);
+    }
+
+    const auto &inst = *node.inst;
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+      return Interval::makeConst(retrieveConstVal(&inst));
+    case InstType::kParam:
+    case InstType::kCall:
+      return Interval::makeFull(node.type);
+    case InstType::kPhi: {
+      Interval res{};
+      for (std::size_t idx = 0; idx < node.inputs.size(); ++idx)
+        res = res.join(inputRange(node, idx));
+      return res;
+    }
+    case InstType::kCast:
+      return evalCast(inputRange(node, 0), node.type);
+    case InstType::kSelect: {
+      const auto cond = inputRange(node, 0);
+      if (cond == Interval::makeConst(0))
+        return inputRange(node, 2);
+      if (!cond.contains(0))
+        return inputRange(node, 1);
+      return inputRange(node, 1).join(inputRange(node, 2));
+    }
+    case InstType::kUnaryOp: {
+      // Zero check
+      const auto val = inputRange(node, 0);
+      return refine(val, Rel::kNotEq, Interval::makeConst(0));
+    }
+    case InstType::kBinOp:
+      return evalBinOp(static_cast<const BinOp &>(inst).getOper(),
+                       inputRange(node, 0), inputRange(node, 1), node.type);
+    case InstType::kUnknown:
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    default:
+      return {};
+    }
+  }
+
+  [[nodiscard]] static Interval refine(const Interval &val, Rel rel,
+                                       const Interval &other)
+  {
+    if (val.isEmpty() || other.isEmpty())
+      return {};
+
+    constexpr auto kMin = std::numeric_limits<std::int64_t>::min();
+    constexpr auto kMax = std::numeric_limits<std::int64_t>::max();
+    switch (rel)
+    {
+    case Rel::kLess:
+      if (other.hi() == kMin)
+        return {};
+      return val.meet({kMin, other.hi() - 1});
+    case Rel::kLessEq:
+      return val.meet({kMin, other.hi()});
+    case Rel::kGreater:
+      if (other.lo() == kMax)
+        return {};
+      return val.meet({other.lo() + 1, kMax});
+    case Rel::kGreaterEq:
+      return val.meet({other.lo(), kMax});
+    case Rel::kEq:
+      return val.meet(other);
+    case Rel::kNotEq:
+      if (!other.isConst())
+        return val;
+      if (val.isConst() && val.lo() == other.lo())
+        return {};
+      if (val.lo() == other.lo())
+        return {val.lo() + 1, val.hi()};
+      if (val.hi() == other.lo())
+        return {val.lo(), val.hi() - 1};
+      return val;
+    case Rel::kNone:
+    default:
+      return val;
+    }
+  }
+
+  [[nodiscard]] static Interval evalCast(const Interval &src, Type type)
+  {
+    if (src.isEmpty())
+      return {};
+
+    if (type == Type::I1)
+    {
+      if (!src.contains(0))
+        return Interval::makeConst(1);
+      return src.isConst() ? Interval::makeConst(0) : Interval{0, 1};
+    }
+
+    const auto full = Interval::makeFull(type);
+    return full.contains(src) ? src : full;
+  }
+
+  [[nodiscard]] static Interval evalBinOp(BinOp::Oper oper, const Interval &lhs,
+                                          const Interval &rhs, Type type)
+  {
+    if (lhs.isEmpty() || rhs.isEmpty())
+      return {};
+
+    const auto full = Interval::makeFull(type);
+    // Result is valid only if it does not wrap around
+    auto &&fit = [&full](std::int64_t lo, std::int64_t hi) {
+      const Interval res{lo, hi};
+      return full.contains(res) ? res : full;
+    };
+
+    switch (oper)
+    {
+    case BinOp::Oper::kAdd: {
+      std::int64_t lo{};
+      std::int64_t hi{};
+      if (__builtin_add_overflow(lhs.lo(), rhs.lo(), &lo) ||
+          __builtin_add_overflow(lhs.hi(), rhs.hi(), &hi))
+        return full;
+      return fit(lo, hi);
+    }
+    case BinOp::Oper::kSub: {
+      std::int64_t lo{};
+      std::int64_t hi{};
+      if (__builtin_sub_overflow(lhs.lo(), rhs.hi(), &lo) ||
+          __builtin_sub_overflow(lhs.hi(), rhs.lo(), &hi))
+        return full;
+      return fit(lo, hi);
+    }
+    case BinOp::Oper::kMul: {
+      Interval res{};
+      for (auto lval : {lhs.lo(), lhs.hi()})
+        for (auto rval : {rhs.lo(), rhs.hi()})
+        {
+          std::int64_t prod{};
+          if (__builtin_mul_overflow(lval, rval, &prod))
+            return full;
+          res = res.join(Interval::makeConst(prod));
+        }
+      return fit(res.lo(), res.hi());
+    }
+    case BinOp::Oper::kDiv: {
+      // Division by zero traps, so zero divisor is excluded
+      const auto div = refine(rhs, Rel::kNotEq, Interval::makeConst(0));
+      if (div.isEmpty() || div.contains(0) ||
+          (lhs.contains(std::numeric_limits<std::int64_t>::min()) &&
+           div.contains(-1)))
+        return full;
+
+      Interval res{};
+      for (auto lval : {lhs.lo(), lhs.hi()})
+        for (auto rval : {div.lo(), div.hi()})
+          res = res.join(Interval::makeConst(lval / rval));
+      return fit(res.lo(), res.hi());
+    }
+    case BinOp::Oper::kShr: {
+      // Shift amount should be less than number of value bits
+      if (rhs.lo() < 0 || rhs.hi() >= getNumDigits(type))
+        return full;
+      return {std::min(lhs.lo() >> rhs.lo(), lhs.lo() >> rhs.hi()),
+              std::max(lhs.hi() >> rhs.lo(), lhs.hi() >> rhs.hi())};
+    }
+    case BinOp::Oper::kShl: {
+      if (rhs.lo() < 0 || rhs.hi() >= getNumDigits(type))
+        return full;
+      // Same as multiplication by 2^shamt
+      Interval res{};
+      for (auto lval : {lhs.lo(), lhs.hi()})
+        for (auto shamt : {rhs.lo(), rhs.hi()})
+        {
+          std::int64_t prod{};
+          if (__builtin_mul_overflow(lval, std::int64_t{1} << shamt, &prod))
+            return full;
+          res = res.join(Interval::makeConst(prod));
+        }
+      return fit(res.lo(), res.hi());
+    }
+    case BinOp::Oper::kOr: {
+      const auto mask =
+        lowBitsMask(std::max({lhs.hi(), rhs.hi(), std::int64_t{0}}));
+      if (lhs.lo() >= 0 && rhs.lo() >= 0)
+        return fit(std::max(lhs.lo(), rhs.lo()), mask);
+      if (lhs.hi() < 0 && rhs.hi() < 0)
+        return {std::max(lhs.lo(), rhs.lo()), -1};
+      // Result is negative, but not less than the negative operand
+      return fit(std::min(lhs.lo(), rhs.lo()),
+                 std::max(mask, std::int64_t{-1}));
+    }
+    case BinOp::Oper::kLE:
+      if (lhs.hi() < rhs.lo())
+        return Interval::makeConst(1);
+      if (lhs.lo() >= rhs.hi())
+        return Interval::makeConst(0);
+      return {0, 1};
+    case BinOp::Oper::kEQ:
+      if (lhs.isConst() && lhs == rhs)
+        return Interval::makeConst(1);
+      if (lhs.meet(rhs).isEmpty())
+        return Interval::makeConst(0);
+      return {0, 1};
+    case BinOp::Oper::kBoundsCheck:
+      // Passed index is known to be in bounds
+      if (rhs.hi() <= 0)
+        return {};
+      return lhs.meet({0, rhs.hi() - 1});
+    default:
+      LJIT_UNREACHABLE("Unknown binary operation");
+    }
+  }
+
+  [[nodiscard]] static std::int64_t getNumDigits(Type type)
+  {
+    switch (type)
+    {
+    case Type::I1:
+      return std::numeric_limits<bool>::digits;
+
+#define DO_CASE(w)                                                             \
+  case Type::I##w:                                                             \
+    return std::numeric_limits<std::int##w##_t>::digits;
+
+      DO_CASE(8)
+      DO_CASE(16)
+      DO_CASE(32)
+      DO_CASE(64)
+
+#undef DO_CASE
+
+    case Type::None:
+    default:
+      LJIT_UNREACHABLE("Bad type");
+    }
+  }
+
+  // Smallest 2^k - 1 not less than val
+  [[nodiscard]] static std::int64_t lowBitsMask(std::int64_t val)
+  {
+    std::int64_t mask = 0;
+    while (mask < val)
+      mask = (mask << 1) | 1;
+    return mask;
+  }
+
+  std::vector<Node> m_nodes;
+  // Dominator tree preorder, with refined values before block's instructions
+  std::vector<std::size_t> m_order;
+  std::unordered_map<const Value *, std::size_t> m_ids;
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_ANALYSIS_RANGE_ANALYSIS_HH_INCLUDED */
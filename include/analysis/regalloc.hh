@@ -90,6 +90,13 @@ public:
     return Location{interval->getLocId(), interval->isOnStack()};
   }
 
+  // Value keeps its location within the interval
+  [[nodiscard]] std::optional<LiveInterval> getLiveInterval(
+    ljit::Value *val) const
+  {
+    return m_liveAnalyzer.getLiveInterval(val);
+  }
+
 private:
   std::vector<LiveInterval *> buildSortedLiveIntervals()
   {
@@ -0,0 +1,500 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_AOT_CACHE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_AOT_CACHE_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "codegen/codegen.hh"
+#include "codegen/exec_memory.hh"
+#include "codegen/fault_handler.hh"
+#include "common/common.hh"
+#include "common/error.hh"
+#include "ir/structural_hash.hh"
+#include "profile/mapped_file.hh"
+
+namespace ljit
+{
+// Persistent cache of the generated code keyed by the caller given hash.
+// File layout (native byte order): header, records, relocations, implicit
+// checks, callee names and the blobs. Blob is placed so that its literal
+// pool starts a page and its code does not share pages w/ other blobs.
+// Loaded file is mapped privately, the code is executed in place: only the
+// pool pages are patched on install, so they are the only copied ones. Code
+// installed again w/ other relocation values is patched in its own copy.
+// Relocation slots are zero in the file, the checksum covers the code w/
+// them.
+class AotCache final
+{
+public:
+  using Key = std::uint64_t;
+  // Value of the relocation, zero if it cannot be resolved
+  using Resolver =
+    std::function<std::uintptr_t(RelocKind, const std::string &callee)>;
+
+  struct Reloc final
+  {
+    RelocKind kind{};
+    // Offset of the pool entry
+    std::size_t offset{};
+    // Name of the callee for the call cell
+    std::string callee{};
+  };
+
+  // Code w/ the literal pool at its end
+  struct Entry final
+  {
+    std::vector<std::uint8_t> code{};
+    std::size_t poolOffset{};
+    std::vector<Reloc> relocs{};
+    std::vector<ImplicitCheck> checks{};
+  };
+
+private:
+  static constexpr std::uint32_t kVersion = 2;
+  static constexpr char kMagic[] = "LJITCODE";
+  static constexpr std::size_t kMagicSize = 8;
+
+  struct FileHeader final
+  {
+    char magic[kMagicSize]{};
+    std::uint32_t version{};
+    std::uint32_t pageSize{};
+    std::uint64_t numRecords{};
+    std::uint64_t numRelocs{};
+    std::uint64_t numChecks{};
+    std::uint64_t namesSize{};
+    // Of the tables and the names
+    std::uint64_t checksum{};
+  };
+
+  struct FileRecord final
+  {
+    Key key{};
+    std::uint64_t codeOffset{};
+    std::uint64_t codeSize{};
+    std::uint64_t poolOffset{};
+    // Ranges of the relocation and the check tables
+    std::uint64_t firstReloc{};
+    std::uint64_t numRelocs{};
+    std::uint64_t firstCheck{};
+    std::uint64_t numChecks{};
+    std::uint64_t checksum{};
+  };
+
+  struct FileReloc final
+  {
+    std::uint64_t offset{};
+    std::uint64_t kind{};
+    std::uint64_t nameOffset{};
+    std::uint64_t nameSize{};
+  };
+
+  struct FileCheck final
+  {
+    std::uint64_t offset{};
+    std::uint64_t slowPath{};
+  };
+
+  struct Installed final
+  {
+    const void *code{};
+    // Resolved relocations
+    std::vector<std::uintptr_t> values{};
+    FaultHandler::Registration checks{};
+    // Patched copy of the loaded code
+    ExecMemory copy{};
+  };
+
+public:
+  AotCache() = default;
+
+  // Replaces the loaded file, throws on the malformed one
+  void load(const std::string &path)
+  {
+    const std::lock_guard lock{m_mutex};
+    if (!m_installed.empty())
+      throw AotCacheError{"Cannot reload the cache w/ installed code"};
+
+    auto file = MappedFile::openRead(path);
+    auto records = parse(file);
+    m_file = std::move(file);
+    m_records.clear();
+    for (const auto &rec : records)
+      m_records.emplace(rec.key, rec);
+  }
+
+  // Keeps the entry for the next save
+  void add(Key key, Entry entry)
+  {
+    const std::lock_guard lock{m_mutex};
+    m_pending.insert_or_assign(key, std::move(entry));
+  }
+
+  // Patches and maps executable the loaded code, it stays there until the
+  // cache is destroyed. Returns null if there is no valid code.
+  const void *install(Key key, const Resolver &resolve)
+  {
+    const std::lock_guard lock{m_mutex};
+    const auto found = m_records.find(key);
+    if (found == m_records.end())
+      return nullptr;
+
+    const auto &rec = found->second;
+    const auto relocs = readRelocs(rec);
+    std::vector<std::uintptr_t> values;
+    for (const auto &reloc : relocs)
+    {
+      const auto val = resolve(reloc.kind, reloc.callee);
+      if (val == 0)
+        return nullptr;
+      values.push_back(val);
+    }
+
+    const auto [first, last] = m_installed.equal_range(key);
+    for (auto it = first; it != last; ++it)
+      if (it->second.values == values)
+        return it->second.code;
+
+    auto *const code = m_file.data() + rec.codeOffset;
+    if (first != last)
+      return installCopy(key, rec, relocs, std::move(values));
+    if (getChecksum(code, rec.codeSize, {}) != rec.checksum)
+      return nullptr;
+
+    const auto pageSize = getPageSize();
+    auto *const pool = code + rec.poolOffset;
+    auto *const end = m_file.data() + alignUp(rec.codeOffset + rec.codeSize);
+    if (pool != end)
+    {
+      protect(pool, end, PROT_READ | PROT_WRITE);
+      for (std::size_t idx = 0; idx < relocs.size(); ++idx)
+        std::memcpy(code + relocs[idx].offset, &values[idx],
+                    sizeof(values[idx]));
+      protect(pool, end, PROT_READ);
+    }
+    protect(code - rec.codeOffset % pageSize, pool, PROT_READ | PROT_EXEC);
+
+    auto &installed = m_installed.emplace(key, Installed{})->second;
+    installed.code = code;
+    installed.values = std::move(values);
+    installed.checks = FaultHandler::add(code, rec.codeSize, readChecks(rec));
+    return code;
+  }
+
+  // Writes the loaded and the added entries. File is replaced atomically,
+  // so the loaded one stays intact while it is mapped.
+  void save(const std::string &path) const
+  {
+    const std::lock_guard lock{m_mutex};
+    std::map<Key, Entry> entries;
+    for (const auto &[key, rec] : m_records)
+      entries.emplace(key, readEntry(rec));
+    for (const auto &[key, entry] : m_pending)
+      entries.insert_or_assign(key, entry);
+
+    std::vector<FileRecord> records;
+    std::vector<FileReloc> relocs;
+    std::vector<FileCheck> checks;
+    std::string names;
+    for (const auto &[key, entry] : entries)
+    {
+      auto &rec = records.emplace_back();
+      rec.key = key;
+      rec.codeSize = entry.code.size();
+      rec.poolOffset = entry.poolOffset;
+      rec.firstReloc = relocs.size();
+      rec.numRelocs = entry.relocs.size();
+      rec.firstCheck = checks.size();
+      rec.numChecks = entry.checks.size();
+      rec.checksum =
+        getChecksum(entry.code.data(), entry.code.size(), entry.relocs);
+      for (const auto &reloc : entry.relocs)
+      {
+        relocs.push_back(FileReloc{reloc.offset,
+                                   static_cast<std::uint64_t>(reloc.kind),
+                                   names.size(), reloc.callee.size()});
+        names += reloc.callee;
+      }
+      for (const auto &check : entry.checks)
+        checks.push_back(FileCheck{check.offset, check.slowPath});
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, kMagic, kMagicSize);
+    header.version = kVersion;
+    header.pageSize = static_cast<std::uint32_t>(getPageSize());
+    header.numRecords = records.size();
+    header.numRelocs = relocs.size();
+    header.numChecks = checks.size();
+    header.namesSize = names.size();
+
+    // Blobs go after the tables
+    auto offset = alignUp(getMetaSize(header));
+    for (auto &rec : records)
+    {
+      rec.codeOffset = alignUp(offset + rec.poolOffset) - rec.poolOffset;
+      offset = alignUp(rec.codeOffset + rec.codeSize);
+    }
+
+    const auto tmpPath = path + ".tmp";
+    {
+      const auto file = MappedFile::create(tmpPath, offset);
+      auto *const data = file.data();
+      auto *cur = data + sizeof(FileHeader);
+      cur = write(cur, records.data(), records.size());
+      cur = write(cur, relocs.data(), relocs.size());
+      cur = write(cur, checks.data(), checks.size());
+      cur = write(cur, names.data(), names.size());
+      header.checksum = getChecksum(data + sizeof(FileHeader), cur);
+      write(data, &header, 1);
+
+      auto rec = records.begin();
+      for (const auto &item : entries)
+      {
+        const auto &entry = item.second;
+        auto *const code = data + (rec++)->codeOffset;
+        write(code, entry.code.data(), entry.code.size());
+        for (const auto &reloc : entry.relocs)
+          std::memset(code + reloc.offset, 0, sizeof(std::uint64_t));
+      }
+      file.sync();
+    }
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+      throw AotCacheError{"Cannot replace " + path};
+  }
+
+  [[nodiscard]] bool contains(Key key) const
+  {
+    const std::lock_guard lock{m_mutex};
+    return m_records.count(key) != 0 || m_pending.count(key) != 0;
+  }
+
+private:
+  [[nodiscard]] static std::size_t getPageSize()
+  {
+    return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  }
+
+  [[nodiscard]] static std::uint64_t alignUp(std::uint64_t offset)
+  {
+    const auto pageSize = getPageSize();
+    return (offset + pageSize - 1) / pageSize * pageSize;
+  }
+
+  [[nodiscard]] static std::uint64_t getMetaSize(const FileHeader &header)
+  {
+    return sizeof(FileHeader) + header.numRecords * sizeof(FileRecord) +
+           header.numRelocs * sizeof(FileReloc) +
+           header.numChecks * sizeof(FileCheck) + header.namesSize;
+  }
+
+  [[nodiscard]] static std::uint64_t getChecksum(const unsigned char *begin,
+                                                 const unsigned char *end)
+  {
+    Fnv1a hash;
+    hash.mix(begin, static_cast<std::size_t>(end - begin));
+    return hash.get();
+  }
+
+  // Relocation slots are hashed as zeros
+  [[nodiscard]] static std::uint64_t getChecksum(
+    const unsigned char *code, std::size_t size,
+    const std::vector<Reloc> &relocs)
+  {
+    std::vector<unsigned char> copy(code, code + size);
+    for (const auto &reloc : relocs)
+      std::memset(copy.data() + reloc.offset, 0, sizeof(std::uint64_t));
+    return getChecksum(copy.data(), copy.data() + copy.size());
+  }
+
+  template <class T>
+  static unsigned char *write(unsigned char *dst, const T *src,
+                              std::size_t num)
+  {
+    // Empty vectors may have no data
+    if (num != 0)
+      std::memcpy(dst, src, num * sizeof(T));
+    return dst + num * sizeof(T);
+  }
+
+  template <class T>
+  [[nodiscard]] T read(std::uint64_t offset) const
+  {
+    T res;
+    std::memcpy(&res, m_file.data() + offset, sizeof(T));
+    return res;
+  }
+
+  static void protect(unsigned char *begin, unsigned char *end, int prot)
+  {
+    if (::mprotect(begin, static_cast<std::size_t>(end - begin), prot) != 0)
+      throw AotCacheError{"Cannot protect the loaded code"};
+  }
+
+  [[nodiscard]] static std::vector<FileRecord> parse(const MappedFile &file)
+  {
+    const auto size = file.size();
+    if (size < sizeof(FileHeader))
+      throw AotCacheError{"Truncated code cache"};
+
+    FileHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, kMagicSize) != 0)
+      throw AotCacheError{"Bad code cache magic"};
+    if (header.version != kVersion || header.pageSize != getPageSize())
+      throw AotCacheError{"Unsupported code cache version"};
+    if (header.numRecords > size / sizeof(FileRecord) ||
+        header.numRelocs > size / sizeof(FileReloc) ||
+        header.numChecks > size / sizeof(FileCheck) ||
+        header.namesSize > size || getMetaSize(header) > size)
+      throw AotCacheError{"Truncated code cache"};
+    const auto *const meta = file.data() + sizeof(FileHeader);
+    if (getChecksum(meta, file.data() + getMetaSize(header)) !=
+        header.checksum)
+      throw AotCacheError{"Bad code cache checksum"};
+
+    std::vector<FileRecord> records(header.numRecords);
+    if (!records.empty())
+      std::memcpy(records.data(), meta, records.size() * sizeof(FileRecord));
+    const auto relocsOffset =
+      sizeof(FileHeader) + header.numRecords * sizeof(FileRecord);
+    const auto checksOffset =
+      relocsOffset + header.numRelocs * sizeof(FileReloc);
+
+    // Blobs are sorted and do not share pages
+    auto minOffset = alignUp(getMetaSize(header));
+    for (const auto &rec : records)
+    {
+      if (rec.codeOffset < minOffset || rec.codeSize > size ||
+          rec.codeOffset > size - rec.codeSize ||
+          rec.poolOffset > rec.codeSize || rec.poolOffset % 8 != 0 ||
+          (rec.codeOffset + rec.poolOffset) % getPageSize() != 0 ||
+          rec.firstReloc > header.numRelocs ||
+          rec.numRelocs > header.numRelocs - rec.firstReloc ||
+          rec.firstCheck > header.numChecks ||
+          rec.numChecks > header.numChecks - rec.firstCheck)
+        throw AotCacheError{"Bad code cache record"};
+      minOffset = alignUp(rec.codeOffset + rec.codeSize);
+
+      for (std::uint64_t idx = 0; idx < rec.numRelocs; ++idx)
+      {
+        FileReloc reloc;
+        std::memcpy(&reloc,
+                    file.data() + relocsOffset +
+                      (rec.firstReloc + idx) * sizeof(FileReloc),
+                    sizeof(reloc));
+        if (reloc.offset < rec.poolOffset || reloc.offset % 8 != 0 ||
+            reloc.offset >= rec.codeSize ||
+            reloc.kind > static_cast<std::uint64_t>(RelocKind::kDeoptCtx) ||
+            reloc.nameOffset > header.namesSize ||
+            reloc.nameSize > header.namesSize - reloc.nameOffset)
+          throw AotCacheError{"Bad code cache relocation"};
+      }
+      for (std::uint64_t idx = 0; idx < rec.numChecks; ++idx)
+      {
+        FileCheck check;
+        std::memcpy(&check,
+                    file.data() + checksOffset +
+                      (rec.firstCheck + idx) * sizeof(FileCheck),
+                    sizeof(check));
+        if (check.offset >= rec.poolOffset ||
+            check.slowPath >= rec.poolOffset)
+          throw AotCacheError{"Bad code cache check"};
+      }
+    }
+    return records;
+  }
+
+  // Loaded code is already patched w/ the values of the first install, it
+  // is checked against the file w/ the relocation slots cleared
+  const void *installCopy(Key key, const FileRecord &rec,
+                          const std::vector<Reloc> &relocs,
+                          std::vector<std::uintptr_t> values)
+  {
+    const auto *const loaded = m_file.data() + rec.codeOffset;
+    if (getChecksum(loaded, rec.codeSize, relocs) != rec.checksum)
+      return nullptr;
+
+    std::vector<std::uint8_t> code(loaded, loaded + rec.codeSize);
+    for (std::size_t idx = 0; idx < relocs.size(); ++idx)
+      std::memcpy(code.data() + relocs[idx].offset, &values[idx],
+                  sizeof(values[idx]));
+
+    ExecMemory copy{code, readChecks(rec)};
+    auto &installed = m_installed.emplace(key, Installed{})->second;
+    installed.code = copy.data();
+    installed.copy = std::move(copy);
+    installed.values = std::move(values);
+    return installed.code;
+  }
+
+  [[nodiscard]] std::uint64_t getRelocsOffset() const
+  {
+    const auto header = read<FileHeader>(0);
+    return sizeof(FileHeader) + header.numRecords * sizeof(FileRecord);
+  }
+
+  [[nodiscard]] std::vector<Reloc> readRelocs(const FileRecord &rec) const
+  {
+    const auto header = read<FileHeader>(0);
+    const auto namesOffset = getMetaSize(header) - header.namesSize;
+    std::vector<Reloc> res;
+    for (std::uint64_t idx = 0; idx < rec.numRelocs; ++idx)
+    {
+      const auto reloc = read<FileReloc>(
+        getRelocsOffset() + (rec.firstReloc + idx) * sizeof(FileReloc));
+      const auto *const name = m_file.data() + namesOffset + reloc.nameOffset;
+      res.push_back(Reloc{static_cast<RelocKind>(reloc.kind), reloc.offset,
+                          std::string(name, name + reloc.nameSize)});
+    }
+    return res;
+  }
+
+  [[nodiscard]] std::vector<ImplicitCheck> readChecks(
+    const FileRecord &rec) const
+  {
+    const auto header = read<FileHeader>(0);
+    const auto checksOffset =
+      getRelocsOffset() + header.numRelocs * sizeof(FileReloc);
+    std::vector<ImplicitCheck> res;
+    for (std::uint64_t idx = 0; idx < rec.numChecks; ++idx)
+    {
+      const auto check = read<FileCheck>(
+        checksOffset + (rec.firstCheck + idx) * sizeof(FileCheck));
+      res.push_back(ImplicitCheck{check.offset, check.slowPath});
+    }
+    return res;
+  }
+
+  // Relocation slots of the installed code are patched in the mapping
+  [[nodiscard]] Entry readEntry(const FileRecord &rec) const
+  {
+    const auto *const code = m_file.data() + rec.codeOffset;
+    Entry res{std::vector<std::uint8_t>(code, code + rec.codeSize),
+              rec.poolOffset, readRelocs(rec), readChecks(rec)};
+    for (const auto &reloc : res.relocs)
+      std::memset(res.code.data() + reloc.offset, 0, sizeof(std::uint64_t));
+    return res;
+  }
+
+  mutable std::mutex m_mutex{};
+  MappedFile m_file{};
+  std::unordered_map<Key, FileRecord> m_records{};
+  std::unordered_map<Key, Entry> m_pending{};
+  std::unordered_multimap<Key, Installed> m_installed{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_AOT_CACHE_HH_INCLUDED */
@@ -0,0 +1,522 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_ASSEMBLER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_ASSEMBLER_HH_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+
+namespace ljit::x86
+{
+enum class Reg : std::uint8_t
+{
+  kRax,
+  kRcx,
+  kRdx,
+  kRbx,
+  kRsp,
+  kRbp,
+  kRsi,
+  kRdi,
+  kR8,
+  kR9,
+  kR10,
+  kR11,
+  kR12,
+  kR13,
+  kR14,
+  kR15,
+};
+
+// Integer argument registers of SysV calling convention
+inline constexpr std::array kArgRegs{Reg::kRdi, Reg::kRsi, Reg::kRdx,
+                                     Reg::kRcx, Reg::kR8,  Reg::kR9};
+
+// Condition codes in the order of their encoding
+enum class Cond : std::uint8_t
+{
+  kO,
+  kNO,
+  kB,
+  kAE,
+  kE,
+  kNE,
+  kBE,
+  kA,
+  kS,
+  kNS,
+  kP,
+  kNP,
+  kL,
+  kGE,
+  kLE,
+  kG,
+};
+
+// [base + disp]
+struct Mem final
+{
+  Reg base{};
+  std::int32_t disp{};
+};
+
+enum class AluOp : std::uint8_t
+{
+  kAdd,
+  kOr,
+  kAnd,
+  kSub,
+  kXor,
+  kCmp,
+};
+
+enum class ShiftOp : std::uint8_t
+{
+  kShl,
+  kSar,
+};
+
+struct Label final
+{
+  std::size_t id{};
+};
+
+// Encoder of 64-bit integer instructions.
+// Jumps and RIP-relative loads always use rel32 displacements, they are
+// patched when the code is finalized, so labels may be bound after use.
+class Assembler final
+{
+  std::vector<std::uint8_t> m_code{};
+  // Offset of bound label, kUnbound otherwise
+  std::vector<std::size_t> m_labels{};
+  // Offset of rel32 field and its target label
+  std::vector<std::pair<std::size_t, std::size_t>> m_fixups{};
+
+  static constexpr auto kUnbound = std::numeric_limits<std::size_t>::max();
+
+public:
+  [[nodiscard]] auto size() const noexcept
+  {
+    return m_code.size();
+  }
+
+  [[nodiscard]] const auto &getCode() const noexcept
+  {
+    return m_code;
+  }
+
+  [[nodiscard]] Label newLabel()
+  {
+    m_labels.push_back(kUnbound);
+    return Label{m_labels.size() - 1};
+  }
+
+  void bind(Label label)
+  {
+    LJIT_ASSERT_MSG(m_labels.at(label.id) == kUnbound, "Label is bound twice");
+    m_labels[label.id] = m_code.size();
+  }
+
+  [[nodiscard]] bool isBound(Label label) const
+  {
+    return m_labels.at(label.id) != kUnbound;
+  }
+
+  [[nodiscard]] std::size_t getOffset(Label label) const
+  {
+    LJIT_ASSERT_MSG(isBound(label), "Offset of unbound label");
+    return m_labels[label.id];
+  }
+
+  // Resolve jumps and return the code
+  [[nodiscard]] std::vector<std::uint8_t> finalize()
+  {
+    for (const auto &[pos, label] : m_fixups)
+    {
+      const auto target = m_labels.at(label);
+      LJIT_ASSERT_MSG(target != kUnbound, "Jump to unbound label");
+      const auto rel = static_cast<std::int64_t>(target) -
+                       static_cast<std::int64_t>(pos + sizeof(std::int32_t));
+      patch32(pos, static_cast<std::int32_t>(rel));
+    }
+    m_fixups.clear();
+    return m_code;
+  }
+
+  // mov dst, src
+  void mov(Reg dst, Reg src)
+  {
+    emitRR(0x89, src, dst);
+  }
+
+  // mov dst, imm (shortest form, zero is set by xor and clobbers flags)
+  void mov(Reg dst, std::int64_t imm)
+  {
+    if (imm == 0)
+    {
+      // xor dst32, dst32
+      emitRex(false, dst, dst);
+      emit8(0x31);
+      emitModRR(dst, dst);
+    }
+    else if (fitsInt32(imm))
+    {
+      emitRex(true, Reg::kRax, dst);
+      emit8(0xC7);
+      emitModRR(Reg::kRax, dst);
+      emit32(static_cast<std::int32_t>(imm));
+    }
+    else
+    {
+      emitRex(true, Reg::kRax, dst);
+      emit8(static_cast<std::uint8_t>(0xB8 + low3(dst)));
+      emit64(static_cast<std::uint64_t>(imm));
+    }
+  }
+
+  // mov dst, qword [mem]
+  void mov(Reg dst, Mem src)
+  {
+    emitRM(0x8B, dst, src);
+  }
+
+  // mov qword [mem], src
+  void mov(Mem dst, Reg src)
+  {
+    emitRM(0x89, src, dst);
+  }
+
+  // mov dst, qword [rip + label]
+  void mov(Reg dst, Label src)
+  {
+    emitRex(true, dst, Reg::kRax);
+    emit8(0x8B);
+    emit8(static_cast<std::uint8_t>(0x05U | (low3(dst) << 3U)));
+    emitFixup(src);
+  }
+
+  void lea(Reg dst, Mem src)
+  {
+    emitRM(0x8D, dst, src);
+  }
+
+  // movsx dst, src8/src16/src32
+  void movsx8(Reg dst, Reg src)
+  {
+    emitRex(true, dst, src);
+    emit8(0x0F);
+    emit8(0xBE);
+    emitModRR(dst, src);
+  }
+
+  void movsx16(Reg dst, Reg src)
+  {
+    emitRex(true, dst, src);
+    emit8(0x0F);
+    emit8(0xBF);
+    emitModRR(dst, src);
+  }
+
+  void movsx32(Reg dst, Reg src)
+  {
+    emitRR(0x63, dst, src);
+  }
+
+  // movzx dst32, src8
+  void movzx8(Reg dst, Reg src)
+  {
+    emitRexByte(dst, src);
+    emit8(0x0F);
+    emit8(0xB6);
+    emitModRR(dst, src);
+  }
+
+  // op dst, src
+  void alu(AluOp op, Reg dst, Reg src)
+  {
+    emitRR(static_cast<std::uint8_t>(getAluExt(op) * 8 + 1), src, dst);
+  }
+
+  // op dst, imm32
+  void alu(AluOp op, Reg dst, std::int32_t imm)
+  {
+    emitRex(true, Reg::kRax, dst);
+    if (imm >= std::numeric_limits<std::int8_t>::min() &&
+        imm <= std::numeric_limits<std::int8_t>::max())
+    {
+      emit8(0x83);
+      emitModExt(getAluExt(op), dst);
+      emit8(static_cast<std::uint8_t>(imm));
+      return;
+    }
+    emit8(0x81);
+    emitModExt(getAluExt(op), dst);
+    emit32(imm);
+  }
+
+  void test(Reg lhs, Reg rhs)
+  {
+    emitRR(0x85, rhs, lhs);
+  }
+
+  // imul dst, src
+  void imul(Reg dst, Reg src)
+  {
+    emitRex(true, dst, src);
+    emit8(0x0F);
+    emit8(0xAF);
+    emitModRR(dst, src);
+  }
+
+  // Sign-extend rax into rdx:rax
+  void cqo()
+  {
+    emit8(0x48);
+    emit8(0x99);
+  }
+
+  // rax = rdx:rax / src, rdx = rdx:rax % src
+  void idiv(Reg src)
+  {
+    emitRex(true, Reg::kRax, src);
+    emit8(0xF7);
+    emitModExt(7, src);
+  }
+
+  void neg(Reg reg)
+  {
+    emitRex(true, Reg::kRax, reg);
+    emit8(0xF7);
+    emitModExt(3, reg);
+  }
+
+  // op reg, cl
+  void shift(ShiftOp op, Reg reg)
+  {
+    emitRex(true, Reg::kRax, reg);
+    emit8(0xD3);
+    emitModExt(op == ShiftOp::kShl ? 4 : 7, reg);
+  }
+
+  // setcc reg8
+  void setcc(Cond cond, Reg dst)
+  {
+    emitRexByte(Reg::kRax, dst);
+    emit8(0x0F);
+    emit8(static_cast<std::uint8_t>(0x90 + static_cast<unsigned>(cond)));
+    emitModRR(Reg::kRax, dst);
+  }
+
+  void cmov(Cond cond, Reg dst, Reg src)
+  {
+    emitRex(true, dst, src);
+    emit8(0x0F);
+    emit8(static_cast<std::uint8_t>(0x40 + static_cast<unsigned>(cond)));
+    emitModRR(dst, src);
+  }
+
+  void push(Reg reg)
+  {
+    if (isExt(reg))
+      emit8(0x41);
+    emit8(static_cast<std::uint8_t>(0x50 + low3(reg)));
+  }
+
+  void pop(Reg reg)
+  {
+    if (isExt(reg))
+      emit8(0x41);
+    emit8(static_cast<std::uint8_t>(0x58 + low3(reg)));
+  }
+
+  void jmp(Label target)
+  {
+    emit8(0xE9);
+    emitFixup(target);
+  }
+
+  void jcc(Cond cond, Label target)
+  {
+    emit8(0x0F);
+    emit8(static_cast<std::uint8_t>(0x80 + static_cast<unsigned>(cond)));
+    emitFixup(target);
+  }
+
+  // call reg
+  void call(Reg target)
+  {
+    emitRex(false, Reg::kRax, target);
+    emit8(0xFF);
+    emitModExt(2, target);
+  }
+
+  // call qword [mem]
+  void call(Mem target)
+  {
+    emitRex(false, Reg::kRax, target.base);
+    emit8(0xFF);
+    emitMem(2, target);
+  }
+
+  void ret()
+  {
+    emit8(0xC3);
+  }
+
+  void ud2()
+  {
+    emit8(0x0F);
+    emit8(0x0B);
+  }
+
+  // Pads w/ int3 up to the alignment
+  void align(std::size_t alignment)
+  {
+    while (m_code.size() % alignment != 0)
+      emit8(0xCC);
+  }
+
+  // Literal data
+  void data64(std::uint64_t val)
+  {
+    emit64(val);
+  }
+
+  [[nodiscard]] static bool fitsInt32(std::int64_t val)
+  {
+    return val >= std::numeric_limits<std::int32_t>::min() &&
+           val <= std::numeric_limits<std::int32_t>::max();
+  }
+
+private:
+  [[nodiscard]] static unsigned getIdx(Reg reg)
+  {
+    return static_cast<unsigned>(reg);
+  }
+
+  [[nodiscard]] static unsigned low3(Reg reg)
+  {
+    return getIdx(reg) & 7U;
+  }
+
+  [[nodiscard]] static bool isExt(Reg reg)
+  {
+    return getIdx(reg) >= 8;
+  }
+
+  [[nodiscard]] static unsigned getAluExt(AluOp op)
+  {
+    switch (op)
+    {
+    case AluOp::kAdd:
+      return 0;
+    case AluOp::kOr:
+      return 1;
+    case AluOp::kAnd:
+      return 4;
+    case AluOp::kSub:
+      return 5;
+    case AluOp::kXor:
+      return 6;
+    case AluOp::kCmp:
+      return 7;
+    default:
+      LJIT_UNREACHABLE("Unknown ALU operation");
+    }
+  }
+
+  void emit8(std::uint8_t byte)
+  {
+    m_code.push_back(byte);
+  }
+
+  void emit32(std::int32_t val)
+  {
+    const auto bits = static_cast<std::uint32_t>(val);
+    for (unsigned i = 0; i < 4; ++i)
+      emit8(static_cast<std::uint8_t>(bits >> (8 * i)));
+  }
+
+  void emit64(std::uint64_t val)
+  {
+    for (unsigned i = 0; i < 8; ++i)
+      emit8(static_cast<std::uint8_t>(val >> (8 * i)));
+  }
+
+  void patch32(std::size_t pos, std::int32_t val)
+  {
+    const auto bits = static_cast<std::uint32_t>(val);
+    for (unsigned i = 0; i < 4; ++i)
+      m_code.at(pos + i) = static_cast<std::uint8_t>(bits >> (8 * i));
+  }
+
+  void emitFixup(Label target)
+  {
+    m_fixups.emplace_back(m_code.size(), target.id);
+    emit32(0);
+  }
+
+  // REX w/ reg in ModRM.reg and rm in ModRM.rm
+  void emitRex(bool wide, Reg reg, Reg rm)
+  {
+    const auto rex = 0x40U | (wide ? 0x8U : 0U) | (isExt(reg) ? 0x4U : 0U) |
+                     (isExt(rm) ? 0x1U : 0U);
+    if (wide || rex != 0x40U)
+      emit8(static_cast<std::uint8_t>(rex));
+  }
+
+  // Byte registers spl..dil require REX as well
+  void emitRexByte(Reg reg, Reg rm)
+  {
+    if (getIdx(reg) >= 4 || getIdx(rm) >= 4)
+      emit8(static_cast<std::uint8_t>(0x40U | (isExt(reg) ? 0x4U : 0U) |
+                                      (isExt(rm) ? 0x1U : 0U)));
+  }
+
+  void emitModRR(Reg reg, Reg rm)
+  {
+    emit8(static_cast<std::uint8_t>(0xC0U | (low3(reg) << 3U) | low3(rm)));
+  }
+
+  void emitModExt(unsigned ext, Reg rm)
+  {
+    emit8(static_cast<std::uint8_t>(0xC0U | (ext << 3U) | low3(rm)));
+  }
+
+  void emitMem(unsigned reg, Mem mem)
+  {
+    const bool isDisp8 = mem.disp >= std::numeric_limits<std::int8_t>::min() &&
+                         mem.disp <= std::numeric_limits<std::int8_t>::max();
+    const auto mod = isDisp8 ? 0x40U : 0x80U;
+    emit8(static_cast<std::uint8_t>(mod | (reg << 3U) | low3(mem.base)));
+    // rsp and r12 as a base require SIB
+    if (low3(mem.base) == 4)
+      emit8(0x24);
+    if (isDisp8)
+      emit8(static_cast<std::uint8_t>(mem.disp));
+    else
+      emit32(mem.disp);
+  }
+
+  // REX.W op reg, rm
+  void emitRR(std::uint8_t opcode, Reg reg, Reg rm)
+  {
+    emitRex(true, reg, rm);
+    emit8(opcode);
+    emitModRR(reg, rm);
+  }
+
+  void emitRM(std::uint8_t opcode, Reg reg, Mem mem)
+  {
+    emitRex(true, reg, mem.base);
+    emit8(opcode);
+    emitMem(low3(reg), mem);
+  }
+};
+} // namespace ljit::x86
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_ASSEMBLER_HH_INCLUDED */
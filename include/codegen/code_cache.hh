@@ -0,0 +1,514 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_CODE_CACHE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_CODE_CACHE_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "codegen/fault_handler.hh"
+#include "common/common.hh"
+#include "common/error.hh"
+
+namespace ljit
+{
+struct CodeCacheParams final
+{
+  // Rounded up to the pages
+  std::size_t regionSize{std::size_t{2} << 20};
+  // Bytes of the code kept by the collection
+  std::size_t budget{std::size_t{64} << 20};
+  // Wasted share of the reserved bytes, which triggers the compaction if
+  // there is a region wasted
+  double maxFragmentation{0.25};
+  // Regions are aligned and advised to be backed by transparent huge pages
+  bool hugePages{};
+};
+
+struct CodeCacheStats final
+{
+  std::size_t numRegions{};
+  std::size_t numBlobs{};
+  // Mapped bytes
+  std::size_t reserved{};
+  // Bytes of the live code
+  std::size_t used{};
+  // Bytes of the removed code and the padding, reclaimed by the compaction
+  std::size_t wasted{};
+  std::size_t numEvicted{};
+  std::size_t numCompactions{};
+  // Protection changes of the regions
+  std::size_t numFlips{};
+
+  [[nodiscard]] double getOccupancy() const noexcept
+  {
+    return reserved == 0 ? 0.0
+                         : static_cast<double>(used) /
+                             static_cast<double>(reserved);
+  }
+
+  [[nodiscard]] double getFragmentation() const noexcept
+  {
+    return reserved == 0 ? 0.0
+                         : static_cast<double>(wasted) /
+                             static_cast<double>(reserved);
+  }
+};
+
+// Storage of the generated code in large mmaped regions.
+// Start of the region is sealed as read + execute, the rest is writable and
+// holds no code (W^X). Blobs are appended to the writable part by a batch,
+// which seals the filled pages of every region once on commit. Last written
+// page stays writable, so the next batches pack their blobs into it. Blobs
+// on it are pending until it is filled or sealed by the flush.
+// Code is owned by the cache: the owner is told the address of its blob by
+// the relocator, once the blob is executable. The relocator gets null when
+// the blob is evicted. Removed and
+// evicted code is reclaimed by the collection only, it must be called when
+// no thread runs the cached code. It evicts the least recently used blobs
+// over the budget and compacts the regions by moving the rest down, so the
+// code must be position independent.
+class CodeCache final
+{
+public:
+  using BlobId = std::size_t;
+  using Relocator = std::function<void(const void *code)>;
+
+  static constexpr BlobId kNoBlob = std::numeric_limits<BlobId>::max();
+
+private:
+  static constexpr std::size_t kAlign = 16;
+  static constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+  struct Region final
+  {
+    std::uint8_t *base{};
+    std::size_t size{};
+    // Read + execute part
+    std::size_t sealed{};
+    // Written part
+    std::size_t cursor{};
+  };
+
+  struct Blob final
+  {
+    std::size_t region{};
+    std::size_t offset{};
+    std::size_t size{};
+    std::vector<ImplicitCheck> checks{};
+    FaultHandler::Registration registration{};
+    Relocator relocator{};
+    std::uint64_t lastUse{};
+    bool removed{};
+  };
+
+public:
+  // Writes blobs under the lock of the cache
+  class Batch final
+  {
+    CodeCache *m_cache{};
+    std::unique_lock<std::mutex> m_lock{};
+    std::vector<BlobId> m_added{};
+
+  public:
+    explicit Batch(CodeCache &cache) : m_cache(&cache), m_lock(cache.m_mutex)
+    {}
+
+    LJIT_NO_COPY_SEMANTICS(Batch);
+    LJIT_DEFAULT_MOVE_SEMANTICS(Batch);
+    // Not committed blobs are dropped
+    ~Batch()
+    {
+      if (m_lock.owns_lock())
+        m_cache->discard(m_added);
+    }
+
+    // Code is not executable until the commit
+    BlobId add(const std::vector<std::uint8_t> &code,
+               std::vector<ImplicitCheck> checks, Relocator relocator)
+    {
+      LJIT_ASSERT_MSG(m_lock.owns_lock(), "Batch is committed");
+      const auto id =
+        m_cache->append(code, std::move(checks), std::move(relocator));
+      m_added.push_back(id);
+      return id;
+    }
+
+    // Seals the filled pages and tells the owners the addresses of the blobs
+    // on them, the rest is pending
+    void commit()
+    {
+      LJIT_ASSERT_MSG(m_lock.owns_lock(), "Batch is committed");
+      m_cache->seal(m_added);
+      m_lock.unlock();
+    }
+  };
+
+  explicit CodeCache(const CodeCacheParams &params = {})
+    : m_params(params),
+      m_pageSize(static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)))
+  {}
+
+  LJIT_NO_COPY_SEMANTICS(CodeCache);
+  LJIT_NO_MOVE_SEMANTICS(CodeCache);
+  ~CodeCache()
+  {
+    m_blobs.clear();
+    for (const auto &region : m_regions)
+      ::munmap(region.base, region.size);
+  }
+
+  [[nodiscard]] Batch beginBatch()
+  {
+    return Batch{*this};
+  }
+
+  // Seals the last written pages and publishes the pending blobs
+  void flush()
+  {
+    const std::lock_guard lock{m_mutex};
+    for (auto &region : m_regions)
+    {
+      if (region.sealed == region.cursor)
+        continue;
+      const auto end = roundToPages(region.cursor);
+      protect(region, region.sealed, end, PROT_READ | PROT_EXEC);
+      m_wasted += end - region.cursor;
+      region.sealed = region.cursor = end;
+    }
+    publish(std::exchange(m_pending, {}));
+  }
+
+  [[nodiscard]] const void *getCode(BlobId id) const
+  {
+    const std::lock_guard lock{m_mutex};
+    return getAddress(m_blobs.at(id));
+  }
+
+  // Marks the code as recently used
+  void touch(BlobId id)
+  {
+    const std::lock_guard lock{m_mutex};
+    if (const auto found = m_blobs.find(id); found != m_blobs.end())
+      found->second.lastUse = ++m_clock;
+  }
+
+  // Code may be running until the collection
+  void remove(BlobId id)
+  {
+    const std::lock_guard lock{m_mutex};
+    auto &blob = m_blobs.at(id);
+    if (std::exchange(blob.removed, true))
+      return;
+    m_used -= blob.size;
+    m_wasted += blob.size;
+  }
+
+  [[nodiscard]] bool needsCollect() const
+  {
+    const std::lock_guard lock{m_mutex};
+    return m_used > m_params.budget || isFragmented();
+  }
+
+  // Must be called when no thread runs the cached code
+  void collect()
+  {
+    const std::lock_guard lock{m_mutex};
+    evictColdBlobs();
+    for (auto it = m_blobs.begin(); it != m_blobs.end();)
+      it = it->second.removed ? m_blobs.erase(it) : std::next(it);
+    if (isFragmented())
+      compact();
+  }
+
+  [[nodiscard]] CodeCacheStats getStats() const
+  {
+    const std::lock_guard lock{m_mutex};
+    CodeCacheStats stats{};
+    stats.numRegions = m_regions.size();
+    stats.numBlobs = m_blobs.size();
+    stats.reserved = getReserved();
+    stats.used = m_used;
+    stats.wasted = m_wasted;
+    stats.numEvicted = m_numEvicted;
+    stats.numCompactions = m_numCompactions;
+    stats.numFlips = m_numFlips;
+    return stats;
+  }
+
+private:
+  [[nodiscard]] const void *getAddress(const Blob &blob) const
+  {
+    return m_regions[blob.region].base + blob.offset;
+  }
+
+  [[nodiscard]] std::size_t getReserved() const
+  {
+    std::size_t res = 0;
+    for (const auto &region : m_regions)
+      res += region.size;
+    return res;
+  }
+
+  // Compaction frees at least a region
+  [[nodiscard]] bool isFragmented() const
+  {
+    return m_wasted >= m_params.regionSize &&
+           static_cast<double>(m_wasted) >
+             m_params.maxFragmentation * static_cast<double>(getReserved());
+  }
+
+  [[nodiscard]] std::size_t roundToPages(std::size_t size) const
+  {
+    return (size + m_pageSize - 1) / m_pageSize * m_pageSize;
+  }
+
+  [[nodiscard]] std::size_t roundDownToPages(std::size_t size) const
+  {
+    return size / m_pageSize * m_pageSize;
+  }
+
+  [[nodiscard]] static std::size_t alignUp(std::size_t size)
+  {
+    return (size + kAlign - 1) / kAlign * kAlign;
+  }
+
+  void protect(Region &region, std::size_t begin, std::size_t end, int prot)
+  {
+    if (begin == end)
+      return;
+    if (::mprotect(region.base + begin, end - begin, prot) != 0)
+      throw CodeGenError{"Cannot change protection of code"};
+    ++m_numFlips;
+  }
+
+  // Region w/ the writable part of the size at least
+  std::size_t getRegion(std::size_t size)
+  {
+    for (std::size_t idx = 0; idx < m_regions.size(); ++idx)
+      if (m_regions[idx].size - m_regions[idx].cursor >= size)
+        return idx;
+
+    auto regionSize = roundToPages(std::max(size, m_params.regionSize));
+    if (m_params.hugePages)
+      regionSize = (regionSize + kHugePageSize - 1) / kHugePageSize *
+                   kHugePageSize;
+    m_regions.push_back(Region{mapRegion(regionSize), regionSize, 0, 0});
+    return m_regions.size() - 1;
+  }
+
+  std::uint8_t *mapRegion(std::size_t size) const
+  {
+    const auto extra = m_params.hugePages ? kHugePageSize : 0;
+    void *const data = ::mmap(nullptr, size + extra, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+      throw CodeGenError{"Cannot allocate memory for code"};
+    if (!m_params.hugePages)
+      return static_cast<std::uint8_t *>(data);
+
+    // Huge pages need the aligned region
+    const auto addr = reinterpret_cast<std::uintptr_t>(data);
+    const auto aligned = (addr + kHugePageSize - 1) / kHugePageSize *
+                         kHugePageSize;
+    auto *const base = static_cast<std::uint8_t *>(data);
+    if (aligned != addr)
+      ::munmap(base, aligned - addr);
+    if (const auto tail = addr + extra - aligned; tail != 0)
+      ::munmap(base + (aligned - addr) + size, tail);
+    auto *const region = base + (aligned - addr);
+    // Only a hint: huge pages may be disabled
+    static_cast<void>(::madvise(region, size, MADV_HUGEPAGE));
+    return region;
+  }
+
+  BlobId append(const std::vector<std::uint8_t> &code,
+                std::vector<ImplicitCheck> checks, Relocator relocator)
+  {
+    const auto size = alignUp(std::max<std::size_t>(code.size(), 1));
+    const auto regionIdx = getRegion(size);
+    auto &region = m_regions[regionIdx];
+    std::memcpy(region.base + region.cursor, code.data(), code.size());
+
+    const auto id = m_nextId++;
+    auto &blob = m_blobs[id];
+    blob.region = regionIdx;
+    blob.offset = region.cursor;
+    blob.size = size;
+    blob.checks = std::move(checks);
+    blob.relocator = std::move(relocator);
+    blob.lastUse = ++m_clock;
+    region.cursor += size;
+    m_used += size;
+    return id;
+  }
+
+  void seal(const std::vector<BlobId> &added)
+  {
+    for (auto &region : m_regions)
+    {
+      const auto end = roundDownToPages(region.cursor);
+      protect(region, region.sealed, end, PROT_READ | PROT_EXEC);
+      region.sealed = end;
+    }
+
+    m_pending.insert(m_pending.end(), added.begin(), added.end());
+    const auto sealed = std::stable_partition(
+      m_pending.begin(), m_pending.end(), [this](BlobId id) {
+        const auto found = m_blobs.find(id);
+        return found != m_blobs.end() &&
+               found->second.offset + found->second.size >
+                 m_regions[found->second.region].sealed;
+      });
+    const std::vector<BlobId> published(sealed, m_pending.end());
+    m_pending.erase(sealed, m_pending.end());
+    publish(published);
+  }
+
+  // Removed and evicted blobs are skipped
+  void publish(const std::vector<BlobId> &ids)
+  {
+    for (const auto id : ids)
+    {
+      const auto found = m_blobs.find(id);
+      if (found == m_blobs.end() || found->second.removed)
+        continue;
+      auto &blob = found->second;
+      const auto *const code = getAddress(blob);
+      blob.registration = FaultHandler::add(code, blob.size, blob.checks);
+      if (blob.relocator)
+        blob.relocator(code);
+    }
+  }
+
+  void discard(const std::vector<BlobId> &added)
+  {
+    for (auto it = added.rbegin(); it != added.rend(); ++it)
+    {
+      const auto &blob = m_blobs.at(*it);
+      auto &region = m_regions[blob.region];
+      // Blobs of the batch are the last ones in their regions
+      region.cursor = std::min(region.cursor, blob.offset);
+      m_used -= blob.size;
+      m_blobs.erase(*it);
+    }
+  }
+
+  void evictColdBlobs()
+  {
+    if (m_used <= m_params.budget)
+      return;
+
+    std::vector<std::pair<std::uint64_t, BlobId>> live;
+    for (const auto &[id, blob] : m_blobs)
+      if (!blob.removed)
+        live.emplace_back(blob.lastUse, id);
+    std::sort(live.begin(), live.end());
+
+    for (const auto &[lastUse, id] : live)
+    {
+      if (m_used <= m_params.budget)
+        break;
+      auto &blob = m_blobs.at(id);
+      blob.removed = true;
+      m_used -= blob.size;
+      m_wasted += blob.size;
+      ++m_numEvicted;
+      if (blob.relocator)
+        blob.relocator(nullptr);
+    }
+  }
+
+  // Live blobs are moved down in the address order, empty regions are
+  // released
+  void compact()
+  {
+    std::vector<std::pair<std::pair<std::size_t, std::size_t>, BlobId>> order;
+    order.reserve(m_blobs.size());
+    for (const auto &[id, blob] : m_blobs)
+      order.emplace_back(std::pair{blob.region, blob.offset}, id);
+    std::sort(order.begin(), order.end());
+
+    for (auto &region : m_regions)
+    {
+      protect(region, 0, region.sealed, PROT_READ | PROT_WRITE);
+      region.cursor = 0;
+    }
+
+    std::size_t dstRegion = 0;
+    std::size_t dstOffset = 0;
+    std::vector<BlobId> moved;
+    for (const auto &[pos, id] : order)
+    {
+      auto &blob = m_blobs.at(id);
+      while (m_regions[dstRegion].size - dstOffset < blob.size)
+      {
+        ++dstRegion;
+        dstOffset = 0;
+      }
+      auto &dst = m_regions[dstRegion];
+      if (dstRegion != blob.region || dstOffset != blob.offset)
+      {
+        std::memmove(dst.base + dstOffset,
+                     m_regions[blob.region].base + blob.offset, blob.size);
+        blob.region = dstRegion;
+        blob.offset = dstOffset;
+        moved.push_back(id);
+      }
+      dstOffset += blob.size;
+      dst.cursor = dstOffset;
+    }
+
+    // Regions after the last used one are released
+    const auto numUsed = order.empty() ? 0 : dstRegion + 1;
+    for (std::size_t idx = numUsed; idx < m_regions.size(); ++idx)
+      ::munmap(m_regions[idx].base, m_regions[idx].size);
+    m_regions.resize(numUsed);
+
+    m_wasted = 0;
+    for (auto &region : m_regions)
+    {
+      const auto end = roundToPages(region.cursor);
+      protect(region, 0, end, PROT_READ | PROT_EXEC);
+      m_wasted += end - region.cursor;
+      region.sealed = region.cursor = end;
+    }
+
+    ++m_numCompactions;
+    // Pending blobs are sealed as well
+    for (const auto id : m_pending)
+      if (std::find(moved.begin(), moved.end(), id) == moved.end())
+        moved.push_back(id);
+    m_pending.clear();
+    publish(moved);
+  }
+
+  CodeCacheParams m_params{};
+  std::size_t m_pageSize{};
+
+  mutable std::mutex m_mutex{};
+  std::vector<Region> m_regions{};
+  std::unordered_map<BlobId, Blob> m_blobs{};
+  // Committed blobs on the writable pages
+  std::vector<BlobId> m_pending{};
+  BlobId m_nextId{};
+  std::uint64_t m_clock{};
+  std::size_t m_used{};
+  std::size_t m_wasted{};
+  std::size_t m_numEvicted{};
+  std::size_t m_numCompactions{};
+  std::size_t m_numFlips{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_CODE_CACHE_HH_INCLUDED */
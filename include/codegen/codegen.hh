@@ -0,0 +1,1031 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_CODEGEN_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_CODEGEN_HH_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <csetjmp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "analysis/regalloc.hh"
+#include "codegen/assembler.hh"
+#include "codegen/fault_handler.hh"
+#include "common/common.hh"
+#include "common/error.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Entry of the compiled code from C++. Trap of the code or of its callees
+// unwinds the compiled frames to the innermost entry of the thread, it is
+// rethrown there as TrapError. Compiled frames have no destructors, so they
+// are left by longjmp. Interpreted callees catch TrapError and raise it
+// again for their compiled callers.
+class TrapScope final
+{
+  struct Context final
+  {
+    TrapScope *scope{};
+    // Kind of the trap being unwound
+    TrapKind kind{};
+  };
+
+  static Context &getContext() noexcept
+  {
+    static thread_local Context ctx{};
+    return ctx;
+  }
+
+  TrapScope() noexcept : m_prev(getContext().scope)
+  {
+    getContext().scope = this;
+  }
+
+  std::jmp_buf m_buf{};
+  TrapScope *m_prev{};
+
+public:
+  LJIT_NO_COPY_SEMANTICS(TrapScope);
+  LJIT_NO_MOVE_SEMANTICS(TrapScope);
+  ~TrapScope()
+  {
+    getContext().scope = m_prev;
+  }
+
+  // Calls the compiled code, func must not have objects w/ destructors
+  template <class Func>
+  static std::int64_t call(Func func)
+  {
+    TrapScope scope;
+    // NOLINTNEXTLINE(cert-err52-cpp)
+    if (setjmp(scope.m_buf) != 0)
+    {
+      const auto kind = getContext().kind;
+      throw TrapError{kind, getTrapMessage(kind)};
+    }
+    return func();
+  }
+
+  // Aborts w/o the entry, e.g. when the code is called directly
+  [[noreturn]] static void raise(TrapKind kind)
+  {
+    auto &ctx = getContext();
+    if (ctx.scope == nullptr)
+    {
+      LJIT_PRINT_ERR("Trap in compiled code: %s\n", getTrapMessage(kind));
+      LJIT_ABORT();
+    }
+    ctx.kind = kind;
+    // NOLINTNEXTLINE(cert-err52-cpp)
+    std::longjmp(ctx.scope->m_buf, 1);
+  }
+};
+
+// Called by the compiled code on a failed check
+[[noreturn]] inline void onCompiledTrap(std::int64_t kind)
+{
+  TrapScope::raise(static_cast<TrapKind>(kind));
+}
+
+// Called by the compiled code on a failed guard instead of onCompiledTrap,
+// its result is returned by the deoptimized function:
+//   handler(ctx, resume, vals)
+// Values are the arguments for kNoResume, otherwise the ones of the block
+// resuming the function (see DeoptBlock).
+using DeoptHandler = std::int64_t (*)(void *ctx, std::int64_t resume,
+                                      const std::int64_t *vals);
+
+inline constexpr std::int64_t kNoResume = -1;
+
+// Block, whose guards deoptimize. The function is resumed w/ the values
+// instead of the arguments by the guards, where all of them are live.
+struct DeoptBlock final
+{
+  const BasicBlock *bb{};
+  std::int64_t resume{kNoResume};
+  std::vector<const Value *> values{};
+};
+
+// Guard of the compiled code: a check or another trapping instruction
+struct DeoptSite final
+{
+  TrapKind kind{};
+  // Offset of the branch to the deoptimization stub or the faulting
+  // instruction
+  std::size_t offset{};
+};
+
+// Absolute address in the literal pool of the generated code
+enum class RelocKind : std::uint8_t
+{
+  // Entry cell of the callee
+  kCallCell,
+  kTrapHandler,
+  kDeoptHandler,
+  kDeoptCtx,
+};
+
+struct Relocation final
+{
+  RelocKind kind{};
+  // Offset of the pool entry
+  std::size_t offset{};
+  // Callee of the call cell
+  const Function *callee{};
+};
+
+// RIP-relative load of the pool entry
+struct LiteralRef final
+{
+  // Offset of the rel32 displacement, the instruction ends w/ it
+  std::size_t offset{};
+  // Offset of the pool entry
+  std::size_t entry{};
+};
+
+// Lowering of the function to x86-64 machine code w/ SysV calling convention.
+// Values live in locations assigned by RegAllocator: its registers are mapped
+// to callee-saved ones, so they survive calls, stack locations are frame
+// slots. Operands are loaded into scratch registers, the result is stored to
+// its location. Values are kept sign-extended from their types, like in the
+// interpreter. Calls go through the entry cells given by the resolver.
+// Absolute addresses are loaded from the literal pool after the code, so
+// the code is position independent and only the pool entries listed by
+// getRelocations depend on the process.
+// If there is a deoptimization handler, all guards branch to one stub. It
+// passes the arguments, which stay in their homes, to the handler and
+// returns its result. Deoptimization may be limited to some blocks, then
+// the others trap and resuming blocks get their own stubs.
+// Division checks its divisor implicitly: #DE of idiv is redirected to the
+// trap or deoptimization stub by the fault handler. Zero check of the
+// divisor right before the division is folded into it.
+class CodeGenerator final
+{
+public:
+  // Address of the cell w/ the entry point of the callee
+  using CallResolver = std::function<const void *const *(const Function &)>;
+
+  CodeGenerator(const Function &func, CallResolver resolver)
+    : m_func(func), m_resolver(std::move(resolver))
+  {}
+
+  void setDeoptHandler(DeoptHandler handler, void *ctx) noexcept
+  {
+    m_deoptHandler = handler;
+    m_deoptCtx = ctx;
+  }
+
+  // Only guards of the blocks deoptimize, the other ones trap
+  void setDeoptBlocks(std::vector<DeoptBlock> blocks)
+  {
+    m_deoptBlocks.clear();
+    for (auto &block : blocks)
+    {
+      const auto *const bb = block.bb;
+      m_deoptBlocks.emplace(bb, std::move(block));
+    }
+    m_limitDeopt = true;
+  }
+
+  // Guards of the generated code in order of their offsets
+  [[nodiscard]] const auto &getDeoptSites() const noexcept
+  {
+    return m_deoptSites;
+  }
+
+  [[nodiscard]] std::vector<Relocation> getRelocations() const
+  {
+    std::vector<Relocation> res;
+    res.reserve(m_literals.size());
+    for (const auto &lit : m_literals)
+      res.push_back(
+        Relocation{lit.kind, m_asm.getOffset(lit.label), lit.callee});
+    return res;
+  }
+
+  // Code may be separated from the pool by patching these
+  [[nodiscard]] std::vector<LiteralRef> getLiteralRefs() const
+  {
+    std::vector<LiteralRef> res;
+    res.reserve(m_literalRefs.size());
+    for (const auto &[offset, label] : m_literalRefs)
+      res.push_back(LiteralRef{offset, m_asm.getOffset(label)});
+    return res;
+  }
+
+  // Start of the literal pool, it ends the code
+  [[nodiscard]] std::size_t getPoolOffset() const noexcept
+  {
+    return m_poolOffset;
+  }
+
+  // Faulting instructions of the generated code for the fault handler
+  [[nodiscard]] std::vector<ImplicitCheck> getImplicitChecks() const
+  {
+    std::vector<ImplicitCheck> res;
+    res.reserve(m_faults.size());
+    for (const auto &[offset, label] : m_faults)
+      res.push_back(ImplicitCheck{offset, m_asm.getOffset(label)});
+    return res;
+  }
+
+  [[nodiscard]] std::vector<std::uint8_t> generate()
+  {
+    if (m_func.size() == 0)
+      throw CodeGenError{"Function " + m_func.getName() + " has no body"};
+
+    m_asm = x86::Assembler{};
+    m_trapLabels.clear();
+    m_deoptSites.clear();
+    m_deoptLabel = m_asm.newLabel();
+    m_deoptUsed = false;
+    m_resumeLabels.clear();
+    m_faults.clear();
+    m_literals.clear();
+    m_literalRefs.clear();
+    m_trampolines.clear();
+    collectBlocks();
+    assignLocations();
+    collectFoldedChecks();
+
+    emitPrologue();
+    for (std::size_t idx = 0; idx < m_order.size(); ++idx)
+    {
+      m_asm.bind(m_blockLabels.at(m_order[idx]));
+      const auto *const next =
+        idx + 1 < m_order.size() ? m_order[idx + 1] : nullptr;
+      for (const auto &inst : *m_order[idx])
+        emitInst(inst, next);
+    }
+
+    for (const auto &tramp : m_trampolines)
+    {
+      m_asm.bind(tramp.label);
+      emitMoves(tramp.pred, tramp.succ);
+      m_asm.jmp(m_blockLabels.at(tramp.succ));
+    }
+    emitTrapStubs();
+    emitDeoptStubs();
+    emitLiteralPool();
+
+    return m_asm.finalize();
+  }
+
+private:
+  using Reg = x86::Reg;
+  using Loc = std::size_t;
+
+  struct Literal final
+  {
+    x86::Label label{};
+    RelocKind kind{};
+    std::uint64_t val{};
+    const Function *callee{};
+  };
+
+  struct Trampoline final
+  {
+    const BasicBlock *pred{};
+    const BasicBlock *succ{};
+    x86::Label label{};
+  };
+
+  // RegAllocator registers
+  static constexpr std::array kAllocRegs{Reg::kRbx, Reg::kR12, Reg::kR13};
+  static constexpr auto &kArgRegs = x86::kArgRegs;
+  // Breaks cycles of phi moves
+  static constexpr Loc kScratchLoc = std::numeric_limits<Loc>::max();
+  static constexpr Reg kScratchReg = Reg::kR11;
+  static constexpr std::int32_t kSlotSize = 8;
+  // Saved rbp, return address
+  static constexpr std::int32_t kArgsOffset = 2 * kSlotSize;
+
+  void collectBlocks()
+  {
+    std::unordered_set<const BasicBlock *> reachable;
+    graph::depthFirstSearchPreOrder(
+      m_func.makeBBGraph(),
+      [&](const BasicBlock *bb) { reachable.insert(bb); });
+
+    m_order.clear();
+    m_blockLabels.clear();
+    for (const auto &bb : m_func)
+      if (reachable.count(&bb) != 0)
+      {
+        m_order.push_back(&bb);
+        m_blockLabels.emplace(&bb, m_asm.newLabel());
+      }
+  }
+
+  // Zero checks of the divisor right before the division
+  void collectFoldedChecks()
+  {
+    m_foldedChecks.clear();
+    for (const auto *const bb : m_order)
+    {
+      const Inst *prev = nullptr;
+      for (const auto &inst : *bb)
+      {
+        if (prev != nullptr && prev->getInstType() == InstType::kUnaryOp &&
+            inst.getInstType() == InstType::kBinOp)
+        {
+          const auto &binOp = static_cast<const BinOp &>(inst);
+          if (binOp.getOper() == BinOp::Oper::kDiv &&
+              binOp.getRight() == prev)
+            m_foldedChecks.insert(prev);
+        }
+        prev = &inst;
+      }
+    }
+  }
+
+  void assignLocations()
+  {
+    const RegAllocator regAlloc{m_func.makeBBGraph()};
+
+    m_locs.clear();
+    m_intervals.clear();
+    m_numSpills = 0;
+    for (const auto *const bb : m_order)
+      for (const auto &inst : *bb)
+      {
+        auto *const val = const_cast<Inst *>(&inst);
+        const auto loc = regAlloc.getLocation(val);
+        if (!loc.has_value())
+          continue;
+
+        m_intervals.emplace(&inst, *regAlloc.getLiveInterval(val));
+
+        if (loc->stack)
+        {
+          m_numSpills = std::max(m_numSpills, loc->locId + 1);
+          m_locs[&inst] = kAllocRegs.size() + loc->locId;
+        }
+        else
+        {
+          LJIT_ASSERT(loc->locId < kAllocRegs.size());
+          m_locs[&inst] = loc->locId;
+        }
+      }
+  }
+
+  [[nodiscard]] std::size_t getNumRegArgs() const
+  {
+    return std::min(m_func.getArgs().size(), kArgRegs.size());
+  }
+
+  // Frame: saved rbp, callee-saved registers, register arguments, spills
+  [[nodiscard]] static std::int32_t getSlotOffset(std::size_t idx)
+  {
+    return -static_cast<std::int32_t>(kAllocRegs.size() + 1 + idx) *
+           kSlotSize;
+  }
+
+  [[nodiscard]] x86::Mem getArgHome(std::size_t idx) const
+  {
+    if (idx < kArgRegs.size())
+      return x86::Mem{Reg::kRbp, getSlotOffset(idx)};
+    return x86::Mem{Reg::kRbp,
+                    kArgsOffset + static_cast<std::int32_t>(
+                                    (idx - kArgRegs.size()) * kSlotSize)};
+  }
+
+  [[nodiscard]] x86::Mem getSpillSlot(std::size_t idx) const
+  {
+    return x86::Mem{Reg::kRbp, getSlotOffset(getNumRegArgs() + idx)};
+  }
+
+  [[nodiscard]] bool isReg(Loc loc) const
+  {
+    return loc < kAllocRegs.size();
+  }
+
+  void loadLoc(Reg dst, Loc loc)
+  {
+    if (loc == kScratchLoc)
+      m_asm.mov(dst, kScratchReg);
+    else if (isReg(loc))
+      m_asm.mov(dst, kAllocRegs[loc]);
+    else
+      m_asm.mov(dst, getSpillSlot(loc - kAllocRegs.size()));
+  }
+
+  void storeLoc(Loc loc, Reg src)
+  {
+    if (loc == kScratchLoc)
+      m_asm.mov(kScratchReg, src);
+    else if (isReg(loc))
+      m_asm.mov(kAllocRegs[loc], src);
+    else
+      m_asm.mov(getSpillSlot(loc - kAllocRegs.size()), src);
+  }
+
+  [[nodiscard]] std::optional<Loc> getLoc(const Value *val) const
+  {
+    LJIT_ASSERT(val->isInst());
+    const auto found = m_locs.find(static_cast<const Inst *>(val));
+    if (found == m_locs.end())
+      return std::nullopt;
+    return found->second;
+  }
+
+  void load(Reg dst, const Value *val)
+  {
+    const auto loc = getLoc(val);
+    LJIT_ASSERT_MSG(loc.has_value(), "Used value has no location");
+    loadLoc(dst, *loc);
+  }
+
+  // Unused values have no location
+  void store(const Inst &inst, Reg src)
+  {
+    if (const auto loc = getLoc(&inst); loc.has_value())
+      storeLoc(*loc, src);
+  }
+
+  void emitPrologue()
+  {
+    m_asm.push(Reg::kRbp);
+    m_asm.mov(Reg::kRbp, Reg::kRsp);
+    for (const auto reg : kAllocRegs)
+      m_asm.push(reg);
+
+    // Keep the stack aligned by 16 at calls
+    const auto saved = static_cast<std::int32_t>(kAllocRegs.size()) * kSlotSize;
+    const auto slots =
+      static_cast<std::int32_t>(getNumRegArgs() + m_numSpills) * kSlotSize;
+    const auto frameSize = (saved + slots + 15) / 16 * 16 - saved;
+    if (frameSize != 0)
+      m_asm.alu(x86::AluOp::kSub, Reg::kRsp, frameSize);
+
+    for (std::size_t idx = 0; idx < getNumRegArgs(); ++idx)
+      m_asm.mov(getArgHome(idx), kArgRegs[idx]);
+  }
+
+  void emitEpilogue()
+  {
+    m_asm.lea(Reg::kRsp, x86::Mem{Reg::kRbp, getSlotOffset(0) + kSlotSize});
+    std::for_each(kAllocRegs.rbegin(), kAllocRegs.rend(),
+                  [this](Reg reg) { m_asm.pop(reg); });
+    m_asm.pop(Reg::kRbp);
+    m_asm.ret();
+  }
+
+  // Sign-extend the value of reg from the type
+  void normalize(Type type, Reg reg)
+  {
+    switch (type)
+    {
+    case Type::I1:
+      m_asm.test(reg, reg);
+      m_asm.setcc(x86::Cond::kNE, reg);
+      m_asm.movzx8(reg, reg);
+      break;
+    case Type::I8:
+      m_asm.movsx8(reg, reg);
+      break;
+    case Type::I16:
+      m_asm.movsx16(reg, reg);
+      break;
+    case Type::I32:
+      m_asm.movsx32(reg, reg);
+      break;
+    case Type::I64:
+    case Type::None:
+    default:
+      break;
+    }
+  }
+
+  [[nodiscard]] static std::int32_t getShiftWidth(Type type)
+  {
+    switch (type)
+    {
+    case Type::I1:
+      return 1;
+    case Type::I8:
+      return 7;
+    case Type::I16:
+      return 15;
+    case Type::I32:
+      return 31;
+    case Type::I64:
+      return 63;
+    case Type::None:
+    default:
+      return 0;
+    }
+  }
+
+  // Called right before the branch or the faulting instruction
+  [[nodiscard]] x86::Label getTrapLabel(TrapKind kind)
+  {
+    if (const auto label = getDeoptLabel(); label.has_value())
+    {
+      m_deoptSites.push_back(DeoptSite{kind, m_asm.size()});
+      return *label;
+    }
+
+    const auto [it, inserted] = m_trapLabels.emplace(kind, x86::Label{});
+    if (inserted)
+      it->second = m_asm.newLabel();
+    return it->second;
+  }
+
+  // Stub of the current guard, none if it traps
+  [[nodiscard]] std::optional<x86::Label> getDeoptLabel()
+  {
+    if (m_deoptHandler == nullptr)
+      return std::nullopt;
+
+    const DeoptBlock *block = nullptr;
+    if (m_limitDeopt)
+    {
+      const auto found = m_deoptBlocks.find(m_inst->getBB());
+      if (found == m_deoptBlocks.end())
+        return std::nullopt;
+      block = &found->second;
+    }
+
+    if (block == nullptr || block->resume == kNoResume ||
+        !std::all_of(block->values.begin(), block->values.end(),
+                     [this](const Value *val) { return isAvailable(val); }))
+    {
+      m_deoptUsed = true;
+      return m_deoptLabel;
+    }
+
+    const auto found =
+      std::find_if(m_resumeLabels.begin(), m_resumeLabels.end(),
+                   [block](const auto &res) { return res.first == block; });
+    if (found != m_resumeLabels.end())
+      return found->second;
+    return m_resumeLabels.emplace_back(block, m_asm.newLabel()).second;
+  }
+
+  // Value is in its location at the current instruction
+  [[nodiscard]] bool isAvailable(const Value *val) const
+  {
+    LJIT_ASSERT(val->isInst());
+    const auto &inst = static_cast<const Inst &>(*val);
+    if (inst.getInstType() == InstType::kConst ||
+        inst.getInstType() == InstType::kParam)
+      return true;
+
+    const auto found = m_intervals.find(&inst);
+    const auto num = m_inst->getLiveNum();
+    return found != m_intervals.end() && found->second.getStart() < num &&
+           num <= found->second.getEnd();
+  }
+
+  void emitTrapStubs()
+  {
+    for (const auto &[kind, label] : m_trapLabels)
+    {
+      m_asm.bind(label);
+      m_asm.mov(Reg::kRdi, static_cast<std::int64_t>(kind));
+      const auto handler = reinterpret_cast<std::uintptr_t>(&onCompiledTrap);
+      loadLiteral(Reg::kRax, RelocKind::kTrapHandler, handler);
+      m_asm.call(Reg::kRax);
+      m_asm.ud2();
+    }
+  }
+
+  void emitDeoptStubs()
+  {
+    if (m_deoptUsed)
+    {
+      m_asm.bind(m_deoptLabel);
+      emitDeoptCall(kNoResume, m_func.getArgs().size(),
+                    [this](std::size_t idx) {
+                      m_asm.mov(Reg::kRax, getArgHome(idx));
+                    });
+    }
+
+    for (const auto &[block, label] : m_resumeLabels)
+    {
+      m_asm.bind(label);
+      const auto &vals = block->values;
+      emitDeoptCall(block->resume, vals.size(),
+                    [this, &vals](std::size_t idx) {
+                      loadResumeValue(Reg::kRax, vals[idx]);
+                    });
+    }
+  }
+
+  // Constants and arguments may have no location
+  void loadResumeValue(Reg dst, const Value *val)
+  {
+    const auto &inst = static_cast<const Inst &>(*val);
+    if (inst.getInstType() == InstType::kConst)
+      m_asm.mov(dst, retrieveConstVal(&inst));
+    else if (inst.getInstType() == InstType::kParam)
+      m_asm.mov(dst, getArgHome(static_cast<const Param &>(inst).getIdx()));
+    else
+      load(dst, val);
+  }
+
+  // Passes the array of the values loaded to rax to the handler
+  template <class LoadFunc>
+  void emitDeoptCall(std::int64_t resume, std::size_t numVals,
+                     LoadFunc loadVal)
+  {
+    // Stack at the guards is aligned by 16
+    const auto arraySize =
+      static_cast<std::int32_t>((numVals + numVals % 2) * kSlotSize);
+    if (arraySize != 0)
+      m_asm.alu(x86::AluOp::kSub, Reg::kRsp, arraySize);
+    for (std::size_t idx = 0; idx < numVals; ++idx)
+    {
+      loadVal(idx);
+      m_asm.mov(
+        x86::Mem{Reg::kRsp, static_cast<std::int32_t>(idx) * kSlotSize},
+        Reg::kRax);
+    }
+
+    m_asm.mov(Reg::kRdx, Reg::kRsp);
+    m_asm.mov(Reg::kRsi, resume);
+    loadLiteral(Reg::kRdi, RelocKind::kDeoptCtx,
+                reinterpret_cast<std::uintptr_t>(m_deoptCtx));
+    const auto handler = reinterpret_cast<std::uintptr_t>(m_deoptHandler);
+    loadLiteral(Reg::kRax, RelocKind::kDeoptHandler, handler);
+    m_asm.call(Reg::kRax);
+    emitEpilogue();
+  }
+
+  // Each address is stored once
+  void loadLiteral(Reg dst, RelocKind kind, std::uintptr_t val,
+                   const Function *callee = nullptr)
+  {
+    auto found =
+      std::find_if(m_literals.begin(), m_literals.end(), [&](const auto &lit) {
+        return lit.kind == kind && lit.callee == callee;
+      });
+    if (found == m_literals.end())
+      found = m_literals.insert(
+        found, Literal{m_asm.newLabel(), kind, val, callee});
+
+    m_asm.mov(dst, found->label);
+    m_literalRefs.emplace_back(m_asm.size() - sizeof(std::int32_t),
+                               found->label);
+  }
+
+  void emitLiteralPool()
+  {
+    m_asm.align(sizeof(std::uint64_t));
+    m_poolOffset = m_asm.size();
+    for (const auto &lit : m_literals)
+    {
+      m_asm.bind(lit.label);
+      m_asm.data64(lit.val);
+    }
+  }
+
+  [[nodiscard]] static bool hasPhis(const BasicBlock *succ)
+  {
+    return std::any_of(succ->begin(), succ->end(), [](const Inst &inst) {
+      return inst.getInstType() == InstType::kPhi;
+    });
+  }
+
+  // Label of the block or of the trampoline w/ phi moves for the edge
+  [[nodiscard]] x86::Label getEdgeLabel(const BasicBlock *pred,
+                                        const BasicBlock *succ)
+  {
+    if (!hasPhis(succ))
+      return m_blockLabels.at(succ);
+
+    const auto label = m_asm.newLabel();
+    m_trampolines.push_back(Trampoline{pred, succ, label});
+    return label;
+  }
+
+  void emitMoves(const BasicBlock *pred, const BasicBlock *succ)
+  {
+    std::vector<std::pair<Loc, Loc>> moves;
+    for (const auto &inst : *succ)
+    {
+      if (inst.getInstType() != InstType::kPhi)
+        continue;
+      const auto &phi = static_cast<const Phi &>(inst);
+      const auto found =
+        std::find_if(phi.begin(), phi.end(),
+                     [pred](const auto &entry) { return entry.bb == pred; });
+      LJIT_ASSERT(found != phi.end());
+
+      const auto dst = getLoc(&phi);
+      const auto src = getLoc(found->m_val);
+      if (dst.has_value() && *dst != *src)
+        moves.emplace_back(*dst, *src);
+    }
+    emitParallelMoves(moves);
+  }
+
+  void emitMove(Loc dst, Loc src)
+  {
+    if (isReg(dst))
+    {
+      loadLoc(kAllocRegs[dst], src);
+      return;
+    }
+    loadLoc(Reg::kRax, src);
+    storeLoc(dst, Reg::kRax);
+  }
+
+  // All moves read their sources before any destination is written
+  void emitParallelMoves(std::vector<std::pair<Loc, Loc>> moves)
+  {
+    auto isRead = [&moves](Loc loc) {
+      return std::any_of(
+        moves.begin(), moves.end(),
+        [loc](const auto &move) { return move.second == loc; });
+    };
+
+    while (!moves.empty())
+    {
+      const auto ready =
+        std::find_if(moves.begin(), moves.end(),
+                     [&](const auto &move) { return !isRead(move.first); });
+      if (ready != moves.end())
+      {
+        emitMove(ready->first, ready->second);
+        moves.erase(ready);
+        continue;
+      }
+
+      // Only cycles are left: save the first destination to break one
+      const auto saved = moves.front().first;
+      loadLoc(kScratchReg, saved);
+      for (auto &move : moves)
+        if (move.second == saved)
+          move.second = kScratchLoc;
+    }
+  }
+
+  void emitBinOp(const BinOp &binOp)
+  {
+    load(Reg::kRax, binOp.getLeft());
+    load(Reg::kRcx, binOp.getRight());
+    const auto type = binOp.getType();
+
+    switch (binOp.getOper())
+    {
+    case BinOp::Oper::kAdd:
+      m_asm.alu(x86::AluOp::kAdd, Reg::kRax, Reg::kRcx);
+      normalize(type, Reg::kRax);
+      break;
+    case BinOp::Oper::kSub:
+      m_asm.alu(x86::AluOp::kSub, Reg::kRax, Reg::kRcx);
+      normalize(type, Reg::kRax);
+      break;
+    case BinOp::Oper::kMul:
+      m_asm.imul(Reg::kRax, Reg::kRcx);
+      normalize(type, Reg::kRax);
+      break;
+    case BinOp::Oper::kDiv: {
+      // INT64_MIN / -1 raises #DE, so -1 is handled separately and the
+      // fault of idiv means the zero divisor
+      const auto divLabel = m_asm.newLabel();
+      const auto doneLabel = m_asm.newLabel();
+      m_asm.alu(x86::AluOp::kCmp, Reg::kRcx, -1);
+      m_asm.jcc(x86::Cond::kNE, divLabel);
+      m_asm.neg(Reg::kRax);
+      m_asm.jmp(doneLabel);
+      m_asm.bind(divLabel);
+      m_asm.cqo();
+      const auto kind = m_foldedChecks.count(binOp.getRight()) != 0
+                          ? TrapKind::kZeroCheck
+                          : TrapKind::kDivByZero;
+      const auto offset = m_asm.size();
+      m_faults.emplace_back(offset, getTrapLabel(kind));
+      m_asm.idiv(Reg::kRcx);
+      m_asm.bind(doneLabel);
+      normalize(type, Reg::kRax);
+      break;
+    }
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kEQ:
+      m_asm.alu(x86::AluOp::kCmp, Reg::kRax, Reg::kRcx);
+      m_asm.setcc(binOp.getOper() == BinOp::Oper::kLE ? x86::Cond::kL
+                                                      : x86::Cond::kE,
+                  Reg::kRax);
+      m_asm.movzx8(Reg::kRax, Reg::kRax);
+      break;
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl: {
+      // Unsigned comparison catches negative amounts too
+      m_asm.alu(x86::AluOp::kCmp, Reg::kRcx, getShiftWidth(type));
+      m_asm.jcc(x86::Cond::kAE, getTrapLabel(TrapKind::kBadShift));
+      const bool isShl = binOp.getOper() == BinOp::Oper::kShl;
+      m_asm.shift(isShl ? x86::ShiftOp::kShl : x86::ShiftOp::kSar, Reg::kRax);
+      if (isShl)
+        normalize(type, Reg::kRax);
+      break;
+    }
+    case BinOp::Oper::kOr:
+      m_asm.alu(x86::AluOp::kOr, Reg::kRax, Reg::kRcx);
+      break;
+    case BinOp::Oper::kBoundsCheck:
+      m_asm.test(Reg::kRax, Reg::kRax);
+      m_asm.jcc(x86::Cond::kS, getTrapLabel(TrapKind::kBoundsCheck));
+      m_asm.alu(x86::AluOp::kCmp, Reg::kRax, Reg::kRcx);
+      m_asm.jcc(x86::Cond::kGE, getTrapLabel(TrapKind::kBoundsCheck));
+      break;
+    default:
+      LJIT_UNREACHABLE("Unknown binary operation");
+    }
+    store(binOp, Reg::kRax);
+  }
+
+  void emitCall(const Call &call)
+  {
+    const auto numArgs = static_cast<std::size_t>(
+      std::distance(call.inputBegin(), call.inputEnd()));
+    const auto numStackArgs =
+      numArgs > kArgRegs.size() ? numArgs - kArgRegs.size() : 0;
+    // Keep the stack aligned by 16
+    const auto padding = numStackArgs % 2;
+    if (padding != 0)
+      m_asm.alu(x86::AluOp::kSub, Reg::kRsp, kSlotSize);
+
+    for (auto idx = numArgs; idx > kArgRegs.size(); --idx)
+    {
+      load(Reg::kRax, call.inputAt(idx - 1));
+      m_asm.push(Reg::kRax);
+    }
+    for (std::size_t idx = 0; idx < std::min(numArgs, kArgRegs.size()); ++idx)
+      load(kArgRegs[idx], call.inputAt(idx));
+
+    const auto *const callee = call.getCallee();
+    const auto cell = reinterpret_cast<std::uintptr_t>(m_resolver(*callee));
+    loadLiteral(Reg::kRax, RelocKind::kCallCell, cell, callee);
+    m_asm.call(x86::Mem{Reg::kRax, 0});
+
+    if (const auto stackSize = numStackArgs + padding; stackSize != 0)
+      m_asm.alu(x86::AluOp::kAdd, Reg::kRsp,
+                static_cast<std::int32_t>(stackSize) * kSlotSize);
+    store(call, Reg::kRax);
+  }
+
+  void emitSwitch(const Switch &sw)
+  {
+    const auto *const bb = sw.getBB();
+    // Each target is reached through one edge
+    std::unordered_map<const BasicBlock *, x86::Label> labels;
+    auto getLabel = [&](const BasicBlock *target) {
+      const auto [it, inserted] = labels.emplace(target, x86::Label{});
+      if (inserted)
+        it->second = getEdgeLabel(bb, target);
+      return it->second;
+    };
+
+    load(Reg::kRax, sw.getVal());
+    for (const auto &swCase : sw.getCases())
+    {
+      if (x86::Assembler::fitsInt32(swCase.val))
+        m_asm.alu(x86::AluOp::kCmp, Reg::kRax,
+                  static_cast<std::int32_t>(swCase.val));
+      else
+      {
+        m_asm.mov(Reg::kRcx, swCase.val);
+        m_asm.alu(x86::AluOp::kCmp, Reg::kRax, Reg::kRcx);
+      }
+      m_asm.jcc(x86::Cond::kE, getLabel(swCase.target));
+    }
+    m_asm.jmp(getLabel(sw.getDefault()));
+  }
+
+  void emitInst(const Inst &inst, const BasicBlock *next)
+  {
+    m_inst = &inst;
+    const auto *const bb = inst.getBB();
+    switch (inst.getInstType())
+    {
+    case InstType::kPhi:
+      break;
+    case InstType::kConst:
+      if (const auto loc = getLoc(&inst); loc.has_value())
+      {
+        const auto val = retrieveConstVal(&inst);
+        if (isReg(*loc))
+          m_asm.mov(kAllocRegs[*loc], val);
+        else
+        {
+          m_asm.mov(Reg::kRax, val);
+          storeLoc(*loc, Reg::kRax);
+        }
+      }
+      break;
+    case InstType::kParam:
+      m_asm.mov(Reg::kRax,
+                getArgHome(static_cast<const Param &>(inst).getIdx()));
+      normalize(inst.getType(), Reg::kRax);
+      store(inst, Reg::kRax);
+      break;
+    case InstType::kBinOp:
+      emitBinOp(static_cast<const BinOp &>(inst));
+      break;
+    case InstType::kUnaryOp:
+      LJIT_ASSERT(static_cast<const UnaryOp &>(inst).getOper() ==
+                  UnaryOp::Oper::kZeroCheck);
+      load(Reg::kRax, inst.inputAt(0));
+      if (m_foldedChecks.count(&inst) == 0)
+      {
+        m_asm.test(Reg::kRax, Reg::kRax);
+        m_asm.jcc(x86::Cond::kE, getTrapLabel(TrapKind::kZeroCheck));
+      }
+      store(inst, Reg::kRax);
+      break;
+    case InstType::kCast:
+      load(Reg::kRax, inst.inputAt(0));
+      normalize(inst.getType(), Reg::kRax);
+      store(inst, Reg::kRax);
+      break;
+    case InstType::kSelect: {
+      const auto &select = static_cast<const Select &>(inst);
+      load(Reg::kRax, select.getFalseVal());
+      load(Reg::kRcx, select.getTrueVal());
+      load(Reg::kRdx, select.getCond());
+      m_asm.test(Reg::kRdx, Reg::kRdx);
+      m_asm.cmov(x86::Cond::kNE, Reg::kRax, Reg::kRcx);
+      store(inst, Reg::kRax);
+      break;
+    }
+    case InstType::kCall:
+      emitCall(static_cast<const Call &>(inst));
+      break;
+    case InstType::kRet:
+      if (inst.inputBegin() != inst.inputEnd())
+        load(Reg::kRax, inst.inputAt(0));
+      emitEpilogue();
+      break;
+    case InstType::kJump: {
+      const auto *const target =
+        static_cast<const JumpInstr &>(inst).getTarget();
+      emitMoves(bb, target);
+      if (target != next)
+        m_asm.jmp(m_blockLabels.at(target));
+      break;
+    }
+    case InstType::kIf: {
+      const auto &ifInst = static_cast<const IfInstr &>(inst);
+      load(Reg::kRax, ifInst.getCond());
+      m_asm.test(Reg::kRax, Reg::kRax);
+      const auto *const falseBB = ifInst.getFalseBB();
+      m_asm.jcc(x86::Cond::kNE, getEdgeLabel(bb, ifInst.getTrueBB()));
+      if (falseBB != next || hasPhis(falseBB))
+        m_asm.jmp(getEdgeLabel(bb, falseBB));
+      break;
+    }
+    case InstType::kSwitch:
+      emitSwitch(static_cast<const Switch &>(inst));
+      break;
+    case InstType::kUnknown:
+    default:
+      LJIT_UNREACHABLE("Unknown instruction");
+    }
+  }
+
+  const Function &m_func;
+  CallResolver m_resolver;
+  x86::Assembler m_asm{};
+  std::vector<const BasicBlock *> m_order{};
+  std::unordered_map<const BasicBlock *, x86::Label> m_blockLabels{};
+  // Registers go first, then stack slots
+  std::unordered_map<const Inst *, Loc> m_locs{};
+  std::unordered_map<const Inst *, LiveInterval> m_intervals{};
+  std::size_t m_numSpills{};
+  std::map<TrapKind, x86::Label> m_trapLabels{};
+  DeoptHandler m_deoptHandler{};
+  void *m_deoptCtx{};
+  x86::Label m_deoptLabel{};
+  bool m_deoptUsed{};
+  std::vector<DeoptSite> m_deoptSites{};
+  std::unordered_map<const BasicBlock *, DeoptBlock> m_deoptBlocks{};
+  bool m_limitDeopt{};
+  std::vector<std::pair<const DeoptBlock *, x86::Label>> m_resumeLabels{};
+  // Instruction being emitted
+  const Inst *m_inst{};
+  // Offsets of the faulting instructions and their stubs
+  std::vector<std::pair<std::size_t, x86::Label>> m_faults{};
+  std::unordered_set<const Value *> m_foldedChecks{};
+  std::vector<Literal> m_literals{};
+  std::vector<std::pair<std::size_t, x86::Label>> m_literalRefs{};
+  std::size_t m_poolOffset{};
+  std::vector<Trampoline> m_trampolines{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_CODEGEN_HH_INCLUDED */
@@ -0,0 +1,291 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_ELF_WRITER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_ELF_WRITER_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <elf.h>
+
+#include "codegen/codegen.hh"
+#include "common/error.hh"
+#include "ir/function.hh"
+#include "ir/module.hh"
+#include "profile/mapped_file.hh"
+
+namespace ljit
+{
+// Relocatable x86-64 ELF object of the compiled functions.
+// Each function w/ body gets a global symbol in .text, functions w/o body
+// are undefined symbols, so the object is called from C and calls C w/
+// SysV ABI. Literal pools go to .data.rel.ro: the code refers to them by
+// PC-relative relocations and only the pools hold absolute addresses, so
+// the object links into PIE w/o text relocations. Calls go through the
+// cells in .data.rel.ro, one per callee, failed checks call abort.
+// Division by zero raises SIGFPE, as there is no fault handler.
+class ElfWriter final
+{
+  // Indices of the sections
+  enum Section : std::uint16_t
+  {
+    kNull,
+    kText,
+    kData,
+    kRelaText,
+    kRelaData,
+    kSymtab,
+    kStrtab,
+    kShstrtab,
+    kNoteStack,
+    kNumSections,
+  };
+
+  // Section symbols precede the global ones
+  static constexpr std::size_t kTextSym = 1;
+  static constexpr std::size_t kDataSym = 2;
+  static constexpr std::size_t kFirstGlobal = 3;
+  static constexpr std::size_t kFuncAlign = 16;
+
+  struct Symbol final
+  {
+    std::string name{};
+    // Undefined if there is no code
+    bool defined{};
+    std::uint64_t value{};
+    std::uint64_t size{};
+  };
+
+  struct Reloc final
+  {
+    std::uint64_t offset{};
+    std::size_t sym{};
+    std::uint32_t type{};
+    std::int64_t addend{};
+  };
+
+public:
+  // Function called by the failed checks
+  static constexpr const char *kTrapHandler = "abort";
+
+  ElfWriter() = default;
+
+  // Compiles the functions w/ body as they are
+  void addModule(const Module &module)
+  {
+    for (const auto &func : module)
+      if (func->size() != 0)
+        addFunction(*func);
+  }
+
+  void addFunction(const Function &func)
+  {
+    const auto symIdx = getSymbol(func.getName()) - kFirstGlobal;
+    if (m_symbols[symIdx].defined)
+      throw CodeGenError{"Function " + func.getName() + " is defined twice"};
+
+    CodeGenerator codegen{func, [](const Function &) { return nullptr; }};
+    const auto code = codegen.generate();
+    const auto poolOffset = codegen.getPoolOffset();
+
+    while (m_text.size() % kFuncAlign != 0)
+      m_text.push_back(0xCC);
+    const auto start = m_text.size();
+    m_text.insert(m_text.end(), code.begin(),
+                  code.begin() + static_cast<std::ptrdiff_t>(poolOffset));
+    m_symbols[symIdx] = Symbol{func.getName(), true, start, poolOffset};
+
+    // Pool entries are 8 byte aligned, as the data is
+    const auto pool = m_data.size();
+    m_data.resize(pool + code.size() - poolOffset);
+    for (const auto &reloc : codegen.getRelocations())
+    {
+      const auto at = pool + reloc.offset - poolOffset;
+      switch (reloc.kind)
+      {
+      case RelocKind::kCallCell:
+        m_dataRelocs.push_back(
+          Reloc{at, kDataSym, R_X86_64_64,
+                static_cast<std::int64_t>(getCell(*reloc.callee))});
+        break;
+      case RelocKind::kTrapHandler:
+        m_dataRelocs.push_back(
+          Reloc{at, getSymbol(kTrapHandler), R_X86_64_64, 0});
+        break;
+      case RelocKind::kDeoptHandler:
+      case RelocKind::kDeoptCtx:
+      default:
+        throw CodeGenError{"Deoptimization is not supported in objects"};
+      }
+    }
+    for (const auto &ref : codegen.getLiteralRefs())
+      m_textRelocs.push_back(
+        Reloc{start + ref.offset, kDataSym, R_X86_64_PC32,
+              static_cast<std::int64_t>(pool + ref.entry - poolOffset) -
+                static_cast<std::int64_t>(sizeof(std::int32_t))});
+  }
+
+  [[nodiscard]] std::vector<unsigned char> serialize() const
+  {
+    std::vector<unsigned char> res(sizeof(Elf64_Ehdr));
+    std::vector<Elf64_Shdr> headers(kNumSections);
+    auto addSection = [&res, &headers](Section idx, const void *data,
+                                       std::size_t size, std::size_t align) {
+      while (res.size() % align != 0)
+        res.push_back(0);
+      auto &hdr = headers[idx];
+      hdr.sh_offset = res.size();
+      hdr.sh_size = size;
+      hdr.sh_addralign = align;
+      const auto *const bytes = static_cast<const unsigned char *>(data);
+      res.insert(res.end(), bytes, bytes + size);
+      return &hdr;
+    };
+
+    std::string shstrtab(1, '\0');
+    auto addName = [](std::string &table, const std::string &name) {
+      const auto offset = table.size();
+      table += name;
+      table += '\0';
+      return static_cast<Elf64_Word>(offset);
+    };
+
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> symtab(kFirstGlobal);
+    symtab[kTextSym].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symtab[kTextSym].st_shndx = kText;
+    symtab[kDataSym].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symtab[kDataSym].st_shndx = kData;
+    for (const auto &sym : m_symbols)
+    {
+      auto &elfSym = symtab.emplace_back();
+      elfSym.st_name = addName(strtab, sym.name);
+      elfSym.st_info =
+        ELF64_ST_INFO(STB_GLOBAL, sym.defined ? STT_FUNC : STT_NOTYPE);
+      elfSym.st_shndx = sym.defined ? kText : SHN_UNDEF;
+      elfSym.st_value = sym.value;
+      elfSym.st_size = sym.size;
+    }
+
+    auto *hdr = addSection(kText, m_text.data(), m_text.size(), kFuncAlign);
+    hdr->sh_name = addName(shstrtab, ".text");
+    hdr->sh_type = SHT_PROGBITS;
+    hdr->sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+
+    hdr = addSection(kData, m_data.data(), m_data.size(), 8);
+    hdr->sh_name = addName(shstrtab, ".data.rel.ro");
+    hdr->sh_type = SHT_PROGBITS;
+    hdr->sh_flags = SHF_ALLOC | SHF_WRITE;
+
+    const std::pair<Section, const std::vector<Reloc> *> relas[] = {
+      {kText, &m_textRelocs}, {kData, &m_dataRelocs}};
+    for (const auto &[target, relocs] : relas)
+    {
+      std::vector<Elf64_Rela> rela;
+      for (const auto &reloc : *relocs)
+        rela.push_back(Elf64_Rela{reloc.offset,
+                                  ELF64_R_INFO(reloc.sym, reloc.type),
+                                  reloc.addend});
+      const auto idx = target == kText ? kRelaText : kRelaData;
+      hdr = addSection(idx, rela.data(), rela.size() * sizeof(Elf64_Rela), 8);
+      hdr->sh_name = addName(
+        shstrtab, target == kText ? ".rela.text" : ".rela.data.rel.ro");
+      hdr->sh_type = SHT_RELA;
+      hdr->sh_flags = SHF_INFO_LINK;
+      hdr->sh_link = kSymtab;
+      hdr->sh_info = target;
+      hdr->sh_entsize = sizeof(Elf64_Rela);
+    }
+
+    hdr = addSection(kSymtab, symtab.data(), symtab.size() * sizeof(Elf64_Sym),
+                     8);
+    hdr->sh_name = addName(shstrtab, ".symtab");
+    hdr->sh_type = SHT_SYMTAB;
+    hdr->sh_link = kStrtab;
+    hdr->sh_info = kFirstGlobal;
+    hdr->sh_entsize = sizeof(Elf64_Sym);
+
+    hdr = addSection(kStrtab, strtab.data(), strtab.size(), 1);
+    hdr->sh_name = addName(shstrtab, ".strtab");
+    hdr->sh_type = SHT_STRTAB;
+
+    // Stack of the linked program stays non-executable
+    hdr = addSection(kNoteStack, nullptr, 0, 1);
+    hdr->sh_name = addName(shstrtab, ".note.GNU-stack");
+    hdr->sh_type = SHT_PROGBITS;
+
+    headers[kShstrtab].sh_name = addName(shstrtab, ".shstrtab");
+    hdr = addSection(kShstrtab, shstrtab.data(), shstrtab.size(), 1);
+    hdr->sh_type = SHT_STRTAB;
+
+    while (res.size() % 8 != 0)
+      res.push_back(0);
+    Elf64_Ehdr ehdr{};
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = res.size();
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = kNumSections;
+    ehdr.e_shstrndx = kShstrtab;
+    std::memcpy(res.data(), &ehdr, sizeof(ehdr));
+
+    const auto *const bytes =
+      reinterpret_cast<const unsigned char *>(headers.data());
+    res.insert(res.end(), bytes, bytes + headers.size() * sizeof(Elf64_Shdr));
+    return res;
+  }
+
+  void write(const std::string &path) const
+  {
+    const auto bytes = serialize();
+    const auto file = MappedFile::create(path, bytes.size());
+    std::memcpy(file.data(), bytes.data(), bytes.size());
+    file.sync();
+  }
+
+private:
+  // Index of the global symbol in the symbol table
+  std::size_t getSymbol(const std::string &name)
+  {
+    const auto [found, inserted] =
+      m_symbolIds.emplace(name, kFirstGlobal + m_symbols.size());
+    if (inserted)
+      m_symbols.push_back(Symbol{name, false, 0, 0});
+    return found->second;
+  }
+
+  // Offset of the callee cell in the data
+  std::uint64_t getCell(const Function &callee)
+  {
+    const auto [found, inserted] =
+      m_cells.emplace(callee.getName(), m_data.size());
+    if (inserted)
+    {
+      m_data.resize(m_data.size() + sizeof(std::uint64_t));
+      m_dataRelocs.push_back(
+        Reloc{found->second, getSymbol(callee.getName()), R_X86_64_64, 0});
+    }
+    return found->second;
+  }
+
+  std::vector<std::uint8_t> m_text{};
+  std::vector<std::uint8_t> m_data{};
+  std::vector<Reloc> m_textRelocs{};
+  std::vector<Reloc> m_dataRelocs{};
+  std::vector<Symbol> m_symbols{};
+  std::unordered_map<std::string, std::size_t> m_symbolIds{};
+  std::unordered_map<std::string, std::uint64_t> m_cells{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_ELF_WRITER_HH_INCLUDED */
@@ -0,0 +1,103 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_EXEC_MEMORY_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_EXEC_MEMORY_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "codegen/fault_handler.hh"
+#include "common/error.hh"
+
+namespace ljit
+{
+// Page-aligned memory w/ machine code.
+// Pages are writable only while the code is copied, after that they are
+// remapped as read + execute (W^X). Implicit checks of the code are
+// registered in the fault handler until the memory is released.
+class ExecMemory final
+{
+  void *m_data{};
+  std::size_t m_size{};
+  FaultHandler::Registration m_checks{};
+
+public:
+  ExecMemory() = default;
+
+  explicit ExecMemory(const std::vector<std::uint8_t> &code,
+                      std::vector<ImplicitCheck> checks = {})
+    : m_size(roundToPages(code.size()))
+  {
+    void *const data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+      throw CodeGenError{"Cannot allocate memory for code"};
+    m_data = data;
+
+    std::memcpy(m_data, code.data(), code.size());
+    if (::mprotect(m_data, m_size, PROT_READ | PROT_EXEC) != 0)
+    {
+      ::munmap(std::exchange(m_data, nullptr), m_size);
+      throw CodeGenError{"Cannot make code executable"};
+    }
+    try
+    {
+      m_checks = FaultHandler::add(m_data, code.size(), std::move(checks));
+    }
+    catch (...)
+    {
+      ::munmap(std::exchange(m_data, nullptr), m_size);
+      throw;
+    }
+  }
+
+  ExecMemory(const ExecMemory &) = delete;
+  ExecMemory &operator=(const ExecMemory &) = delete;
+
+  ExecMemory(ExecMemory &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0)),
+      m_checks(std::move(other.m_checks))
+  {}
+
+  ExecMemory &operator=(ExecMemory &&other) noexcept
+  {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_checks, other.m_checks);
+    return *this;
+  }
+
+  ~ExecMemory()
+  {
+    m_checks.reset();
+    if (m_data != nullptr)
+      ::munmap(m_data, m_size);
+  }
+
+  [[nodiscard]] const void *data() const noexcept
+  {
+    return m_data;
+  }
+
+  [[nodiscard]] auto size() const noexcept
+  {
+    return m_size;
+  }
+
+private:
+  [[nodiscard]] static std::size_t roundToPages(std::size_t size)
+  {
+    const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return (std::max<std::size_t>(size, 1) + pageSize - 1) / pageSize *
+           pageSize;
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_EXEC_MEMORY_HH_INCLUDED */
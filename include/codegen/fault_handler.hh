@@ -0,0 +1,258 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_FAULT_HANDLER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_FAULT_HANDLER_HH_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <ucontext.h>
+
+#include "common/common.hh"
+#include "common/error.hh"
+
+namespace ljit
+{
+// Instruction of the generated code, whose fault replaces an explicit check
+struct ImplicitCheck final
+{
+  // Offsets in the code
+  std::size_t offset{};
+  std::size_t slowPath{};
+};
+
+// SIGFPE handler of the implicit checks.
+// Faulting instruction of the registered code is resumed at its slow path,
+// like the branch of the explicit check: the trap stub unwinds to the entry
+// of the compiled code (see TrapScope). Other signals are passed to the
+// previous handler. The signal handler reads the immutable table of the
+// code, writers replace it and wait for the readers of the old one. The old
+// table is kept as the storage of the next one, so the removal, called by
+// the destructors, never allocates.
+class FaultHandler final
+{
+  struct CodeChecks final
+  {
+    std::uintptr_t begin{};
+    std::uintptr_t end{};
+    // Sorted by offsets
+    std::vector<ImplicitCheck> checks{};
+  };
+  // Sorted by the start of the code
+  using Table = std::vector<const CodeChecks *>;
+
+  // Writers are serialized w/o std::mutex, whose lock may throw
+  class WriterLock final
+  {
+    std::atomic_flag &m_flag;
+
+  public:
+    explicit WriterLock(std::atomic_flag &flag) noexcept : m_flag(flag)
+    {
+      while (m_flag.test_and_set(std::memory_order_acquire))
+        std::this_thread::yield();
+    }
+    LJIT_NO_COPY_SEMANTICS(WriterLock);
+    LJIT_NO_MOVE_SEMANTICS(WriterLock);
+    ~WriterLock()
+    {
+      m_flag.clear(std::memory_order_release);
+    }
+  };
+
+public:
+  // Checks of the code are handled while it is alive
+  class Registration final
+  {
+    std::unique_ptr<CodeChecks> m_checks{};
+
+  public:
+    Registration() = default;
+    explicit Registration(std::unique_ptr<CodeChecks> checks)
+      : m_checks(std::move(checks))
+    {}
+
+    LJIT_NO_COPY_SEMANTICS(Registration);
+    Registration(Registration &&other) noexcept = default;
+    Registration &operator=(Registration &&other) noexcept
+    {
+      if (this != &other)
+      {
+        reset();
+        m_checks = std::move(other.m_checks);
+      }
+      return *this;
+    }
+    ~Registration()
+    {
+      reset();
+    }
+
+    void reset() noexcept
+    {
+      if (m_checks != nullptr)
+        instance().remove(m_checks.get());
+      m_checks.reset();
+    }
+  };
+
+  LJIT_NO_COPY_SEMANTICS(FaultHandler);
+  LJIT_NO_MOVE_SEMANTICS(FaultHandler);
+  ~FaultHandler() = default;
+
+  // Handler is installed by the first registration
+  [[nodiscard]] static Registration add(const void *code, std::size_t size,
+                                        std::vector<ImplicitCheck> checks)
+  {
+    if (checks.empty())
+      return Registration{};
+
+    std::sort(checks.begin(), checks.end(),
+              [](const auto &lhs, const auto &rhs) {
+                return lhs.offset < rhs.offset;
+              });
+    const auto begin = reinterpret_cast<std::uintptr_t>(code);
+    auto entry =
+      std::make_unique<CodeChecks>(CodeChecks{begin, begin + size, {}});
+    entry->checks = std::move(checks);
+    instance().insert(entry.get());
+    return Registration{std::move(entry)};
+  }
+
+  // Address to resume the faulting instruction at, zero if it is unknown
+  [[nodiscard]] static std::uintptr_t findSlowPath(std::uintptr_t pc) noexcept
+  {
+    return instance().lookup(pc);
+  }
+
+private:
+  FaultHandler()
+  {
+    struct sigaction action{};
+    action.sa_sigaction = &onSignal;
+    action.sa_flags = SA_SIGINFO;
+    ::sigemptyset(&action.sa_mask);
+    if (::sigaction(SIGFPE, &action, &m_prev) != 0)
+      throw CodeGenError{"Cannot install SIGFPE handler"};
+  }
+
+  // Never destroyed: the code may fault until the exit
+  static FaultHandler &instance()
+  {
+    static auto *const handler = new FaultHandler;
+    return *handler;
+  }
+
+  static void onSignal(int sig, siginfo_t *info, void *ctx)
+  {
+    auto &pc = static_cast<ucontext_t *>(ctx)->uc_mcontext.gregs[REG_RIP];
+    const auto slowPath = findSlowPath(static_cast<std::uintptr_t>(pc));
+    if (slowPath != 0)
+    {
+      pc = static_cast<greg_t>(slowPath);
+      return;
+    }
+    instance().chain(sig, info, ctx);
+  }
+
+  void chain(int sig, siginfo_t *info, void *ctx) const
+  {
+    if ((m_prev.sa_flags & SA_SIGINFO) != 0)
+    {
+      m_prev.sa_sigaction(sig, info, ctx);
+      return;
+    }
+
+    // Sent by the process
+    const bool sent = info->si_code <= 0;
+    if (m_prev.sa_handler == SIG_IGN && sent)
+      return;
+    if (m_prev.sa_handler != SIG_DFL && m_prev.sa_handler != SIG_IGN)
+    {
+      m_prev.sa_handler(sig);
+      return;
+    }
+
+    // Restarted faulting instruction gets the default action
+    ::signal(sig, SIG_DFL);
+    if (sent)
+      ::raise(sig);
+  }
+
+  [[nodiscard]] std::uintptr_t lookup(std::uintptr_t pc) noexcept
+  {
+    m_numReaders.fetch_add(1);
+    const auto &table = *m_table.load();
+    std::uintptr_t res = 0;
+
+    const auto found = std::upper_bound(
+      table.begin(), table.end(), pc,
+      [](std::uintptr_t val, const CodeChecks *code) {
+        return val < code->begin;
+      });
+    if (found != table.begin() && pc < (*std::prev(found))->end)
+    {
+      const auto &code = **std::prev(found);
+      const auto offset = pc - code.begin;
+      const auto check = std::lower_bound(
+        code.checks.begin(), code.checks.end(), offset,
+        [](const ImplicitCheck &lhs, std::size_t val) {
+          return lhs.offset < val;
+        });
+      if (check != code.checks.end() && check->offset == offset)
+        res = code.begin + check->slowPath;
+    }
+
+    m_numReaders.fetch_sub(1);
+    return res;
+  }
+
+  void insert(const CodeChecks *code)
+  {
+    const WriterLock lock{m_writing};
+    auto next = std::make_unique<Table>(*m_table.load());
+    const auto pos = std::upper_bound(
+      next->begin(), next->end(), code,
+      [](const CodeChecks *lhs, const CodeChecks *rhs) {
+        return lhs->begin < rhs->begin;
+      });
+    next->insert(pos, code);
+    m_spare = publish(std::move(next));
+  }
+
+  // Spare table holds the current one, so it has room for all but one
+  void remove(const CodeChecks *code) noexcept
+  {
+    const WriterLock lock{m_writing};
+    const auto &cur = *m_table.load();
+    auto next = std::move(m_spare);
+    next->clear();
+    std::remove_copy(cur.begin(), cur.end(), std::back_inserter(*next), code);
+    m_spare = publish(std::move(next));
+  }
+
+  // Must be called under the lock, returns the table w/o readers
+  std::unique_ptr<Table> publish(std::unique_ptr<Table> next) noexcept
+  {
+    std::unique_ptr<Table> prev{m_table.exchange(next.release())};
+    while (m_numReaders.load() != 0)
+      std::this_thread::yield();
+    return prev;
+  }
+
+  struct sigaction m_prev{};
+  std::atomic_flag m_writing = ATOMIC_FLAG_INIT;
+  // Published tables are not modified
+  std::atomic<Table *> m_table{new Table{}};
+  std::unique_ptr<Table> m_spare{};
+  std::atomic<std::size_t> m_numReaders{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_FAULT_HANDLER_HH_INCLUDED */
@@ -0,0 +1,130 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_JIT_COMPILER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_JIT_COMPILER_HH_INCLUDED
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "codegen/codegen.hh"
+#include "codegen/exec_memory.hh"
+#include "common/error.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// IR type of the C++ type in signatures of compiled functions
+template <typename T>
+[[nodiscard]] constexpr Type getNativeType()
+{
+  if constexpr (std::is_void_v<T>)
+    return Type::None;
+  else if constexpr (std::is_same_v<T, bool>)
+    return Type::I1;
+  else if constexpr (std::is_integral_v<T> && sizeof(T) == 1)
+    return Type::I8;
+  else if constexpr (std::is_integral_v<T> && sizeof(T) == 2)
+    return Type::I16;
+  else if constexpr (std::is_integral_v<T> && sizeof(T) == 4)
+    return Type::I32;
+  else if constexpr (std::is_integral_v<T> && sizeof(T) == 8)
+    return Type::I64;
+  else
+    static_assert(!sizeof(T), "Type is not supported by compiled code");
+}
+
+// Owner of the machine code of compiled functions.
+// Each function has an entry cell, compiled calls jump through it. Callees
+// are compiled together w/ the caller, so all cells are set before the code
+// is run.
+class JitCompiler final
+{
+  struct Entry final
+  {
+    const void *code{};
+    std::size_t size{};
+    ExecMemory mem{};
+  };
+
+public:
+  // Entry point of the compiled function
+  const void *compile(const Function &func)
+  {
+    if (const auto found = m_entries.find(&func); found != m_entries.end())
+      return found->second->code;
+
+    std::vector<const Function *> newFuncs;
+    std::vector<const Function *> toCompile;
+    const auto resolve = [&](const Function &callee) -> const void *const * {
+      auto &entry = m_entries[&callee];
+      if (entry == nullptr)
+      {
+        entry = std::make_unique<Entry>();
+        newFuncs.push_back(&callee);
+        toCompile.push_back(&callee);
+      }
+      return &entry->code;
+    };
+
+    static_cast<void>(resolve(func));
+    try
+    {
+      while (!toCompile.empty())
+      {
+        const auto *const cur = toCompile.back();
+        toCompile.pop_back();
+
+        CodeGenerator codegen{*cur, resolve};
+        const auto code = codegen.generate();
+        auto &entry = *m_entries.at(cur);
+        entry.mem = ExecMemory{code, codegen.getImplicitChecks()};
+        entry.code = entry.mem.data();
+        entry.size = code.size();
+      }
+    }
+    catch (...)
+    {
+      // Code of the new functions may refer to each other
+      for (const auto *const newFunc : newFuncs)
+        m_entries.erase(newFunc);
+      throw;
+    }
+    return m_entries.at(&func)->code;
+  }
+
+  // Compiled function w/ the signature checked against the IR one
+  template <typename Ret, typename... Args>
+  auto getFunction(const Function &func) -> Ret (*)(Args...)
+  {
+    const std::vector<Type> args{getNativeType<Args>()...};
+    if (getNativeType<Ret>() != func.getResType() || args != func.getArgs())
+      throw CodeGenError{"Signature mismatch for " + func.getName()};
+
+    const auto *const code = compile(func);
+    Ret (*res)(Args...) = nullptr;
+    std::memcpy(&res, &code, sizeof(res));
+    return res;
+  }
+
+  [[nodiscard]] bool isCompiled(const Function &func) const
+  {
+    const auto found = m_entries.find(&func);
+    return found != m_entries.end() && found->second->code != nullptr;
+  }
+
+  // Size of the generated code in bytes
+  [[nodiscard]] std::size_t getCodeSize(const Function &func) const
+  {
+    const auto found = m_entries.find(&func);
+    return found == m_entries.end() ? 0 : found->second->size;
+  }
+
+private:
+  std::unordered_map<const Function *, std::unique_ptr<Entry>> m_entries{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_JIT_COMPILER_HH_INCLUDED */
@@ -0,0 +1,114 @@
+#ifndef LEECH_JIT_INCLUDE_CODEGEN_STUBS_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_CODEGEN_STUBS_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "codegen/assembler.hh"
+#include "ir/function.hh"
+
+namespace ljit
+{
+// Handler of the calls of not compiled functions
+using InterpHandler = std::int64_t (*)(void *ctx, const Function *func,
+                                       const std::int64_t *args);
+// Call of the code through the array of arguments
+using ArrayCall = std::int64_t (*)(const std::int64_t *args);
+
+namespace detail
+{
+inline constexpr std::int32_t kStubSlotSize = 8;
+
+[[nodiscard]] inline std::int64_t toImm(const void *ptr)
+{
+  return static_cast<std::int64_t>(reinterpret_cast<std::uintptr_t>(ptr));
+}
+} // namespace detail
+
+// Stub w/ the calling convention of the compiled code. It stores arguments
+// to an array on the stack and passes it to the handler:
+//   handler(ctx, func, args)
+[[nodiscard]] inline std::vector<std::uint8_t> genInterpEntryStub(
+  const Function &func, InterpHandler handler, void *ctx)
+{
+  using x86::Reg;
+  using detail::kStubSlotSize;
+  x86::Assembler masm;
+  const auto numArgs = func.getArgs().size();
+
+  masm.push(Reg::kRbp);
+  masm.mov(Reg::kRbp, Reg::kRsp);
+  // Keep the stack aligned by 16
+  const auto arraySize =
+    static_cast<std::int32_t>((numArgs + numArgs % 2) * kStubSlotSize);
+  if (arraySize != 0)
+    masm.alu(x86::AluOp::kSub, Reg::kRsp, arraySize);
+
+  for (std::size_t idx = 0; idx < numArgs; ++idx)
+  {
+    const x86::Mem slot{Reg::kRsp,
+                        static_cast<std::int32_t>(idx) * kStubSlotSize};
+    if (idx < x86::kArgRegs.size())
+    {
+      masm.mov(slot, x86::kArgRegs[idx]);
+      continue;
+    }
+    // Above the return address and saved rbp
+    const auto stackIdx =
+      static_cast<std::int32_t>(idx - x86::kArgRegs.size()) + 2;
+    masm.mov(Reg::kRax, x86::Mem{Reg::kRbp, stackIdx * kStubSlotSize});
+    masm.mov(slot, Reg::kRax);
+  }
+
+  masm.mov(Reg::kRdx, Reg::kRsp);
+  masm.mov(Reg::kRdi, detail::toImm(ctx));
+  masm.mov(Reg::kRsi, detail::toImm(&func));
+  masm.mov(Reg::kRax, static_cast<std::int64_t>(
+                        reinterpret_cast<std::uintptr_t>(handler)));
+  masm.call(Reg::kRax);
+
+  masm.mov(Reg::kRsp, Reg::kRbp);
+  masm.pop(Reg::kRbp);
+  masm.ret();
+  return masm.finalize();
+}
+
+// Adapter w/ ArrayCall signature, it calls the code through the entry cell
+[[nodiscard]] inline std::vector<std::uint8_t> genArrayCallAdapter(
+  std::size_t numArgs, const void *const *cell)
+{
+  using x86::Reg;
+  using detail::kStubSlotSize;
+  x86::Assembler masm;
+  const auto getArraySlot = [](std::size_t idx) {
+    return x86::Mem{Reg::kRax, static_cast<std::int32_t>(idx) * kStubSlotSize};
+  };
+
+  masm.push(Reg::kRbp);
+  masm.mov(Reg::kRbp, Reg::kRsp);
+  masm.mov(Reg::kRax, Reg::kRdi);
+
+  const auto numRegArgs = std::min(numArgs, x86::kArgRegs.size());
+  if ((numArgs - numRegArgs) % 2 != 0)
+    masm.alu(x86::AluOp::kSub, Reg::kRsp, kStubSlotSize);
+  for (auto idx = numArgs; idx > numRegArgs; --idx)
+  {
+    masm.mov(Reg::kR11, getArraySlot(idx - 1));
+    masm.push(Reg::kR11);
+  }
+  for (std::size_t idx = 0; idx < numRegArgs; ++idx)
+    masm.mov(x86::kArgRegs[idx], getArraySlot(idx));
+
+  masm.mov(Reg::kRax, detail::toImm(cell));
+  masm.call(x86::Mem{Reg::kRax, 0});
+
+  masm.mov(Reg::kRsp, Reg::kRbp);
+  masm.pop(Reg::kRbp);
+  masm.ret();
+  return masm.finalize();
+}
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_CODEGEN_STUBS_HH_INCLUDED */
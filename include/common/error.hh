@@ -2,6 +2,7 @@
 #define LEECH_JIT_INCLUDE_COMMON_ERROR_HH_INCLUDED
 
 #include <stdexcept>
+#include <string>
 
 namespace ljit
 {
@@ -9,6 +10,62 @@ class ArithmeticError : public std::runtime_error
 {
   using std::runtime_error::runtime_error;
 };
+
+enum class TrapKind
+{
+  kZeroCheck,
+  kBoundsCheck,
+  kDivByZero,
+  kBadShift,
+};
+
+[[nodiscard]] inline const char *getTrapMessage(TrapKind kind)
+{
+  switch (kind)
+  {
+  case TrapKind::kZeroCheck:
+    return "Zero check failed";
+  case TrapKind::kBoundsCheck:
+    return "Bounds check failed";
+  case TrapKind::kDivByZero:
+    return "Division by zero";
+  case TrapKind::kBadShift:
+    return "Shift amount exceeds the width of type";
+  default:
+    return "Unknown trap";
+  }
+}
+
+// Failed runtime check during execution
+class TrapError : public std::runtime_error
+{
+  TrapKind m_kind{};
+
+public:
+  TrapError(TrapKind kind, const std::string &msg)
+    : std::runtime_error(msg), m_kind(kind)
+  {}
+
+  [[nodiscard]] auto getKind() const noexcept
+  {
+    return m_kind;
+  }
+};
+
+class ProfileError : public std::runtime_error
+{
+  using std::runtime_error::runtime_error;
+};
+
+class AotCacheError : public std::runtime_error
+{
+  using std::runtime_error::runtime_error;
+};
+
+class CodeGenError : public std::runtime_error
+{
+  using std::runtime_error::runtime_error;
+};
 } // namespace ljit
 
 #endif /* LEECH_JIT_INCLUDE_COMMON_ERROR_HH_INCLUDED */
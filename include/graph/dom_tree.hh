@@ -72,6 +72,15 @@ public:
     return false;
   }
 
+  [[nodiscard]] std::vector<NodePtrTy> getIDommed(NodePtrTy node) const
+  {
+    const auto found = m_tree.find(detail::getNodeId<GraphTy>(node));
+    if (found == m_tree.end())
+      return {};
+
+    return found->second.getIDommed();
+  }
+
   [[nodiscard]] auto size() const noexcept
   {
     return m_tree.size();
@@ -184,20 +193,43 @@ private:
   }
   void doDFS(const GraphTy &graph)
   {
-    depthFirstSearchPreOrder(
-      graph, [this, prev = Traits::entryPoint(graph)](NodePtrTy node) mutable {
-        const auto dfsTime = detail::toDFSTime(m_dfsTimes.size());
+    // Parent of the node in DFS tree is the innermost unfinished node
+    class Vis final : public DFSVisitor<GraphTy>
+    {
+      DomTreeBuilder &m_builder;
+      std::vector<NodePtrTy> m_path;
+
+    public:
+      explicit Vis(DomTreeBuilder &builder) : m_builder(builder)
+      {}
+
+      void discoverNode(NodePtrTy node)
+      {
+        m_builder.addDFSNode(node, m_path.empty() ? node : m_path.back());
+        m_path.push_back(node);
+      }
+
+      void finishNode([[maybe_unused]] NodePtrTy node)
+      {
+        m_path.pop_back();
+      }
+    };
+
+    depthFirstSearch(graph, Vis{*this});
+  }
+
+  void addDFSNode(NodePtrTy node, NodePtrTy parent)
+  {
+    const auto dfsTime = detail::toDFSTime(m_dfsTimes.size());
 
-        m_dfsTimes.push_back(node);
+    m_dfsTimes.push_back(node);
 
-        const auto nodeId = getNodeId(node);
-        m_revIdMap[nodeId] = dfsTime;
-        m_sdoms[dfsTime] = dfsTime;
-        m_idoms[dfsTime] = dfsTime;
+    const auto nodeId = getNodeId(node);
+    m_revIdMap[nodeId] = dfsTime;
+    m_sdoms[dfsTime] = dfsTime;
+    m_idoms[dfsTime] = dfsTime;
 
-        m_dfsParents[nodeId] = prev;
-        prev = node;
-      });
+    m_dfsParents[nodeId] = parent;
   }
 
   [[nodiscard]] auto findMinSdom(NodePtrTy node, DSUTy &dsu)
@@ -0,0 +1,488 @@
+#ifndef LEECH_JIT_INCLUDE_INTERP_BYTECODE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_INTERP_BYTECODE_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "analysis/loop_analyzer.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+enum class Opcode : std::uint8_t
+{
+  kMov,
+  kAdd,
+  kSub,
+  kMul,
+  kDiv,
+  kLE,
+  kEQ,
+  kShr,
+  kShl,
+  kOr,
+  kBoundsCheck,
+  kZeroCheck,
+  kCast,
+  kSelect,
+  kJump,
+  kBranch,
+  kSwitch,
+  kCall,
+  kRet,
+  kRetVoid,
+  kLoopHeader,
+};
+
+// Register-based instruction, operands are frame slots. Jump targets are
+// indices of instructions, calls, switches and loops refer to side tables:
+//   kJump a,  kBranch a ? b : c,  kSwitch table a on b,  kCall site a,
+//   kLoopHeader loop a.
+struct BcInst final
+{
+  Opcode op{};
+  // Type of the result, values are kept sign-extended from it
+  Type type{Type::None};
+  std::uint32_t dst{};
+  std::uint32_t a{};
+  std::uint32_t b{};
+  std::uint32_t c{};
+};
+
+struct BcCallSite final
+{
+  const Function *callee{};
+  std::vector<std::uint32_t> args{};
+};
+
+struct BcSwitchTable final
+{
+  // Sorted by value
+  std::vector<std::pair<std::int64_t, std::uint32_t>> cases{};
+  std::uint32_t defaultTarget{};
+};
+
+// Reducible loop, its header starts w/ kLoopHeader
+struct BcLoop final
+{
+  const BasicBlock *header{};
+  // Profiling counter for the on-stack replacement
+  std::uint64_t numIters{};
+};
+
+struct BytecodeFunction final
+{
+  std::vector<BcInst> code{};
+  // Initial frame w/ constants in their slots
+  std::vector<std::int64_t> frame{};
+  // Param slot and index of the argument
+  std::vector<std::pair<std::uint32_t, std::size_t>> params{};
+  std::vector<BcCallSite> calls{};
+  std::vector<BcSwitchTable> switches{};
+  std::vector<BcLoop> loops{};
+  // Frame slots of the values
+  std::unordered_map<const Inst *, std::uint32_t> slots{};
+  std::size_t numArgs{};
+  const Function *func{};
+  // Profiling counters for tiering
+  std::uint64_t numCalls{};
+  std::uint64_t numBackEdges{};
+  // Failed checks and other traps
+  std::uint64_t numTraps{};
+};
+
+// Lowering of the function to bytecode.
+// Blocks are emitted in the layout order, a jump to the next block is
+// omitted. Every value gets its own slot, phis are resolved by parallel moves
+// on the incoming edges: before the jump or in a separate trampoline if the
+// predecessor branches. Headers of the reducible loops start w/ kLoopHeader,
+// so it is executed after the phi moves.
+class BytecodeCompiler final
+{
+  using Moves = std::vector<std::pair<std::uint32_t, std::uint32_t>>;
+
+  struct Trampoline final
+  {
+    const BasicBlock *pred{};
+    const BasicBlock *succ{};
+    std::uint32_t label{};
+  };
+
+  const Function &m_func;
+
+public:
+  explicit BytecodeCompiler(const Function &func) : m_func(func)
+  {}
+
+  [[nodiscard]] BytecodeFunction compile()
+  {
+    if (m_func.size() == 0)
+      throw std::runtime_error{"Function " + m_func.getName() +
+                               " has no body"};
+
+    m_res = BytecodeFunction{};
+    m_res.numArgs = m_func.getArgs().size();
+    m_res.func = &m_func;
+    collectBlocks();
+    assignSlots();
+
+    m_labelPc.assign(m_order.size(), 0);
+    m_trampolines.clear();
+    for (std::size_t idx = 0; idx < m_order.size(); ++idx)
+    {
+      m_labelPc[idx] = getPc();
+      if (const auto found = m_loopIdx.find(m_order[idx]);
+          found != m_loopIdx.end())
+        emit(BcInst{Opcode::kLoopHeader, Type::None, 0, found->second, 0, 0});
+      const auto *const next =
+        idx + 1 < m_order.size() ? m_order[idx + 1] : nullptr;
+      for (const auto &inst : *m_order[idx])
+        emitInst(inst, next);
+    }
+
+    for (const auto &tramp : m_trampolines)
+    {
+      m_labelPc[tramp.label] = getPc();
+      emitMoves(tramp.pred, tramp.succ);
+      emit(BcInst{Opcode::kJump, Type::None, 0, m_blockLabel.at(tramp.succ),
+                  0, 0});
+    }
+
+    resolveLabels();
+    m_res.slots = std::move(m_slots);
+    return std::move(m_res);
+  }
+
+private:
+  void collectBlocks()
+  {
+    std::unordered_set<const BasicBlock *> reachable;
+    graph::depthFirstSearchPreOrder(
+      m_func.makeBBGraph(),
+      [&](const BasicBlock *bb) { reachable.insert(bb); });
+
+    m_order.clear();
+    m_blockLabel.clear();
+    for (const auto &bb : m_func)
+      if (reachable.count(&bb) != 0)
+      {
+        m_blockLabel[&bb] = static_cast<std::uint32_t>(m_order.size());
+        m_order.push_back(&bb);
+      }
+
+    m_loopIdx.clear();
+    const LoopAnalyzer<BasicBlockGraph> loops{m_func.makeBBGraph()};
+    for (const auto *const bb : m_order)
+      if (const auto *const loop =
+            loops.getLoopInfo(const_cast<BasicBlock *>(bb));
+          loop->getHeader() == bb && loop->reducible())
+      {
+        m_loopIdx[bb] = static_cast<std::uint32_t>(m_res.loops.size());
+        m_res.loops.push_back(BcLoop{bb, 0});
+      }
+  }
+
+  void assignSlots()
+  {
+    m_slots.clear();
+    std::vector<std::pair<std::uint32_t, std::int64_t>> consts;
+    std::uint32_t numSlots = 0;
+    for (const auto *const bb : m_order)
+      for (const auto &inst : *bb)
+      {
+        if (!producesValue(inst))
+          continue;
+
+        const auto slot = numSlots++;
+        m_slots[&inst] = slot;
+        if (inst.getInstType() == InstType::kConst)
+          consts.emplace_back(slot, retrieveConstVal(&inst));
+        else if (inst.getInstType() == InstType::kParam)
+          m_res.params.emplace_back(
+            slot, static_cast<const Param &>(inst).getIdx());
+      }
+
+    // Breaks cycles of phi moves
+    m_scratch = numSlots++;
+    m_res.frame.assign(numSlots, 0);
+    for (const auto &[slot, val] : consts)
+      m_res.frame[slot] = val;
+  }
+
+  [[nodiscard]] std::uint32_t getSlot(const Value *val) const
+  {
+    LJIT_ASSERT(val->isInst());
+    return m_slots.at(static_cast<const Inst *>(val));
+  }
+
+  [[nodiscard]] std::uint32_t getPc() const
+  {
+    return static_cast<std::uint32_t>(m_res.code.size());
+  }
+
+  void emit(const BcInst &inst)
+  {
+    m_res.code.push_back(inst);
+  }
+
+  [[nodiscard]] static bool hasPhis(const BasicBlock *succ)
+  {
+    return std::any_of(succ->begin(), succ->end(), [](const Inst &inst) {
+      return inst.getInstType() == InstType::kPhi;
+    });
+  }
+
+  // Label of the block or of the trampoline w/ phi moves for the edge
+  [[nodiscard]] std::uint32_t getEdgeLabel(const BasicBlock *pred,
+                                           const BasicBlock *succ)
+  {
+    if (!hasPhis(succ))
+      return m_blockLabel.at(succ);
+
+    const auto label = static_cast<std::uint32_t>(m_labelPc.size());
+    m_labelPc.push_back(0);
+    m_trampolines.push_back(Trampoline{pred, succ, label});
+    return label;
+  }
+
+  void emitMoves(const BasicBlock *pred, const BasicBlock *succ)
+  {
+    Moves moves;
+    for (const auto &inst : *succ)
+    {
+      if (inst.getInstType() != InstType::kPhi)
+        continue;
+      const auto &phi = static_cast<const Phi &>(inst);
+      const auto found =
+        std::find_if(phi.begin(), phi.end(),
+                     [pred](const auto &entry) { return entry.bb == pred; });
+      LJIT_ASSERT(found != phi.end());
+
+      const auto dst = getSlot(&phi);
+      const auto src = getSlot(found->m_val);
+      if (dst != src)
+        moves.emplace_back(dst, src);
+    }
+    emitParallelMoves(moves);
+  }
+
+  // All moves read their sources before any destination is written
+  void emitParallelMoves(Moves moves)
+  {
+    auto isRead = [&moves](std::uint32_t slot) {
+      return std::any_of(
+        moves.begin(), moves.end(),
+        [slot](const auto &move) { return move.second == slot; });
+    };
+
+    while (!moves.empty())
+    {
+      const auto ready =
+        std::find_if(moves.begin(), moves.end(),
+                     [&](const auto &move) { return !isRead(move.first); });
+      if (ready != moves.end())
+      {
+        emit(BcInst{Opcode::kMov, Type::None, ready->first, ready->second, 0,
+                    0});
+        moves.erase(ready);
+        continue;
+      }
+
+      // Only cycles are left: save the first destination to break one
+      const auto saved = moves.front().first;
+      emit(BcInst{Opcode::kMov, Type::None, m_scratch, saved, 0, 0});
+      for (auto &move : moves)
+        if (move.second == saved)
+          move.second = m_scratch;
+    }
+  }
+
+  [[nodiscard]] static Opcode getOpcode(BinOp::Oper oper)
+  {
+    switch (oper)
+    {
+    case BinOp::Oper::kAdd:
+      return Opcode::kAdd;
+    case BinOp::Oper::kSub:
+      return Opcode::kSub;
+    case BinOp::Oper::kMul:
+      return Opcode::kMul;
+    case BinOp::Oper::kDiv:
+      return Opcode::kDiv;
+    case BinOp::Oper::kLE:
+      return Opcode::kLE;
+    case BinOp::Oper::kEQ:
+      return Opcode::kEQ;
+    case BinOp::Oper::kShr:
+      return Opcode::kShr;
+    case BinOp::Oper::kShl:
+      return Opcode::kShl;
+    case BinOp::Oper::kOr:
+      return Opcode::kOr;
+    case BinOp::Oper::kBoundsCheck:
+      return Opcode::kBoundsCheck;
+    default:
+      LJIT_UNREACHABLE("Unknown binary operation");
+    }
+  }
+
+  void emitInst(const Inst &inst, const BasicBlock *next)
+  {
+    const auto *const bb = inst.getBB();
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+    case InstType::kParam:
+    case InstType::kPhi:
+      break;
+    case InstType::kBinOp: {
+      const auto &binOp = static_cast<const BinOp &>(inst);
+      emit(BcInst{getOpcode(binOp.getOper()), inst.getType(), getSlot(&inst),
+                  getSlot(binOp.getLeft()), getSlot(binOp.getRight()), 0});
+      break;
+    }
+    case InstType::kUnaryOp:
+      LJIT_ASSERT(static_cast<const UnaryOp &>(inst).getOper() ==
+                  UnaryOp::Oper::kZeroCheck);
+      emit(BcInst{Opcode::kZeroCheck, inst.getType(), getSlot(&inst),
+                  getSlot(inst.inputAt(0)), 0, 0});
+      break;
+    case InstType::kCast:
+      emit(BcInst{Opcode::kCast, inst.getType(), getSlot(&inst),
+                  getSlot(inst.inputAt(0)), 0, 0});
+      break;
+    case InstType::kSelect: {
+      const auto &select = static_cast<const Select &>(inst);
+      emit(BcInst{Opcode::kSelect, inst.getType(), getSlot(&inst),
+                  getSlot(select.getCond()), getSlot(select.getTrueVal()),
+                  getSlot(select.getFalseVal())});
+      break;
+    }
+    case InstType::kCall: {
+      const auto &call = static_cast<const Call &>(inst);
+      BcCallSite site{call.getCallee(), {}};
+      for (auto it = call.inputBegin(); it != call.inputEnd(); ++it)
+        site.args.push_back(getSlot(*it));
+      const auto idx = static_cast<std::uint32_t>(m_res.calls.size());
+      m_res.calls.push_back(std::move(site));
+      emit(BcInst{Opcode::kCall, inst.getType(), getSlot(&inst), idx, 0, 0});
+      break;
+    }
+    case InstType::kRet:
+      if (inst.inputBegin() == inst.inputEnd())
+        emit(BcInst{Opcode::kRetVoid, Type::None, 0, 0, 0, 0});
+      else
+        emit(BcInst{Opcode::kRet, Type::None, 0, getSlot(inst.inputAt(0)), 0,
+                    0});
+      break;
+    case InstType::kJump: {
+      const auto *const target =
+        static_cast<const JumpInstr &>(inst).getTarget();
+      emitMoves(bb, target);
+      if (target != next)
+        emit(BcInst{Opcode::kJump, Type::None, 0, m_blockLabel.at(target), 0,
+                    0});
+      break;
+    }
+    case InstType::kIf: {
+      const auto &ifInst = static_cast<const IfInstr &>(inst);
+      emit(BcInst{Opcode::kBranch, Type::None, 0, getSlot(ifInst.getCond()),
+                  getEdgeLabel(bb, ifInst.getTrueBB()),
+                  getEdgeLabel(bb, ifInst.getFalseBB())});
+      break;
+    }
+    case InstType::kSwitch: {
+      const auto &sw = static_cast<const Switch &>(inst);
+      // Each target is reached through one edge
+      std::unordered_map<const BasicBlock *, std::uint32_t> labels;
+      auto getLabel = [&](const BasicBlock *target) {
+        const auto [it, inserted] = labels.emplace(target, 0);
+        if (inserted)
+          it->second = getEdgeLabel(bb, target);
+        return it->second;
+      };
+
+      BcSwitchTable table;
+      table.defaultTarget = getLabel(sw.getDefault());
+      for (const auto &swCase : sw.getCases())
+        table.cases.emplace_back(swCase.val, getLabel(swCase.target));
+      const auto idx = static_cast<std::uint32_t>(m_res.switches.size());
+      m_res.switches.push_back(std::move(table));
+      emit(BcInst{Opcode::kSwitch, Type::None, 0, idx, getSlot(sw.getVal()),
+                  0});
+      break;
+    }
+    case InstType::kUnknown:
+    default:
+      LJIT_UNREACHABLE("Unknown instruction");
+    }
+  }
+
+  void resolveLabels()
+  {
+    for (auto &inst : m_res.code)
+    {
+      switch (inst.op)
+      {
+      case Opcode::kJump:
+        inst.a = m_labelPc.at(inst.a);
+        break;
+      case Opcode::kBranch:
+        inst.b = m_labelPc.at(inst.b);
+        inst.c = m_labelPc.at(inst.c);
+        break;
+      case Opcode::kMov:
+      case Opcode::kAdd:
+      case Opcode::kSub:
+      case Opcode::kMul:
+      case Opcode::kDiv:
+      case Opcode::kLE:
+      case Opcode::kEQ:
+      case Opcode::kShr:
+      case Opcode::kShl:
+      case Opcode::kOr:
+      case Opcode::kBoundsCheck:
+      case Opcode::kZeroCheck:
+      case Opcode::kCast:
+      case Opcode::kSelect:
+      case Opcode::kSwitch:
+      case Opcode::kCall:
+      case Opcode::kRet:
+      case Opcode::kRetVoid:
+      case Opcode::kLoopHeader:
+      default:
+        break;
+      }
+    }
+
+    for (auto &table : m_res.switches)
+    {
+      table.defaultTarget = m_labelPc.at(table.defaultTarget);
+      for (auto &swCase : table.cases)
+        swCase.second = m_labelPc.at(swCase.second);
+    }
+  }
+
+  BytecodeFunction m_res{};
+  std::vector<const BasicBlock *> m_order{};
+  std::unordered_map<const BasicBlock *, std::uint32_t> m_blockLabel{};
+  std::unordered_map<const Inst *, std::uint32_t> m_slots{};
+  std::unordered_map<const BasicBlock *, std::uint32_t> m_loopIdx{};
+  std::uint32_t m_scratch{};
+  // Blocks go first, then trampolines
+  std::vector<std::uint32_t> m_labelPc{};
+  std::vector<Trampoline> m_trampolines{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_INTERP_BYTECODE_HH_INCLUDED */
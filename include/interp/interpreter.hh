@@ -0,0 +1,452 @@
+#ifndef LEECH_JIT_INCLUDE_INTERP_INTERPRETER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_INTERP_INTERPRETER_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "common/error.hh"
+#include "interp/bytecode.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+// Labels as values are used for dispatch if the compiler supports them
+#if defined(__GNUC__)
+#define LJIT_INTERP_COMPUTED_GOTO 1
+#else
+#define LJIT_INTERP_COMPUTED_GOTO 0
+#endif
+
+namespace ljit
+{
+// Connection of the interpreter to the upper tiers
+class TierHook
+{
+public:
+  TierHook() = default;
+  LJIT_NO_COPY_SEMANTICS(TierHook);
+  LJIT_NO_MOVE_SEMANTICS(TierHook);
+  virtual ~TierHook() = default;
+
+  // Counter of calls or back edges of the function reached its threshold.
+  // If the function is not accepted, the counter starts over
+  virtual bool onHot(const Function &func, std::uint64_t hotness) = 0;
+  // Run the compiled code of the callee if there is one. Arguments are read
+  // before the callee starts
+  virtual bool tryCallCompiled(const Function &callee,
+                               const std::int64_t *args,
+                               std::int64_t &res) = 0;
+  // Loop of the function is hot. Continue it in the compiled code if there
+  // is one, the frame is read before the code starts
+  virtual bool tryEnterOsr(const BytecodeFunction &func, std::size_t loopIdx,
+                           const std::int64_t *frame, std::int64_t &res) = 0;
+};
+
+// Bytecode interpreter.
+// Functions are compiled to bytecode on the first call. All frames live on
+// one value stack, calls of the interpreted code recurse into execute().
+// Arithmetic wraps in the type of the result, failed checks, division by
+// zero and too wide shifts throw TrapError.
+// Calls and back edges of each function are counted, the tier hook is
+// notified once a counter reaches its threshold. Iterations of each loop are
+// counted too, a hot loop may leave the interpreter in the middle of the
+// function.
+class Interpreter final
+{
+  using Word = std::int64_t;
+
+public:
+  static constexpr std::size_t kMaxCallDepth = 1024;
+  static constexpr auto kNoThreshold =
+    std::numeric_limits<std::uint64_t>::max();
+
+  Interpreter()
+  {
+    m_stack.reserve(kInitialStackSize);
+  }
+
+  // Arguments are truncated to the parameter types, result of void function
+  // is zero
+  Word run(const Function &func, const std::vector<Word> &args = {})
+  {
+    return run(func, args.data(), args.size());
+  }
+
+  // May be called from the code run by the interpreter
+  Word run(const Function &func, const Word *args, std::size_t numArgs)
+  {
+    auto &code = getCode(func);
+    if (numArgs != code.numArgs)
+      throw std::runtime_error{"Wrong number of arguments for " +
+                               func.getName()};
+
+    // Frames of the failed run are left on the stack
+    if (m_depth == 0)
+      m_stack.clear();
+    const auto base = m_stack.size();
+    m_stack.insert(m_stack.end(), code.frame.begin(), code.frame.end());
+    for (const auto &[slot, idx] : code.params)
+      m_stack[base + slot] = wrap(func.getArgs().at(idx),
+                                  static_cast<std::uint64_t>(args[idx]));
+    const auto res = execute(code, base);
+    m_stack.resize(base);
+    return res;
+  }
+
+  void setTierHook(TierHook *hook, std::uint64_t callThreshold = kNoThreshold,
+                   std::uint64_t backEdgeThreshold = kNoThreshold,
+                   std::uint64_t osrThreshold = kNoThreshold) noexcept
+  {
+    m_hook = hook;
+    m_callThreshold = callThreshold;
+    m_backEdgeThreshold = backEdgeThreshold;
+    m_osrThreshold = osrThreshold;
+  }
+
+  // Bytecode of the function, it is compiled on demand
+  BytecodeFunction &getCode(const Function &func)
+  {
+    auto &code = m_code[&func];
+    if (code == nullptr)
+      code = std::make_unique<BytecodeFunction>(
+        BytecodeCompiler{func}.compile());
+    return *code;
+  }
+
+  // Drop the bytecode of the changed function
+  void invalidate(const Function &func)
+  {
+    m_code.erase(&func);
+  }
+
+  // Value truncated to the type and sign-extended back
+  [[nodiscard]] static Word wrap(Type type, std::uint64_t val)
+  {
+    switch (type)
+    {
+    case Type::I64:
+      return static_cast<Word>(val);
+    case Type::I32:
+      return static_cast<std::int32_t>(val);
+    case Type::I16:
+      return static_cast<std::int16_t>(val);
+    case Type::I8:
+      return static_cast<std::int8_t>(val);
+    case Type::I1:
+      return val != 0 ? 1 : 0;
+    case Type::None:
+    default:
+      return 0;
+    }
+  }
+
+  // Number of executed bytecode instructions
+  [[nodiscard]] auto getNumExecuted() const noexcept
+  {
+    return m_numExecuted;
+  }
+
+private:
+  static constexpr std::size_t kInitialStackSize = 1 << 16;
+
+  class DepthGuard final
+  {
+    std::size_t &m_depth;
+
+  public:
+    explicit DepthGuard(std::size_t &depth) : m_depth(depth)
+    {
+      if (++m_depth > kMaxCallDepth)
+        throw std::runtime_error{"Call stack overflow"};
+    }
+    DepthGuard(const DepthGuard &) = delete;
+    DepthGuard &operator=(const DepthGuard &) = delete;
+    DepthGuard(DepthGuard &&) = delete;
+    DepthGuard &operator=(DepthGuard &&) = delete;
+    ~DepthGuard()
+    {
+      --m_depth;
+    }
+  };
+
+  [[nodiscard]] static Word getWidth(Type type)
+  {
+    switch (type)
+    {
+    case Type::I1:
+      return 1;
+    case Type::I8:
+      return 7;
+    case Type::I16:
+      return 15;
+    case Type::I32:
+      return 31;
+    case Type::I64:
+      return 63;
+    case Type::None:
+    default:
+      return 0;
+    }
+  }
+
+  [[noreturn]] static void trap(BytecodeFunction &func, TrapKind kind)
+  {
+    ++func.numTraps;
+    throw TrapError{kind, getTrapMessage(kind)};
+  }
+
+  void onBackEdge(BytecodeFunction &func)
+  {
+    if (++func.numBackEdges == m_backEdgeThreshold && !notifyHot(func))
+      func.numBackEdges = 0;
+  }
+
+  // Counter starts over after each request, so the code compiled in the
+  // background is entered on the next round
+  bool onLoopHeader(BytecodeFunction &func, std::size_t loopIdx,
+                    const Word *frame, Word &res)
+  {
+    auto &loop = func.loops[loopIdx];
+    if (++loop.numIters != m_osrThreshold || m_hook == nullptr)
+      return false;
+    loop.numIters = 0;
+    return m_hook->tryEnterOsr(func, loopIdx, frame, res);
+  }
+
+  bool notifyHot(const BytecodeFunction &func)
+  {
+    return m_hook == nullptr ||
+           m_hook->onHot(*func.func, func.numCalls + func.numBackEdges);
+  }
+
+  Word call(const BcCallSite &site, std::size_t base)
+  {
+    if (m_hook != nullptr)
+    {
+      m_args.clear();
+      for (const auto slot : site.args)
+        m_args.push_back(m_stack[base + slot]);
+      if (Word res{}; m_hook->tryCallCompiled(*site.callee, m_args.data(), res))
+        return res;
+    }
+
+    auto &callee = getCode(*site.callee);
+    const auto newBase = m_stack.size();
+    m_stack.insert(m_stack.end(), callee.frame.begin(), callee.frame.end());
+    for (const auto &[slot, idx] : callee.params)
+      m_stack[newBase + slot] = m_stack[base + site.args[idx]];
+
+    const auto res = execute(callee, newBase);
+    m_stack.resize(newBase);
+    return res;
+  }
+
+#if LJIT_INTERP_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+  Word execute(BytecodeFunction &func, std::size_t base)
+  {
+    const DepthGuard guard{m_depth};
+    if (++func.numCalls == m_callThreshold && !notifyHot(func))
+      func.numCalls = 0;
+
+    const auto *const code = func.code.data();
+    const auto *ip = code;
+    auto *fp = m_stack.data() + base;
+    std::uint64_t numExecuted = 0;
+
+    auto finish = [&](Word res) {
+      m_numExecuted += numExecuted;
+      return res;
+    };
+
+#if LJIT_INTERP_COMPUTED_GOTO
+    // In order of Opcode
+    static const void *const kLabels[] = {
+      &&kMov,        &&kAdd,       &&kSub,    &&kMul,   &&kDiv,
+      &&kLE,         &&kEQ,        &&kShr,    &&kShl,   &&kOr,
+      &&kBoundsCheck, &&kZeroCheck, &&kCast,   &&kSelect, &&kJump,
+      &&kBranch,     &&kSwitch,    &&kCall,   &&kRet,   &&kRetVoid,
+      &&kLoopHeader,
+    };
+#define LJIT_DISPATCH()                                                        \
+  do                                                                           \
+  {                                                                            \
+    ++numExecuted;                                                             \
+    goto *kLabels[static_cast<std::size_t>(ip->op)];                           \
+  } while (false)
+#define LJIT_HANDLER(name) name
+#else
+#define LJIT_DISPATCH()                                                        \
+  do                                                                           \
+  {                                                                            \
+    ++numExecuted;                                                             \
+    goto dispatch;                                                             \
+  } while (false)
+#define LJIT_HANDLER(name) case Opcode::name
+#endif
+
+#define LJIT_NEXT(next)                                                        \
+  do                                                                           \
+  {                                                                            \
+    ip = (next);                                                               \
+    LJIT_DISPATCH();                                                           \
+  } while (false)
+
+// Jumps backwards close loops
+#define LJIT_JUMP(target)                                                      \
+  do                                                                           \
+  {                                                                            \
+    const auto *const dest = code + (target);                                  \
+    if (dest <= ip)                                                            \
+      onBackEdge(func);                                                        \
+    LJIT_NEXT(dest);                                                           \
+  } while (false)
+
+#define LJIT_BINARY(name, expr)                                                \
+  LJIT_HANDLER(name) :                                                         \
+  {                                                                            \
+    const auto lhs = fp[ip->a];                                                \
+    const auto rhs = fp[ip->b];                                                \
+    fp[ip->dst] = (expr);                                                      \
+    LJIT_NEXT(ip + 1);                                                         \
+  }
+
+    LJIT_DISPATCH();
+
+#if !LJIT_INTERP_COMPUTED_GOTO
+  dispatch:
+    switch (ip->op)
+    {
+#endif
+      LJIT_HANDLER(kMov) :
+      {
+        fp[ip->dst] = fp[ip->a];
+        LJIT_NEXT(ip + 1);
+      }
+      LJIT_BINARY(kAdd, wrap(ip->type, static_cast<std::uint64_t>(lhs) +
+                                         static_cast<std::uint64_t>(rhs)))
+      LJIT_BINARY(kSub, wrap(ip->type, static_cast<std::uint64_t>(lhs) -
+                                         static_cast<std::uint64_t>(rhs)))
+      LJIT_BINARY(kMul, wrap(ip->type, static_cast<std::uint64_t>(lhs) *
+                                         static_cast<std::uint64_t>(rhs)))
+      LJIT_BINARY(kDiv,
+                  rhs == 0    ? (trap(func, TrapKind::kDivByZero), Word{})
+                  : rhs == -1 ? wrap(ip->type, 0 - static_cast<std::uint64_t>(
+                                                     lhs))
+                              : wrap(ip->type, static_cast<std::uint64_t>(
+                                                 lhs / rhs)))
+      LJIT_BINARY(kLE, lhs < rhs ? 1 : 0)
+      LJIT_BINARY(kEQ, lhs == rhs ? 1 : 0)
+      LJIT_BINARY(kShr, rhs < 0 || rhs >= getWidth(ip->type)
+                          ? (trap(func, TrapKind::kBadShift), Word{})
+                          : lhs >> rhs)
+      LJIT_BINARY(kShl, rhs < 0 || rhs >= getWidth(ip->type)
+                          ? (trap(func, TrapKind::kBadShift), Word{})
+                          : wrap(ip->type, static_cast<std::uint64_t>(lhs)
+                                             << rhs))
+      LJIT_BINARY(kOr, lhs | rhs)
+      LJIT_BINARY(kBoundsCheck,
+                  lhs < 0 || lhs >= rhs
+                    ? (trap(func, TrapKind::kBoundsCheck), Word{})
+                    : lhs)
+      LJIT_HANDLER(kZeroCheck) :
+      {
+        const auto val = fp[ip->a];
+        if (val == 0)
+          trap(func, TrapKind::kZeroCheck);
+        fp[ip->dst] = val;
+        LJIT_NEXT(ip + 1);
+      }
+      LJIT_HANDLER(kCast) :
+      {
+        fp[ip->dst] = wrap(ip->type, static_cast<std::uint64_t>(fp[ip->a]));
+        LJIT_NEXT(ip + 1);
+      }
+      LJIT_HANDLER(kSelect) :
+      {
+        fp[ip->dst] = fp[ip->a] != 0 ? fp[ip->b] : fp[ip->c];
+        LJIT_NEXT(ip + 1);
+      }
+      LJIT_HANDLER(kJump) :
+      {
+        LJIT_JUMP(ip->a);
+      }
+      LJIT_HANDLER(kBranch) :
+      {
+        LJIT_JUMP(fp[ip->a] != 0 ? ip->b : ip->c);
+      }
+      LJIT_HANDLER(kSwitch) :
+      {
+        const auto &table = func.switches[ip->a];
+        const auto val = fp[ip->b];
+        const auto found = std::lower_bound(
+          table.cases.begin(), table.cases.end(), val,
+          [](const auto &swCase, Word key) { return swCase.first < key; });
+        const auto target = found != table.cases.end() && found->first == val
+                              ? found->second
+                              : table.defaultTarget;
+        LJIT_JUMP(target);
+      }
+      LJIT_HANDLER(kCall) :
+      {
+        const auto res = call(func.calls[ip->a], base);
+        // Stack may be reallocated
+        fp = m_stack.data() + base;
+        fp[ip->dst] = res;
+        LJIT_NEXT(ip + 1);
+      }
+      LJIT_HANDLER(kRet) :
+      {
+        return finish(fp[ip->a]);
+      }
+      LJIT_HANDLER(kRetVoid) :
+      {
+        return finish(0);
+      }
+      LJIT_HANDLER(kLoopHeader) :
+      {
+        if (Word res{}; onLoopHeader(func, ip->a, fp, res))
+          return finish(res);
+        LJIT_NEXT(ip + 1);
+      }
+#if !LJIT_INTERP_COMPUTED_GOTO
+    default:
+      LJIT_UNREACHABLE("Unknown opcode");
+    }
+#endif
+
+#undef LJIT_BINARY
+#undef LJIT_JUMP
+#undef LJIT_NEXT
+#undef LJIT_HANDLER
+#undef LJIT_DISPATCH
+  }
+
+#if LJIT_INTERP_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+  std::unordered_map<const Function *, std::unique_ptr<BytecodeFunction>>
+    m_code{};
+  std::vector<Word> m_stack{};
+  std::size_t m_depth{};
+  std::uint64_t m_numExecuted{};
+  TierHook *m_hook{};
+  std::uint64_t m_callThreshold{kNoThreshold};
+  std::uint64_t m_backEdgeThreshold{kNoThreshold};
+  std::uint64_t m_osrThreshold{kNoThreshold};
+  std::vector<Word> m_args{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_INTERP_INTERPRETER_HH_INCLUDED */
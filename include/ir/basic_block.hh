@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <functional>
 #include <iterator>
@@ -283,6 +284,31 @@ public:
     return toIns;
   }
 
+  // Insertion in the middle of the block does not change links
+  template <class T, class... Args>
+  auto insertInstBefore(Inst *pos, Args &&...args)
+  {
+    auto *const toIns = static_cast<T *>(&emplaceToList<T>(
+      m_instructions, InstIter{pos}, std::forward<Args>(args)...));
+    toIns->setBB(this);
+
+    return toIns;
+  }
+
+  Inst *insertConstBefore(Inst *pos, Type type, std::int64_t val)
+  {
+    return insertConst(InstIter{pos}, type, val);
+  }
+
+  // Append constant of the given type, value is truncated to type's width
+  Inst *pushConstBack(Type type, std::int64_t val)
+  {
+    auto *const toIns = insertConst(m_instructions.end(), type, val);
+    updateLinks();
+
+    return toIns;
+  }
+
   void eraseInst(Inst *toErase)
   {
     m_instructions.erase(InstIter{toErase});
@@ -291,6 +317,7 @@ public:
   void replaceInst(Inst *old, Inst *newInst)
   {
     newInst->setUsersFrom(*old);
+    newInst->setBB(this);
     m_instructions.insert(m_instructions.erase(InstIter{old}), newInst);
   }
 
@@ -298,7 +325,8 @@ public:
   void replaceInstEmplace(Inst *old, Args &&...args)
   {
     const auto pos = m_instructions.erase(InstIter{old});
-    emplaceToList<T>(m_instructions, pos, std::forward<Args>(args)...);
+    emplaceToList<T>(m_instructions, pos, std::forward<Args>(args)...)
+      .setBB(this);
   }
 
   void print(std::ostream &ost) const
@@ -333,16 +361,47 @@ public:
       updateLinks();
   }
 
+  // Retarget terminator from oldSucc to newSucc
+  void replaceSucc(const BasicBlock *oldSucc, BasicBlock *newSucc)
+  {
+    LJIT_ASSERT(!m_instructions.empty());
+    auto &lastInsn = m_instructions.back();
+    switch (lastInsn.getInstType())
+    {
+    case InstType::kIf:
+      static_cast<IfInstr &>(lastInsn).replaceTarget(oldSucc, newSucc);
+      break;
+    case InstType::kJump:
+      static_cast<JumpInstr &>(lastInsn).replaceTarget(oldSucc, newSucc);
+      break;
+    case InstType::kSwitch:
+      static_cast<Switch &>(lastInsn).replaceTarget(oldSucc, newSucc);
+      break;
+    case InstType::kUnknown:
+    case InstType::kConst:
+    case InstType::kBinOp:
+    case InstType::kUnaryOp:
+    case InstType::kRet:
+    case InstType::kCast:
+    case InstType::kSelect:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    default:
+      LJIT_UNREACHABLE("Block does not end with a branch");
+    }
+
+    updateLinks();
+  }
+
   void updateLinks()
   {
     // cleanup succs
-    for (auto *succ : m_succ)
+    while (!m_succ.empty())
     {
-      unlinkBBs(this, succ);
+      unlinkBBs(this, m_succ.back());
     }
 
-    LJIT_ASSERT(m_succ.empty());
-
     if (m_instructions.empty())
     {
       return;
@@ -359,12 +418,20 @@ public:
       linkSucc(static_cast<const JumpInstr &>(lastInsn).getTarget());
       break;
     }
+    case InstType::kSwitch: {
+      // Edge is added once for all cases w/ the same target
+      for (auto *const target :
+           static_cast<const Switch &>(lastInsn).getTargets())
+        linkSucc(target);
+      break;
+    }
     case InstType::kUnknown:
     case InstType::kConst:
     case InstType::kBinOp:
     case InstType::kUnaryOp:
     case InstType::kRet:
     case InstType::kCast:
+    case InstType::kSelect:
     case InstType::kPhi:
     case InstType::kCall:
     case InstType::kParam:
@@ -407,6 +474,15 @@ private:
   {
     m_succ.push_back(bb);
   }
+
+  Inst *insertConst(InstIter pos, Type type, std::int64_t val)
+  {
+    auto *const toIns = makeConst(type, val).release();
+    toIns->setBB(this);
+    m_instructions.insert(pos, toIns);
+
+    return toIns;
+  }
 };
 
 inline void removeInst(Inst *inst)
@@ -0,0 +1,59 @@
+#ifndef LEECH_JIT_INCLUDE_IR_CFG_UTILS_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_IR_CFG_UTILS_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "basic_block.hh"
+#include "common/common.hh"
+#include "function.hh"
+#include "inst.hh"
+
+namespace ljit
+{
+// Edge from the block w/ several successors to the block w/ several
+// predecessors, nothing can be placed on it w/o a new block
+[[nodiscard]] inline bool isCriticalEdge(const BasicBlock *pred,
+                                         const BasicBlock *succ)
+{
+  return pred->numSucc() > 1 && succ->numPred() > 1;
+}
+
+// Place the new block on the edge pred -> succ. The block is put after pred
+// in the layout, phis of succ take their values from it.
+inline BasicBlock *splitEdge(Function *func, BasicBlock *pred,
+                             BasicBlock *succ)
+{
+  LJIT_ASSERT(std::count(pred->getSucc().begin(), pred->getSucc().end(),
+                         succ) == 1);
+
+  auto *const bb = func->insertBBAfter(pred);
+  pred->replaceSucc(succ, bb);
+  bb->pushInstBack<JumpInstr>(succ);
+
+  for (auto &phi : succ->collectInsts(InstType::kPhi))
+    static_cast<Phi &>(phi.get()).replaceBB(pred, bb);
+
+  return bb;
+}
+
+// Returns the number of split edges. Edges duplicated by a branch w/ equal
+// targets are left as is.
+inline std::size_t splitCriticalEdges(Function *func)
+{
+  std::vector<std::pair<BasicBlock *, BasicBlock *>> edges;
+  for (auto &bb : *func)
+    for (auto *const succ : bb.getSucc())
+      if (isCriticalEdge(&bb, succ) &&
+          std::count(bb.getSucc().begin(), bb.getSucc().end(), succ) == 1)
+        edges.emplace_back(&bb, succ);
+
+  for (auto &[pred, succ] : edges)
+    splitEdge(func, pred, succ);
+  return edges.size();
+}
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_IR_CFG_UTILS_HH_INCLUDED */
@@ -0,0 +1,182 @@
+#ifndef LEECH_JIT_INCLUDE_IR_CLONER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_IR_CLONER_HH_INCLUDED
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "basic_block.hh"
+#include "common/common.hh"
+#include "function.hh"
+#include "graph/dfs.hh"
+#include "inst.hh"
+
+namespace ljit
+{
+// Copies blocks of one function into another one (or into the same one).
+// Blocks are visited in reverse post order, so inputs of an instruction are
+// always cloned before it. The only exception are phi inputs, which are filled
+// after all the blocks are done. Values and blocks, which are not cloned, are
+// used as is.
+class Cloner final
+{
+  std::unordered_map<const Value *, Value *> m_values{};
+  std::unordered_map<const BasicBlock *, BasicBlock *> m_blocks{};
+  std::vector<std::pair<const Phi *, Phi *>> m_phis{};
+
+public:
+  // Use given value instead of cloning the instruction (e.g. for params)
+  void mapValue(const Value *from, Value *to)
+  {
+    m_values[from] = to;
+  }
+
+  // Append clone of the block to the existing one
+  void mapBB(const BasicBlock *from, BasicBlock *to)
+  {
+    m_blocks[from] = to;
+  }
+
+  [[nodiscard]] Value *getValue(Value *val) const
+  {
+    const auto found = m_values.find(val);
+    return found == m_values.end() ? val : found->second;
+  }
+
+  [[nodiscard]] BasicBlock *getBB(const BasicBlock *bb) const
+  {
+    const auto found = m_blocks.find(bb);
+    return found == m_blocks.end() ? nullptr : found->second;
+  }
+
+  // Returns cloned blocks in reverse post order of the source
+  std::vector<BasicBlock *> cloneBody(const Function &src, Function *dst)
+  {
+    return cloneBlocks(
+      graph::depthFirstSearchReversePostOrder(src.makeBBGraph()), dst);
+  }
+
+  // Blocks should go in reverse post order. Phi entries for predecessors,
+  // which are not cloned, are dropped.
+  std::vector<BasicBlock *> cloneBlocks(const std::vector<BasicBlock *> &order,
+                                        Function *dst)
+  {
+    std::vector<BasicBlock *> res;
+    res.reserve(order.size());
+    for (const auto *bb : order)
+    {
+      auto *&newBB = m_blocks[bb];
+      if (newBB == nullptr)
+        newBB = dst->appendBB();
+      res.push_back(newBB);
+    }
+
+    for (const auto *bb : order)
+    {
+      auto *const newBB = getBB(bb);
+      for (const auto &inst : *bb)
+        if (m_values.find(&inst) == m_values.end())
+          m_values[&inst] = cloneInst(inst, newBB);
+    }
+
+    for (const auto &[phi, newPhi] : m_phis)
+      for (const auto &entry : *phi)
+        if (auto *const pred = getBB(entry.bb); pred != nullptr)
+          newPhi->addNode(getValue(entry.m_val), pred);
+    m_phis.clear();
+
+    return res;
+  }
+
+private:
+  [[nodiscard]] BasicBlock *getTarget(BasicBlock *bb) const
+  {
+    auto *const newBB = getBB(bb);
+    return newBB == nullptr ? bb : newBB;
+  }
+
+  Inst *cloneInst(const Inst &inst, BasicBlock *bb)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+      return bb->pushConstBack(inst.getType(), retrieveConstVal(&inst));
+    case InstType::kIf: {
+      const auto &branch = static_cast<const IfInstr &>(inst);
+      return bb->pushInstBack<IfInstr>(getValue(branch.getCond()),
+                                       getTarget(branch.getTrueBB()),
+                                       getTarget(branch.getFalseBB()));
+    }
+    case InstType::kJump:
+      return bb->pushInstBack<JumpInstr>(
+        getTarget(static_cast<const JumpInstr &>(inst).getTarget()));
+    case InstType::kSwitch: {
+      const auto &sw = static_cast<const Switch &>(inst);
+      auto cases = sw.getCases();
+      for (auto &cs : cases)
+        cs.target = getTarget(cs.target);
+      return bb->pushInstBack<Switch>(getValue(sw.getVal()),
+                                      getTarget(sw.getDefault()),
+                                      std::move(cases));
+    }
+    case InstType::kBinOp: {
+      const auto &binOp = static_cast<const BinOp &>(inst);
+      return bb->pushInstBack<BinOp>(binOp.getOper(),
+                                     getValue(binOp.getLeft()),
+                                     getValue(binOp.getRight()));
+    }
+    case InstType::kUnaryOp: {
+      const auto &unOp = static_cast<const UnaryOp &>(inst);
+      return bb->pushInstBack<UnaryOp>(unOp.getOper(),
+                                       getValue(unOp.getVal()));
+    }
+    case InstType::kRet:
+      if (inst.inputBegin() == inst.inputEnd())
+        return bb->pushInstBack<Ret>();
+      return bb->pushInstBack<Ret>(
+        getValue(static_cast<const Ret &>(inst).getVal()));
+    case InstType::kCast:
+      return bb->pushInstBack<Cast>(
+        inst.getType(), getValue(static_cast<const Cast &>(inst).getSrc()));
+    case InstType::kSelect: {
+      const auto &select = static_cast<const Select &>(inst);
+      return bb->pushInstBack<Select>(getValue(select.getCond()),
+                                      getValue(select.getTrueVal()),
+                                      getValue(select.getFalseVal()));
+    }
+    case InstType::kPhi: {
+      auto *const newPhi = bb->pushInstBack<Phi>(inst.getType());
+      m_phis.emplace_back(&static_cast<const Phi &>(inst), newPhi);
+      return newPhi;
+    }
+    case InstType::kCall: {
+      const auto &call = static_cast<const Call &>(inst);
+      auto *const newCall = bb->pushInstBack<Call>(call.getCallee());
+      for (auto it = call.inputBegin(); it != call.inputEnd(); ++it)
+        newCall->appendArg(getValue(*it));
+      return newCall;
+    }
+    case InstType::kParam:
+      return bb->pushInstBack<Param>(
+        static_cast<const Param &>(inst).getIdx(), inst.getType());
+    case InstType::kUnknown:
+    default:
+      LJIT_UNREACHABLE("Unknown instruction");
+    }
+  }
+};
+
+// Deep copy of the function (only reachable blocks are copied)
+[[nodiscard]] inline std::unique_ptr<Function> cloneFunction(
+  const Function &src)
+{
+  auto dst = std::make_unique<Function>(src.getResType(), src.getArgs());
+  dst->setName(src.getName());
+  if (src.size() != 0)
+    Cloner{}.cloneBody(src, dst.get());
+  return dst;
+}
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_IR_CLONER_HH_INCLUDED */
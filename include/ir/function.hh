@@ -5,6 +5,15 @@
 #include "common/common.hh"
 #include "inst.hh"
 #include "intrusive_list/intrusive_list.hh"
+#include "profile.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace ljit
 {
@@ -14,6 +23,9 @@ class Function final
   IList<BasicBlock> m_bbs;
   Type m_resType{Type::None};
   std::vector<Type> m_args{};
+  std::string m_name{};
+  std::size_t m_nextBBId{};
+  std::optional<FunctionProfile> m_profile{};
 
 public:
   using BBIterator = decltype(m_bbs.begin());
@@ -29,6 +41,7 @@ public:
   void splice(BBIterator pos, Function &src)
   {
     m_bbs.splice(pos, src.m_bbs);
+    m_nextBBId = std::max(m_nextBBId, src.m_nextBBId);
   }
 
   [[nodiscard]] auto size() const
@@ -36,6 +49,26 @@ public:
     return m_bbs.size();
   }
 
+  [[nodiscard]] auto begin() const
+  {
+    return m_bbs.begin();
+  }
+
+  [[nodiscard]] auto begin()
+  {
+    return m_bbs.begin();
+  }
+
+  [[nodiscard]] auto end() const
+  {
+    return m_bbs.end();
+  }
+
+  [[nodiscard]] auto end()
+  {
+    return m_bbs.end();
+  }
+
   [[nodiscard]] auto getResType() const noexcept
   {
     return m_resType;
@@ -46,6 +79,32 @@ public:
     return m_args;
   }
 
+  [[nodiscard]] const auto &getName() const noexcept
+  {
+    return m_name;
+  }
+
+  void setName(std::string name)
+  {
+    m_name = std::move(name);
+  }
+
+  void setProfile(FunctionProfile profile)
+  {
+    m_profile = std::move(profile);
+  }
+
+  void resetProfile() noexcept
+  {
+    m_profile.reset();
+  }
+
+  // Null if no profile is attached
+  [[nodiscard]] const FunctionProfile *getProfile() const noexcept
+  {
+    return m_profile ? &*m_profile : nullptr;
+  }
+
   void eraseBB(BasicBlock *toErase)
   {
     m_bbs.erase(decltype(m_bbs.begin()){toErase});
@@ -53,8 +112,23 @@ public:
 
   auto *appendBB()
   {
-    const auto idx = m_bbs.empty() ? 0ULL : m_bbs.back().getId() + 1;
-    return &emplaceBackToList<BasicBlock>(m_bbs, idx);
+    return &emplaceBackToList<BasicBlock>(m_bbs, m_nextBBId++);
+  }
+
+  // New block is placed right after the given one
+  auto *insertBBAfter(BasicBlock *pos)
+  {
+    return &emplaceToList<BasicBlock>(m_bbs, std::next(BBIterator{pos}),
+                                      m_nextBBId++);
+  }
+
+  // Reorder blocks, the entry block has to stay the first one
+  void setLayout(const std::vector<BasicBlock *> &order)
+  {
+    LJIT_ASSERT(order.size() == m_bbs.size());
+    LJIT_ASSERT(order.empty() || order.front() == &m_bbs.front());
+    for (auto *const bb : order)
+      m_bbs.splice(m_bbs.end(), BBIterator{bb});
   }
 
   [[nodiscard]] auto makeBBGraph() const noexcept
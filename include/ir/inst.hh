@@ -2,8 +2,11 @@
 #define LEECH_JIT_INCLUDE_IR_INST_HH_INCLUDED
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <type_traits>
 #include <unordered_set>
@@ -29,6 +32,8 @@ enum class InstType : std::uint8_t
   kCall,
   kParam,
   kUnaryOp,
+  kSelect,
+  kSwitch,
 };
 
 enum class Type
@@ -40,6 +45,59 @@ enum class Type
   I32,
   I64,
 };
+
+// Signed range of values, which can be held by the type
+[[nodiscard]] inline std::pair<std::int64_t, std::int64_t> getTypeRange(
+  Type type)
+{
+  switch (type)
+  {
+  case Type::I1:
+    return {0, 1};
+
+#define DO_CASE(w)                                                             \
+  case Type::I##w:                                                             \
+    return {std::numeric_limits<std::int##w##_t>::min(),                       \
+            std::numeric_limits<std::int##w##_t>::max()};
+
+    DO_CASE(8)
+    DO_CASE(16)
+    DO_CASE(32)
+    DO_CASE(64)
+
+#undef DO_CASE
+
+  case Type::None:
+  default:
+    LJIT_UNREACHABLE("Bad type");
+  }
+}
+
+// Number of value bits of the type, shift amounts must be less than it
+[[nodiscard]] inline std::int64_t getTypeDigits(Type type)
+{
+  switch (type)
+  {
+  case Type::I1:
+    return std::numeric_limits<bool>::digits;
+
+#define DO_CASE(w)                                                             \
+  case Type::I##w:                                                             \
+    return std::numeric_limits<std::int##w##_t>::digits;
+
+    DO_CASE(8)
+    DO_CASE(16)
+    DO_CASE(32)
+    DO_CASE(64)
+
+#undef DO_CASE
+
+  case Type::None:
+  default:
+    LJIT_UNREACHABLE("Bad type");
+  }
+}
+
 class Inst;
 class Value
 {
@@ -133,6 +191,10 @@ protected:
     return m_inputs;
   }
 
+  // Called each time input with index idx is replaced
+  virtual void inputChanged([[maybe_unused]] std::size_t idx)
+  {}
+
   void addInput(Value *val)
   {
     LJIT_ASSERT(val != nullptr);
@@ -140,6 +202,17 @@ protected:
     m_inputs.push_back(val);
   }
 
+  void removeInput(std::size_t idx)
+  {
+    LJIT_ASSERT(idx < m_inputs.size());
+    const auto pos =
+      std::next(m_inputs.begin(), static_cast<std::ptrdiff_t>(idx));
+    auto *const inp = *pos;
+    m_inputs.erase(pos);
+    if (std::find(m_inputs.begin(), m_inputs.end(), inp) == m_inputs.end())
+      inp->users().erase(this);
+  }
+
 public:
   LJIT_NO_COPY_SEMANTICS(Inst);
   LJIT_NO_MOVE_SEMANTICS(Inst);
@@ -193,13 +266,30 @@ public:
     }
     inp = newInput;
     inp->users().insert(this);
+    inputChanged(idx);
+  }
+
+  // Replace all occurrences of oldInput w/o touching users sets
+  void replaceInput(const Value *oldInput, Value *newInput)
+  {
+    for (std::size_t idx = 0; idx < m_inputs.size(); ++idx)
+    {
+      if (m_inputs[idx] != oldInput)
+        continue;
+
+      m_inputs[idx] = newInput;
+      inputChanged(idx);
+    }
   }
 
   void clearInputs()
   {
     for (auto *input : m_inputs)
     {
-      [[maybe_unused]] const bool removed = input->users().erase(this) != 0;
+      // Value used several times is erased from users on the first occurrence
+      [[maybe_unused]] const bool removed =
+        input->users().erase(this) != 0 ||
+        std::count(m_inputs.begin(), m_inputs.end(), input) > 1;
       LJIT_ASSERT(removed);
     }
 
@@ -244,7 +334,7 @@ inline void Value::setUsersFrom(Value &other)
 
   for (auto *user : usrs)
   {
-    std::replace(user->inputBegin(), user->inputEnd(), &other, this);
+    user->replaceInput(&other, this);
   }
 }
 
@@ -325,6 +415,14 @@ public:
     return m_false;
   }
 
+  void replaceTarget(const BasicBlock *oldBB, BasicBlock *newBB) noexcept
+  {
+    if (m_true == oldBB)
+      m_true = newBB;
+    if (m_false == oldBB)
+      m_false = newBB;
+  }
+
   void print([[maybe_unused]] std::ostream &ost) const override
   {}
 };
@@ -343,6 +441,92 @@ public:
     return m_target;
   }
 
+  void replaceTarget(const BasicBlock *oldBB, BasicBlock *newBB) noexcept
+  {
+    if (m_target == oldBB)
+      m_target = newBB;
+  }
+
+  void print([[maybe_unused]] std::ostream &ost) const override
+  {}
+};
+
+// Multi-way branch: jumps to the target of the case equal to the value or to
+// the default target. Case values are sign-extended from the value's type.
+class Switch final : public Inst
+{
+public:
+  struct Case final
+  {
+    std::int64_t val{};
+    BasicBlock *target{nullptr};
+  };
+
+private:
+  BasicBlock *m_default{nullptr};
+  std::vector<Case> m_cases{};
+
+public:
+  Switch(Value *val, BasicBlock *defaultBB, std::vector<Case> cases)
+    : Inst(InstType::kSwitch), m_default(defaultBB), m_cases(std::move(cases))
+  {
+    addInput(val);
+    std::sort(
+      m_cases.begin(), m_cases.end(),
+      [](const Case &lhs, const Case &rhs) { return lhs.val < rhs.val; });
+    LJIT_ASSERT(std::adjacent_find(m_cases.begin(), m_cases.end(),
+                                   [](const Case &lhs, const Case &rhs) {
+                                     return lhs.val == rhs.val;
+                                   }) == m_cases.end());
+  }
+
+  [[nodiscard]] auto *getVal() const noexcept
+  {
+    return inputAt(0);
+  }
+  [[nodiscard]] auto *getDefault() const noexcept
+  {
+    return m_default;
+  }
+  // Cases are sorted by value
+  [[nodiscard]] const auto &getCases() const noexcept
+  {
+    return m_cases;
+  }
+  [[nodiscard]] auto numCases() const noexcept
+  {
+    return m_cases.size();
+  }
+
+  [[nodiscard]] BasicBlock *getTarget(std::int64_t val) const noexcept
+  {
+    const auto found = std::lower_bound(
+      m_cases.begin(), m_cases.end(), val,
+      [](const Case &cs, std::int64_t key) { return cs.val < key; });
+    if (found != m_cases.end() && found->val == val)
+      return found->target;
+    return m_default;
+  }
+
+  // Distinct targets, default goes first
+  [[nodiscard]] std::vector<BasicBlock *> getTargets() const
+  {
+    std::vector<BasicBlock *> res{m_default};
+    for (const auto &cs : m_cases)
+      if (std::find(res.begin(), res.end(), cs.target) == res.end())
+        res.push_back(cs.target);
+    return res;
+  }
+
+  void replaceTarget(const BasicBlock *oldBB, BasicBlock *newBB) noexcept
+  {
+    if (m_default == oldBB)
+      m_default = newBB;
+    for (auto &cs : m_cases)
+      if (cs.target == oldBB)
+        cs.target = newBB;
+  }
+
   void print([[maybe_unused]] std::ostream &ost) const override
   {}
 };
@@ -388,8 +572,35 @@ public:
     return m_vars.end();
   }
 
+  [[nodiscard]] auto numEntries() const noexcept
+  {
+    return m_vars.size();
+  }
+
+  void replaceBB(const BasicBlock *oldBB, BasicBlock *newBB) noexcept
+  {
+    for (auto &entry : m_vars)
+      if (entry.bb == oldBB)
+        entry.bb = newBB;
+  }
+
+  void removeEntry(std::size_t idx)
+  {
+    LJIT_ASSERT(idx < m_vars.size());
+    m_vars.erase(
+      std::next(m_vars.begin(), static_cast<std::ptrdiff_t>(idx)));
+    removeInput(idx);
+  }
+
   void print([[maybe_unused]] std::ostream &ost) const override
   {}
+
+private:
+  void inputChanged(std::size_t idx) override
+  {
+    LJIT_ASSERT(idx < m_vars.size());
+    m_vars[idx].m_val = inputAt(idx);
+  }
 };
 
 class UnaryOp final : public Inst
@@ -435,6 +646,7 @@ public:
     kLE,
     kEQ,
     kShr,
+    kShl,
     kOr,
     kBoundsCheck,
   };
@@ -526,6 +738,9 @@ public:
   {
     return m_callee;
   }
+
+  // Redirect the call to another function w/ the same signature
+  void setCallee(Function *callee);
   void print([[maybe_unused]] std::ostream &ost) const override
   {}
 };
@@ -547,6 +762,35 @@ public:
   {}
 };
 
+// cond ? trueVal : falseVal w/o branching
+class Select final : public Inst
+{
+public:
+  Select(Value *cond, Value *trueVal, Value *falseVal)
+    : Inst(trueVal->getType(), InstType::kSelect)
+  {
+    addInput(cond);
+    addInput(trueVal);
+    addInput(falseVal);
+  }
+
+  [[nodiscard]] auto *getCond() const noexcept
+  {
+    return inputAt(0);
+  }
+  [[nodiscard]] auto *getTrueVal() const noexcept
+  {
+    return inputAt(1);
+  }
+  [[nodiscard]] auto *getFalseVal() const noexcept
+  {
+    return inputAt(2);
+  }
+
+  void print([[maybe_unused]] std::ostream &ost) const override
+  {}
+};
+
 [[nodiscard]] inline bool producesValue(const Inst &inst)
 {
   switch (inst.getInstType())
@@ -555,6 +799,7 @@ public:
   case InstType::kBinOp:
   case InstType::kUnaryOp:
   case InstType::kCast:
+  case InstType::kSelect:
   case InstType::kPhi:
   case InstType::kCall:
   case InstType::kParam:
@@ -562,6 +807,7 @@ public:
   case InstType::kJump:
   case InstType::kRet:
   case InstType::kIf:
+  case InstType::kSwitch:
     return false;
   case InstType::kUnknown:
   default:
@@ -569,6 +815,59 @@ public:
   }
 }
 
+// Sign-extended value of the constant instruction
+[[nodiscard]] inline std::int64_t retrieveConstVal(const Inst *inst)
+{
+  LJIT_ASSERT(inst->getInstType() == InstType::kConst);
+  switch (inst->getType())
+  {
+  case Type::I1:
+    return static_cast<const ConstVal_I1 *>(inst)->getVal() ? 1 : 0;
+
+#define DO_CASE(w)                                                             \
+  case Type::I##w:                                                             \
+    return static_cast<const ConstVal_I##w *>(inst)->getVal();
+
+    DO_CASE(8)
+    DO_CASE(16)
+    DO_CASE(32)
+    DO_CASE(64)
+
+#undef DO_CASE
+
+  case Type::None:
+  default:
+    LJIT_UNREACHABLE("Bad const");
+  }
+}
+
+// Constant of the given type, value is truncated to type's width
+[[nodiscard]] inline std::unique_ptr<Inst> makeConst(Type type,
+                                                     std::int64_t val)
+{
+  switch (type)
+  {
+  case Type::I1:
+    return std::make_unique<ConstVal_I1>(val != 0);
+
+#define DO_CASE(w)                                                             \
+  case Type::I##w:                                                             \
+    return std::make_unique<ConstVal_I##w>(static_cast<std::int##w##_t>(val));
+
+    DO_CASE(8)
+    DO_CASE(16)
+    DO_CASE(32)
+
+#undef DO_CASE
+
+  case Type::I64:
+    return std::make_unique<ConstVal_I64>(val);
+  case Type::None:
+  default:
+    LJIT_UNREACHABLE("Bad const type");
+  }
+}
+
 inline const Inst *tryRetrieveConst(const Value *val)
 {
   // Check for instruction
@@ -583,6 +882,34 @@ inline const Inst *tryRetrieveConst(const Value *val)
   return pInst;
 }
 
+// Division, failed check and shift by amount out of [0, digits) trap, so
+// they may not be executed speculatively
+[[nodiscard]] inline bool mayTrap(const BinOp &binOp)
+{
+  switch (binOp.getOper())
+  {
+  case BinOp::Oper::kDiv:
+  case BinOp::Oper::kBoundsCheck:
+    return true;
+  case BinOp::Oper::kShr:
+  case BinOp::Oper::kShl: {
+    const auto *const amount = tryRetrieveConst(binOp.getRight());
+    if (amount == nullptr)
+      return true;
+    const auto val = retrieveConstVal(amount);
+    return val < 0 || val >= getTypeDigits(binOp.getType());
+  }
+  case BinOp::Oper::kAdd:
+  case BinOp::Oper::kSub:
+  case BinOp::Oper::kMul:
+  case BinOp::Oper::kLE:
+  case BinOp::Oper::kEQ:
+  case BinOp::Oper::kOr:
+  default:
+    return false;
+  }
+}
+
 } // namespace ljit
 
 #endif /* LEECH_JIT_INCLUDE_IR_INST_HH_INCLUDED */
@@ -0,0 +1,63 @@
+#ifndef LEECH_JIT_INCLUDE_IR_MODULE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_IR_MODULE_HH_INCLUDED
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "function.hh"
+
+namespace ljit
+{
+// Owner of all functions, which can call each other
+class Module final
+{
+  std::vector<std::unique_ptr<Function>> m_funcs{};
+
+public:
+  Module() = default;
+
+  template <class... Args>
+  Function *createFunction(std::string name, Args &&...args)
+  {
+    auto &func = m_funcs.emplace_back(
+      std::make_unique<Function>(std::forward<Args>(args)...));
+    func->setName(std::move(name));
+    return func.get();
+  }
+
+  Function *addFunction(std::unique_ptr<Function> func)
+  {
+    LJIT_ASSERT(func != nullptr);
+    return m_funcs.emplace_back(std::move(func)).get();
+  }
+
+  [[nodiscard]] Function *findFunction(const std::string &name) const
+  {
+    const auto found = std::find_if(
+      m_funcs.begin(), m_funcs.end(),
+      [&name](const auto &func) { return func->getName() == name; });
+    return found == m_funcs.end() ? nullptr : found->get();
+  }
+
+  [[nodiscard]] auto size() const noexcept
+  {
+    return m_funcs.size();
+  }
+
+  [[nodiscard]] auto begin() const
+  {
+    return m_funcs.begin();
+  }
+
+  [[nodiscard]] auto end() const
+  {
+    return m_funcs.end();
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_IR_MODULE_HH_INCLUDED */
@@ -0,0 +1,67 @@
+#ifndef LEECH_JIT_INCLUDE_IR_PROFILE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_IR_PROFILE_HH_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace ljit
+{
+// Execution counts of the function, blocks are referred to by their ids
+struct FunctionProfile final
+{
+  // Block id and index of the call among calls of the block
+  using CallSiteId = std::pair<std::size_t, std::size_t>;
+  // Taken counts of the true and the false successors
+  using BranchCounts = std::array<std::uint64_t, 2>;
+
+  std::map<std::size_t, std::uint64_t> blockCounts{};
+  // Keyed by the block, which ends w/ IfInstr
+  std::map<std::size_t, BranchCounts> branchCounts{};
+  std::map<CallSiteId, std::uint64_t> callCounts{};
+
+  [[nodiscard]] std::optional<std::uint64_t> getBlockCount(
+    std::size_t bbId) const
+  {
+    const auto found = blockCounts.find(bbId);
+    if (found == blockCounts.end())
+      return std::nullopt;
+    return found->second;
+  }
+
+  [[nodiscard]] const BranchCounts *getBranchCounts(std::size_t bbId) const
+  {
+    const auto found = branchCounts.find(bbId);
+    return found == branchCounts.end() ? nullptr : &found->second;
+  }
+
+  [[nodiscard]] std::optional<std::uint64_t> getCallCount(
+    std::size_t bbId, std::size_t idx) const
+  {
+    const auto found = callCounts.find(CallSiteId{bbId, idx});
+    if (found == callCounts.end())
+      return std::nullopt;
+    return found->second;
+  }
+
+  // Sum counts of another run
+  void merge(const FunctionProfile &other)
+  {
+    for (const auto &[id, count] : other.blockCounts)
+      blockCounts[id] += count;
+    for (const auto &[id, counts] : other.branchCounts)
+    {
+      auto &dst = branchCounts[id];
+      dst[0] += counts[0];
+      dst[1] += counts[1];
+    }
+    for (const auto &[site, count] : other.callCounts)
+      callCounts[site] += count;
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_IR_PROFILE_HH_INCLUDED */
@@ -0,0 +1,208 @@
+#ifndef LEECH_JIT_INCLUDE_IR_STRUCTURAL_HASH_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_IR_STRUCTURAL_HASH_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// FNV-1a hash, words are mixed byte by byte
+class Fnv1a final
+{
+  std::uint64_t m_hash{14695981039346656037ULL};
+
+public:
+  void mix(const unsigned char *data, std::size_t size) noexcept
+  {
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+      m_hash ^= data[idx];
+      m_hash *= 1099511628211ULL;
+    }
+  }
+
+  void mix(std::uint64_t val) noexcept
+  {
+    for (unsigned idx = 0; idx < 8; ++idx)
+    {
+      m_hash ^= (val >> (8 * idx)) & 0xFF;
+      m_hash *= 1099511628211ULL;
+    }
+  }
+
+  void mix(const std::string &str) noexcept
+  {
+    mix(str.size());
+    mix(reinterpret_cast<const unsigned char *>(str.data()), str.size());
+  }
+
+  [[nodiscard]] std::uint64_t get() const noexcept
+  {
+    return m_hash;
+  }
+};
+
+// Hash of the function structure: signature, CFG, opcodes, types, constants
+// and the operand graph. Blocks and values are numbered in reverse post
+// order, so the hash does not depend on the addresses, the ids and the block
+// layout, and it survives cloning. Bodies of the reachable callees are mixed
+// in as well, since they may be inlined.
+class StructuralHash final
+{
+  const Function &m_root;
+  std::vector<const Function *> m_funcs{};
+  std::unordered_set<const Function *> m_seen{};
+
+public:
+  explicit StructuralHash(const Function &func) : m_root(func)
+  {}
+
+  [[nodiscard]] std::uint64_t get()
+  {
+    m_funcs = {&m_root};
+    m_seen = {&m_root};
+    Fnv1a hash;
+    for (std::size_t idx = 0; idx < m_funcs.size(); ++idx)
+      hashBody(hash, *m_funcs[idx]);
+    return hash.get();
+  }
+
+  // Function and its reachable callees, filled by get
+  [[nodiscard]] const auto &getFunctions() const noexcept
+  {
+    return m_funcs;
+  }
+
+private:
+  // Entities outside of the reachable part of the function share an id
+  template <class T>
+  static std::uint64_t getId(
+    const std::unordered_map<const T *, std::uint64_t> &ids, const T *key)
+  {
+    const auto found = ids.find(key);
+    return found == ids.end() ? ids.size() : found->second;
+  }
+
+  static void hashSignature(Fnv1a &hash, const Function &func)
+  {
+    hash.mix(func.getName());
+    hash.mix(static_cast<std::uint64_t>(func.getResType()));
+    hash.mix(func.getArgs().size());
+    for (const auto type : func.getArgs())
+      hash.mix(static_cast<std::uint64_t>(type));
+  }
+
+  void hashBody(Fnv1a &hash, const Function &func)
+  {
+    hashSignature(hash, func);
+    if (func.size() == 0)
+      return;
+
+    const auto order =
+      graph::depthFirstSearchReversePostOrder(func.makeBBGraph());
+    hash.mix(order.size());
+    std::unordered_map<const BasicBlock *, std::uint64_t> bbIds;
+    std::unordered_map<const Value *, std::uint64_t> valIds;
+    for (const auto *bb : order)
+    {
+      bbIds.emplace(bb, bbIds.size());
+      for (const auto &inst : *bb)
+        valIds.emplace(&inst, valIds.size());
+    }
+
+    for (const auto *bb : order)
+    {
+      hash.mix(bb->size());
+      for (const auto &inst : *bb)
+      {
+        hash.mix(static_cast<std::uint64_t>(inst.getInstType()));
+        hash.mix(static_cast<std::uint64_t>(inst.getType()));
+        hash.mix(
+          static_cast<std::uint64_t>(inst.inputEnd() - inst.inputBegin()));
+        for (auto it = inst.inputBegin(); it != inst.inputEnd(); ++it)
+          hash.mix(getId(valIds, *it));
+        hashAttrs(hash, inst, bbIds);
+      }
+    }
+  }
+
+  // Operands except the values
+  void hashAttrs(
+    Fnv1a &hash, const Inst &inst,
+    const std::unordered_map<const BasicBlock *, std::uint64_t> &bbIds)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+      hash.mix(static_cast<std::uint64_t>(retrieveConstVal(&inst)));
+      break;
+    case InstType::kParam:
+      hash.mix(static_cast<const Param &>(inst).getIdx());
+      break;
+    case InstType::kBinOp:
+      hash.mix(
+        static_cast<std::uint64_t>(static_cast<const BinOp &>(inst).getOper()));
+      break;
+    case InstType::kUnaryOp:
+      hash.mix(static_cast<std::uint64_t>(
+        static_cast<const UnaryOp &>(inst).getOper()));
+      break;
+    case InstType::kIf: {
+      const auto &ifInst = static_cast<const IfInstr &>(inst);
+      hash.mix(getId(bbIds, ifInst.getTrueBB()));
+      hash.mix(getId(bbIds, ifInst.getFalseBB()));
+      break;
+    }
+    case InstType::kJump:
+      hash.mix(getId(bbIds, static_cast<const JumpInstr &>(inst).getTarget()));
+      break;
+    case InstType::kSwitch: {
+      const auto &sw = static_cast<const Switch &>(inst);
+      hash.mix(getId(bbIds, sw.getDefault()));
+      hash.mix(sw.numCases());
+      for (const auto &swCase : sw.getCases())
+      {
+        hash.mix(static_cast<std::uint64_t>(swCase.val));
+        hash.mix(getId(bbIds, swCase.target));
+      }
+      break;
+    }
+    case InstType::kPhi:
+      for (const auto &entry : static_cast<const Phi &>(inst))
+        hash.mix(getId(bbIds, entry.bb));
+      break;
+    case InstType::kCall: {
+      const auto *const callee = static_cast<const Call &>(inst).getCallee();
+      hashSignature(hash, *callee);
+      if (m_seen.insert(callee).second)
+        m_funcs.push_back(callee);
+      break;
+    }
+    case InstType::kRet:
+    case InstType::kCast:
+    case InstType::kSelect:
+      break;
+    case InstType::kUnknown:
+    default:
+      LJIT_UNREACHABLE("Unknown instruction");
+    }
+  }
+};
+
+[[nodiscard]] inline std::uint64_t getStructuralHash(const Function &func)
+{
+  return StructuralHash{func}.get();
+}
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_IR_STRUCTURAL_HASH_HH_INCLUDED */
@@ -0,0 +1,172 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_BLOCK_LAYOUT_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_BLOCK_LAYOUT_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "analysis/block_frequency.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+
+namespace ljit
+{
+// Block placement.
+// Pettis-Hansen chain formation: edges are visited from the hottest one and
+// chains are merged, when the source ends one chain and the target starts
+// another, so the source falls through to the target. Back edges are never
+// merged, so loop headers are entered from the preheader. Chains are placed
+// starting from the entry one, the next chain is the most frequently reached
+// from the placed ones. Edge weights are frequencies from BlockFrequencyInfo,
+// the profile attached to the function is used unless another one is given.
+class BlockLayout final
+{
+  using GraphTy = BasicBlockGraph;
+
+  struct Edge final
+  {
+    BasicBlock *src{};
+    BasicBlock *dst{};
+    double weight{};
+  };
+
+  Function *m_func{};
+  EdgeProfile m_profile{};
+
+public:
+  explicit BlockLayout(Function *func, EdgeProfile profile = {})
+    : m_func(func), m_profile(std::move(profile))
+  {}
+
+  void run()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const auto rpo = graph::depthFirstSearchReversePostOrder(graph);
+    m_rpoIdx.clear();
+    for (std::size_t idx = 0; idx < rpo.size(); ++idx)
+      m_rpoIdx[rpo[idx]] = idx;
+
+    collectEdges(graph, rpo);
+    formChains(rpo);
+    const auto order = placeChains(graph.getRoot());
+    m_func->setLayout(order);
+
+    m_numFallThrough = 0;
+    for (std::size_t idx = 1; idx < order.size(); ++idx)
+    {
+      const auto &succs = order[idx - 1]->getSucc();
+      if (std::find(succs.begin(), succs.end(), order[idx]) != succs.end())
+        ++m_numFallThrough;
+    }
+  }
+
+  // Number of blocks placed right after their predecessor
+  [[nodiscard]] auto getNumFallThrough() const noexcept
+  {
+    return m_numFallThrough;
+  }
+
+private:
+  void collectEdges(const GraphTy &graph, const std::vector<BasicBlock *> &rpo)
+  {
+    const auto &profile =
+      m_profile.empty() ? makeEdgeProfile(*m_func) : m_profile;
+    const BlockFrequencyInfo freqs{graph, profile};
+
+    m_edges.clear();
+    for (auto *const src : rpo)
+    {
+      std::vector<BasicBlock *> succs;
+      for (auto *const dst : src->getSucc())
+        if (std::find(succs.begin(), succs.end(), dst) == succs.end())
+          succs.push_back(dst);
+
+      for (auto *const dst : succs)
+        // Back edges are not merged
+        if (m_rpoIdx.at(dst) > m_rpoIdx.at(src))
+          m_edges.push_back(Edge{src, dst, freqs.getEdgeFrequency(src, dst)});
+    }
+
+    std::stable_sort(
+      m_edges.begin(), m_edges.end(),
+      [](const Edge &lhs, const Edge &rhs) { return lhs.weight > rhs.weight; });
+  }
+
+  void formChains(const std::vector<BasicBlock *> &rpo)
+  {
+    m_chains.clear();
+    m_chainOf.clear();
+    for (auto *const bb : rpo)
+    {
+      m_chainOf[bb] = m_chains.size();
+      m_chains.push_back({bb});
+    }
+
+    for (const auto &edge : m_edges)
+    {
+      const auto srcChain = m_chainOf.at(edge.src);
+      const auto dstChain = m_chainOf.at(edge.dst);
+      if (srcChain == dstChain || m_chains[srcChain].back() != edge.src ||
+          m_chains[dstChain].front() != edge.dst)
+        continue;
+
+      for (auto *const bb : m_chains[dstChain])
+        m_chainOf[bb] = srcChain;
+      m_chains[srcChain].insert(m_chains[srcChain].end(),
+                                m_chains[dstChain].begin(),
+                                m_chains[dstChain].end());
+      m_chains[dstChain].clear();
+    }
+  }
+
+  [[nodiscard]] std::vector<BasicBlock *> placeChains(BasicBlock *entry)
+  {
+    std::vector<BasicBlock *> order;
+    std::vector<bool> placed(m_chains.size(), false);
+    // Weight of edges from placed blocks to each chain
+    std::vector<double> weights(m_chains.size(), 0.);
+
+    auto place = [&](std::size_t chain) {
+      placed[chain] = true;
+      for (auto *const bb : m_chains[chain])
+        order.push_back(bb);
+      for (const auto &edge : m_edges)
+        if (m_chainOf.at(edge.src) == chain)
+          weights[m_chainOf.at(edge.dst)] += edge.weight;
+    };
+
+    place(m_chainOf.at(entry));
+    for (;;)
+    {
+      // Chains are in RPO of their heads, so ties keep the natural order
+      std::size_t next = m_chains.size();
+      for (std::size_t idx = 0; idx < m_chains.size(); ++idx)
+        if (!placed[idx] && !m_chains[idx].empty() &&
+            (next == m_chains.size() || weights[idx] > weights[next]))
+          next = idx;
+      if (next == m_chains.size())
+        break;
+      place(next);
+    }
+
+    // Unreachable blocks keep their order at the end
+    for (auto &bb : *m_func)
+      if (m_rpoIdx.find(&bb) == m_rpoIdx.end())
+        order.push_back(&bb);
+    return order;
+  }
+
+  std::unordered_map<const BasicBlock *, std::size_t> m_rpoIdx{};
+  std::vector<Edge> m_edges{};
+  std::vector<std::vector<BasicBlock *>> m_chains{};
+  std::unordered_map<const BasicBlock *, std::size_t> m_chainOf{};
+  std::size_t m_numFallThrough{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_BLOCK_LAYOUT_HH_INCLUDED */
@@ -1,6 +1,7 @@
 #ifndef LEECH_JIT_INCLUDE_OPT_CHECKS_ELIMINATION_HH_INCLUDED
 #define LEECH_JIT_INCLUDE_OPT_CHECKS_ELIMINATION_HH_INCLUDED
 
+#include "analysis/range_analysis.hh"
 #include "common/common.hh"
 #include "graph/dom_tree.hh"
 #include "ir/basic_block.hh"
@@ -19,14 +20,22 @@ public:
   {
     fillCandidates(graph);
     m_domTree = graph::buildDomTree(graph);
+    const RangeAnalyzer ranges{graph};
 
     for (auto &cand : m_candidates)
     {
       Inst &inst = cand.get();
+      if (isProven(inst, ranges))
+      {
+        removeCheck(inst);
+        continue;
+      }
+
       switch (inst.getInstType())
       {
       case InstType::kUnknown:
       case InstType::kIf:
+      case InstType::kSwitch:
       case InstType::kConst:
       case InstType::kJump:
       case InstType::kBinOp: {
@@ -47,6 +56,7 @@ public:
       }
       case InstType::kRet:
       case InstType::kCast:
+      case InstType::kSelect:
       case InstType::kPhi:
       case InstType::kCall:
       case InstType::kParam:
@@ -57,6 +67,24 @@ public:
   }
 
 private:
+  [[nodiscard]] static bool isProven(const Inst &check,
+                                     const RangeAnalyzer &ranges)
+  {
+    const auto val = ranges.getInputRange(&check, 0);
+    if (check.getInstType() == InstType::kUnaryOp)
+      return !val.contains(0);
+
+    const auto bound = ranges.getInputRange(&check, 1);
+    return val.lo() >= 0 && val.hi() < bound.lo();
+  }
+
+  // Check passes its input through
+  static void removeCheck(Inst &check)
+  {
+    check.inputAt(0)->setUsersFrom(check);
+    removeInst(&check);
+  }
+
   void zeroCheckElim(UnaryOp &op)
   {
     auto *input = op.getVal();
@@ -79,8 +107,8 @@ private:
 
       if (m_domTree.isDominator(user, &op))
       {
-        input->users().erase(&op);
-        op.getBB()->eraseInst(&op);
+        removeCheck(op);
+        return;
       }
     }
   }
@@ -110,8 +138,8 @@ private:
 
       if (m_domTree.isDominator(user, &op))
       {
-        input->users().erase(&op);
-        op.getBB()->eraseInst(&op);
+        removeCheck(op);
+        return;
       }
     }
   }
@@ -134,10 +162,12 @@ private:
                               BinOp::Oper::kBoundsCheck;
                      case InstType::kUnknown:
                      case InstType::kIf:
+                     case InstType::kSwitch:
                      case InstType::kConst:
                      case InstType::kJump:
                      case InstType::kRet:
                      case InstType::kCast:
+                     case InstType::kSelect:
                      case InstType::kPhi:
                      case InstType::kCall:
                      case InstType::kParam:
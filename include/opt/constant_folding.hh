@@ -30,41 +30,41 @@ class ConstantFolding
 public:
   void run(const GraphTy &graph)
   {
-    findFoldable(graph);
-
-    for (auto inst : m_toFold)
-    {
-      auto &rInst = inst.get();
-      auto newInst = fold(rInst);
-      auto *const bb = rInst.getBB();
-      // Remove inputs
-      rInst.clearInputs();
-
-      bb->replaceInst(&rInst, newInst.release());
-    }
-  }
-
-private:
-  void findFoldable(const GraphTy &graph)
-  {
+    // Operands are visited before their users, so chains of constants are
+    // folded in one pass
     auto &&bbs = graph::depthFirstSearchReversePostOrder(graph);
-
-    std::vector<std::reference_wrapper<Inst>> toFold{};
     for (auto *const bb : bbs)
     {
-      std::copy_if(bb->begin(), bb->end(), std::back_inserter(toFold),
-                   foldable);
-    }
+      for (auto it = bb->begin(); it != bb->end();)
+      {
+        auto &rInst = *it++;
+        if (rInst.getInstType() == InstType::kSelect)
+        {
+          foldSelect(static_cast<Select &>(rInst));
+          continue;
+        }
+        if (!foldable(rInst))
+          continue;
 
-    m_toFold.swap(toFold);
+        auto newInst = fold(rInst);
+        // Remove inputs
+        rInst.clearInputs();
+
+        bb->replaceInst(&rInst, newInst.release());
+      }
+    }
   }
 
+private:
   [[nodiscard]] static bool foldable(Inst &inst)
   {
     switch (inst.getInstType())
     {
     case InstType::kBinOp: {
       const auto &binOp = static_cast<BinOp &>(inst);
+      // Trapping instructions are left as is
+      if (mayTrap(binOp))
+        return false;
       return (tryRetrieveConst(binOp.getLeft()) != nullptr) &&
              (tryRetrieveConst(binOp.getRight()) != nullptr);
     }
@@ -75,18 +75,38 @@ private:
     }
     case InstType::kConst:
     case InstType::kIf:
+    case InstType::kSwitch:
     case InstType::kUnaryOp:
     case InstType::kJump:
     case InstType::kParam:
     case InstType::kCall:
     case InstType::kPhi:
     case InstType::kRet:
+    case InstType::kSelect:
     case InstType::kUnknown:
     default:
       return false;
     }
   }
 
+  // Select is replaced w/ one of its operands, so no new value is created
+  static void foldSelect(Select &select)
+  {
+    const auto *const cond = tryRetrieveConst(select.getCond());
+    Value *res = nullptr;
+    if (cond != nullptr)
+      res = retrieveConstVal(cond) != 0 ? select.getTrueVal()
+                                        : select.getFalseVal();
+    else if (select.getTrueVal() == select.getFalseVal())
+      res = select.getTrueVal();
+    else
+      return;
+
+    select.clearInputs();
+    res->setUsersFrom(select);
+    select.getBB()->eraseInst(&select);
+  }
+
   std::unique_ptr<Inst> fold(Inst &inst) const
   {
     // Check if instruction supports folding
@@ -103,11 +123,13 @@ private:
     case InstType::kConst:
     case InstType::kUnaryOp:
     case InstType::kIf:
+    case InstType::kSwitch:
     case InstType::kJump:
     case InstType::kPhi:
     case InstType::kParam:
     case InstType::kCall:
     case InstType::kRet:
+    case InstType::kSelect:
     case InstType::kUnknown:
     default:
       break;
@@ -115,6 +137,26 @@ private:
     LJIT_UNREACHABLE("Cannot fold");
   }
 
+  template <typename T>
+  static void checkShamt(T rval)
+  {
+    constexpr auto kWidth = std::numeric_limits<T>::digits;
+    if (rval >= kWidth)
+    {
+      std::ostringstream ss;
+      ss << "Shift amount (which is " << rval
+         << ") exceeds the width of type (" << kWidth << ")";
+      throw ArithmeticError{ss.str()};
+    }
+    if constexpr (!std::is_same_v<T, bool>)
+    {
+      if (rval < 0)
+      {
+        throw ArithmeticError{"Shamt is negative"};
+      }
+    }
+  }
+
   template <typename T>
   static std::unique_ptr<Inst> binEval(BinOp::Oper oper, const Inst *lv,
                                        const Inst *rv)
@@ -124,15 +166,18 @@ private:
 
     const auto lval = lhs->getVal();
     const auto rval = rhs->getVal();
+    // Arithmetic wraps around like in the generated code
+    const auto ulval = static_cast<std::uint64_t>(lval);
+    const auto urval = static_cast<std::uint64_t>(rval);
     T res{};
 
     switch (oper)
     {
     case BinOp::Oper::kAdd:
-      res = static_cast<T>(lval + rval);
+      res = static_cast<T>(ulval + urval);
       break;
     case BinOp::Oper::kSub:
-      res = static_cast<T>(lval - rval);
+      res = static_cast<T>(ulval - urval);
       break;
     case BinOp::Oper::kMul:
       if constexpr (std::is_same_v<T, bool>)
@@ -141,7 +186,7 @@ private:
       }
       else
       {
-        res = static_cast<T>(lval * rval);
+        res = static_cast<T>(ulval * urval);
       }
       break;
     case BinOp::Oper::kLE:
@@ -150,25 +195,25 @@ private:
     case BinOp::Oper::kEQ:
       res = static_cast<T>(lval == rval);
       break;
-    case BinOp::Oper::kShr: {
-      constexpr auto kWidth = std::numeric_limits<T>::digits;
-      if (rval >= kWidth)
+    case BinOp::Oper::kShr:
+      checkShamt<T>(rval);
+      res = static_cast<T>(lval >> rval);
+      break;
+    case BinOp::Oper::kShl:
+      checkShamt<T>(rval);
+      if constexpr (std::is_same_v<T, bool>)
       {
-        std::ostringstream ss;
-        ss << "Shift amount (which is " << rval
-           << ") exceeds the width of type (" << kWidth << ")";
-        throw ArithmeticError{ss.str()};
+        // The only valid shift amount is zero
+        res = lval;
       }
-      if constexpr (!std::is_same_v<T, bool>)
+      else
       {
-        if (rval < 0)
-        {
-          throw ArithmeticError{"Shamt is negative"};
-        }
+        // Shift of negative value is done on its bits
+        using UnsignedT = std::make_unsigned_t<T>;
+        res = static_cast<T>(static_cast<UnsignedT>(
+          static_cast<UnsignedT>(lval) << static_cast<UnsignedT>(rval)));
       }
-      res = static_cast<T>(lval >> rval);
       break;
-    }
     case BinOp::Oper::kOr: {
       res = static_cast<T>(lval | rval);
       break;
@@ -220,8 +265,8 @@ private:
   template <typename T>
   std::unique_ptr<Inst> castEval(const Inst *val) const
   {
-    const auto *const cval = static_cast<const ConstVal<T> *>(val);
-    const auto res = static_cast<T>(cval->getVal());
+    // Source may be of any type
+    const auto res = static_cast<T>(retrieveConstVal(val));
     return std::make_unique<ConstVal<T>>(res);
   }
   std::unique_ptr<Inst> doCastFold(Cast &inst) const
@@ -247,8 +292,6 @@ private:
       LJIT_UNREACHABLE("Bad type");
     }
   }
-
-  std::vector<std::reference_wrapper<Inst>> m_toFold{};
 };
 } // namespace ljit
 
@@ -0,0 +1,242 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_DCE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_DCE_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <unordered_set>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Remove entries for the given predecessor from phis of the block
+inline void removePhiEntries(BasicBlock *bb, const BasicBlock *pred)
+{
+  for (auto &phiRef : bb->collectInsts(InstType::kPhi))
+  {
+    auto &phi = static_cast<Phi &>(phiRef.get());
+    for (std::size_t idx = phi.numEntries(); idx != 0; --idx)
+    {
+      const auto &entry =
+        *std::next(phi.begin(), static_cast<std::ptrdiff_t>(idx - 1));
+      if (entry.bb == pred)
+        phi.removeEntry(idx - 1);
+    }
+  }
+}
+
+// Remove blocks, which are not reachable from the entry one.
+// Returns the number of removed blocks.
+inline std::size_t removeUnreachableBBs(Function *func)
+{
+  const auto &&reachable =
+    graph::depthFirstSearchPreOrder(func->makeBBGraph());
+  const std::unordered_set<BasicBlock *> live{reachable.begin(),
+                                              reachable.end()};
+
+  std::vector<BasicBlock *> dead;
+  for (auto &bb : *func)
+    if (live.find(&bb) == live.end())
+      dead.push_back(&bb);
+
+  for (auto *const bb : dead)
+  {
+    for (auto *const succ : bb->getSucc())
+      if (live.find(succ) != live.end())
+        removePhiEntries(succ, bb);
+
+    for (auto &inst : *bb)
+      inst.clearInputs();
+  }
+
+  for (auto *const bb : dead)
+  {
+    while (!bb->empty())
+      bb->eraseInst(&bb->getLast());
+    // Unlink from successors
+    bb->updateLinks();
+  }
+
+  for (auto *const bb : dead)
+    func->eraseBB(bb);
+
+  return dead.size();
+}
+
+// Dead code elimination.
+// Branches on constant conditions are turned into jumps first, so blocks,
+// which become unreachable, are removed along w/ their phi entries. Then
+// instructions w/o side effects, whose results are never used, are removed.
+class DCE final
+{
+  Function *m_func{};
+
+public:
+  explicit DCE(Function *func) : m_func(func)
+  {}
+
+  void run()
+  {
+    m_numRemovedInsts = 0;
+    m_numRemovedBBs = 0;
+
+    foldBranches();
+    removeUnreachable();
+    removeDeadInsts();
+  }
+
+  [[nodiscard]] auto getNumRemovedInsts() const noexcept
+  {
+    return m_numRemovedInsts;
+  }
+
+  [[nodiscard]] auto getNumRemovedBBs() const noexcept
+  {
+    return m_numRemovedBBs;
+  }
+
+private:
+  void foldBranches()
+  {
+    for (auto *const bb :
+         graph::depthFirstSearchPreOrder(m_func->makeBBGraph()))
+    {
+      auto &last = bb->getLast();
+      BasicBlock *target = nullptr;
+      std::vector<BasicBlock *> targets;
+      if (last.getInstType() == InstType::kIf)
+      {
+        const auto &branch = static_cast<const IfInstr &>(last);
+        const auto *const cond = tryRetrieveConst(branch.getCond());
+        if (cond == nullptr)
+          continue;
+
+        const bool taken = retrieveConstVal(cond) != 0;
+        target = taken ? branch.getTrueBB() : branch.getFalseBB();
+        targets = {branch.getTrueBB(), branch.getFalseBB()};
+      }
+      else if (last.getInstType() == InstType::kSwitch)
+      {
+        const auto &sw = static_cast<const Switch &>(last);
+        const auto *const val = tryRetrieveConst(sw.getVal());
+        if (val == nullptr)
+          continue;
+
+        target = sw.getTarget(retrieveConstVal(val));
+        targets = sw.getTargets();
+      }
+      else
+        continue;
+
+      // Each successor has one phi entry for this block
+      targets.erase(std::unique(targets.begin(), targets.end()),
+                    targets.end());
+      for (auto *const skipped : targets)
+        if (skipped != target)
+          removePhiEntries(skipped, bb);
+
+      last.clearInputs();
+      bb->eraseInst(&last);
+      bb->pushInstBack<JumpInstr>(target);
+    }
+  }
+
+  void removeUnreachable()
+  {
+    m_numRemovedBBs += removeUnreachableBBs(m_func);
+
+    // Phi w/ the only entry is just a copy
+    for (auto *const bb :
+         graph::depthFirstSearchPreOrder(m_func->makeBBGraph()))
+    {
+      for (auto &phiRef : bb->collectInsts(InstType::kPhi))
+      {
+        auto &phi = static_cast<Phi &>(phiRef.get());
+        if (phi.numEntries() != 1 || phi.inputAt(0) == &phi)
+          continue;
+
+        auto *const val = phi.inputAt(0);
+        phi.clearInputs();
+        val->setUsersFrom(phi);
+        bb->eraseInst(&phi);
+        ++m_numRemovedInsts;
+      }
+    }
+  }
+
+  [[nodiscard]] static bool hasSideEffects(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kCall:
+    case InstType::kUnaryOp:
+    case InstType::kParam:
+      return true;
+    case InstType::kBinOp:
+      // Trap of the dead instruction is observable
+      return mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kConst:
+    case InstType::kCast:
+    case InstType::kSelect:
+    case InstType::kPhi:
+      return false;
+    case InstType::kUnknown:
+    default:
+      LJIT_UNREACHABLE("Unknown instruction");
+    }
+  }
+
+  void removeDeadInsts()
+  {
+    const auto &&bbs = graph::depthFirstSearchPreOrder(m_func->makeBBGraph());
+
+    std::unordered_set<const Inst *> live;
+    std::vector<const Inst *> toVisit;
+    for (auto *const bb : bbs)
+      for (const auto &inst : *bb)
+        if (hasSideEffects(inst) && live.insert(&inst).second)
+          toVisit.push_back(&inst);
+
+    while (!toVisit.empty())
+    {
+      const auto *const inst = toVisit.back();
+      toVisit.pop_back();
+      for (auto it = inst->inputBegin(); it != inst->inputEnd(); ++it)
+      {
+        // Only instructions are values
+        const auto *const input = static_cast<const Inst *>(*it);
+        if (live.insert(input).second)
+          toVisit.push_back(input);
+      }
+    }
+
+    std::vector<Inst *> dead;
+    for (auto *const bb : bbs)
+      for (auto &inst : *bb)
+        if (live.find(&inst) == live.end())
+          dead.push_back(&inst);
+
+    // Dead instructions may use each other (e.g. phis in loops)
+    for (auto *const inst : dead)
+      inst->clearInputs();
+    for (auto *const inst : dead)
+      inst->getBB()->eraseInst(inst);
+    m_numRemovedInsts += dead.size();
+  }
+
+  std::size_t m_numRemovedInsts{};
+  std::size_t m_numRemovedBBs{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_DCE_HH_INCLUDED */
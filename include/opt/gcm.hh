@@ -0,0 +1,327 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_GCM_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_GCM_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "analysis/block_frequency.hh"
+#include "analysis/loop_analyzer.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "graph/dom_tree.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Global code motion (Click).
+// Pinned instructions (control flow, phis, calls and checks) stay in place.
+// Each floating one gets the earliest block, which is the deepest dominator
+// tree node among its inputs, and the latest one, which is LCA of its uses.
+// It is placed on the dominator tree path between them into the block of the
+// least loop depth and then of the least frequency. Blocks w/ moved
+// instructions are rescheduled, so instructions follow their inputs.
+class GCM final
+{
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+
+  Function *m_func{};
+
+public:
+  explicit GCM(Function *func) : m_func(func)
+  {}
+
+  void run()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const auto rpo = graph::depthFirstSearchReversePostOrder(graph);
+    const Loops loops{graph};
+    const BlockFrequencyInfo freqs{graph, makeEdgeProfile(*m_func)};
+
+    buildDomInfo(graph);
+    m_loopDepth.clear();
+    m_freq.clear();
+    for (auto *const bb : rpo)
+    {
+      std::size_t depth = 0;
+      for (const auto *loop = loops.getLoopInfo(bb);
+           loop != nullptr && !loop->isRoot(); loop = loop->getOuterLoop())
+        ++depth;
+      m_loopDepth[bb] = depth;
+      m_freq[bb] = freqs.getFrequency(bb);
+    }
+
+    collectFloating(rpo);
+    scheduleEarly(rpo);
+    scheduleLate();
+
+    m_numMoved = 0;
+    std::unordered_set<BasicBlock *> changed;
+    for (auto *const inst : m_floating)
+    {
+      auto *const dst = m_block.at(inst);
+      if (dst == inst->getBB())
+        continue;
+
+      const BasicBlock::iterator pos{inst};
+      dst->splice(BasicBlock::iterator{&dst->getLast()}, pos, std::next(pos));
+      changed.insert(dst);
+      ++m_numMoved;
+    }
+
+    for (auto *const bb : rpo)
+      if (changed.count(bb) != 0)
+        scheduleLocal(bb);
+  }
+
+  [[nodiscard]] auto getNumMoved() const noexcept
+  {
+    return m_numMoved;
+  }
+
+private:
+  void buildDomInfo(const GraphTy &graph)
+  {
+    const auto domTree = graph::buildDomTree(graph);
+    m_idom.clear();
+    m_domDepth.clear();
+
+    auto *const entry = graph.getRoot();
+    m_idom[entry] = nullptr;
+    m_domDepth[entry] = 0;
+    std::queue<BasicBlock *> toVisit;
+    toVisit.push(entry);
+    while (!toVisit.empty())
+    {
+      auto *const bb = toVisit.front();
+      toVisit.pop();
+      for (auto *const dommed : domTree.getIDommed(bb))
+      {
+        m_idom[dommed] = bb;
+        m_domDepth[dommed] = m_domDepth[bb] + 1;
+        toVisit.push(dommed);
+      }
+    }
+  }
+
+  [[nodiscard]] bool isReachable(const BasicBlock *bb) const
+  {
+    return m_domDepth.find(bb) != m_domDepth.end();
+  }
+
+  [[nodiscard]] BasicBlock *getLCA(BasicBlock *lhs, BasicBlock *rhs) const
+  {
+    if (lhs == nullptr)
+      return rhs;
+    while (m_domDepth.at(lhs) > m_domDepth.at(rhs))
+      lhs = m_idom.at(lhs);
+    while (m_domDepth.at(rhs) > m_domDepth.at(lhs))
+      rhs = m_idom.at(rhs);
+    while (lhs != rhs)
+    {
+      lhs = m_idom.at(lhs);
+      rhs = m_idom.at(rhs);
+    }
+    return lhs;
+  }
+
+  [[nodiscard]] static bool isFloatingType(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+    case InstType::kCast:
+    case InstType::kSelect:
+      return true;
+    case InstType::kBinOp:
+      return !mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    case InstType::kUnaryOp:
+    case InstType::kUnknown:
+    default:
+      return false;
+    }
+  }
+
+  // All uses have to be reachable to compute LCA
+  [[nodiscard]] bool canFloat(const Inst &inst) const
+  {
+    if (!isFloatingType(inst))
+      return false;
+    return std::all_of(
+      inst.usersBegin(), inst.usersEnd(), [&](const Inst *user) {
+        if (user->getInstType() != InstType::kPhi)
+          return isReachable(user->getBB());
+        const auto &phi = static_cast<const Phi &>(*user);
+        return std::all_of(phi.begin(), phi.end(), [&](const auto &entry) {
+          return entry.m_val != &inst || isReachable(entry.bb);
+        });
+      });
+  }
+
+  void collectFloating(const std::vector<BasicBlock *> &rpo)
+  {
+    m_floating.clear();
+    m_floatingSet.clear();
+    for (auto *const bb : rpo)
+      for (auto &inst : *bb)
+        if (canFloat(inst))
+        {
+          m_floating.push_back(&inst);
+          m_floatingSet.insert(&inst);
+        }
+  }
+
+  [[nodiscard]] bool isFloating(const Inst *inst) const
+  {
+    return m_floatingSet.count(inst) != 0;
+  }
+
+  // Inputs dominate their users, so they are visited first in RPO
+  void scheduleEarly(const std::vector<BasicBlock *> &rpo)
+  {
+    m_early.clear();
+    for (auto *const inst : m_floating)
+    {
+      auto *early = rpo.front();
+      for (auto it = inst->inputBegin(); it != inst->inputEnd(); ++it)
+      {
+        if (!(*it)->isInst())
+          continue;
+        const auto *const input = static_cast<const Inst *>(*it);
+        auto *const bb =
+          isFloating(input) ? m_early.at(input) : input->getBB();
+        if (m_domDepth.at(bb) > m_domDepth.at(early))
+          early = bb;
+      }
+      m_early[inst] = early;
+    }
+  }
+
+  [[nodiscard]] bool isBetter(const BasicBlock *cand,
+                              const BasicBlock *best) const
+  {
+    const auto candDepth = m_loopDepth.at(cand);
+    const auto bestDepth = m_loopDepth.at(best);
+    if (candDepth != bestDepth)
+      return candDepth < bestDepth;
+    // Equal frequencies keep the later block
+    return m_freq.at(cand) < m_freq.at(best) * (1. - kFreqEps);
+  }
+
+  // Users are placed before their inputs in reverse order
+  void scheduleLate()
+  {
+    m_block.clear();
+    for (auto it = m_floating.rbegin(); it != m_floating.rend(); ++it)
+    {
+      auto *const inst = *it;
+      BasicBlock *late = nullptr;
+      for (auto uIt = inst->usersBegin(); uIt != inst->usersEnd(); ++uIt)
+      {
+        auto *const user = *uIt;
+        if (user->getInstType() == InstType::kPhi)
+        {
+          for (const auto &entry : static_cast<const Phi &>(*user))
+            if (entry.m_val == inst)
+              late = getLCA(late, entry.bb);
+          continue;
+        }
+        late = getLCA(late,
+                      isFloating(user) ? m_block.at(user) : user->getBB());
+      }
+
+      // Unused instructions stay in place
+      if (late == nullptr)
+      {
+        m_block[inst] = inst->getBB();
+        continue;
+      }
+
+      auto *const early = m_early.at(inst);
+      auto *best = late;
+      for (auto *cur = late; cur != early;)
+      {
+        cur = m_idom.at(cur);
+        LJIT_ASSERT(cur != nullptr);
+        if (isBetter(cur, best))
+          best = cur;
+      }
+      m_block[inst] = best;
+    }
+  }
+
+  // Keep pinned instructions in order, each one follows its inputs from the
+  // same block. Floating ones w/o local users go right before the terminator.
+  void scheduleLocal(BasicBlock *bb)
+  {
+    std::vector<Inst *> order;
+    std::unordered_set<const Inst *> visited;
+    auto *const term = &bb->getLast();
+
+    std::vector<Inst *> pinned;
+    std::vector<Inst *> floating;
+    for (auto &inst : *bb)
+    {
+      if (&inst == term || inst.getInstType() == InstType::kPhi)
+        continue;
+      (isFloating(&inst) ? floating : pinned).push_back(&inst);
+    }
+
+    for (auto *const inst : pinned)
+      emit(bb, inst, visited, order);
+    for (auto *const inst : floating)
+      emit(bb, inst, visited, order);
+
+    for (auto *const inst : order)
+    {
+      const BasicBlock::iterator pos{inst};
+      bb->splice(BasicBlock::iterator{term}, pos, std::next(pos));
+    }
+  }
+
+  static void emit(const BasicBlock *bb, Inst *inst,
+                   std::unordered_set<const Inst *> &visited,
+                   std::vector<Inst *> &order)
+  {
+    if (!visited.insert(inst).second)
+      return;
+
+    for (auto it = inst->inputBegin(); it != inst->inputEnd(); ++it)
+    {
+      if (!(*it)->isInst())
+        continue;
+      auto *const input = static_cast<Inst *>(*it);
+      if (input->getBB() == bb && input->getInstType() != InstType::kPhi)
+        emit(bb, input, visited, order);
+    }
+    order.push_back(inst);
+  }
+
+  static constexpr double kFreqEps = 1e-9;
+
+  std::unordered_map<const BasicBlock *, BasicBlock *> m_idom{};
+  std::unordered_map<const BasicBlock *, std::size_t> m_domDepth{};
+  std::unordered_map<const BasicBlock *, std::size_t> m_loopDepth{};
+  std::unordered_map<const BasicBlock *, double> m_freq{};
+  std::vector<Inst *> m_floating{};
+  std::unordered_set<const Inst *> m_floatingSet{};
+  std::unordered_map<const Inst *, BasicBlock *> m_early{};
+  std::unordered_map<const Inst *, BasicBlock *> m_block{};
+  std::size_t m_numMoved{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_GCM_HH_INCLUDED */
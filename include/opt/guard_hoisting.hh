@@ -0,0 +1,549 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_GUARD_HOISTING_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_GUARD_HOISTING_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "analysis/induction.hh"
+#include "analysis/loop_analyzer.hh"
+#include "common/common.hh"
+#include "graph/dom_tree.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/loop_utils.hh"
+
+namespace ljit
+{
+// Loop-wide bounds checks elimination.
+// Checks, indexed by basic induction variable of a counted loop, are removed
+// if IV's range proves them, otherwise they are replaced by checks of the
+// range's extreme values before the loop. The latter is done only for loops
+// without calls and other trapping instructions, so the only difference is
+// the moment of the trap. Speculative mode drops this restriction: the
+// compiled code has to deoptimize on the failure of the hoisted check.
+class GuardHoisting final
+{
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+  using LoopInfo = typename Loops::LoopInfo;
+
+  // base + off, base is nullptr for constants
+  struct SymVal final
+  {
+    Value *base{};
+    std::int64_t off{};
+  };
+
+  // Inclusive range of IV values inside loop body. Inexact end is only a
+  // bound: IV may never take its value
+  struct Range final
+  {
+    SymVal lo{};
+    SymVal hi{};
+    bool exactLo{true};
+    bool exactHi{true};
+  };
+
+  struct Candidate final
+  {
+    BinOp *check{};
+    SymVal lo{};
+    SymVal hi{};
+    bool needLo{};
+    bool needHi{};
+  };
+
+  Function *m_func{};
+  bool m_speculative{};
+
+public:
+  explicit GuardHoisting(Function *func, bool speculative = false)
+    : m_func(func), m_speculative(speculative)
+  {}
+
+  void run()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const Loops loops{graph};
+    const InductionAnalyzer ivs{loops};
+    m_domTree = graph::buildDomTree(graph);
+    m_numRemoved = 0;
+    m_numHoisted = 0;
+
+    for (const auto *loop : loops.getLoopsInnerFirst())
+      processLoop(loop, ivs);
+  }
+
+  [[nodiscard]] auto getNumRemoved() const noexcept
+  {
+    return m_numRemoved;
+  }
+
+  [[nodiscard]] auto getNumHoisted() const noexcept
+  {
+    return m_numHoisted;
+  }
+
+private:
+  void processLoop(const LoopInfo *loop, const InductionAnalyzer &ivs)
+  {
+    const auto *const exit = ivs.getExitTest(loop);
+    if (exit == nullptr)
+      return;
+
+    // Header's instructions are executed with the IV value failing the test
+    if (exit->body == loop->getHeader())
+      return;
+
+    const auto range = getRange(*exit);
+    if (!range.has_value())
+      return;
+
+    std::vector<Candidate> candidates;
+    for (auto *bb : loop->getLinearOrder())
+    {
+      // IV's range holds only after the exit test
+      if (!m_domTree.isDominator(exit->body, bb))
+        continue;
+
+      for (auto it = bb->begin(); it != bb->end();)
+      {
+        auto &inst = *it++;
+        if (!isBoundsCheck(inst))
+          continue;
+
+        auto &check = static_cast<BinOp &>(inst);
+        auto cand = makeCandidate(check, *exit, *range);
+        if (!cand.has_value())
+          continue;
+
+        if (!cand->needLo && !cand->needHi)
+        {
+          check.getLeft()->setUsersFrom(check);
+          removeInst(&check);
+          ++m_numRemoved;
+          continue;
+        }
+        // Check of the value IV never takes may fail spuriously
+        if ((cand->needLo && !range->exactLo) ||
+            (cand->needHi && !range->exactHi))
+          continue;
+        candidates.push_back(*cand);
+      }
+    }
+
+    if (!candidates.empty() && canHoist(loop, ivs, *exit, candidates))
+      hoist(loop, ivs, *exit, candidates);
+  }
+
+  [[nodiscard]] static bool isBoundsCheck(const Inst &inst)
+  {
+    return inst.getInstType() == InstType::kBinOp &&
+           static_cast<const BinOp &>(inst).getOper() ==
+             BinOp::Oper::kBoundsCheck;
+  }
+
+  [[nodiscard]] static std::optional<Range> getRange(const LoopExitTest &exit)
+  {
+    const auto type = exit.iv->phi->getType();
+    if (type == Type::I1)
+      return std::nullopt;
+
+    const auto step = exit.iv->step;
+    const auto start = toSym(exit.iv->start);
+    const auto limit = toSym(exit.limit);
+    // Last value of IV, which fails the exit test, should not wrap around
+    auto &&fits = [&](std::int64_t delta) {
+      const auto [tMin, tMax] = getTypeRange(type);
+      std::int64_t last{};
+      return limit.base == nullptr &&
+             !__builtin_add_overflow(limit.off, delta, &last) &&
+             last >= tMin && last <= tMax;
+    };
+
+    switch (exit.cmp)
+    {
+    case ExitCmp::kLess:
+      if (step < 0 || (step != 1 && !fits(step - 1)))
+        return std::nullopt;
+      return alignToStep(makeRange(start, shift(limit, -1)), step);
+    case ExitCmp::kLessEq:
+      if (step < 0 || !fits(step))
+        return std::nullopt;
+      return alignToStep(makeRange(start, limit), step);
+    case ExitCmp::kGreater:
+      if (step > 0 || (step != -1 && !fits(step + 1)))
+        return std::nullopt;
+      return alignToStep(makeRange(shift(limit, 1), start), step);
+    case ExitCmp::kGreaterEq:
+      if (step > 0 || !fits(step))
+        return std::nullopt;
+      return alignToStep(makeRange(limit, start), step);
+    case ExitCmp::kNotEq:
+      if (step == 1 && isLessEq(start, limit))
+        return makeRange(start, shift(limit, -1));
+      if (step == -1 && isLessEq(limit, start))
+        return makeRange(shift(limit, 1), start);
+      return std::nullopt;
+    default:
+      LJIT_UNREACHABLE("Unknown exit condition");
+    }
+  }
+
+  // Moves the end of the range opposite to start to the last IV value.
+  // Without constant start the end is left as inexact bound
+  [[nodiscard]] static std::optional<Range> alignToStep(
+    std::optional<Range> range, std::int64_t step)
+  {
+    if (!range.has_value() || step == 1 || step == -1)
+      return range;
+
+    const bool up = step > 0;
+    const auto &start = up ? range->lo : range->hi;
+    auto &end = up ? range->hi : range->lo;
+    auto &exact = up ? range->exactHi : range->exactLo;
+    std::int64_t dist{};
+    if (start.base != nullptr || end.base != nullptr ||
+        step == std::numeric_limits<std::int64_t>::min() ||
+        __builtin_sub_overflow(up ? end.off : start.off,
+                               up ? start.off : end.off, &dist))
+    {
+      exact = false;
+      return range;
+    }
+
+    // Loop body is not executed
+    if (dist < 0)
+      return range;
+
+    dist -= dist % (up ? step : -step);
+    end.off = up ? start.off + dist : start.off - dist;
+    return range;
+  }
+
+  [[nodiscard]] static std::optional<Candidate> makeCandidate(
+    BinOp &check, const LoopExitTest &exit, const Range &range)
+  {
+    auto *const idx = check.getLeft();
+    auto *const bound = check.getRight();
+    if (idx->getType() != bound->getType())
+      return std::nullopt;
+
+    const auto off = getIVOffset(idx, exit.iv->phi);
+    if (!off.has_value())
+      return std::nullopt;
+
+    const auto lo = shift(range.lo, *off);
+    const auto hi = shift(range.hi, *off);
+    if (!lo.has_value() || !hi.has_value())
+      return std::nullopt;
+
+    const auto boundSym = toSym(bound);
+    Candidate cand{&check, *lo, *hi, !isNonNegative(*lo),
+                   !isLess(*hi, boundSym)};
+
+    // Extreme values of shifted non-constant IV may wrap around
+    if (*off != 0 && (cand.needLo || cand.needHi) &&
+        (!fitsType(*lo, idx->getType()) || !fitsType(*hi, idx->getType())))
+      return std::nullopt;
+
+    return cand;
+  }
+
+  // idx == iv + off
+  [[nodiscard]] static std::optional<std::int64_t> getIVOffset(
+    const Value *idx, const Phi *iv)
+  {
+    if (idx == iv)
+      return 0;
+
+    if (!idx->isInst() ||
+        static_cast<const Inst *>(idx)->getInstType() != InstType::kBinOp)
+      return std::nullopt;
+
+    const auto *const binop = static_cast<const BinOp *>(idx);
+    const auto lhs = toSym(binop->getLeft());
+    const auto rhs = toSym(binop->getRight());
+    switch (binop->getOper())
+    {
+    case BinOp::Oper::kAdd:
+      if (lhs.base == iv && rhs.base == nullptr)
+        return rhs.off;
+      if (rhs.base == iv && lhs.base == nullptr)
+        return lhs.off;
+      return std::nullopt;
+    case BinOp::Oper::kSub:
+      if (lhs.base == iv && rhs.base == nullptr &&
+          rhs.off != std::numeric_limits<std::int64_t>::min())
+        return -rhs.off;
+      return std::nullopt;
+    case BinOp::Oper::kMul:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kEQ:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl:
+    case BinOp::Oper::kOr:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      return std::nullopt;
+    }
+  }
+
+  [[nodiscard]] bool canHoist(const LoopInfo *loop,
+                              const InductionAnalyzer &ivs,
+                              const LoopExitTest &exit,
+                              const std::vector<Candidate> &candidates) const
+  {
+    if (!ivs.isInvariant(loop, exit.iv->start))
+      return false;
+
+    auto *const header = loop->getHeader();
+    const auto &preds = header->getPred();
+    const auto numOutPreds =
+      std::count_if(preds.begin(), preds.end(), [&](const BasicBlock *bb) {
+        return !ivs.contains(loop, bb);
+      });
+    if (numOutPreds != 1)
+      return false;
+
+    std::unordered_set<const Inst *> hoistable;
+    for (const auto &cand : candidates)
+    {
+      // Each check has to be executed on every iteration
+      const auto &latches = loop->getBackEdgesSrc();
+      const bool everyIter =
+        std::all_of(latches.begin(), latches.end(), [&](BasicBlock *latch) {
+          return m_domTree.isDominator(cand.check->getBB(), latch);
+        });
+      if (!everyIter || !ivs.isInvariant(loop, cand.check->getRight()))
+        return false;
+      hoistable.insert(cand.check);
+    }
+
+    if (m_speculative)
+      return true;
+
+    for (auto *bb : loop->getLinearOrder())
+    {
+      // Loop should be left only via exit test, so all IV values are visited
+      if (bb != header &&
+          std::any_of(bb->getSucc().begin(), bb->getSucc().end(),
+                      [&](const BasicBlock *succ) {
+                        return !ivs.contains(loop, succ);
+                      }))
+        return false;
+
+      const bool hasSideEffects =
+        std::any_of(bb->begin(), bb->end(), [&](const Inst &inst) {
+          return mayTrapOrCall(inst) &&
+                 hoistable.find(&inst) == hoistable.end();
+        });
+      if (hasSideEffects)
+        return false;
+    }
+
+    return true;
+  }
+
+  [[nodiscard]] static bool mayTrapOrCall(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kCall:
+      return true;
+    case InstType::kBinOp:
+      return mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kUnaryOp:
+      return static_cast<const UnaryOp &>(inst).getOper() ==
+             UnaryOp::Oper::kZeroCheck;
+    case InstType::kUnknown:
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kConst:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kCast:
+    case InstType::kSelect:
+    case InstType::kPhi:
+    case InstType::kParam:
+    default:
+      return false;
+    }
+  }
+
+  void hoist(const LoopInfo *loop, const InductionAnalyzer &ivs,
+             const LoopExitTest &exit, const std::vector<Candidate> &cands)
+  {
+    auto *const header = loop->getHeader();
+    auto *preheader =
+      getOrCreatePreheader(m_func, header, [&](const BasicBlock *bb) {
+        return ivs.contains(loop, bb);
+      });
+    LJIT_ASSERT(preheader != nullptr);
+
+    auto *const start = exit.iv->start;
+    auto *const limit = exit.limit;
+    removeInst(&preheader->getLast());
+
+    BasicBlock *checkBB = preheader;
+    const auto entered = isEntered(exit);
+    if (!entered.has_value())
+    {
+      // Checks are performed only if loop body is executed at least once
+      checkBB = m_func->appendBB();
+      auto *const joinBB = m_func->appendBB();
+
+      const auto [cond, onTrue] = makeEntryCond(preheader, exit.cmp, start,
+                                                limit);
+      preheader->pushInstBack<IfInstr>(cond, onTrue ? checkBB : joinBB,
+                                       onTrue ? joinBB : checkBB);
+      joinBB->pushInstBack<JumpInstr>(header);
+
+      for (auto &phi : header->collectInsts(InstType::kPhi))
+        static_cast<Phi &>(phi.get()).replaceBB(preheader, joinBB);
+      preheader = joinBB;
+    }
+
+    for (const auto &cand : cands)
+    {
+      // Checks of never executed loop body are dead
+      if (entered.value_or(true))
+      {
+        auto *const bound = cand.check->getRight();
+        const auto type = cand.check->getLeft()->getType();
+        if (cand.needLo)
+          checkBB->pushInstBack<BinOp>(BinOp::Oper::kBoundsCheck,
+                                       materialize(checkBB, cand.lo, type),
+                                       bound);
+        if (cand.needHi)
+          checkBB->pushInstBack<BinOp>(BinOp::Oper::kBoundsCheck,
+                                       materialize(checkBB, cand.hi, type),
+                                       bound);
+      }
+
+      cand.check->getLeft()->setUsersFrom(*cand.check);
+      removeInst(cand.check);
+      ++m_numHoisted;
+    }
+
+    checkBB->pushInstBack<JumpInstr>(checkBB == preheader ? header : preheader);
+  }
+
+  // Emit condition of entering the loop, second is true if loop is entered
+  // when condition holds
+  static std::pair<Inst *, bool> makeEntryCond(BasicBlock *bb, ExitCmp cmp,
+                                               Value *start, Value *limit)
+  {
+    switch (cmp)
+    {
+    case ExitCmp::kLess:
+      return {bb->pushInstBack<BinOp>(BinOp::Oper::kLE, start, limit), true};
+    case ExitCmp::kLessEq:
+      return {bb->pushInstBack<BinOp>(BinOp::Oper::kLE, limit, start), false};
+    case ExitCmp::kGreater:
+      return {bb->pushInstBack<BinOp>(BinOp::Oper::kLE, limit, start), true};
+    case ExitCmp::kGreaterEq:
+      return {bb->pushInstBack<BinOp>(BinOp::Oper::kLE, start, limit), false};
+    case ExitCmp::kNotEq:
+      return {bb->pushInstBack<BinOp>(BinOp::Oper::kEQ, start, limit), false};
+    default:
+      LJIT_UNREACHABLE("Unknown exit condition");
+    }
+  }
+
+  [[nodiscard]] static std::optional<bool> isEntered(const LoopExitTest &exit)
+  {
+    const auto start = toSym(exit.iv->start);
+    const auto limit = toSym(exit.limit);
+    if (start.base != nullptr || limit.base != nullptr)
+      return std::nullopt;
+
+    switch (exit.cmp)
+    {
+    case ExitCmp::kLess:
+      return start.off < limit.off;
+    case ExitCmp::kLessEq:
+      return start.off <= limit.off;
+    case ExitCmp::kGreater:
+      return start.off > limit.off;
+    case ExitCmp::kGreaterEq:
+      return start.off >= limit.off;
+    case ExitCmp::kNotEq:
+      return start.off != limit.off;
+    default:
+      LJIT_UNREACHABLE("Unknown exit condition");
+    }
+  }
+
+  static Value *materialize(BasicBlock *bb, const SymVal &val, Type type)
+  {
+    if (val.base == nullptr)
+      return bb->pushConstBack(type, val.off);
+    if (val.off == 0)
+      return val.base;
+
+    auto *const off = bb->pushConstBack(type, val.off);
+    return bb->pushInstBack<BinOp>(BinOp::Oper::kAdd, val.base, off);
+  }
+
+  [[nodiscard]] static SymVal toSym(Value *val)
+  {
+    const auto *const cnst = tryRetrieveConst(val);
+    if (cnst != nullptr)
+      return SymVal{nullptr, retrieveConstVal(cnst)};
+    return SymVal{val, 0};
+  }
+
+  [[nodiscard]] static std::optional<SymVal> shift(const SymVal &val,
+                                                   std::int64_t off)
+  {
+    SymVal res{val.base, 0};
+    if (__builtin_add_overflow(val.off, off, &res.off))
+      return std::nullopt;
+    return res;
+  }
+
+  [[nodiscard]] static std::optional<Range> makeRange(
+    const std::optional<SymVal> &lo, const std::optional<SymVal> &hi)
+  {
+    if (!lo.has_value() || !hi.has_value())
+      return std::nullopt;
+    return Range{*lo, *hi};
+  }
+
+  [[nodiscard]] static bool isNonNegative(const SymVal &val)
+  {
+    return val.base == nullptr && val.off >= 0;
+  }
+
+  [[nodiscard]] static bool isLess(const SymVal &lhs, const SymVal &rhs)
+  {
+    return lhs.base == rhs.base && lhs.off < rhs.off;
+  }
+
+  [[nodiscard]] static bool isLessEq(const SymVal &lhs, const SymVal &rhs)
+  {
+    return lhs.base == rhs.base && lhs.off <= rhs.off;
+  }
+
+  [[nodiscard]] static bool fitsType(const SymVal &val, Type type)
+  {
+    const auto [tMin, tMax] = getTypeRange(type);
+    return val.base == nullptr && val.off >= tMin && val.off <= tMax;
+  }
+
+  graph::DominatorTree<GraphTy> m_domTree;
+  std::size_t m_numRemoved{};
+  std::size_t m_numHoisted{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_GUARD_HOISTING_HH_INCLUDED */
@@ -0,0 +1,215 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_GVN_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_GVN_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stack>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dom_tree.hh"
+#include "ir/basic_block.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Dominator-scoped global value numbering.
+// Walks the dominator tree keeping a scoped table of structural instruction
+// keys, so each instruction is replaced by an identical dominating one.
+class GVN final
+{
+  using GraphTy = BasicBlockGraph;
+  using Traits = GraphTraits<GraphTy>;
+  using NodePtrTy = typename Traits::node_pointer;
+
+public:
+  void run(const GraphTy &graph)
+  {
+    m_domTree = graph::buildDomTree(graph);
+    m_table.clear();
+    m_numReplaced = 0;
+
+    // second == true means that node's scope should be closed
+    std::stack<std::pair<NodePtrTy, bool>> toVisit;
+    std::stack<std::vector<const InstKey *>> scopes;
+    toVisit.emplace(Traits::entryPoint(graph), false);
+
+    while (!toVisit.empty())
+    {
+      const auto [node, leave] = toVisit.top();
+      toVisit.pop();
+
+      if (leave)
+      {
+        for (const auto *key : scopes.top())
+          m_table.erase(m_table.find(*key));
+        scopes.pop();
+        continue;
+      }
+
+      toVisit.emplace(node, true);
+      scopes.emplace();
+      processBB(node, scopes.top());
+
+      for (auto *dommed : m_domTree.getIDommed(node))
+        toVisit.emplace(dommed, false);
+    }
+  }
+
+  [[nodiscard]] auto getNumReplaced() const noexcept
+  {
+    return m_numReplaced;
+  }
+
+private:
+  struct InstKey final
+  {
+    InstType iType{};
+    Type type{};
+    // Operation kind or constant value
+    std::int64_t extra{};
+    std::vector<Value *> inputs{};
+
+    [[nodiscard]] bool operator==(const InstKey &rhs) const
+    {
+      return iType == rhs.iType && type == rhs.type && extra == rhs.extra &&
+             inputs == rhs.inputs;
+    }
+  };
+
+  struct InstKeyHash final
+  {
+    std::size_t operator()(const InstKey &key) const
+    {
+      std::size_t seed = std::hash<std::int64_t>{}(key.extra);
+      auto &&combine = [&seed](std::size_t val) {
+        constexpr std::size_t kMagic = 0x9e3779b9;
+        seed ^= val + kMagic + (seed << 6U) + (seed >> 2U);
+      };
+
+      combine(toUnderlying(key.iType));
+      combine(static_cast<std::size_t>(key.type));
+      for (auto *inp : key.inputs)
+        combine(std::hash<Value *>{}(inp));
+
+      return seed;
+    }
+  };
+
+  using Table = std::unordered_map<InstKey, Inst *, InstKeyHash>;
+
+  void processBB(NodePtrTy bb, std::vector<const InstKey *> &scope)
+  {
+    for (auto it = bb->begin(); it != bb->end();)
+    {
+      auto &inst = *it++;
+      if (!isCandidate(inst))
+        continue;
+
+      auto key = makeKey(inst);
+      const auto found = m_table.find(key);
+      if (found != m_table.end())
+      {
+        found->second->setUsersFrom(inst);
+        removeInst(&inst);
+        ++m_numReplaced;
+        continue;
+      }
+
+      const auto [ins, wasNew] = m_table.emplace(std::move(key), &inst);
+      LJIT_ASSERT(wasNew);
+      scope.push_back(&ins->first);
+    }
+  }
+
+  [[nodiscard]] static bool isCandidate(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+    case InstType::kBinOp:
+    case InstType::kUnaryOp:
+    case InstType::kCast:
+    case InstType::kSelect:
+      return true;
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    case InstType::kUnknown:
+    default:
+      return false;
+    }
+  }
+
+  [[nodiscard]] static bool isCommutative(BinOp::Oper oper)
+  {
+    switch (oper)
+    {
+    case BinOp::Oper::kAdd:
+    case BinOp::Oper::kMul:
+    case BinOp::Oper::kOr:
+    case BinOp::Oper::kEQ:
+      return true;
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      return false;
+    }
+  }
+
+  [[nodiscard]] static InstKey makeKey(const Inst &inst)
+  {
+    InstKey key{inst.getInstType(), inst.getType(), 0,
+                std::vector<Value *>{inst.inputBegin(), inst.inputEnd()}};
+
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+      key.extra = retrieveConstVal(&inst);
+      break;
+    case InstType::kBinOp: {
+      const auto oper = static_cast<const BinOp &>(inst).getOper();
+      key.extra = toUnderlying(oper);
+      if (isCommutative(oper))
+        std::sort(key.inputs.begin(), key.inputs.end(), std::less<>{});
+      break;
+    }
+    case InstType::kUnaryOp:
+      key.extra = toUnderlying(static_cast<const UnaryOp &>(inst).getOper());
+      break;
+    case InstType::kCast:
+    case InstType::kSelect:
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    case InstType::kUnknown:
+    default:
+      break;
+    }
+
+    return key;
+  }
+
+  graph::DominatorTree<GraphTy> m_domTree;
+  Table m_table;
+  std::size_t m_numReplaced{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_GVN_HH_INCLUDED */
@@ -0,0 +1,202 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_IF_CONVERSION_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_IF_CONVERSION_HH_INCLUDED
+
+#include <cstddef>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/dce.hh"
+
+namespace ljit
+{
+struct IfConversionParams final
+{
+  // Limit for instructions executed speculatively (in both arms)
+  std::size_t maxSpeculated{4};
+  // Limit for phis in the join block
+  std::size_t maxSelects{2};
+};
+
+// If-conversion.
+// Small diamonds and triangles w/o side effects are flattened: instructions
+// of the arms are moved to the branch block and phis of the join block are
+// replaced w/ selects on the branch condition.
+class IfConversion final
+{
+  struct Region final
+  {
+    BasicBlock *head{};
+    BasicBlock *join{};
+    // Block executed on true (false) condition, it is the head for triangles
+    BasicBlock *trueBB{};
+    BasicBlock *falseBB{};
+  };
+
+  Function *m_func{};
+  IfConversionParams m_params{};
+
+public:
+  explicit IfConversion(Function *func, const IfConversionParams &params = {})
+    : m_func(func), m_params(params)
+  {}
+
+  void run()
+  {
+    m_numConverted = 0;
+    // Inner regions go first, so enclosing ones may become convertible
+    while (convertNext())
+      ++m_numConverted;
+  }
+
+  [[nodiscard]] auto getNumConverted() const noexcept
+  {
+    return m_numConverted;
+  }
+
+private:
+  bool convertNext()
+  {
+    for (auto *const bb :
+         graph::depthFirstSearchPostOrder(m_func->makeBBGraph()))
+    {
+      if (bb->empty() || bb->getLast().getInstType() != InstType::kIf)
+        continue;
+      if (const auto region = matchRegion(bb); region.head != nullptr &&
+                                               isProfitable(region))
+      {
+        convert(region);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Block has the only predecessor and jumps to the join
+  [[nodiscard]] static bool isArm(const BasicBlock *bb, const BasicBlock *head)
+  {
+    return bb != head && bb->numPred() == 1 && bb->getPred().front() == head &&
+           bb->getLast().getInstType() == InstType::kJump;
+  }
+
+  [[nodiscard]] static BasicBlock *getJumpTarget(const BasicBlock *bb)
+  {
+    return static_cast<const JumpInstr &>(bb->getLast()).getTarget();
+  }
+
+  [[nodiscard]] static Region matchRegion(BasicBlock *head)
+  {
+    const auto &branch = static_cast<const IfInstr &>(head->getLast());
+    auto *const trueBB = branch.getTrueBB();
+    auto *const falseBB = branch.getFalseBB();
+    if (trueBB == falseBB)
+      return {};
+
+    const bool trueArm = isArm(trueBB, head);
+    const bool falseArm = isArm(falseBB, head);
+    // Diamond
+    if (trueArm && falseArm)
+    {
+      auto *const join = getJumpTarget(trueBB);
+      if (join == getJumpTarget(falseBB) && join != head &&
+          join->numPred() == 2)
+        return {head, join, trueBB, falseBB};
+      return {};
+    }
+    // Triangles
+    if (trueArm && getJumpTarget(trueBB) == falseBB && falseBB->numPred() == 2)
+      return {head, falseBB, trueBB, head};
+    if (falseArm && getJumpTarget(falseBB) == trueBB && trueBB->numPred() == 2)
+      return {head, trueBB, head, falseBB};
+    return {};
+  }
+
+  // Instructions, which may be executed regardless of the condition
+  [[nodiscard]] static bool isSpeculatable(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+    case InstType::kCast:
+    case InstType::kSelect:
+      return true;
+    case InstType::kBinOp:
+      return !mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    case InstType::kUnaryOp:
+    case InstType::kUnknown:
+    default:
+      return false;
+    }
+  }
+
+  [[nodiscard]] bool isProfitable(const Region &region) const
+  {
+    std::size_t cost = 0;
+    for (const auto *arm : {region.trueBB, region.falseBB})
+    {
+      if (arm == region.head)
+        continue;
+      for (auto it = arm->begin(); &*it != &arm->getLast(); ++it)
+      {
+        if (!isSpeculatable(*it))
+          return false;
+        ++cost;
+      }
+    }
+
+    const auto numPhis = region.join->collectInsts(InstType::kPhi).size();
+    return cost <= m_params.maxSpeculated && numPhis <= m_params.maxSelects;
+  }
+
+  [[nodiscard]] static Value *getIncoming(const Phi &phi,
+                                          const BasicBlock *pred)
+  {
+    for (const auto &entry : phi)
+      if (entry.bb == pred)
+        return entry.m_val;
+    LJIT_UNREACHABLE("No entry for predecessor");
+  }
+
+  void convert(const Region &region)
+  {
+    auto *const head = region.head;
+    auto &branch = static_cast<IfInstr &>(head->getLast());
+    auto *const cond = branch.getCond();
+
+    for (auto *const arm : {region.trueBB, region.falseBB})
+      if (arm != head)
+        head->splice(BasicBlock::iterator{&branch}, arm->begin(),
+                     BasicBlock::iterator{&arm->getLast()});
+
+    for (auto &phiRef : region.join->collectInsts(InstType::kPhi))
+    {
+      auto &phi = static_cast<Phi &>(phiRef.get());
+      auto *const select = head->insertInstBefore<Select>(
+        &branch, cond, getIncoming(phi, region.trueBB),
+        getIncoming(phi, region.falseBB));
+      phi.clearInputs();
+      select->setUsersFrom(phi);
+      region.join->eraseInst(&phi);
+    }
+
+    branch.clearInputs();
+    head->eraseInst(&branch);
+    head->pushInstBack<JumpInstr>(region.join);
+    removeUnreachableBBs(m_func);
+  }
+
+  std::size_t m_numConverted{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_IF_CONVERSION_HH_INCLUDED */
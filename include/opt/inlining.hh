@@ -1,145 +1,381 @@
 #ifndef LEECH_JIT_INCLUDE_OPT_INLINING_HH_INCLUDED
 #define LEECH_JIT_INCLUDE_OPT_INLINING_HH_INCLUDED
 
+#include "analysis/call_graph.hh"
+#include "analysis/loop_analyzer.hh"
 #include "common/common.hh"
 #include "graph/dfs.hh"
 #include "ir/basic_block.hh"
+#include "ir/cloner.hh"
 #include "ir/function.hh"
 #include "ir/inst.hh"
+#include "ir/module.hh"
 #include <algorithm>
-#include <functional>
+#include <cstddef>
+#include <cstdint>
 #include <iterator>
+#include <optional>
+#include <ostream>
 #include <vector>
 
 namespace ljit
 {
+// Tuning knobs of the inlining cost model.
+// Callee is inlined if its size (in instructions) does not exceed the
+// threshold, which grows w/ each constant argument and w/ loop depth of the
+// call site. W/ the profile attached to the caller the loop depth bonus is
+// replaced by the hot call site one, never executed call sites are rejected.
+struct InlineParams final
+{
+  std::size_t baseThreshold{30};
+  std::size_t constArgBonus{10};
+  std::size_t loopDepthBonus{20};
+  std::size_t hotCallBonus{40};
+  // Minimal number of executions of the hot call site
+  std::uint64_t hotCallCount{1000};
+  // Caller may not grow beyond this size
+  std::size_t callerBudget{1000};
+};
+
+enum class InlineReason
+{
+  kInlined,
+  kNoBody,
+  kBadSignature,
+  kRecursive,
+  kColdCallSite,
+  kTooBig,
+  kCallerBudget,
+};
+
+[[nodiscard]] inline const char *toString(InlineReason reason)
+{
+  switch (reason)
+  {
+  case InlineReason::kInlined:
+    return "inlined";
+  case InlineReason::kNoBody:
+    return "callee has no body";
+  case InlineReason::kBadSignature:
+    return "signature mismatch";
+  case InlineReason::kRecursive:
+    return "recursive call";
+  case InlineReason::kColdCallSite:
+    return "call site is never executed";
+  case InlineReason::kTooBig:
+    return "callee is too big";
+  case InlineReason::kCallerBudget:
+    return "caller budget exceeded";
+  default:
+    LJIT_UNREACHABLE("Unknown reason");
+  }
+}
+
+struct InlineDecision final
+{
+  const Function *caller{};
+  const Function *callee{};
+  InlineReason reason{};
+  std::size_t cost{};
+  std::size_t threshold{};
+
+  [[nodiscard]] bool isInlined() const noexcept
+  {
+    return reason == InlineReason::kInlined;
+  }
+
+  void print(std::ostream &ost) const
+  {
+    ost << caller->getName() << " -> " << callee->getName() << ": "
+        << toString(reason) << " (cost " << cost << ", threshold "
+        << threshold << ")\n";
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &ost, const InlineDecision &dec)
+{
+  dec.print(ost);
+  return ost;
+}
+
+// Number of instructions, which are left after inlining (params are replaced
+// w/ arguments)
+[[nodiscard]] inline std::size_t getInlineSize(const Function &func)
+{
+  if (func.size() == 0)
+    return 0;
+
+  std::size_t res = 0;
+  graph::depthFirstSearchPreOrder(func.makeBBGraph(), [&res](BasicBlock *bb) {
+    res += static_cast<std::size_t>(
+      std::count_if(bb->begin(), bb->end(), [](const Inst &inst) {
+        return inst.getInstType() != InstType::kParam;
+      }));
+  });
+  return res;
+}
+
+// Inliner w/ cost model.
+// Callees are cloned, so they stay intact. For the whole module functions are
+// processed bottom-up over call graph SCCs, so callees are already optimized
+// (and have their final size) when their callers are visited.
 class Inlining final
 {
+  struct CallSite final
+  {
+    Call *call{};
+    std::size_t loopDepth{};
+    // Number of executions from the profile
+    std::optional<std::uint64_t> count{};
+  };
+
+  Module *m_module{};
   Function *m_func{};
+  InlineParams m_params{};
 
 public:
-  explicit Inlining(Function *func) : m_func(func)
+  explicit Inlining(Function *func, const InlineParams &params = {})
+    : m_func(func), m_params(params)
   {}
 
-  void run()
-  {
-    fillCandidates();
-    for (auto &inst : m_candidates)
-      doInline(static_cast<Call &>(inst.get()));
-  }
+  explicit Inlining(Module *module, const InlineParams &params = {})
+    : m_module(module), m_params(params)
+  {}
 
-private:
-  void fillCandidates()
+  void run()
   {
-    auto &&bbs = graph::depthFirstSearchReversePostOrder(m_func->makeBBGraph());
-    m_candidates.clear();
-    for (auto *const bb : bbs)
+    m_decisions.clear();
+    if (m_module == nullptr)
     {
-      std::copy_if(
-        bb->begin(), bb->end(), std::back_inserter(m_candidates),
-        [](Inst &inst) { return inst.getInstType() == InstType::kCall; });
+      inlineCalls(m_func, nullptr);
+      return;
     }
+
+    const CallGraph callGraph{*m_module};
+    for (const auto &scc : callGraph.getSCCs())
+      for (auto *const func : scc)
+        inlineCalls(func, &callGraph);
   }
 
-  auto *splitBBAfter(Inst *inst)
+  [[nodiscard]] const auto &getDecisions() const noexcept
   {
-    auto *const newBB = m_func->appendBB();
-    const auto pivot = std::next(BasicBlock::iterator{inst});
+    return m_decisions;
+  }
 
-    newBB->splice(newBB->end(), pivot, inst->getBB()->end());
+  [[nodiscard]] auto getNumInlined() const
+  {
+    return static_cast<std::size_t>(
+      std::count_if(m_decisions.begin(), m_decisions.end(),
+                    [](const auto &dec) { return dec.isInlined(); }));
+  }
 
-    return newBB;
+  void printDecisions(std::ostream &ost) const
+  {
+    for (const auto &dec : m_decisions)
+      ost << dec;
   }
 
-  static void adjustInputs(Call &inst, Function *callee)
+private:
+  [[nodiscard]] static std::vector<CallSite> collectCallSites(
+    const Function &func)
   {
-    BasicBlock *const firstBB = callee->makeBBGraph().getRoot();
+    std::vector<CallSite> res;
+    if (func.size() == 0)
+      return res;
+
+    const auto graph = func.makeBBGraph();
+    const LoopAnalyzer<BasicBlockGraph> loops{graph};
+    const auto *const profile = func.getProfile();
+    for (auto *const bb : graph::depthFirstSearchReversePostOrder(graph))
+    {
+      std::size_t depth = 0;
+      for (const auto *loop = loops.getLoopInfo(bb);
+           loop != nullptr && !loop->isRoot(); loop = loop->getOuterLoop())
+        ++depth;
 
-    auto &&params = firstBB->collectInsts(InstType::kParam);
-    auto paramIt = params.begin();
+      std::size_t callIdx = 0;
+      for (auto &inst : *bb)
+      {
+        if (inst.getInstType() != InstType::kCall)
+          continue;
+        auto &site = res.emplace_back(
+          CallSite{&static_cast<Call &>(inst), depth, std::nullopt});
+        if (profile != nullptr)
+          site.count = profile->getCallCount(bb->getId(), callIdx);
+        ++callIdx;
+      }
+    }
+    return res;
+  }
 
-    for (auto inpIt = inst.inputBegin();
-         inpIt != inst.inputEnd() && paramIt != params.end();
-         ++inpIt, ++paramIt)
+  [[nodiscard]] InlineDecision decide(const CallSite &site,
+                                      const Function *caller,
+                                      std::size_t callerSize,
+                                      const CallGraph *callGraph) const
+  {
+    const auto &call = *site.call;
+    auto *const callee = call.getCallee();
+    InlineDecision dec{caller, callee, InlineReason::kInlined, 0, 0};
+
+    if (callee->size() == 0)
     {
-      auto *input = *inpIt;
-      Inst &param = *paramIt;
-      // Instructions in callee function should use origins of parameters
-      input->setUsersFrom(param);
-      firstBB->eraseInst(&param);
+      dec.reason = InlineReason::kNoBody;
+      return dec;
     }
+    if (!call.verify())
+    {
+      dec.reason = InlineReason::kBadSignature;
+      return dec;
+    }
+    const bool isRecursive =
+      callGraph == nullptr
+        ? callee == caller
+        : callGraph->getSCCId(callee) == callGraph->getSCCId(caller);
+    if (isRecursive)
+    {
+      dec.reason = InlineReason::kRecursive;
+      return dec;
+    }
+    if (site.count == 0U)
+    {
+      dec.reason = InlineReason::kColdCallSite;
+      return dec;
+    }
+
+    const auto numConstArgs = static_cast<std::size_t>(
+      std::count_if(call.inputBegin(), call.inputEnd(),
+                    [](const Value *arg) { return tryRetrieveConst(arg); }));
+    dec.cost = getInlineSize(*callee);
+    dec.threshold =
+      m_params.baseThreshold + numConstArgs * m_params.constArgBonus;
+    if (!site.count.has_value())
+      dec.threshold += site.loopDepth * m_params.loopDepthBonus;
+    else if (*site.count >= m_params.hotCallCount)
+      dec.threshold += m_params.hotCallBonus;
+
+    if (dec.cost > dec.threshold)
+      dec.reason = InlineReason::kTooBig;
+    else if (callerSize + dec.cost > m_params.callerBudget)
+      dec.reason = InlineReason::kCallerBudget;
+
+    return dec;
   }
 
-  static void adjustOutputs(Call &inst, Function *callee,
-                            BasicBlock *afterCallBB)
+  void inlineCalls(Function *caller, const CallGraph *callGraph)
   {
-    if (callee->getResType() == Type::None)
+    // Calls, which appear from inlined bodies, were already rejected in
+    // context of their callers
+    const auto &&sites = collectCallSites(*caller);
+    auto callerSize = getInlineSize(*caller);
+    for (const auto &site : sites)
     {
-      return;
+      const auto &dec = m_decisions.emplace_back(
+        decide(site, caller, callerSize, callGraph));
+      if (!dec.isInlined())
+        continue;
+
+      doInline(caller, *site.call);
+      // Call instruction itself is gone
+      callerSize += dec.cost - 1;
     }
+  }
+
+  static auto *splitBBAfter(Function *func, Inst *inst)
+  {
+    auto *const bb = inst->getBB();
+    auto *const newBB = func->insertBBAfter(bb);
+    const auto pivot = std::next(BasicBlock::iterator{inst});
+
+    newBB->splice(newBB->end(), pivot, bb->end());
+
+    // Successors are reached from the new block now
+    for (auto *const succ : newBB->getSucc())
+      for (auto &phi : succ->collectInsts(InstType::kPhi))
+        static_cast<Phi &>(phi.get()).replaceBB(bb, newBB);
+
+    return newBB;
+  }
 
+  static void adjustOutputs(Call &inst, const Function &callee,
+                            const Cloner &cloner, BasicBlock *afterCallBB)
+  {
     std::vector<Ret *> rets;
     graph::depthFirstSearchPreOrder(
-      callee->makeBBGraph(), [&rets](BasicBlock *bb) {
-        LJIT_ASSERT(!bb->empty());
-        auto *lastInsn = &bb->getLast();
+      callee.makeBBGraph(), [&](const BasicBlock *bb) {
+        auto *const newBB = cloner.getBB(bb);
+        LJIT_ASSERT(!newBB->empty());
+        auto *lastInsn = &newBB->getLast();
         if (lastInsn->getInstType() == InstType::kRet)
         {
           rets.push_back(static_cast<Ret *>(lastInsn));
         }
       });
 
-    if (rets.size() == 1)
+    if (callee.getResType() != Type::None)
     {
-      auto *retVal = rets.front()->getVal();
+      if (rets.size() == 1)
+      {
+        auto *retVal = rets.front()->getVal();
 
-      retVal->setUsersFrom(inst);
-    }
-    else
-    {
-      auto *const phi = afterCallBB->pushInstFront<Phi>(callee->getResType());
+        retVal->setUsersFrom(inst);
+      }
+      else
+      {
+        auto *const phi = afterCallBB->pushInstFront<Phi>(callee.getResType());
 
-      for (auto *ret : rets)
-        phi->addNode(ret->getVal(), ret->getBB());
+        for (auto *ret : rets)
+          phi->addNode(ret->getVal(), ret->getBB());
 
-      phi->setUsersFrom(inst);
+        phi->setUsersFrom(inst);
+      }
     }
 
     // Replace return w/ jmp
-
     for (auto *ret : rets)
     {
       auto *bb = ret->getBB();
+      ret->clearInputs();
       bb->eraseInst(ret);
       bb->pushInstBack<JumpInstr>(afterCallBB);
     }
   }
 
-  void doInline(Call &inst)
+  static void doInline(Function *caller, Call &inst)
   {
     LJIT_ASSERT(inst.verify());
 
     auto *bb = inst.getBB();
-    auto *callee = inst.getCallee();
+    const auto &callee = *inst.getCallee();
 
-    auto *afterCallBB = splitBBAfter(&inst);
+    auto *afterCallBB = splitBBAfter(caller, &inst);
 
-    adjustInputs(inst, callee);
-    adjustOutputs(inst, callee, afterCallBB);
+    Cloner cloner;
+    auto *const calleeFstBB = callee.makeBBGraph().getRoot();
+    // Instructions in callee function should use origins of parameters
+    for (auto &param : calleeFstBB->collectInsts(InstType::kParam))
+      cloner.mapValue(
+        &param.get(),
+        inst.inputAt(static_cast<const Param &>(param.get()).getIdx()));
+
+    // Entry block is merged into the caller one, unless it is a loop header
+    if (calleeFstBB->numPred() == 0)
+      cloner.mapBB(calleeFstBB, bb);
+    else
     {
-      auto *const calleeFstBB = callee->makeBBGraph().getRoot();
-      bb->splice(bb->end(), *calleeFstBB);
-      callee->eraseBB(calleeFstBB);
+      auto *const entryBB = caller->appendBB();
+      cloner.mapBB(calleeFstBB, entryBB);
+      bb->pushInstBack<JumpInstr>(entryBB);
     }
+    cloner.cloneBody(callee, caller);
+
+    adjustOutputs(inst, callee, cloner, afterCallBB);
 
     // Remove call instruction from caller BB
+    inst.clearInputs();
     bb->eraseInst(&inst);
-
-    // Inline function into caller graph
-    m_func->splice(Function::BBIterator{afterCallBB}, *callee);
   }
 
-  std::vector<std::reference_wrapper<Inst>> m_candidates;
+  std::vector<InlineDecision> m_decisions;
 };
 } // namespace ljit
 
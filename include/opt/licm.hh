@@ -0,0 +1,171 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_LICM_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_LICM_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "analysis/loop_analyzer.hh"
+#include "common/common.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/loop_utils.hh"
+
+namespace ljit
+{
+// Loop-invariant code motion.
+// Loops are processed inside-out, so invariants of inner loop can be moved
+// further out by the enclosing one.
+// Speculative mode moves divisions and checks as well: the compiled code
+// has to deoptimize on their failure, the loop may not reach them.
+class LICM final
+{
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+  using LoopInfo = typename Loops::LoopInfo;
+
+  struct LoopBlocks final
+  {
+    std::vector<BasicBlock *> order{};
+    std::unordered_set<const BasicBlock *> set{};
+
+    void add(BasicBlock *bb)
+    {
+      if (set.insert(bb).second)
+        order.push_back(bb);
+    }
+  };
+
+  Function *m_func{};
+  bool m_speculative{};
+
+public:
+  explicit LICM(Function *func, bool speculative = false)
+    : m_func(func), m_speculative(speculative)
+  {}
+
+  void run()
+  {
+    const Loops loops{m_func->makeBBGraph()};
+    const auto &&order = loops.getLoopsInnerFirst();
+
+    m_loopBlocks.clear();
+    m_numHoisted = 0;
+    for (const auto *loop : order)
+    {
+      auto &blocks = m_loopBlocks[loop];
+      for (auto *bb : loop->getLinearOrder())
+        blocks.add(bb);
+    }
+
+    for (const auto *loop : order)
+    {
+      auto *const preheader = getPreheader(loop);
+      if (preheader != nullptr)
+        hoist(loop, preheader);
+    }
+  }
+
+  [[nodiscard]] auto getNumHoisted() const noexcept
+  {
+    return m_numHoisted;
+  }
+
+private:
+  [[nodiscard]] bool inLoop(const LoopInfo *loop, const BasicBlock *bb) const
+  {
+    const auto &blocks = m_loopBlocks.at(loop).set;
+    return blocks.find(bb) != blocks.end();
+  }
+
+  BasicBlock *getPreheader(const LoopInfo *loop)
+  {
+    auto *const preheader = getOrCreatePreheader(
+      m_func, loop->getHeader(),
+      [&](const BasicBlock *bb) { return inLoop(loop, bb); });
+    if (preheader == nullptr)
+      return nullptr;
+
+    // Preheader belongs to all enclosing loops
+    for (const auto *outer = loop->getOuterLoop(); outer != nullptr;
+         outer = outer->getOuterLoop())
+    {
+      const auto found = m_loopBlocks.find(outer);
+      if (found != m_loopBlocks.end())
+        found->second.add(preheader);
+    }
+
+    return preheader;
+  }
+
+  void hoist(const LoopInfo *loop, BasicBlock *preheader)
+  {
+    const auto &body = m_loopBlocks.at(loop).order;
+    for (bool changed = true; changed;)
+    {
+      changed = false;
+      for (auto *bb : body)
+      {
+        for (auto it = bb->begin(); it != bb->end();)
+        {
+          auto &inst = *it++;
+          if (!isInvariant(loop, inst))
+            continue;
+
+          const BasicBlock::iterator pos{&inst};
+          preheader->splice(BasicBlock::iterator{&preheader->getLast()}, pos,
+                            std::next(pos));
+          ++m_numHoisted;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  [[nodiscard]] bool isInvariant(const LoopInfo *loop, const Inst &inst) const
+  {
+    if (!isHoistable(inst))
+      return false;
+
+    return std::all_of(inst.inputBegin(), inst.inputEnd(), [&](Value *val) {
+      return !val->isInst() ||
+             !inLoop(loop, static_cast<const Inst *>(val)->getBB());
+    });
+  }
+
+  [[nodiscard]] bool isHoistable(const Inst &inst) const
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kConst:
+    case InstType::kCast:
+    case InstType::kSelect:
+      return true;
+    case InstType::kBinOp:
+      return m_speculative || !mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kUnaryOp:
+      return m_speculative && static_cast<const UnaryOp &>(inst).getOper() ==
+                                UnaryOp::Oper::kZeroCheck;
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kPhi:
+    case InstType::kCall:
+    case InstType::kParam:
+    case InstType::kUnknown:
+    default:
+      return false;
+    }
+  }
+
+  std::unordered_map<const LoopInfo *, LoopBlocks> m_loopBlocks;
+  std::size_t m_numHoisted{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_LICM_HH_INCLUDED */
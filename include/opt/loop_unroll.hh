@@ -0,0 +1,474 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_LOOP_UNROLL_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_LOOP_UNROLL_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "analysis/induction.hh"
+#include "analysis/loop_analyzer.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/dce.hh"
+#include "opt/loop_utils.hh"
+
+namespace ljit
+{
+struct UnrollParams final
+{
+  // Loops w/ constant trip count up to this one are unrolled completely
+  std::uint64_t maxFullTripCount{8};
+  // Limit for the number of instructions in unrolled loop
+  std::size_t maxUnrolledSize{64};
+  // Number of iterations in the body of partially unrolled loop
+  std::size_t factor{4};
+};
+
+// Loop unrolling.
+// Only innermost counted loops, which are left only by the exit test in the
+// header, are unrolled. Loops w/ small constant trip count are replaced w/
+// the straight-line code. Others get the main loop, which does `factor`
+// iterations at once w/o exit tests. Original loop follows it and does the
+// remaining iterations.
+class LoopUnroll final
+{
+  using Loops = LoopAnalyzer<BasicBlockGraph>;
+  using LoopInfo = typename Loops::LoopInfo;
+
+  struct LoopShape final
+  {
+    BasicBlock *header{};
+    BasicBlock *latch{};
+    // Header's successors
+    BasicBlock *body{};
+    BasicBlock *exit{};
+    // In reverse post order, header goes first
+    std::vector<BasicBlock *> blocks{};
+    std::unordered_set<const BasicBlock *> blockSet{};
+    std::size_t size{};
+
+    Phi *iv{};
+    std::int64_t step{};
+    Value *limit{};
+    ExitCmp cmp{};
+
+    [[nodiscard]] bool contains(const BasicBlock *bb) const
+    {
+      return blockSet.find(bb) != blockSet.end();
+    }
+  };
+
+  Function *m_func{};
+  UnrollParams m_params{};
+
+public:
+  explicit LoopUnroll(Function *func, const UnrollParams &params = {})
+    : m_func(func), m_params(params)
+  {}
+
+  void run()
+  {
+    m_visited.clear();
+    m_numFull = 0;
+    m_numPartial = 0;
+    while (unrollNext())
+    {}
+  }
+
+  [[nodiscard]] auto getNumFull() const noexcept
+  {
+    return m_numFull;
+  }
+
+  [[nodiscard]] auto getNumPartial() const noexcept
+  {
+    return m_numPartial;
+  }
+
+private:
+  // Returns true if any loop was unrolled, analyses should be rebuilt then
+  bool unrollNext()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const Loops loops{graph};
+    const InductionAnalyzer ivs{loops};
+    const auto &&rpo = graph::depthFirstSearchReversePostOrder(graph);
+
+    for (const auto *loop : loops.getLoopsInnerFirst())
+    {
+      if (loop->isRoot() || !loop->getInners().empty() ||
+          !m_visited.insert(loop->getHeader()).second)
+        continue;
+
+      const auto &shape = makeShape(loop, ivs, rpo);
+      if (!shape.has_value())
+        continue;
+
+      const auto count = ivs.getTripCount(loop);
+      if (count.has_value() && *count <= m_params.maxFullTripCount &&
+          *count * shape->size <= m_params.maxUnrolledSize)
+      {
+        unrollFull(*shape, *count);
+        ++m_numFull;
+        return true;
+      }
+
+      if (m_params.factor > 1 &&
+          shape->size * m_params.factor <= m_params.maxUnrolledSize &&
+          unrollPartial(*shape))
+      {
+        ++m_numPartial;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  [[nodiscard]] static std::optional<LoopShape> makeShape(
+    const LoopInfo *loop, const InductionAnalyzer &ivs,
+    const std::vector<BasicBlock *> &rpo)
+  {
+    const auto *const exitTest = ivs.getExitTest(loop);
+    const auto &latches = loop->getBackEdgesSrc();
+    if (!loop->reducible() || exitTest == nullptr || latches.size() != 1)
+      return std::nullopt;
+
+    LoopShape shape;
+    shape.header = loop->getHeader();
+    shape.latch = latches.front();
+    shape.body = exitTest->body;
+    shape.exit = exitTest->exit;
+    shape.iv = exitTest->iv->phi;
+    shape.step = exitTest->iv->step;
+    shape.limit = exitTest->limit;
+    shape.cmp = exitTest->cmp;
+
+    if (shape.latch->getLast().getInstType() != InstType::kJump)
+      return std::nullopt;
+
+    const auto &preds = shape.header->getPred();
+    if (std::all_of(preds.begin(), preds.end(), [&](const BasicBlock *pred) {
+          return ivs.contains(loop, pred);
+        }))
+      return std::nullopt;
+
+    std::copy_if(rpo.begin(), rpo.end(), std::back_inserter(shape.blocks),
+                 [&](const BasicBlock *bb) { return ivs.contains(loop, bb); });
+    shape.blockSet.insert(shape.blocks.begin(), shape.blocks.end());
+    LJIT_ASSERT(shape.blocks.front() == shape.header);
+
+    for (const auto *bb : shape.blocks)
+    {
+      shape.size += bb->size();
+      // Loop is left only from the header
+      if (bb != shape.header &&
+          !std::all_of(
+            bb->getSucc().begin(), bb->getSucc().end(),
+            [&shape](const BasicBlock *succ) { return shape.contains(succ); }))
+        return std::nullopt;
+    }
+
+    // Header is executed once more for the main loop in partial unrolling
+    if (std::any_of(shape.header->begin(), shape.header->end(),
+                    [](const Inst &inst) {
+                      return inst.getInstType() == InstType::kCall;
+                    }))
+      return std::nullopt;
+
+    return shape;
+  }
+
+  [[nodiscard]] static Value *getIncoming(const Phi &phi,
+                                          const BasicBlock *pred)
+  {
+    const auto found = std::find_if(phi.begin(), phi.end(),
+                                    [pred](const auto &entry) {
+                                      return entry.bb == pred;
+                                    });
+    LJIT_ASSERT(found != phi.end());
+    return found->m_val;
+  }
+
+  [[nodiscard]] static std::vector<Phi *> getPhis(BasicBlock *bb)
+  {
+    std::vector<Phi *> res;
+    for (auto &phi : bb->collectInsts(InstType::kPhi))
+      res.push_back(&static_cast<Phi &>(phi.get()));
+    return res;
+  }
+
+  static void replaceTerminator(BasicBlock *bb, BasicBlock *target)
+  {
+    auto &last = bb->getLast();
+    last.clearInputs();
+    bb->eraseInst(&last);
+    bb->pushInstBack<JumpInstr>(target);
+  }
+
+  BasicBlock *getPreheader(const LoopShape &shape)
+  {
+    auto *const preheader = getOrCreatePreheader(
+      m_func, shape.header,
+      [&shape](const BasicBlock *bb) { return shape.contains(bb); });
+    LJIT_ASSERT(preheader != nullptr);
+    LJIT_ASSERT(preheader->getLast().getInstType() == InstType::kJump);
+    return preheader;
+  }
+
+  // Clone one iteration of the loop, header phis are replaced w/ given
+  // values. Header jumps to the body unconditionally.
+  static Cloner cloneIteration(Function *func, const LoopShape &shape,
+                               const std::vector<Phi *> &phis,
+                               const std::vector<Value *> &vals)
+  {
+    Cloner cloner;
+    for (std::size_t idx = 0; idx < phis.size(); ++idx)
+      cloner.mapValue(phis[idx], vals[idx]);
+
+    cloner.cloneBlocks(shape.blocks, func);
+    replaceTerminator(cloner.getBB(shape.header), cloner.getBB(shape.body));
+    return cloner;
+  }
+
+  [[nodiscard]] static std::vector<Value *> getBackValues(
+    const LoopShape &shape, const std::vector<Phi *> &phis,
+    const Cloner &cloner)
+  {
+    std::vector<Value *> res;
+    for (const auto *phi : phis)
+      res.push_back(cloner.getValue(getIncoming(*phi, shape.latch)));
+    return res;
+  }
+
+  void unrollFull(const LoopShape &shape, std::uint64_t count)
+  {
+    auto *const preheader = getPreheader(shape);
+    const auto &&phis = getPhis(shape.header);
+
+    std::vector<Value *> vals;
+    for (const auto *phi : phis)
+      vals.push_back(getIncoming(*phi, preheader));
+
+    // Block, which jumps to the header of the next iteration
+    auto *prevLatch = preheader;
+    auto *prevTarget = shape.header;
+    for (std::uint64_t iter = 0; iter < count; ++iter)
+    {
+      const auto &cloner = cloneIteration(m_func, shape, phis, vals);
+      auto *const newHeader = cloner.getBB(shape.header);
+      prevLatch->replaceSucc(prevTarget, newHeader);
+
+      prevLatch = cloner.getBB(shape.latch);
+      prevTarget = newHeader;
+      vals = getBackValues(shape, phis, cloner);
+    }
+
+    // The last check of the exit condition
+    Cloner cloner;
+    for (std::size_t idx = 0; idx < phis.size(); ++idx)
+      cloner.mapValue(phis[idx], vals[idx]);
+    cloner.cloneBlocks({shape.header}, m_func);
+    auto *const lastHeader = cloner.getBB(shape.header);
+    replaceTerminator(lastHeader, shape.exit);
+    prevLatch->replaceSucc(prevTarget, lastHeader);
+
+    // Only header values can be used outside of the loop
+    for (auto &inst : *shape.header)
+    {
+      std::vector<Inst *> outUsers;
+      std::copy_if(inst.usersBegin(), inst.usersEnd(),
+                   std::back_inserter(outUsers), [&shape](const Inst *user) {
+                     return !shape.contains(user->getBB());
+                   });
+
+      auto *const newVal = cloner.getValue(&inst);
+      for (auto *const user : outUsers)
+      {
+        user->replaceInput(&inst, newVal);
+        inst.users().erase(user);
+        newVal->users().insert(user);
+      }
+    }
+    for (auto *const phi : getPhis(shape.exit))
+      phi->replaceBB(shape.header, lastHeader);
+
+    removeUnreachableBBs(m_func);
+  }
+
+  bool unrollPartial(const LoopShape &shape)
+  {
+    const bool isUp = shape.step > 0;
+    switch (shape.cmp)
+    {
+    case ExitCmp::kLess:
+    case ExitCmp::kLessEq:
+      if (!isUp)
+        return false;
+      break;
+    case ExitCmp::kGreater:
+    case ExitCmp::kGreaterEq:
+      if (isUp)
+        return false;
+      break;
+    case ExitCmp::kNotEq:
+      return false;
+    default:
+      LJIT_UNREACHABLE("Unknown exit comparison");
+    }
+
+    // Main loop does the iteration only if `factor - 1` more iterations
+    // remain: iv +/- dist still satisfies the exit test
+    const auto type = shape.iv->getType();
+    const auto [min, max] = getTypeRange(type);
+    std::int64_t dist{};
+    if (__builtin_mul_overflow(static_cast<std::int64_t>(m_params.factor - 1),
+                               isUp ? shape.step : -shape.step, &dist) ||
+        dist > max)
+      return false;
+
+    const auto *const constLimit = tryRetrieveConst(shape.limit);
+    std::int64_t adjusted{};
+    if (constLimit != nullptr)
+    {
+      const auto limit = retrieveConstVal(constLimit);
+      adjusted = isUp ? limit - dist : limit + dist;
+      if (adjusted < min || adjusted > max)
+        return false;
+    }
+
+    auto *const preheader = getPreheader(shape);
+    const auto &&phis = getPhis(shape.header);
+    std::vector<Value *> startVals;
+    for (const auto *phi : phis)
+      startVals.push_back(getIncoming(*phi, preheader));
+
+    // Main loop's header and the first iteration
+    Cloner fstCloner;
+    fstCloner.cloneBlocks(shape.blocks, m_func);
+    auto *const mainHeader = fstCloner.getBB(shape.header);
+    m_visited.insert(mainHeader);
+
+    // Adjusted limit and the guard for its overflow
+    auto &jump = preheader->getLast();
+    preheader->eraseInst(&jump);
+    Value *adjLimit = nullptr;
+    if (constLimit != nullptr)
+    {
+      adjLimit = preheader->pushConstBack(type, adjusted);
+      preheader->pushInstBack<JumpInstr>(mainHeader);
+    }
+    else
+    {
+      auto *const distVal = preheader->pushConstBack(type, dist);
+      adjLimit = preheader->pushInstBack<BinOp>(
+        isUp ? BinOp::Oper::kSub : BinOp::Oper::kAdd, shape.limit, distVal);
+      auto *const bound = preheader->pushConstBack(
+        type, isUp ? min + dist - 1 : max - dist + 1);
+      auto *const noOverflow =
+        isUp ? preheader->pushInstBack<BinOp>(BinOp::Oper::kLE, bound,
+                                              shape.limit)
+             : preheader->pushInstBack<BinOp>(BinOp::Oper::kLE, shape.limit,
+                                              bound);
+      preheader->pushInstBack<IfInstr>(noOverflow, mainHeader, shape.header);
+    }
+
+    // Exit test of the main loop
+    {
+      auto *const mainIV = fstCloner.getValue(shape.iv);
+      auto *const bodyBB = fstCloner.getBB(shape.body);
+      auto &branch = mainHeader->getLast();
+      branch.clearInputs();
+      mainHeader->eraseInst(&branch);
+      switch (shape.cmp)
+      {
+      case ExitCmp::kLess: {
+        // iv < adjLimit
+        auto *const cond = mainHeader->pushInstBack<BinOp>(BinOp::Oper::kLE,
+                                                           mainIV, adjLimit);
+        mainHeader->pushInstBack<IfInstr>(cond, bodyBB, shape.header);
+        break;
+      }
+      case ExitCmp::kLessEq: {
+        // !(adjLimit < iv)
+        auto *const cond = mainHeader->pushInstBack<BinOp>(BinOp::Oper::kLE,
+                                                           adjLimit, mainIV);
+        mainHeader->pushInstBack<IfInstr>(cond, shape.header, bodyBB);
+        break;
+      }
+      case ExitCmp::kGreater: {
+        // adjLimit < iv
+        auto *const cond = mainHeader->pushInstBack<BinOp>(BinOp::Oper::kLE,
+                                                           adjLimit, mainIV);
+        mainHeader->pushInstBack<IfInstr>(cond, bodyBB, shape.header);
+        break;
+      }
+      case ExitCmp::kGreaterEq: {
+        // !(iv < adjLimit)
+        auto *const cond = mainHeader->pushInstBack<BinOp>(BinOp::Oper::kLE,
+                                                           mainIV, adjLimit);
+        mainHeader->pushInstBack<IfInstr>(cond, shape.header, bodyBB);
+        break;
+      }
+      case ExitCmp::kNotEq:
+      default:
+        LJIT_UNREACHABLE("Unexpected exit comparison");
+      }
+    }
+
+    // The rest of iterations
+    auto *prevLatch = fstCloner.getBB(shape.latch);
+    auto *prevTarget = mainHeader;
+    auto &&vals = getBackValues(shape, phis, fstCloner);
+    for (std::size_t iter = 1; iter < m_params.factor; ++iter)
+    {
+      const auto &cloner = cloneIteration(m_func, shape, phis, vals);
+      auto *const newHeader = cloner.getBB(shape.header);
+      prevLatch->replaceSucc(prevTarget, newHeader);
+
+      prevLatch = cloner.getBB(shape.latch);
+      prevTarget = newHeader;
+      vals = getBackValues(shape, phis, cloner);
+    }
+    prevLatch->replaceSucc(prevTarget, mainHeader);
+
+    // Link main loop w/ the original one, which does the remainder
+    for (std::size_t idx = 0; idx < phis.size(); ++idx)
+    {
+      auto *const mainPhi = static_cast<Phi *>(fstCloner.getValue(phis[idx]));
+      mainPhi->addNode(startVals[idx], preheader);
+      mainPhi->addNode(vals[idx], prevLatch);
+
+      if (constLimit == nullptr)
+        phis[idx]->addNode(mainPhi, mainHeader);
+      else
+      {
+        const auto found =
+          std::find_if(phis[idx]->begin(), phis[idx]->end(),
+                       [preheader](const auto &entry) {
+                         return entry.bb == preheader;
+                       });
+        const auto pos =
+          static_cast<std::size_t>(std::distance(phis[idx]->begin(), found));
+        phis[idx]->setInput(pos, mainPhi);
+        phis[idx]->replaceBB(preheader, mainHeader);
+      }
+    }
+
+    return true;
+  }
+
+  std::unordered_set<const BasicBlock *> m_visited{};
+  std::size_t m_numFull{};
+  std::size_t m_numPartial{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_LOOP_UNROLL_HH_INCLUDED */
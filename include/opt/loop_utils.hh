@@ -0,0 +1,71 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_LOOP_UTILS_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_LOOP_UTILS_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+namespace detail
+{
+inline void movePhiEntries(Phi &phi, const std::vector<BasicBlock *> &preds,
+                           BasicBlock *preheader)
+{
+  if (preds.size() == 1)
+  {
+    phi.replaceBB(preds.front(), preheader);
+    return;
+  }
+
+  auto *const newPhi = preheader->pushInstBack<Phi>(phi.getType());
+  for (std::size_t idx = phi.numEntries(); idx != 0; --idx)
+  {
+    const auto &entry =
+      *std::next(phi.begin(), static_cast<std::ptrdiff_t>(idx - 1));
+    if (std::find(preds.begin(), preds.end(), entry.bb) == preds.end())
+      continue;
+
+    newPhi->addNode(entry.m_val, entry.bb);
+    phi.removeEntry(idx - 1);
+  }
+  phi.addNode(newPhi, preheader);
+}
+} // namespace detail
+
+// Returns the only block outside of the loop, which jumps to the header.
+// New block is created if there are several such blocks or the only one has
+// other successors. Returns nullptr if loop header is the entry block.
+template <typename InLoop>
+BasicBlock *getOrCreatePreheader(Function *func, BasicBlock *header,
+                                 InLoop inLoop)
+{
+  std::vector<BasicBlock *> outPreds;
+  std::copy_if(header->getPred().begin(), header->getPred().end(),
+               std::back_inserter(outPreds),
+               [&](const BasicBlock *pred) { return !inLoop(pred); });
+
+  if (outPreds.empty())
+    return nullptr;
+
+  if (outPreds.size() == 1 && outPreds.front()->numSucc() == 1)
+    return outPreds.front();
+
+  auto *const preheader = func->appendBB();
+  for (auto &phi : header->collectInsts(InstType::kPhi))
+    detail::movePhiEntries(static_cast<Phi &>(phi.get()), outPreds, preheader);
+
+  for (auto *pred : outPreds)
+    pred->replaceSucc(header, preheader);
+  preheader->pushInstBack<JumpInstr>(header);
+
+  return preheader;
+}
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_LOOP_UTILS_HH_INCLUDED */
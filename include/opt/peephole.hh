@@ -1,11 +1,17 @@
 #ifndef LEECH_JIT_INCLUDE_OPT_PEEPHOLE_HH_INCLUDED
 #define LEECH_JIT_INCLUDE_OPT_PEEPHOLE_HH_INCLUDED
 
+#include "analysis/range_analysis.hh"
 #include "common/common.hh"
 #include "ir/basic_block.hh"
 #include "ir/inst.hh"
+#include "opt/dce.hh"
+#include <algorithm>
 #include <cstdio>
+#include <iterator>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace ljit
 {
@@ -20,11 +26,12 @@ public:
   void run(const GraphTy &graph)
   {
     findCandidates(graph);
+    const RangeAnalyzer ranges{graph};
 
     for (auto inst : m_candidates)
     {
       auto &rInst = inst.get();
-      fold(rInst);
+      fold(rInst, ranges);
     }
   }
 
@@ -48,9 +55,11 @@ private:
     switch (inst.getInstType())
     {
     case InstType::kBinOp:
+    case InstType::kSwitch:
       return true;
 
     case InstType::kCast:
+    case InstType::kSelect:
     case InstType::kUnaryOp:
     case InstType::kConst:
     case InstType::kIf:
@@ -65,7 +74,7 @@ private:
     }
   }
 
-  static bool doBinFold(BinOp &binop)
+  static bool doBinFold(BinOp &binop, const RangeAnalyzer &ranges)
   {
     if (binop.users().empty())
     {
@@ -94,11 +103,13 @@ private:
       return doShr(binop);
     case BinOp::Oper::kOr:
       return doOr(binop);
-    case BinOp::Oper::kSub:
-    case BinOp::Oper::kMul:
     case BinOp::Oper::kLE:
     case BinOp::Oper::kEQ:
+      return doCmp(binop, ranges);
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kMul:
     case BinOp::Oper::kDiv:
+    case BinOp::Oper::kShl:
     case BinOp::Oper::kBoundsCheck:
     default:
       break;
@@ -175,14 +186,20 @@ private:
           static_cast<Inst *>(fstShamt)->getInstType() != InstType::kConst)
         return false;
 
-      std::unique_ptr<Inst> newAdd{
-        new BinOp{BinOp::Oper::kAdd, fstShamt, rval}};
+      // Combined shift must not exceed the width of type
+      if (retrieveConstVal(static_cast<Inst *>(fstShamt)) +
+            retrieveConstVal(const_) >=
+          getTypeDigits(binop.getType()))
+        return false;
+
+      // Both shift amounts are defined before the second shift
+      auto *const newAdd = binop.getBB()->insertInstBefore<BinOp>(
+        &binop, BinOp::Oper::kAdd, fstShamt, rval);
 
       binop.setInput(0, fstShr->getLeft());
-      binop.setInput(1, newAdd.get());
+      binop.setInput(1, newAdd);
 
-      fstShr->clearInputs();
-      fstShr->getBB()->replaceInst(fstShr, newAdd.release());
+      removeInst(fstShr);
     }
 
     return false;
@@ -226,13 +243,92 @@ private:
     return false;
   }
 
-  static bool fold(Inst &inst)
+  static bool doCmp(BinOp &cmp, const RangeAnalyzer &ranges)
+  {
+    // Rule 0:
+    // v2 = le v0, v1 where ranges of v0 and v1 do not intersect
+    // --> v2 = const
+    const auto res = ranges.getRange(&cmp);
+    if (!res.isConst())
+    {
+      return false;
+    }
+
+    auto cnst = makeConst(cmp.getType(), res.lo());
+    cmp.clearInputs();
+    cmp.getBB()->replaceInst(&cmp, cnst.release());
+    return true;
+  }
+
+  static bool doSwitch(Switch &sw, const RangeAnalyzer &ranges)
+  {
+    auto *const bb = sw.getBB();
+    auto *const val = sw.getVal();
+    auto *defaultBB = sw.getDefault();
+    const auto range = ranges.getRange(val);
+
+    // Rule 0:
+    // cases out of the value's range are never taken
+    std::vector<Switch::Case> cases;
+    std::copy_if(
+      sw.getCases().begin(), sw.getCases().end(), std::back_inserter(cases),
+      [&range](const Switch::Case &cs) { return range.contains(cs.val); });
+
+    // Rule 1:
+    // switch on constant --> jump to its target
+    if (range.isConst())
+    {
+      defaultBB = sw.getTarget(range.lo());
+      cases.clear();
+    }
+
+    // Rule 2:
+    // all cases go to the default --> jump to the default
+    if (std::all_of(cases.begin(), cases.end(),
+                    [defaultBB](const Switch::Case &cs) {
+                      return cs.target == defaultBB;
+                    }))
+      cases.clear();
+
+    if (cases.size() > 1 && cases.size() == sw.numCases())
+      return false;
+
+    const auto oldTargets = sw.getTargets();
+    sw.clearInputs();
+    bb->eraseInst(&sw);
+
+    if (cases.empty())
+      bb->pushInstBack<JumpInstr>(defaultBB);
+    else if (cases.size() == 1)
+    {
+      // Rule 3:
+      // switch v0, [c: bb1], default: bb2
+      // --> v1 = eq v0, c
+      // --> if v1, bb1, bb2
+      auto *const cst = bb->pushConstBack(val->getType(), cases.front().val);
+      auto *const cmp = bb->pushInstBack<BinOp>(BinOp::Oper::kEQ, val, cst);
+      bb->pushInstBack<IfInstr>(cmp, cases.front().target, defaultBB);
+    }
+    else
+      bb->pushInstBack<Switch>(val, defaultBB, std::move(cases));
+
+    for (auto *const target : oldTargets)
+      if (std::find(bb->getSucc().begin(), bb->getSucc().end(), target) ==
+          bb->getSucc().end())
+        removePhiEntries(target, bb);
+
+    return true;
+  }
+
+  static bool fold(Inst &inst, const RangeAnalyzer &ranges)
   {
     switch (inst.getInstType())
     {
     case InstType::kBinOp: {
-      return doBinFold(static_cast<BinOp &>(inst));
+      return doBinFold(static_cast<BinOp &>(inst), ranges);
     }
+    case InstType::kSwitch:
+      return doSwitch(static_cast<Switch &>(inst), ranges);
     case InstType::kUnknown:
     case InstType::kIf:
     case InstType::kUnaryOp:
@@ -242,6 +338,7 @@ private:
     case InstType::kParam:
     case InstType::kCall:
     case InstType::kCast:
+    case InstType::kSelect:
     case InstType::kPhi:
     default:
       break;
@@ -0,0 +1,259 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_REASSOCIATION_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_REASSOCIATION_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+// Reassociation of associative and commutative operations (add, mul, or).
+// Each tree of single-use operations inside a block is flattened into the
+// list of leaves. Constant leaves are folded into one, which goes last.
+// Other leaves are sorted by rank (definition order in RPO), so equal
+// prefixes of different trees become common subexpressions for GVN.
+class Reassociation final
+{
+  using GraphTy = BasicBlockGraph;
+
+public:
+  void run(const GraphTy &graph)
+  {
+    m_ranks.clear();
+    m_numRewritten = 0;
+
+    std::vector<BinOp *> roots;
+    // Rank 0 is for constants
+    std::size_t rank = 1;
+    for (auto *const bb : graph::depthFirstSearchReversePostOrder(graph))
+      for (auto &inst : *bb)
+      {
+        m_ranks[&inst] = rank++;
+        if (isRoot(inst))
+          roots.push_back(static_cast<BinOp *>(&inst));
+      }
+
+    // Trees are rebuilt in definition order, so leaves are already final
+    for (auto *const root : roots)
+      rewrite(root);
+  }
+
+  // Number of rebuilt trees
+  [[nodiscard]] auto getNumRewritten() const noexcept
+  {
+    return m_numRewritten;
+  }
+
+private:
+  [[nodiscard]] static bool isAssociative(BinOp::Oper oper)
+  {
+    switch (oper)
+    {
+    case BinOp::Oper::kAdd:
+    case BinOp::Oper::kMul:
+    case BinOp::Oper::kOr:
+      return true;
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kEQ:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      return false;
+    }
+  }
+
+  // Booleans are not reassociated, arithmetic on them is not modular
+  [[nodiscard]] static bool isTreeNode(const Value *val, BinOp::Oper oper,
+                                       Type type)
+  {
+    if (!val->isInst() || val->getType() != type || type == Type::I1)
+      return false;
+    const auto *const inst = static_cast<const Inst *>(val);
+    return inst->getInstType() == InstType::kBinOp &&
+           static_cast<const BinOp *>(inst)->getOper() == oper &&
+           isAssociative(oper);
+  }
+
+  // Node is internal if its only user is the same operation in the same block
+  [[nodiscard]] static bool isInternal(const BinOp &node)
+  {
+    if (node.users().size() != 1)
+      return false;
+    const auto *const user = *node.users().begin();
+    return user->getBB() == node.getBB() &&
+           isTreeNode(user, node.getOper(), node.getType()) &&
+           user->inputAt(0) != user->inputAt(1);
+  }
+
+  [[nodiscard]] static bool isRoot(const Inst &inst)
+  {
+    if (inst.getInstType() != InstType::kBinOp)
+      return false;
+    const auto &binOp = static_cast<const BinOp &>(inst);
+    return isTreeNode(&binOp, binOp.getOper(), binOp.getType()) &&
+           !isInternal(binOp);
+  }
+
+  static void collectTree(BinOp *node, std::vector<Value *> &leaves,
+                          std::vector<BinOp *> &nodes)
+  {
+    nodes.push_back(node);
+    for (auto *const input : {node->getLeft(), node->getRight()})
+    {
+      if (isTreeNode(input, node->getOper(), node->getType()) &&
+          isInternal(*static_cast<BinOp *>(input)))
+        collectTree(static_cast<BinOp *>(input), leaves, nodes);
+      else
+        leaves.push_back(input);
+    }
+  }
+
+  [[nodiscard]] static std::int64_t eval(BinOp::Oper oper, std::int64_t lhs,
+                                         std::int64_t rhs)
+  {
+    // Modular arithmetic, result is truncated to the type later
+    const auto ulhs = static_cast<std::uint64_t>(lhs);
+    const auto urhs = static_cast<std::uint64_t>(rhs);
+    switch (oper)
+    {
+    case BinOp::Oper::kAdd:
+      return static_cast<std::int64_t>(ulhs + urhs);
+    case BinOp::Oper::kMul:
+      return static_cast<std::int64_t>(ulhs * urhs);
+    case BinOp::Oper::kOr:
+      return static_cast<std::int64_t>(ulhs | urhs);
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kEQ:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kShl:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      LJIT_UNREACHABLE("Operation is not associative");
+    }
+  }
+
+  // Value, which does not change the result
+  [[nodiscard]] static std::int64_t getIdentity(BinOp::Oper oper)
+  {
+    return oper == BinOp::Oper::kMul ? 1 : 0;
+  }
+
+  // Value, which makes the result constant
+  [[nodiscard]] static bool isAbsorbing(BinOp::Oper oper, std::int64_t val)
+  {
+    return (oper == BinOp::Oper::kMul && val == 0) ||
+           (oper == BinOp::Oper::kOr && val == -1);
+  }
+
+  [[nodiscard]] std::size_t getRank(const Value *val) const
+  {
+    if (tryRetrieveConst(val) != nullptr)
+      return 0;
+    const auto found = m_ranks.find(val);
+    LJIT_ASSERT(found != m_ranks.end());
+    return found->second;
+  }
+
+  // Tree is left-linear, its right operands are the given leaves
+  [[nodiscard]] static bool matches(const BinOp *root,
+                                    const std::vector<Value *> &operands)
+  {
+    const Value *node = root;
+    for (std::size_t idx = operands.size() - 1; idx != 0; --idx)
+    {
+      if (!node->isInst() || static_cast<const Inst *>(node)->getInstType() !=
+                               InstType::kBinOp)
+        return false;
+
+      const auto *const binOp = static_cast<const BinOp *>(node);
+      if (binOp->getRight() != operands[idx])
+        return false;
+      node = binOp->getLeft();
+    }
+    return node == operands.front();
+  }
+
+  void rewrite(BinOp *root)
+  {
+    std::vector<Value *> leaves;
+    std::vector<BinOp *> nodes;
+    collectTree(root, leaves, nodes);
+
+    const auto oper = root->getOper();
+    const auto type = root->getType();
+    std::vector<Value *> operands;
+    std::size_t numConsts = 0;
+    auto acc = getIdentity(oper);
+    for (auto *const leaf : leaves)
+    {
+      if (const auto *const cst = tryRetrieveConst(leaf); cst != nullptr)
+      {
+        acc = eval(oper, acc, retrieveConstVal(cst));
+        ++numConsts;
+      }
+      else
+        operands.push_back(leaf);
+    }
+    // Truncate to the width of type
+    acc = retrieveConstVal(makeConst(type, acc).get());
+
+    std::stable_sort(operands.begin(), operands.end(),
+                     [this](const Value *lhs, const Value *rhs) {
+                       return getRank(lhs) < getRank(rhs);
+                     });
+
+    const bool absorbed = isAbsorbing(oper, acc);
+    if (absorbed)
+      operands.clear();
+    const bool needConst =
+      absorbed || acc != getIdentity(oper) || operands.empty();
+
+    // Tree may be canonical already
+    if (!absorbed && numConsts <= 1 && needConst == (numConsts == 1))
+    {
+      auto expected = operands;
+      if (needConst)
+        expected.push_back(*std::find_if(
+          leaves.begin(), leaves.end(),
+          [](const Value *leaf) { return tryRetrieveConst(leaf) != nullptr; }));
+      if (matches(root, expected))
+        return;
+    }
+
+    auto *const bb = root->getBB();
+    if (needConst)
+      operands.push_back(bb->insertConstBefore(root, type, acc));
+
+    auto *res = operands.front();
+    for (auto it = std::next(operands.begin()); it != operands.end(); ++it)
+      res = bb->insertInstBefore<BinOp>(root, oper, res, *it);
+    if (operands.size() > 1)
+      m_ranks[res] = m_ranks[root];
+
+    res->setUsersFrom(*root);
+    for (auto *const node : nodes)
+      node->clearInputs();
+    for (auto *const node : nodes)
+      bb->eraseInst(node);
+    ++m_numRewritten;
+  }
+
+  std::unordered_map<const Value *, std::size_t> m_ranks{};
+  std::size_t m_numRewritten{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_REASSOCIATION_HH_INCLUDED */
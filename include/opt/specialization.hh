@@ -0,0 +1,178 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_SPECIALIZATION_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_SPECIALIZATION_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "common/error.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "opt/constant_folding.hh"
+#include "opt/dce.hh"
+
+namespace ljit
+{
+// Function specialization on constant arguments.
+// Callee is cloned once for each distinct set of constants passed to it.
+// Params of the clone are replaced w/ the constants, then the clone is
+// simplified w/ constant folding and DCE. Calls are redirected to the clones,
+// signature stays the same.
+class Specialization final
+{
+  // Constant value for each argument (if any)
+  using ArgsKey = std::vector<std::optional<std::int64_t>>;
+
+  Module *m_module{};
+  std::size_t m_maxClones{};
+
+public:
+  static constexpr std::size_t kDefaultMaxClones = 4;
+
+  explicit Specialization(Module *module,
+                          std::size_t maxClones = kDefaultMaxClones)
+    : m_module(module), m_maxClones(maxClones)
+  {}
+
+  void run()
+  {
+    m_clones.clear();
+    m_numClones.clear();
+    m_numRedirected = 0;
+
+    // Clones are appended to the module, they are not processed
+    std::vector<Function *> funcs;
+    for (const auto &func : *m_module)
+      funcs.push_back(func.get());
+
+    for (auto *const func : funcs)
+      specializeCalls(*func);
+  }
+
+  // Number of calls redirected to clones
+  [[nodiscard]] auto getNumRedirected() const noexcept
+  {
+    return m_numRedirected;
+  }
+
+private:
+  [[nodiscard]] static std::vector<Call *> collectCalls(const Function &func)
+  {
+    std::vector<Call *> res;
+    if (func.size() == 0)
+      return res;
+
+    graph::depthFirstSearchPreOrder(func.makeBBGraph(), [&res](auto *bb) {
+      for (auto &inst : *bb)
+        if (inst.getInstType() == InstType::kCall)
+          res.push_back(static_cast<Call *>(&inst));
+    });
+    return res;
+  }
+
+  [[nodiscard]] static std::optional<ArgsKey> makeKey(const Call &call)
+  {
+    ArgsKey key;
+    bool hasConst = false;
+    for (auto it = call.inputBegin(); it != call.inputEnd(); ++it)
+    {
+      const auto *const cst = tryRetrieveConst(*it);
+      if (cst == nullptr)
+      {
+        key.emplace_back();
+        continue;
+      }
+      key.emplace_back(retrieveConstVal(cst));
+      hasConst = true;
+    }
+
+    if (!hasConst)
+      return std::nullopt;
+    return key;
+  }
+
+  void specializeCalls(const Function &caller)
+  {
+    for (auto *const call : collectCalls(caller))
+    {
+      const auto *const callee = call->getCallee();
+      if (callee->size() == 0 || !call->verify())
+        continue;
+
+      const auto &key = makeKey(*call);
+      if (!key.has_value())
+        continue;
+
+      auto *const clone = getClone(callee, *key);
+      if (clone == nullptr)
+        continue;
+
+      call->setCallee(clone);
+      ++m_numRedirected;
+    }
+  }
+
+  Function *getClone(const Function *callee, const ArgsKey &key)
+  {
+    const auto [it, wasNew] = m_clones.try_emplace({callee, key}, nullptr);
+    if (!wasNew)
+      return it->second;
+
+    auto &num = m_numClones[callee];
+    if (num == m_maxClones)
+      return nullptr;
+
+    auto clone = specialize(*callee, key);
+    if (clone == nullptr)
+      return nullptr;
+
+    clone->setName(callee->getName() + ".spec" + std::to_string(num++));
+    it->second = m_module->addFunction(std::move(clone));
+    return it->second;
+  }
+
+  [[nodiscard]] static std::unique_ptr<Function> specialize(
+    const Function &callee, const ArgsKey &key)
+  {
+    auto clone = cloneFunction(callee);
+    auto *const entry = clone->makeBBGraph().getRoot();
+    for (auto &paramRef : entry->collectInsts(InstType::kParam))
+    {
+      auto &param = static_cast<Param &>(paramRef.get());
+      const auto &val = key.at(param.getIdx());
+      if (val.has_value())
+        entry->replaceInst(&param, makeConst(param.getType(), *val).release());
+    }
+
+    try
+    {
+      ConstantFolding{}.run(clone->makeBBGraph());
+    }
+    catch (const ArithmeticError &)
+    {
+      // Constants lead to invalid operation, keep the generic version
+      return nullptr;
+    }
+    DCE{clone.get()}.run();
+
+    return clone;
+  }
+
+  std::map<std::pair<const Function *, ArgsKey>, Function *> m_clones{};
+  std::unordered_map<const Function *, std::size_t> m_numClones{};
+  std::size_t m_numRedirected{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_SPECIALIZATION_HH_INCLUDED */
@@ -0,0 +1,372 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_STRENGTH_REDUCTION_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_STRENGTH_REDUCTION_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "analysis/induction.hh"
+#include "analysis/loop_analyzer.hh"
+#include "analysis/range_analysis.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/loop_utils.hh"
+
+namespace ljit
+{
+// Strength reduction and induction variables simplification.
+// Products of induction variable and constant are replaced w/ new induction
+// variables, which are updated by addition. Induction variables of the same
+// loop w/ equal start and step are merged. Multiplication by power of two is
+// replaced w/ left shift, so is division of non-negative value.
+class StrengthReduction final
+{
+  using GraphTy = BasicBlockGraph;
+  using Loops = LoopAnalyzer<GraphTy>;
+  using LoopInfo = typename Loops::LoopInfo;
+
+  struct Candidate final
+  {
+    BinOp *inst{};
+    const InductionVar *iv{};
+    std::int64_t factor{};
+  };
+
+  Function *m_func{};
+
+public:
+  explicit StrengthReduction(Function *func) : m_func(func)
+  {}
+
+  void run()
+  {
+    m_numReducedMuls = 0;
+    m_numRemovedIVs = 0;
+    m_numShifts = 0;
+
+    reduceIVMuls();
+    removeRedundantIVs();
+    reduceToShifts();
+  }
+
+  // Number of products replaced w/ additive recurrences
+  [[nodiscard]] auto getNumReducedMuls() const noexcept
+  {
+    return m_numReducedMuls;
+  }
+
+  [[nodiscard]] auto getNumRemovedIVs() const noexcept
+  {
+    return m_numRemovedIVs;
+  }
+
+  [[nodiscard]] auto getNumShifts() const noexcept
+  {
+    return m_numShifts;
+  }
+
+private:
+  [[nodiscard]] static std::optional<std::int64_t> getPowerOfTwo(
+    const Value *val)
+  {
+    const auto *const cst = tryRetrieveConst(val);
+    if (cst == nullptr)
+      return std::nullopt;
+
+    const auto num = retrieveConstVal(cst);
+    if (num <= 1 || (num & (num - 1)) != 0)
+      return std::nullopt;
+    return __builtin_ctzll(static_cast<unsigned long long>(num));
+  }
+
+  // Multiplication modulo 2^64, constants are truncated to their type anyway
+  [[nodiscard]] static std::int64_t wrapMul(std::int64_t lhs, std::int64_t rhs)
+  {
+    return static_cast<std::int64_t>(static_cast<std::uint64_t>(lhs) *
+                                     static_cast<std::uint64_t>(rhs));
+  }
+
+  [[nodiscard]] static Value *getIncoming(const Phi &phi,
+                                          const BasicBlock *pred)
+  {
+    for (const auto &entry : phi)
+      if (entry.bb == pred)
+        return entry.m_val;
+    LJIT_UNREACHABLE("No entry for predecessor");
+  }
+
+  // Arithmetic on booleans is left as is
+  [[nodiscard]] static std::vector<BinOp *> collectBinOps(const GraphTy &graph)
+  {
+    std::vector<BinOp *> res;
+    for (auto *const bb : graph::depthFirstSearchReversePostOrder(graph))
+      for (auto &inst : *bb)
+        if (inst.getInstType() == InstType::kBinOp &&
+            inst.getType() != Type::I1)
+          res.push_back(static_cast<BinOp *>(&inst));
+    return res;
+  }
+
+  static void replaceWith(Inst *inst, Inst *newInst)
+  {
+    newInst->setUsersFrom(*inst);
+    inst->clearInputs();
+    inst->getBB()->eraseInst(inst);
+  }
+
+  [[nodiscard]] static std::optional<Candidate> makeCandidate(
+    BinOp *inst, const Loops &loops, const InductionAnalyzer &ivs)
+  {
+    const auto *const lhsIV = ivs.getIV(inst->getLeft());
+    const auto *const rhsIV = ivs.getIV(inst->getRight());
+
+    Candidate cand{inst, nullptr, 0};
+    switch (inst->getOper())
+    {
+    case BinOp::Oper::kMul: {
+      const auto *const other =
+        tryRetrieveConst(lhsIV != nullptr ? inst->getRight() : inst->getLeft());
+      if (other == nullptr)
+        return std::nullopt;
+      cand.iv = lhsIV != nullptr ? lhsIV : rhsIV;
+      cand.factor = retrieveConstVal(other);
+      break;
+    }
+    case BinOp::Oper::kShl: {
+      const auto *const shamt = tryRetrieveConst(inst->getRight());
+      if (shamt == nullptr)
+        return std::nullopt;
+      const auto amount = retrieveConstVal(shamt);
+      // Factor should be representable in the type
+      constexpr std::int64_t kMaxShamt = 62;
+      if (amount < 1 || amount > kMaxShamt ||
+          (std::int64_t{1} << amount) > getTypeRange(inst->getType()).second)
+        return std::nullopt;
+      cand.iv = lhsIV;
+      cand.factor = std::int64_t{1} << amount;
+      break;
+    }
+    case BinOp::Oper::kAdd:
+    case BinOp::Oper::kSub:
+    case BinOp::Oper::kDiv:
+    case BinOp::Oper::kLE:
+    case BinOp::Oper::kEQ:
+    case BinOp::Oper::kShr:
+    case BinOp::Oper::kOr:
+    case BinOp::Oper::kBoundsCheck:
+    default:
+      return std::nullopt;
+    }
+
+    if (cand.iv == nullptr || cand.factor == 0 || cand.factor == 1)
+      return std::nullopt;
+
+    // Only products inside the loop are worth reducing
+    const auto *const loop = loops.getLoopInfo(cand.iv->phi->getBB());
+    if (!ivs.contains(loop, inst->getBB()))
+      return std::nullopt;
+    return cand;
+  }
+
+  void reduceIVMuls()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const Loops loops{graph};
+    const InductionAnalyzer ivs{loops};
+
+    std::vector<Candidate> candidates;
+    for (auto *const inst : collectBinOps(graph))
+      if (auto cand = makeCandidate(inst, loops, ivs); cand.has_value())
+        candidates.push_back(*cand);
+
+    // Equal products share the recurrence
+    std::map<std::pair<const Phi *, std::int64_t>, Phi *> recurrences;
+    for (const auto &cand : candidates)
+    {
+      auto &phi = recurrences[{cand.iv->phi, cand.factor}];
+      if (phi == nullptr)
+      {
+        const auto *const loop = loops.getLoopInfo(cand.iv->phi->getBB());
+        phi = makeRecurrence(*cand.iv, cand.factor, [&](const BasicBlock *bb) {
+          return ivs.contains(loop, bb);
+        });
+      }
+      if (phi == nullptr)
+        continue;
+
+      replaceWith(cand.inst, phi);
+      ++m_numReducedMuls;
+    }
+  }
+
+  // phi * factor = phi(start * factor, phi * factor + step * factor)
+  template <typename InLoop>
+  Phi *makeRecurrence(const InductionVar &iv, std::int64_t factor,
+                      InLoop inLoop)
+  {
+    auto *const header = iv.phi->getBB();
+    BasicBlock *const preheader =
+      getOrCreatePreheader(m_func, header, inLoop);
+    if (preheader == nullptr)
+      return nullptr;
+
+    const auto type = iv.phi->getType();
+    auto *const term = &preheader->getLast();
+    auto *const start = getIncoming(*iv.phi, preheader);
+    Value *init = nullptr;
+    if (const auto *const cst = tryRetrieveConst(start); cst != nullptr)
+      init = preheader->insertConstBefore(
+        term, type, wrapMul(retrieveConstVal(cst), factor));
+    else
+    {
+      auto *const factorVal = preheader->insertConstBefore(term, type, factor);
+      init = preheader->insertInstBefore<BinOp>(term, BinOp::Oper::kMul, start,
+                                                factorVal);
+    }
+
+    // Updated right after the original variable
+    auto *const updBB = iv.update->getBB();
+    auto *const pos = &*std::next(BasicBlock::iterator{iv.update});
+    auto *const phi = header->pushInstFront<Phi>(type);
+    auto *const step =
+      updBB->insertConstBefore(pos, type, wrapMul(iv.step, factor));
+    auto *const upd =
+      updBB->insertInstBefore<BinOp>(pos, BinOp::Oper::kAdd, phi, step);
+
+    for (const auto &entry : *iv.phi)
+      phi->addNode(entry.bb == preheader ? init : upd, entry.bb);
+    return phi;
+  }
+
+  [[nodiscard]] static bool sameStart(const Value *lhs, const Value *rhs)
+  {
+    if (lhs == rhs)
+      return true;
+    const auto *const lhsConst = tryRetrieveConst(lhs);
+    const auto *const rhsConst = tryRetrieveConst(rhs);
+    return lhsConst != nullptr && rhsConst != nullptr &&
+           lhsConst->getType() == rhsConst->getType() &&
+           retrieveConstVal(lhsConst) == retrieveConstVal(rhsConst);
+  }
+
+  void removeRedundantIVs()
+  {
+    const Loops loops{m_func->makeBBGraph()};
+    const InductionAnalyzer ivs{loops};
+
+    for (const auto *loop : loops.getLoopsInnerFirst())
+    {
+      std::vector<const InductionVar *> unique;
+      for (auto &phiRef : loop->getHeader()->collectInsts(InstType::kPhi))
+      {
+        const auto *const iv = ivs.getIV(&phiRef.get());
+        if (iv == nullptr)
+          continue;
+
+        const auto found =
+          std::find_if(unique.begin(), unique.end(), [iv](const auto *other) {
+            return other->phi->getType() == iv->phi->getType() &&
+                   other->step == iv->step &&
+                   sameStart(other->start, iv->start);
+          });
+        if (found == unique.end())
+        {
+          unique.push_back(iv);
+          continue;
+        }
+
+        mergeIVs(*iv, **found);
+        ++m_numRemovedIVs;
+      }
+    }
+  }
+
+  // Update of the redundant variable is computed from the kept one, so it
+  // stays valid at all its uses
+  static void mergeIVs(const InductionVar &redundant, const InductionVar &kept)
+  {
+    auto *const upd = redundant.update;
+    upd->setInput(upd->getLeft() == redundant.phi ? 0 : 1, kept.phi);
+
+    kept.phi->setUsersFrom(*redundant.phi);
+    redundant.phi->clearInputs();
+    redundant.phi->getBB()->eraseInst(redundant.phi);
+
+    if (upd->users().empty())
+    {
+      upd->clearInputs();
+      upd->getBB()->eraseInst(upd);
+    }
+  }
+
+  void reduceToShifts()
+  {
+    const auto graph = m_func->makeBBGraph();
+    const RangeAnalyzer ranges{graph};
+
+    for (auto *const inst : collectBinOps(graph))
+    {
+      auto *const bb = inst->getBB();
+      switch (inst->getOper())
+      {
+      case BinOp::Oper::kMul: {
+        auto shamt = getPowerOfTwo(inst->getRight());
+        auto *val = inst->getLeft();
+        if (!shamt.has_value())
+        {
+          shamt = getPowerOfTwo(inst->getLeft());
+          val = inst->getRight();
+        }
+        if (!shamt.has_value())
+          break;
+
+        auto *const shamtVal =
+          bb->insertConstBefore(inst, inst->getType(), *shamt);
+        replaceWith(inst, bb->insertInstBefore<BinOp>(
+                            inst, BinOp::Oper::kShl, val, shamtVal));
+        ++m_numShifts;
+        break;
+      }
+      case BinOp::Oper::kDiv: {
+        // Arithmetic shift rounds negative values down, not toward zero
+        const auto shamt = getPowerOfTwo(inst->getRight());
+        if (!shamt.has_value() || ranges.getInputRange(inst, 0).lo() < 0)
+          break;
+
+        auto *const shamtVal =
+          bb->insertConstBefore(inst, inst->getType(), *shamt);
+        replaceWith(inst,
+                    bb->insertInstBefore<BinOp>(inst, BinOp::Oper::kShr,
+                                                inst->getLeft(), shamtVal));
+        ++m_numShifts;
+        break;
+      }
+      case BinOp::Oper::kAdd:
+      case BinOp::Oper::kSub:
+      case BinOp::Oper::kLE:
+      case BinOp::Oper::kEQ:
+      case BinOp::Oper::kShr:
+      case BinOp::Oper::kShl:
+      case BinOp::Oper::kOr:
+      case BinOp::Oper::kBoundsCheck:
+      default:
+        break;
+      }
+    }
+  }
+
+  std::size_t m_numReducedMuls{};
+  std::size_t m_numRemovedIVs{};
+  std::size_t m_numShifts{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_STRENGTH_REDUCTION_HH_INCLUDED */
@@ -0,0 +1,400 @@
+#ifndef LEECH_JIT_INCLUDE_OPT_SWITCH_LOWERING_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_OPT_SWITCH_LOWERING_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "opt/dce.hh"
+
+namespace ljit
+{
+struct SwitchLoweringParams final
+{
+  // Minimal number of ranges (of cases w/ the same target) in a jump table
+  std::size_t minJumpTableCases{4};
+  // Minimal percentage of table entries, which do not go to the default
+  std::size_t minJumpTableDensity{40};
+  // Minimal number of cases in a bit test cluster
+  std::size_t minBitTestCases{3};
+  // Maximal number of distinct targets in a bit test cluster
+  std::size_t maxBitTestTargets{3};
+};
+
+// Switch lowering.
+// Cases are split into clusters by density: dense ones are kept as smaller
+// switches (emitted as jump tables by the code generator), cases of few
+// targets in a narrow range are checked w/ bit masks and the rest are ranges
+// of consecutive values w/ the same target. Clusters are dispatched by the
+// binary decision tree of comparisons.
+class SwitchLowering final
+{
+public:
+  enum class ClusterKind
+  {
+    kRange,
+    kJumpTable,
+    kBitTest,
+  };
+
+  struct Cluster final
+  {
+    ClusterKind kind{};
+    std::int64_t lo{};
+    std::int64_t hi{};
+    std::vector<Switch::Case> cases{};
+  };
+
+private:
+  // Bit of the case is shifted to the sign, so shift amount is less than 63
+  static constexpr std::uint64_t kBitTestWidth = 63;
+
+  Function *m_func{};
+  SwitchLoweringParams m_params{};
+
+public:
+  explicit SwitchLowering(Function *func,
+                          const SwitchLoweringParams &params = {})
+    : m_func(func), m_params(params)
+  {}
+
+  void run()
+  {
+    m_numLowered = 0;
+    m_numJumpTables = 0;
+    m_numBitTests = 0;
+
+    std::vector<Switch *> switches;
+    for (auto *const bb :
+         graph::depthFirstSearchPreOrder(m_func->makeBBGraph()))
+      if (!bb->empty() && bb->getLast().getInstType() == InstType::kSwitch)
+        switches.push_back(static_cast<Switch *>(&bb->getLast()));
+
+    for (auto *const sw : switches)
+      lower(*sw);
+  }
+
+  [[nodiscard]] auto getNumLowered() const noexcept
+  {
+    return m_numLowered;
+  }
+
+  [[nodiscard]] auto getNumJumpTables() const noexcept
+  {
+    return m_numJumpTables;
+  }
+
+  [[nodiscard]] auto getNumBitTests() const noexcept
+  {
+    return m_numBitTests;
+  }
+
+  // Clusters in ascending order, cases going to the default are dropped
+  [[nodiscard]] static std::vector<Cluster> clusterize(
+    const Switch &sw, const SwitchLoweringParams &params)
+  {
+    std::vector<Switch::Case> cases;
+    std::copy_if(sw.getCases().begin(), sw.getCases().end(),
+                 std::back_inserter(cases),
+                 [&sw](const Switch::Case &cs) {
+                   return cs.target != sw.getDefault();
+                 });
+
+    std::vector<Cluster> res;
+    for (std::size_t first = 0; first < cases.size();)
+    {
+      // Cluster is chosen only if it covers more than the plain range
+      auto kind = ClusterKind::kRange;
+      auto last = findRange(cases, first);
+      if (const auto tableEnd = findJumpTable(cases, first, params);
+          tableEnd > last)
+      {
+        kind = ClusterKind::kJumpTable;
+        last = tableEnd;
+      }
+      else if (const auto testEnd = findBitTest(cases, first, params);
+               testEnd > last)
+      {
+        kind = ClusterKind::kBitTest;
+        last = testEnd;
+      }
+
+      const auto begin =
+        std::next(cases.begin(), static_cast<std::ptrdiff_t>(first));
+      const auto end =
+        std::next(cases.begin(), static_cast<std::ptrdiff_t>(last));
+      res.push_back(Cluster{kind, begin->val, std::prev(end)->val,
+                            std::vector<Switch::Case>(begin, end)});
+      first = last;
+    }
+
+    return res;
+  }
+
+private:
+  [[nodiscard]] static std::uint64_t getSpan(std::int64_t lo, std::int64_t hi)
+  {
+    return static_cast<std::uint64_t>(hi) - static_cast<std::uint64_t>(lo);
+  }
+
+  // Consecutive values w/ the same target
+  [[nodiscard]] static std::size_t findRange(
+    const std::vector<Switch::Case> &cases, std::size_t first)
+  {
+    auto last = first + 1;
+    while (last < cases.size() &&
+           cases[last].val == cases[last - 1].val + 1 &&
+           cases[last].target == cases[first].target)
+      ++last;
+    return last;
+  }
+
+  // The longest dense sequence of cases, returns first if there is no such.
+  // Table has to be better than a few range checks, so it is measured in
+  // ranges of consecutive values w/ the same target.
+  [[nodiscard]] static std::size_t findJumpTable(
+    const std::vector<Switch::Case> &cases, std::size_t first,
+    const SwitchLoweringParams &params)
+  {
+    // Starts of ranges of consecutive values w/ the same target
+    std::vector<std::size_t> starts;
+    for (auto idx = first; idx < cases.size(); idx = findRange(cases, idx))
+      starts.push_back(idx);
+
+    for (auto last = cases.size(); last > first; --last)
+    {
+      const auto numRanges = static_cast<std::size_t>(std::distance(
+        starts.begin(), std::lower_bound(starts.begin(), starts.end(), last)));
+      if (numRanges < params.minJumpTableCases)
+        break;
+
+      const std::uint64_t numCases = last - first;
+      const auto span = getSpan(cases[first].val, cases[last - 1].val);
+      // Check the span first to avoid overflow
+      if (span < numCases * 100 &&
+          (span + 1) * params.minJumpTableDensity <= numCases * 100)
+        return last;
+    }
+    return first;
+  }
+
+  // Cases fitting into the mask, returns first if they are too few
+  [[nodiscard]] static std::size_t findBitTest(
+    const std::vector<Switch::Case> &cases, std::size_t first,
+    const SwitchLoweringParams &params)
+  {
+    std::vector<const BasicBlock *> targets;
+    auto last = first;
+    for (; last < cases.size() &&
+           getSpan(cases[first].val, cases[last].val) < kBitTestWidth;
+         ++last)
+    {
+      const auto *const target = cases[last].target;
+      if (std::find(targets.begin(), targets.end(), target) != targets.end())
+        continue;
+      if (targets.size() == params.maxBitTestTargets)
+        break;
+      targets.push_back(target);
+    }
+    return last - first >= params.minBitTestCases ? last : first;
+  }
+
+  void lower(Switch &sw)
+  {
+    const auto clusters = clusterize(sw, m_params);
+    // Dense switch is lowered by the code generator
+    if (clusters.size() == 1 &&
+        clusters.front().kind == ClusterKind::kJumpTable &&
+        clusters.front().cases.size() == sw.numCases())
+      return;
+
+    auto *const bb = sw.getBB();
+    m_val = sw.getVal();
+    m_default = sw.getDefault();
+    const auto targets = sw.getTargets();
+    sw.clearInputs();
+    bb->eraseInst(&sw);
+
+    m_region = {bb};
+    const auto [lb, ub] = getTypeRange(m_val->getType());
+    lowerTree(bb, clusters.begin(), clusters.end(), lb, ub);
+    for (auto *const target : targets)
+      updatePhis(target, bb);
+    ++m_numLowered;
+  }
+
+  using ClusterIt = std::vector<Cluster>::const_iterator;
+
+  // Value is known to be in [lb, ub] in the block
+  void lowerTree(BasicBlock *bb, ClusterIt first, ClusterIt last,
+                 std::int64_t lb, std::int64_t ub)
+  {
+    if (first == last)
+    {
+      bb->pushInstBack<JumpInstr>(m_default);
+      return;
+    }
+    if (std::next(first) == last)
+    {
+      lowerCluster(bb, *first, lb, ub);
+      return;
+    }
+
+    const auto mid = std::next(first, std::distance(first, last) / 2);
+    auto *const left = makeBB();
+    auto *const right = makeBB();
+    // Pivot is greater than all values of the left part
+    emitBranch(bb, BinOp::Oper::kLE, mid->lo, left, right);
+    lowerTree(left, first, mid, lb, mid->lo - 1);
+    lowerTree(right, mid, last, mid->lo, ub);
+  }
+
+  void lowerCluster(BasicBlock *bb, const Cluster &cluster, std::int64_t lb,
+                    std::int64_t ub)
+  {
+    switch (cluster.kind)
+    {
+    case ClusterKind::kRange:
+      emitRangeCheck(bb, cluster, lb, ub, cluster.cases.front().target);
+      break;
+    case ClusterKind::kJumpTable:
+      // Out of range values go to the default anyway
+      bb->pushInstBack<Switch>(m_val, m_default, cluster.cases);
+      ++m_numJumpTables;
+      break;
+    case ClusterKind::kBitTest: {
+      auto *const testBB = makeBB();
+      emitRangeCheck(bb, cluster, lb, ub, testBB);
+      emitBitTests(testBB, cluster);
+      ++m_numBitTests;
+      break;
+    }
+    default:
+      LJIT_UNREACHABLE("Unknown cluster kind");
+    }
+  }
+
+  // Jump to inBB if the value is in cluster's range and to default otherwise
+  void emitRangeCheck(BasicBlock *bb, const Cluster &cluster, std::int64_t lb,
+                      std::int64_t ub, BasicBlock *inBB)
+  {
+    const bool checkLo = lb < cluster.lo;
+    const bool checkHi = cluster.hi < ub;
+    if (!checkLo && !checkHi)
+    {
+      bb->pushInstBack<JumpInstr>(inBB);
+      return;
+    }
+    if (cluster.lo == cluster.hi)
+    {
+      emitBranch(bb, BinOp::Oper::kEQ, cluster.lo, inBB, m_default);
+      return;
+    }
+
+    if (checkLo)
+    {
+      auto *const next = checkHi ? makeBB() : inBB;
+      emitBranch(bb, BinOp::Oper::kLE, cluster.lo, m_default, next);
+      bb = next;
+    }
+    if (checkHi)
+      emitBranch(bb, BinOp::Oper::kLE, cluster.hi + 1, inBB, m_default);
+  }
+
+  // Mask of the target has bit (63 - idx) set for each case w/ value
+  // (lo + idx), so mask << idx is negative iff the case is taken
+  void emitBitTests(BasicBlock *bb, const Cluster &cluster)
+  {
+    Value *idx = m_val;
+    if (m_val->getType() != Type::I64)
+      idx = bb->pushInstBack<Cast>(Type::I64, m_val);
+    idx = bb->pushInstBack<BinOp>(BinOp::Oper::kSub, idx,
+                                  bb->pushConstBack(Type::I64, cluster.lo));
+
+    std::vector<std::pair<BasicBlock *, std::uint64_t>> masks;
+    for (const auto &cs : cluster.cases)
+    {
+      const auto bit = std::uint64_t{1}
+                       << (kBitTestWidth - getSpan(cluster.lo, cs.val));
+      const auto found = std::find_if(
+        masks.begin(), masks.end(),
+        [&cs](const auto &mask) { return mask.first == cs.target; });
+      if (found == masks.end())
+        masks.emplace_back(cs.target, bit);
+      else
+        found->second |= bit;
+    }
+
+    for (auto it = masks.begin(); it != masks.end(); ++it)
+    {
+      auto *const next =
+        std::next(it) == masks.end() ? m_default : makeBB();
+      auto *const mask =
+        bb->pushConstBack(Type::I64, static_cast<std::int64_t>(it->second));
+      auto *const shifted =
+        bb->pushInstBack<BinOp>(BinOp::Oper::kShl, mask, idx);
+      auto *const cmp = bb->pushInstBack<BinOp>(
+        BinOp::Oper::kLE, shifted, bb->pushConstBack(Type::I64, 0));
+      bb->pushInstBack<IfInstr>(cmp, it->first, next);
+      bb = next;
+    }
+  }
+
+  // if (val oper cst) trueBB else falseBB
+  void emitBranch(BasicBlock *bb, BinOp::Oper oper, std::int64_t cst,
+                  BasicBlock *trueBB, BasicBlock *falseBB)
+  {
+    auto *const cmp = bb->pushInstBack<BinOp>(
+      oper, m_val, bb->pushConstBack(m_val->getType(), cst));
+    bb->pushInstBack<IfInstr>(cmp, trueBB, falseBB);
+  }
+
+  BasicBlock *makeBB()
+  {
+    auto *const bb = m_func->appendBB();
+    m_region.insert(bb);
+    return bb;
+  }
+
+  // Phi entry for the switch block is copied for each new predecessor
+  void updatePhis(BasicBlock *target, const BasicBlock *switchBB)
+  {
+    std::vector<std::pair<Phi *, Value *>> incoming;
+    for (auto &phiRef : target->collectInsts(InstType::kPhi))
+    {
+      auto &phi = static_cast<Phi &>(phiRef.get());
+      const auto found =
+        std::find_if(phi.begin(), phi.end(), [switchBB](const auto &entry) {
+          return entry.bb == switchBB;
+        });
+      LJIT_ASSERT(found != phi.end());
+      incoming.emplace_back(&phi, found->m_val);
+    }
+
+    removePhiEntries(target, switchBB);
+    for (auto *const pred : target->getPred())
+      if (m_region.count(pred) != 0)
+        for (auto &[phi, val] : incoming)
+          phi->addNode(val, pred);
+  }
+
+  Value *m_val{};
+  BasicBlock *m_default{};
+  std::unordered_set<const BasicBlock *> m_region{};
+
+  std::size_t m_numLowered{};
+  std::size_t m_numJumpTables{};
+  std::size_t m_numBitTests{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_OPT_SWITCH_LOWERING_HH_INCLUDED */
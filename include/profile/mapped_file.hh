@@ -0,0 +1,133 @@
+#ifndef LEECH_JIT_INCLUDE_PROFILE_MAPPED_FILE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_PROFILE_MAPPED_FILE_HH_INCLUDED
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/error.hh"
+
+namespace ljit
+{
+// Whole file mapped into memory
+class MappedFile final
+{
+  void *m_data{};
+  std::size_t m_size{};
+
+public:
+  // Nothing is mapped
+  MappedFile() = default;
+
+  // Map the existing file for reading
+  static MappedFile openRead(const std::string &path)
+  {
+    const FileDesc fd{::open(path.c_str(), O_RDONLY)};
+    if (fd.get() < 0)
+      throw ProfileError{"Cannot open " + path};
+
+    struct stat st{};
+    if (::fstat(fd.get(), &st) != 0)
+      throw ProfileError{"Cannot stat " + path};
+
+    return MappedFile{fd.get(), static_cast<std::size_t>(st.st_size),
+                      PROT_READ, MAP_PRIVATE, path};
+  }
+
+  // Create (or truncate) the file of the given size and map it for writing
+  static MappedFile create(const std::string &path, std::size_t size)
+  {
+    const FileDesc fd{::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)};
+    if (fd.get() < 0)
+      throw ProfileError{"Cannot create " + path};
+    if (::ftruncate(fd.get(), static_cast<off_t>(size)) != 0)
+      throw ProfileError{"Cannot resize " + path};
+
+    return MappedFile{fd.get(), size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      path};
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  MappedFile(MappedFile &&other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr)),
+      m_size(std::exchange(other.m_size, 0))
+  {}
+
+  MappedFile &operator=(MappedFile &&other) noexcept
+  {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    return *this;
+  }
+
+  ~MappedFile()
+  {
+    if (m_data != nullptr)
+      ::munmap(m_data, m_size);
+  }
+
+  [[nodiscard]] auto *data() const noexcept
+  {
+    return static_cast<unsigned char *>(m_data);
+  }
+
+  [[nodiscard]] auto size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Flush changes of the shared mapping to the file
+  void sync() const
+  {
+    if (m_data != nullptr && ::msync(m_data, m_size, MS_SYNC) != 0)
+      throw ProfileError{"Cannot sync mapped file"};
+  }
+
+private:
+  class FileDesc final
+  {
+    int m_fd{-1};
+
+  public:
+    explicit FileDesc(int fd) : m_fd(fd)
+    {}
+    FileDesc(const FileDesc &) = delete;
+    FileDesc &operator=(const FileDesc &) = delete;
+    FileDesc(FileDesc &&) = delete;
+    FileDesc &operator=(FileDesc &&) = delete;
+    ~FileDesc()
+    {
+      if (m_fd >= 0)
+        ::close(m_fd);
+    }
+
+    [[nodiscard]] int get() const noexcept
+    {
+      return m_fd;
+    }
+  };
+
+  MappedFile(int fd, std::size_t size, int prot, int flags,
+             const std::string &path)
+    : m_size(size)
+  {
+    // Empty mappings are not allowed
+    if (size == 0)
+      return;
+
+    void *const data = ::mmap(nullptr, size, prot, flags, fd, 0);
+    if (data == MAP_FAILED)
+      throw ProfileError{"Cannot map " + path};
+    m_data = data;
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_PROFILE_MAPPED_FILE_HH_INCLUDED */
@@ -0,0 +1,237 @@
+#ifndef LEECH_JIT_INCLUDE_PROFILE_PROFILE_DATA_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_PROFILE_PROFILE_DATA_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/error.hh"
+#include "ir/function.hh"
+#include "ir/module.hh"
+#include "ir/profile.hh"
+#include "mapped_file.hh"
+
+namespace ljit
+{
+// FNV-1a hash of the function name and signature. It does not depend on the
+// function body, so it stays the same across runs and optimizations.
+[[nodiscard]] inline std::uint64_t getFunctionHash(const Function &func)
+{
+  std::uint64_t hash = 14695981039346656037ULL;
+  auto mix = [&hash](unsigned char byte) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  };
+
+  for (const char ch : func.getName())
+    mix(static_cast<unsigned char>(ch));
+  // Separates the name from the types
+  mix(0);
+  mix(static_cast<unsigned char>(func.getResType()));
+  for (const auto type : func.getArgs())
+    mix(static_cast<unsigned char>(type));
+  return hash;
+}
+
+// Profiles of the module functions keyed by function hash.
+// File layout: 8 byte magic, then unsigned LEB128 numbers: version, number
+// of functions and the function records:
+//   hash, #blocks, #branches, #calls,
+//   #blocks x (block id, count),
+//   #branches x (block id, true count, false count),
+//   #calls x (block id, call index, count)
+class ProfileData final
+{
+  std::map<std::uint64_t, FunctionProfile> m_profiles{};
+
+public:
+  static constexpr char kMagic[] = "LJITPROF";
+  static constexpr std::size_t kMagicSize = sizeof(kMagic) - 1;
+  static constexpr std::uint64_t kVersion = 1;
+
+  // Counts of the same function are summed
+  void add(std::uint64_t hash, const FunctionProfile &profile)
+  {
+    m_profiles[hash].merge(profile);
+  }
+
+  [[nodiscard]] const FunctionProfile *find(std::uint64_t hash) const
+  {
+    const auto found = m_profiles.find(hash);
+    return found == m_profiles.end() ? nullptr : &found->second;
+  }
+
+  [[nodiscard]] auto size() const noexcept
+  {
+    return m_profiles.size();
+  }
+
+  // Profiles attached to the module functions
+  [[nodiscard]] static ProfileData collect(const Module &module)
+  {
+    ProfileData res;
+    for (const auto &func : module)
+      if (const auto *const profile = func->getProfile(); profile != nullptr)
+        res.add(getFunctionHash(*func), *profile);
+    return res;
+  }
+
+  // Returns true if there is the profile for the function
+  bool attach(Function &func) const
+  {
+    const auto *const profile = find(getFunctionHash(func));
+    if (profile == nullptr)
+      return false;
+    func.setProfile(*profile);
+    return true;
+  }
+
+  // Returns the number of functions w/ attached profile
+  std::size_t attach(const Module &module) const
+  {
+    std::size_t res = 0;
+    for (const auto &func : module)
+      if (attach(*func))
+        ++res;
+    return res;
+  }
+
+  [[nodiscard]] std::vector<unsigned char> serialize() const
+  {
+    std::vector<unsigned char> res(kMagic, kMagic + kMagicSize);
+    auto put = [&res](std::uint64_t val) {
+      for (; val >= 0x80; val >>= 7)
+        res.push_back(static_cast<unsigned char>((val & 0x7f) | 0x80));
+      res.push_back(static_cast<unsigned char>(val));
+    };
+
+    put(kVersion);
+    put(m_profiles.size());
+    for (const auto &[hash, profile] : m_profiles)
+    {
+      put(hash);
+      put(profile.blockCounts.size());
+      put(profile.branchCounts.size());
+      put(profile.callCounts.size());
+      for (const auto &[id, count] : profile.blockCounts)
+      {
+        put(id);
+        put(count);
+      }
+      for (const auto &[id, counts] : profile.branchCounts)
+      {
+        put(id);
+        put(counts[0]);
+        put(counts[1]);
+      }
+      for (const auto &[site, count] : profile.callCounts)
+      {
+        put(site.first);
+        put(site.second);
+        put(count);
+      }
+    }
+    return res;
+  }
+
+  [[nodiscard]] static ProfileData deserialize(const unsigned char *data,
+                                               std::size_t size)
+  {
+    if (size < kMagicSize || std::memcmp(data, kMagic, kMagicSize) != 0)
+      throw ProfileError{"Bad profile magic"};
+
+    Reader reader{data + kMagicSize, data + size};
+    if (reader.get() != kVersion)
+      throw ProfileError{"Unsupported profile version"};
+
+    ProfileData res;
+    const auto numFuncs = reader.get();
+    for (std::uint64_t idx = 0; idx < numFuncs; ++idx)
+    {
+      const auto hash = reader.get();
+      const auto numBlocks = reader.get();
+      const auto numBranches = reader.get();
+      const auto numCalls = reader.get();
+
+      FunctionProfile profile;
+      for (std::uint64_t i = 0; i < numBlocks; ++i)
+      {
+        const auto id = reader.get();
+        profile.blockCounts[id] = reader.get();
+      }
+      for (std::uint64_t i = 0; i < numBranches; ++i)
+      {
+        const auto id = reader.get();
+        auto &counts = profile.branchCounts[id];
+        counts[0] = reader.get();
+        counts[1] = reader.get();
+      }
+      for (std::uint64_t i = 0; i < numCalls; ++i)
+      {
+        const auto id = reader.get();
+        const auto callIdx = reader.get();
+        profile.callCounts[{id, callIdx}] = reader.get();
+      }
+      res.add(hash, profile);
+    }
+
+    if (!reader.atEnd())
+      throw ProfileError{"Trailing data in profile"};
+    return res;
+  }
+
+  void write(const std::string &path) const
+  {
+    const auto bytes = serialize();
+    const auto file = MappedFile::create(path, bytes.size());
+    std::memcpy(file.data(), bytes.data(), bytes.size());
+    file.sync();
+  }
+
+  [[nodiscard]] static ProfileData read(const std::string &path)
+  {
+    const auto file = MappedFile::openRead(path);
+    return deserialize(file.data(), file.size());
+  }
+
+private:
+  class Reader final
+  {
+    const unsigned char *m_cur{};
+    const unsigned char *m_end{};
+
+  public:
+    Reader(const unsigned char *begin, const unsigned char *end)
+      : m_cur(begin), m_end(end)
+    {}
+
+    [[nodiscard]] bool atEnd() const noexcept
+    {
+      return m_cur == m_end;
+    }
+
+    std::uint64_t get()
+    {
+      std::uint64_t res = 0;
+      for (unsigned shift = 0;; shift += 7)
+      {
+        if (m_cur == m_end)
+          throw ProfileError{"Truncated profile"};
+        if (shift >= 64)
+          throw ProfileError{"Too long number in profile"};
+
+        const auto byte = *m_cur++;
+        res |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+          return res;
+      }
+    }
+  };
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_PROFILE_PROFILE_DATA_HH_INCLUDED */
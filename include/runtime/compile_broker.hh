@@ -0,0 +1,283 @@
+#ifndef LEECH_JIT_INCLUDE_RUNTIME_COMPILE_BROKER_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_RUNTIME_COMPILE_BROKER_HH_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "common/common.hh"
+#include "ir/function.hh"
+#include "runtime/mpsc_queue.hh"
+
+namespace ljit
+{
+class CompileTask final
+{
+  const Function *m_func{};
+  std::uint64_t m_hotness{};
+  const BasicBlock *m_osrHeader{};
+  std::atomic<bool> m_cancelled{};
+
+public:
+  CompileTask(const Function &func, std::uint64_t hotness,
+              const BasicBlock *osrHeader = nullptr)
+    : m_func(&func), m_hotness(hotness), m_osrHeader(osrHeader)
+  {}
+
+  [[nodiscard]] const Function &getFunc() const noexcept
+  {
+    return *m_func;
+  }
+
+  // Loop header of the on-stack replacement entry, null for the function
+  [[nodiscard]] const BasicBlock *getOsrHeader() const noexcept
+  {
+    return m_osrHeader;
+  }
+
+  [[nodiscard]] auto getHotness() const noexcept
+  {
+    return m_hotness;
+  }
+
+  // Compiler should not publish the code of the cancelled task
+  void cancel() noexcept
+  {
+    m_cancelled.store(true, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] bool isCancelled() const noexcept
+  {
+    return m_cancelled.load(std::memory_order_relaxed);
+  }
+};
+
+struct BrokerStats final
+{
+  std::size_t numSubmitted{};
+  std::size_t numRejected{};
+  std::size_t numCancelled{};
+  std::size_t numCompleted{};
+};
+
+// Pool of compiler threads.
+// Requests are pushed to the lock-free queue, so the executing thread never
+// waits for the compiler. Workers take turns in draining the queue into the
+// heap ordered by hotness and compile the hottest function first. Number of
+// not started requests is bounded, extra ones are rejected. Submitter takes
+// the lock only to wake up the sleeping worker.
+// Worker, which finds no requests after the compilation, calls the idle
+// function before the broker becomes idle, e.g. to publish the batched code.
+class CompileBroker final
+{
+  using TaskPtr = std::shared_ptr<CompileTask>;
+
+  struct HotnessLess final
+  {
+    bool operator()(const TaskPtr &lhs, const TaskPtr &rhs) const noexcept
+    {
+      return lhs->getHotness() < rhs->getHotness();
+    }
+  };
+
+public:
+  using CompileFunc = std::function<void(const CompileTask &)>;
+  using IdleFunc = std::function<void()>;
+
+  LJIT_NO_COPY_SEMANTICS(CompileBroker);
+  LJIT_NO_MOVE_SEMANTICS(CompileBroker);
+
+  CompileBroker(std::size_t numThreads, std::size_t maxDepth,
+                CompileFunc compile, IdleFunc onIdle = {})
+    : m_maxDepth(maxDepth),
+      m_compile(std::move(compile)),
+      m_onIdle(std::move(onIdle))
+  {
+    m_workers.reserve(numThreads);
+    for (std::size_t idx = 0; idx < numThreads; ++idx)
+      m_workers.emplace_back([this] { work(); });
+  }
+
+  // Not started requests are cancelled
+  ~CompileBroker()
+  {
+    {
+      const std::lock_guard lock{m_mutex};
+      m_stop = true;
+    }
+    m_wakeup.notify_all();
+    for (auto &worker : m_workers)
+      worker.join();
+
+    drainInbox();
+    for (; !m_ready.empty(); m_ready.pop())
+    {
+      m_ready.top()->cancel();
+      ++m_numCancelled;
+    }
+  }
+
+  // Null if the queue is full
+  TaskPtr submit(const Function &func, std::uint64_t hotness,
+                 const BasicBlock *osrHeader = nullptr)
+  {
+    auto depth = m_depth.load(std::memory_order_relaxed);
+    do
+    {
+      if (depth >= m_maxDepth)
+      {
+        m_numRejected.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+    } while (!m_depth.compare_exchange_weak(depth, depth + 1,
+                                            std::memory_order_relaxed));
+
+    auto task = std::make_shared<CompileTask>(func, hotness, osrHeader);
+    m_inbox.push(task);
+    m_numSubmitted.fetch_add(1, std::memory_order_relaxed);
+    // Pairs w/ the fence of the worker going to sleep: either it sees the
+    // task or the task is followed by the notification
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_numSleeping.load(std::memory_order_relaxed) != 0)
+    {
+      // Sleeping worker holds the lock until it waits
+      {
+        const std::lock_guard lock{m_mutex};
+      }
+      m_wakeup.notify_one();
+    }
+    return task;
+  }
+
+  // Wait until all submitted requests are processed
+  void waitIdle()
+  {
+    std::unique_lock lock{m_mutex};
+    m_idle.wait(lock,
+                [this] { return m_depth.load() == 0 && m_numRunning == 0; });
+  }
+
+  [[nodiscard]] BrokerStats getStats() const
+  {
+    const std::lock_guard lock{m_mutex};
+    return BrokerStats{m_numSubmitted.load(), m_numRejected.load(),
+                       m_numCancelled, m_numCompleted};
+  }
+
+private:
+  // Must be called under the lock: the queue has a single consumer
+  void drainInbox()
+  {
+    while (auto task = m_inbox.pop())
+      m_ready.push(std::move(*task));
+  }
+
+  void work()
+  {
+    std::unique_lock lock{m_mutex};
+    while (true)
+    {
+      drainInbox();
+      if (m_stop)
+        return;
+      if (m_ready.empty())
+      {
+        sleep(lock);
+        continue;
+      }
+
+      const auto task = m_ready.top();
+      m_ready.pop();
+      m_depth.fetch_sub(1);
+      if (task->isCancelled())
+      {
+        ++m_numCancelled;
+        m_idle.notify_all();
+        continue;
+      }
+
+      ++m_numRunning;
+      lock.unlock();
+      runTask(*task);
+      lock.lock();
+      drainInbox();
+      if (m_ready.empty() && m_onIdle)
+      {
+        lock.unlock();
+        runIdle();
+        lock.lock();
+      }
+      --m_numRunning;
+      ++(task->isCancelled() ? m_numCancelled : m_numCompleted);
+      m_idle.notify_all();
+    }
+  }
+
+  // Submitter locks and notifies only if there are sleeping workers
+  void sleep(std::unique_lock<std::mutex> &lock)
+  {
+    m_numSleeping.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    drainInbox();
+    if (m_ready.empty())
+      m_wakeup.wait(lock);
+    m_numSleeping.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void runTask(const CompileTask &task) const
+  {
+    try
+    {
+      m_compile(task);
+    }
+    catch (...)
+    {
+      // Worker must survive failures of the compiler
+    }
+  }
+
+  void runIdle() const
+  {
+    try
+    {
+      m_onIdle();
+    }
+    catch (...)
+    {
+      // Worker must survive failures of the idle function
+    }
+  }
+
+  std::size_t m_maxDepth{};
+  CompileFunc m_compile{};
+  IdleFunc m_onIdle{};
+  MPSCQueue<TaskPtr> m_inbox{};
+  // Submitted but not started tasks
+  std::atomic<std::size_t> m_depth{};
+  std::atomic<std::size_t> m_numSubmitted{};
+  std::atomic<std::size_t> m_numRejected{};
+  // Workers waiting for the tasks, changed under the lock
+  std::atomic<std::size_t> m_numSleeping{};
+
+  mutable std::mutex m_mutex{};
+  std::condition_variable m_wakeup{};
+  std::condition_variable m_idle{};
+  std::priority_queue<TaskPtr, std::vector<TaskPtr>, HotnessLess> m_ready{};
+  std::size_t m_numRunning{};
+  std::size_t m_numCancelled{};
+  std::size_t m_numCompleted{};
+  bool m_stop{};
+
+  // Started last and joined first
+  std::vector<std::thread> m_workers{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_RUNTIME_COMPILE_BROKER_HH_INCLUDED */
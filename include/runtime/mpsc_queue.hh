@@ -0,0 +1,68 @@
+#ifndef LEECH_JIT_INCLUDE_RUNTIME_MPSC_QUEUE_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_RUNTIME_MPSC_QUEUE_HH_INCLUDED
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+#include "common/common.hh"
+
+namespace ljit
+{
+// Lock-free queue w/ many producers and a single consumer (Vyukov's
+// algorithm). Producers link nodes after the head, the consumer unlinks them
+// from the tail, the last unlinked node serves as a stub.
+// Push may be not observed by pop until the producer links its node.
+template <typename T>
+class MPSCQueue final
+{
+  struct Node final
+  {
+    std::atomic<Node *> next{};
+    T value{};
+  };
+
+public:
+  LJIT_NO_COPY_SEMANTICS(MPSCQueue);
+  LJIT_NO_MOVE_SEMANTICS(MPSCQueue);
+
+  MPSCQueue() : m_head(new Node{}), m_tail(m_head.load())
+  {}
+
+  ~MPSCQueue()
+  {
+    while (pop().has_value())
+      ;
+    delete m_tail;
+  }
+
+  // May be called from any thread
+  void push(T value)
+  {
+    auto *const node = new Node{};
+    node->value = std::move(value);
+    auto *const prev = m_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // Must be called from one thread at a time
+  std::optional<T> pop()
+  {
+    auto *const tail = m_tail;
+    auto *const next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+      return std::nullopt;
+
+    auto res = std::move(next->value);
+    m_tail = next;
+    delete tail;
+    return res;
+  }
+
+private:
+  std::atomic<Node *> m_head;
+  Node *m_tail;
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_RUNTIME_MPSC_QUEUE_HH_INCLUDED */
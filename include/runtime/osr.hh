@@ -0,0 +1,456 @@
+#ifndef LEECH_JIT_INCLUDE_RUNTIME_OSR_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_RUNTIME_OSR_HH_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "analysis/liveness.hh"
+#include "analysis/loop_analyzer.hh"
+#include "codegen/codegen.hh"
+#include "common/common.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+namespace ljit
+{
+struct OsrEntry final
+{
+  // Continues the function from the start of the loop header
+  std::unique_ptr<Function> func{};
+  // Values of the source function passed as arguments, in order
+  std::vector<const Inst *> liveIns{};
+};
+
+// Builds the variant of the function entered in the middle of the loop.
+// Its entry block takes the values live at the header as parameters
+// (constants are rematerialized) and jumps to the copy of the header, phis
+// of the header get one more incoming value from it. Only the blocks
+// reachable from the header are copied. Source function is not changed.
+// Throws if some live value is redefined after the header, it holds for the
+// outermost loops.
+class OsrBuilder final
+{
+  const Function &m_func;
+  const BasicBlock *m_header{};
+
+public:
+  OsrBuilder(const Function &func, const BasicBlock &header)
+    : m_func(func), m_header(&header)
+  {}
+
+  [[nodiscard]] OsrEntry build()
+  {
+    // Liveness numbers the instructions, so it works on the copy
+    Function copy{m_func.getResType(), m_func.getArgs()};
+    Cloner copier;
+    copier.cloneBody(m_func, &copy);
+    auto *const header = copier.getBB(m_header);
+    if (header == nullptr)
+      throw std::runtime_error{"Loop header of " + m_func.getName() +
+                               " is unreachable"};
+
+    const auto toSource = mapToSource(copier);
+    const auto liveIns = collectLiveIns(copy, header);
+
+    OsrEntry res;
+    std::vector<Type> argTypes;
+    for (const auto *val : liveIns)
+      if (val->getInstType() != InstType::kConst)
+      {
+        argTypes.push_back(val->getType());
+        res.liveIns.push_back(toSource.at(val));
+      }
+
+    res.func = std::make_unique<Function>(m_func.getResType(), argTypes);
+    res.func->setName(m_func.getName() + ".osr");
+    auto *const entry = res.func->appendBB();
+
+    Cloner cloner;
+    std::vector<std::pair<Inst *, Param *>> headerPhis;
+    std::size_t argIdx = 0;
+    for (auto *val : liveIns)
+    {
+      if (val->getInstType() == InstType::kConst)
+        continue;
+      auto *const param =
+        entry->pushInstBack<Param>(argIdx++, val->getType());
+      if (val->getBB() == header)
+        headerPhis.emplace_back(val, param);
+      else
+        cloner.mapValue(val, param);
+    }
+    for (auto *val : liveIns)
+      if (val->getInstType() == InstType::kConst)
+        cloner.mapValue(
+          val, entry->pushConstBack(val->getType(), retrieveConstVal(val)));
+
+    cloner.cloneBlocks(
+      graph::depthFirstSearchReversePostOrder(BasicBlockGraph{header}),
+      res.func.get());
+    for (const auto &[phi, param] : headerPhis)
+      static_cast<Phi *>(cloner.getValue(phi))->addNode(param, entry);
+    entry->pushInstBack<JumpInstr>(cloner.getBB(header));
+    return res;
+  }
+
+private:
+  // Blocks are cloned instruction by instruction
+  [[nodiscard]] std::unordered_map<const Inst *, const Inst *> mapToSource(
+    const Cloner &copier) const
+  {
+    std::unordered_map<const Inst *, const Inst *> res;
+    for (const auto &bb : m_func)
+    {
+      const auto *const copyBB = copier.getBB(&bb);
+      if (copyBB == nullptr)
+        continue;
+      auto it = copyBB->begin();
+      for (const auto &inst : bb)
+        res.emplace(&*it++, &inst);
+    }
+    return res;
+  }
+
+  // Phis of the header go first, then the values defined before the loop
+  [[nodiscard]] std::vector<Inst *> collectLiveIns(Function &copy,
+                                                   BasicBlock *header) const
+  {
+    std::vector<Inst *> res;
+    for (auto &inst : *header)
+      if (inst.getInstType() == InstType::kPhi)
+        res.push_back(&inst);
+
+    const LivenessAnalyzer liveness{copy.makeBBGraph()};
+    std::unordered_set<const BasicBlock *> reachable;
+    graph::depthFirstSearchPreOrder(
+      BasicBlockGraph{header},
+      [&](const BasicBlock *bb) { reachable.insert(bb); });
+
+    const auto start = header->getLiveInterval().getStart();
+    for (auto &bb : copy)
+      for (auto &inst : bb)
+      {
+        if (!producesValue(inst) || inst.getBB() == header)
+          continue;
+        const auto interval = liveness.getLiveInterval(&inst);
+        if (!interval.has_value() || interval->getStart() > start ||
+            interval->getEnd() <= start)
+          continue;
+
+        if (reachable.count(&bb) != 0)
+          throw std::runtime_error{"Value live at the loop header of " +
+                                   m_func.getName() +
+                                   " is redefined in the loop"};
+        res.push_back(&inst);
+      }
+    return res;
+  }
+};
+
+// Deoptimization of the speculative code resumed at the loop headers.
+// Speculation moves guards out of the loops to the blocks jumping to their
+// headers. Failed guard there resumes the function by the OSR entry of the
+// loop w/ the values live at the header, if they are available. It is
+// correct when the code before the loop cannot trap, as the source function
+// would reach the header w/ the same values. Other guards of these blocks
+// restart the function, the rest ones are not speculative and trap.
+// Values of the entry are tracked through the optimizations of the copy.
+class DeoptPlanner final
+{
+  // Detached user of the values: passes replace the uses of the values they
+  // remove. DCE erases the dead ones w/o that, as it runs last, the values
+  // not in the function are erased.
+  class Tracker final : public Inst
+  {
+  public:
+    explicit Tracker(const std::vector<Value *> &vals)
+      : Inst(InstType::kUnknown)
+    {
+      for (auto *const val : vals)
+        addInput(val);
+    }
+
+    // None if some value is erased
+    [[nodiscard]] std::optional<std::vector<Value *>> release(
+      const std::unordered_set<const Value *> &alive)
+    {
+      auto vals = std::move(inputs());
+      inputs().clear();
+      bool erased = false;
+      for (auto *const val : vals)
+        if (alive.count(val) != 0)
+          val->users().erase(this);
+        else
+          erased = true;
+
+      if (erased)
+        return std::nullopt;
+      return vals;
+    }
+
+    void print([[maybe_unused]] std::ostream &ost) const override
+    {}
+  };
+
+  struct Resume final
+  {
+    std::int64_t id{};
+    // Header phis go first
+    std::size_t numPhis{};
+    std::unique_ptr<Tracker> tracker{};
+  };
+
+  // Tracked values of the optimized copy
+  struct Entry final
+  {
+    std::int64_t id{};
+    std::size_t numPhis{};
+    std::vector<Value *> vals{};
+  };
+
+  using Loops = LoopAnalyzer<BasicBlockGraph>;
+
+  const Function &m_func;
+  std::vector<BasicBlock *> m_order{};
+  std::vector<Resume> m_resumes{};
+
+public:
+  explicit DeoptPlanner(const Function &func) : m_func(func)
+  {
+    if (func.size() != 0)
+      m_order = graph::depthFirstSearchReversePostOrder(func.makeBBGraph());
+  }
+
+  // Loop header of the resumption point
+  [[nodiscard]] static const BasicBlock &getHeader(const Function &func,
+                                                   std::int64_t resume)
+  {
+    const auto &&order =
+      graph::depthFirstSearchReversePostOrder(func.makeBBGraph());
+    return *order.at(static_cast<std::size_t>(resume));
+  }
+
+  // Outermost loops w/o trapping code before them
+  [[nodiscard]] std::vector<const BasicBlock *> getResumableHeaders() const
+  {
+    std::vector<const BasicBlock *> res;
+    if (m_order.empty())
+      return res;
+
+    const Loops loops{m_func.makeBBGraph()};
+    for (const auto *const loop : loops.getLoopsInnerFirst())
+    {
+      const auto *const outer = loop->getOuterLoop();
+      if ((outer == nullptr || outer->isRoot()) &&
+          isTrapFreeBefore(*loop->getHeader()))
+        res.push_back(loop->getHeader());
+    }
+    return res;
+  }
+
+  // Values of the OSR entry of the loop (see OsrEntry) in the copy of the
+  // function, it is not optimized yet
+  void track(const BasicBlock &header, const std::vector<const Inst *> &liveIns,
+             const Cloner &cloner)
+  {
+    Resume resume;
+    const auto found = std::find(m_order.begin(), m_order.end(), &header);
+    LJIT_ASSERT(found != m_order.end());
+    resume.id = std::distance(m_order.begin(), found);
+
+    std::vector<Value *> vals;
+    for (const auto *const val : liveIns)
+    {
+      auto *const copy = cloner.getValue(const_cast<Inst *>(val));
+      if (copy == val)
+        return;
+      if (val->getBB() == &header && val->getInstType() == InstType::kPhi)
+        ++resume.numPhis;
+      vals.push_back(copy);
+    }
+    resume.tracker = std::make_unique<Tracker>(vals);
+    m_resumes.push_back(std::move(resume));
+  }
+
+  // Blocks of the optimized copy, whose guards deoptimize
+  [[nodiscard]] std::vector<DeoptBlock> plan(const Function &func)
+  {
+    std::vector<DeoptBlock> res;
+    if (func.size() == 0)
+      return res;
+
+    std::unordered_set<const Value *> alive;
+    for (const auto &bb : func)
+      for (const auto &inst : bb)
+        alive.insert(&inst);
+
+    std::unordered_map<const BasicBlock *, Entry> entries;
+    for (auto &resume : m_resumes)
+    {
+      auto vals = resume.tracker->release(alive);
+      if (!vals.has_value())
+        continue;
+      const auto *const header = findHeader(*vals, resume.numPhis);
+      if (header != nullptr)
+        entries.emplace(header,
+                        Entry{resume.id, resume.numPhis, std::move(*vals)});
+    }
+    m_resumes.clear();
+
+    const Loops loops{func.makeBBGraph()};
+    for (const auto *const loop : loops.getLoopsInnerFirst())
+    {
+      const auto &&body = loop->getLinearOrder();
+      const std::unordered_set<const BasicBlock *> inLoop{body.begin(),
+                                                          body.end()};
+      const auto *const header = loop->getHeader();
+
+      DeoptBlock block;
+      if (const auto found = entries.find(header); found != entries.end())
+        if (auto vals = getEntryValues(*header, inLoop, found->second);
+            vals.has_value())
+        {
+          block.resume = found->second.id;
+          block.values = std::move(*vals);
+        }
+
+      for (const auto *const bb : collectJumpsTo(*header, inLoop))
+      {
+        block.bb = bb;
+        res.push_back(block);
+      }
+    }
+    return res;
+  }
+
+private:
+  [[nodiscard]] static bool mayTrapOrCall(const Inst &inst)
+  {
+    switch (inst.getInstType())
+    {
+    case InstType::kCall:
+    case InstType::kUnaryOp:
+      return true;
+    case InstType::kBinOp:
+      return mayTrap(static_cast<const BinOp &>(inst));
+    case InstType::kUnknown:
+    case InstType::kIf:
+    case InstType::kSwitch:
+    case InstType::kConst:
+    case InstType::kJump:
+    case InstType::kRet:
+    case InstType::kCast:
+    case InstType::kSelect:
+    case InstType::kPhi:
+    case InstType::kParam:
+    default:
+      return false;
+    }
+  }
+
+  // Blocks reachable w/o passing the header
+  [[nodiscard]] bool isTrapFreeBefore(const BasicBlock &header) const
+  {
+    std::unordered_set<const BasicBlock *> visited{&header};
+    std::vector<const BasicBlock *> toVisit{m_order.front()};
+    while (!toVisit.empty())
+    {
+      const auto *const bb = toVisit.back();
+      toVisit.pop_back();
+      if (!visited.insert(bb).second)
+        continue;
+
+      if (std::any_of(bb->begin(), bb->end(), mayTrapOrCall))
+        return false;
+      for (const auto *const succ : bb->getSucc())
+        toVisit.push_back(succ);
+    }
+    return true;
+  }
+
+  // Phis of the header are still there, unless they are replaced
+  [[nodiscard]] static const BasicBlock *findHeader(
+    const std::vector<Value *> &vals, std::size_t numPhis)
+  {
+    for (std::size_t idx = 0; idx < numPhis; ++idx)
+    {
+      const auto *const inst = static_cast<const Inst *>(vals[idx]);
+      if (inst->getInstType() == InstType::kPhi)
+        return inst->getBB();
+    }
+    return nullptr;
+  }
+
+  // Values entering the header from the only outside predecessor
+  [[nodiscard]] static std::optional<std::vector<const Value *>>
+  getEntryValues(const BasicBlock &header,
+                 const std::unordered_set<const BasicBlock *> &inLoop,
+                 const Entry &entry)
+  {
+    std::vector<const BasicBlock *> outside;
+    std::copy_if(
+      header.getPred().begin(), header.getPred().end(),
+      std::back_inserter(outside),
+      [&inLoop](const auto *pred) { return inLoop.count(pred) == 0; });
+    if (outside.size() != 1)
+      return std::nullopt;
+
+    std::vector<const Value *> res;
+    for (std::size_t idx = 0; idx < entry.vals.size(); ++idx)
+    {
+      const Value *val = entry.vals[idx];
+      const auto *const inst = static_cast<const Inst *>(val);
+      if (idx < entry.numPhis && inst->getBB() == &header &&
+          inst->getInstType() == InstType::kPhi)
+      {
+        const auto &phi = static_cast<const Phi &>(*inst);
+        const auto found =
+          std::find_if(phi.begin(), phi.end(), [&](const auto &phiEntry) {
+            return phiEntry.bb == outside.front();
+          });
+        if (found == phi.end())
+          return std::nullopt;
+        val = found->m_val;
+      }
+      else if (inLoop.count(inst->getBB()) != 0)
+        return std::nullopt;
+      res.push_back(val);
+    }
+    return res;
+  }
+
+  // Blocks outside the loop reaching its header through the jumps
+  [[nodiscard]] static std::vector<const BasicBlock *> collectJumpsTo(
+    const BasicBlock &header,
+    const std::unordered_set<const BasicBlock *> &inLoop)
+  {
+    std::vector<const BasicBlock *> res;
+    auto addPreds = [&](const BasicBlock &bb) {
+      for (const auto *const pred : bb.getPred())
+        if (pred->numSucc() == 1 && inLoop.count(pred) == 0 &&
+            std::find(res.begin(), res.end(), pred) == res.end())
+          res.push_back(pred);
+    };
+
+    addPreds(header);
+    for (std::size_t idx = 0; idx < res.size(); ++idx)
+      addPreds(*res[idx]);
+    return res;
+  }
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_RUNTIME_OSR_HH_INCLUDED */
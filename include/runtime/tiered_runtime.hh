@@ -0,0 +1,803 @@
+#ifndef LEECH_JIT_INCLUDE_RUNTIME_TIERED_RUNTIME_HH_INCLUDED
+#define LEECH_JIT_INCLUDE_RUNTIME_TIERED_RUNTIME_HH_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "codegen/aot_cache.hh"
+#include "codegen/code_cache.hh"
+#include "codegen/codegen.hh"
+#include "codegen/exec_memory.hh"
+#include "codegen/stubs.hh"
+#include "common/common.hh"
+#include "common/error.hh"
+#include "interp/interpreter.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/structural_hash.hh"
+#include "opt/constant_folding.hh"
+#include "opt/dce.hh"
+#include "opt/guard_hoisting.hh"
+#include "opt/gvn.hh"
+#include "opt/inlining.hh"
+#include "opt/licm.hh"
+#include "opt/peephole.hh"
+#include "runtime/compile_broker.hh"
+#include "runtime/osr.hh"
+
+namespace ljit
+{
+struct TieringParams final
+{
+  std::uint64_t callThreshold{1000};
+  std::uint64_t backEdgeThreshold{10000};
+  InlineParams inlineParams{};
+  // Zero means compilation in the executing thread
+  std::size_t numCompilerThreads{1};
+  std::size_t maxQueueDepth{64};
+  // Iterations of the loop before its on-stack replacement
+  std::uint64_t osrThreshold{20000};
+  // Deoptimizations before the code is recompiled w/o speculation
+  std::size_t maxDeopts{8};
+  CodeCacheParams codeCache{};
+  // File of the AOT code cache, it is loaded on construction if exists
+  std::string aotCache{};
+};
+
+enum class Tier : std::uint8_t
+{
+  kInterpreter,
+  kCompiled,
+};
+
+struct TieringStats final
+{
+  using Duration = std::chrono::steady_clock::duration;
+
+  Duration interpTime{};
+  Duration compiledTime{};
+  // Summed over the compiler threads
+  Duration compileTime{};
+  std::size_t numCompiled{};
+  std::size_t numFailed{};
+  std::size_t numOsrCompiled{};
+  std::size_t numOsrEntries{};
+  std::size_t numDeopts{};
+  // Taken from the AOT code cache instead of compiling
+  std::size_t numAotLoaded{};
+};
+
+// Optimizing pipeline of the top tier.
+// Speculative code moves checks out of loops regardless of the trapping
+// instructions and exits in between, it must deoptimize on failed checks.
+inline void optimizeFunction(Function &func, const InlineParams &params = {},
+                             bool speculative = false)
+{
+  Inlining{&func, params}.run();
+  ConstantFolding{}.run(func.makeBBGraph());
+  PeepHole{}.run(func.makeBBGraph());
+  GVN{}.run(func.makeBBGraph());
+  GuardHoisting{&func, speculative}.run();
+  LICM{&func, speculative}.run();
+  DCE{&func}.run();
+}
+
+// Runtime w/ two tiers: the interpreter and the optimized machine code.
+// Every function has an entry cell, compiled calls jump through it. The cell
+// points to a stub entering the interpreter until the function gets hot,
+// then to its compiled code. Calls from the interpreter switch to the
+// compiled code as well.
+// Hot loop of the interpreted function is continued by the code compiled
+// for its header (see OsrBuilder), the live values are taken from the
+// interpreter frame.
+// Traps of the compiled code are thrown as TrapError by the call entering it
+// (see TrapScope).
+// Hot functions are compiled by the broker threads, each one works on its
+// own copy of the IR. The code is published by the atomic store to the entry
+// cell. Functions are executed by a single thread.
+// Code of the functions, which have not trapped in the interpreter, is
+// speculative. Its failed checks hoisted out of the loops deoptimize: the
+// unoptimized function is interpreted from the loop header (see
+// DeoptPlanner) or from the start, it is correct as the IR has no side
+// effects.
+// After maxDeopts the code is dropped and the function warms up again to be
+// recompiled w/o speculation.
+// Compiled code lives in the code cache. It is collected before the top-level
+// call, when no compiled code runs: evicted functions fall back to the
+// interpreter and warm up again. Broker threads share the pages of the cache
+// between the functions: the code is published once the page is filled or
+// the broker runs out of requests.
+// If there is the AOT code cache, the code of the previous runs is found by
+// the structural hash of the function and the compiler settings. It is
+// installed instead of compiling when the function gets hot.
+class TieredRuntime final : public TierHook
+{
+  using Word = std::int64_t;
+  using Clock = std::chrono::steady_clock;
+
+  struct CodeState
+  {
+    TieredRuntime *rt{};
+    std::atomic<const void *> entry{};
+    // Value of the entry w/o compiled code
+    const void *noCode{};
+    // Code is requested once until it is dropped
+    std::atomic<bool> queued{};
+    // Last request to the broker, used by the executing thread only
+    std::shared_ptr<CompileTask> task{};
+    std::atomic<bool> speculate{true};
+    ExecMemory adapter{};
+    // Set by the compiler before the code is published
+    std::atomic<CodeCache::BlobId> code{CodeCache::kNoBlob};
+    // Interpreted on deoptimization
+    const Function *source{};
+    std::size_t numDeopts{};
+
+    [[nodiscard]] bool isCompiled() const noexcept
+    {
+      return entry.load(std::memory_order_acquire) != noCode;
+    }
+  };
+
+  struct FuncState final : public CodeState
+  {
+    ExecMemory stub{};
+  };
+
+  struct OsrState final : public CodeState
+  {
+    // Unoptimized variant of the function, built by the first compile of
+    // the loop or of the function (see buildOsrEntry)
+    std::once_flag built{};
+    std::unique_ptr<Function> func{};
+    std::vector<const Inst *> liveIns{};
+    // Frame slots of the live values, filled on the first entry
+    std::vector<std::uint32_t> slots{};
+  };
+
+  // Compiled code reads the cell w/ plain loads
+  static_assert(std::atomic<const void *>::is_always_lock_free &&
+                sizeof(std::atomic<const void *>) == sizeof(const void *));
+
+  enum class State : std::uint8_t
+  {
+    kIdle,
+    kInterpreter,
+    kCompiled,
+    kCompiling,
+  };
+
+  // Accounts the time to the state
+  class StateScope final
+  {
+    TieredRuntime &m_rt;
+    State m_prev{};
+
+  public:
+    StateScope(TieredRuntime &rt, State state)
+      : m_rt(rt), m_prev(rt.switchState(state))
+    {}
+    LJIT_NO_COPY_SEMANTICS(StateScope);
+    LJIT_NO_MOVE_SEMANTICS(StateScope);
+    ~StateScope()
+    {
+      m_rt.switchState(m_prev);
+    }
+  };
+
+public:
+  LJIT_NO_COPY_SEMANTICS(TieredRuntime);
+  LJIT_NO_MOVE_SEMANTICS(TieredRuntime);
+  // Requests in flight are not published
+  ~TieredRuntime() override
+  {
+    const std::lock_guard lock{m_funcsMutex};
+    for (auto &[func, state] : m_funcs)
+      cancelCompile(*state);
+    for (auto &[header, state] : m_osr)
+      cancelCompile(*state);
+  }
+
+  explicit TieredRuntime(const TieringParams &params = {})
+    : m_params(params), m_cache(params.codeCache)
+  {
+    if (!params.aotCache.empty())
+      try
+      {
+        m_aot.load(params.aotCache);
+      }
+      catch (const std::exception &)
+      {
+        // Missing or stale file is overwritten by saveAotCache
+      }
+    m_interp.setTierHook(this, params.callThreshold, params.backEdgeThreshold,
+                         params.osrThreshold);
+    if (params.numCompilerThreads != 0)
+      m_broker = std::make_unique<CompileBroker>(
+        params.numCompilerThreads, params.maxQueueDepth,
+        [this](const CompileTask &task) {
+          if (const auto *const header = task.getOsrHeader();
+              header != nullptr)
+            compileOsr(task.getFunc(), *header, &task);
+          else
+            compile(task.getFunc(), &task);
+        },
+        [this] { m_cache.flush(); });
+  }
+
+  Word run(const Function &func, const std::vector<Word> &args = {})
+  {
+    if (args.size() != func.getArgs().size())
+      throw std::runtime_error{"Wrong number of arguments for " +
+                               func.getName()};
+
+    std::vector<Word> wrapped(args.size());
+    for (std::size_t idx = 0; idx < args.size(); ++idx)
+      wrapped[idx] = Interpreter::wrap(func.getArgs()[idx],
+                                       static_cast<std::uint64_t>(args[idx]));
+
+    if (m_state == State::kIdle && m_cache.needsCollect())
+      m_cache.collect();
+    if (Word res{}; tryCallCompiled(func, wrapped.data(), res))
+      return res;
+
+    const StateScope scope{*this, State::kInterpreter};
+    return m_interp.run(func, wrapped);
+  }
+
+  bool onHot(const Function &func, std::uint64_t hotness) override
+  {
+    // Resumes the deoptimized code only, its loops are still compiled
+    if (isOsrVariant(func))
+      return true;
+
+    auto &state = getState(func);
+    if (state.queued.exchange(true))
+      return true;
+    if (m_interp.getCode(func).numTraps != 0)
+      state.speculate = false;
+
+    if (m_broker == nullptr)
+    {
+      const StateScope scope{*this, State::kCompiling};
+      compile(func, nullptr);
+      return true;
+    }
+
+    state.task = m_broker->submit(func, hotness);
+    if (state.task != nullptr)
+      return true;
+    state.queued = false;
+    return false;
+  }
+
+  bool tryCallCompiled(const Function &callee, const Word *args,
+                       Word &res) override
+  {
+    const auto *const state = findState(callee);
+    if (state == nullptr || !state->isCompiled())
+      return false;
+
+    m_cache.touch(state->code);
+    const StateScope scope{*this, State::kCompiled};
+    ArrayCall adapter = nullptr;
+    const auto *const code = state->adapter.data();
+    std::memcpy(&adapter, &code, sizeof(adapter));
+    res = TrapScope::call([adapter, args] { return adapter(args); });
+    return true;
+  }
+
+  bool tryEnterOsr(const BytecodeFunction &func, std::size_t loopIdx,
+                   const Word *frame, Word &res) override
+  {
+    const auto &header = *func.loops.at(loopIdx).header;
+    auto &osr = getOsrState(header);
+    if (!osr.queued.exchange(true))
+    {
+      if (func.numTraps != 0)
+        osr.speculate = false;
+      requestOsr(*func.func, header, func.numBackEdges);
+    }
+    if (!osr.isCompiled())
+      return false;
+
+    if (osr.slots.size() != osr.liveIns.size())
+      for (const auto *const val : osr.liveIns)
+        osr.slots.push_back(func.slots.at(val));
+    std::vector<Word> args(osr.slots.size());
+    for (std::size_t idx = 0; idx < args.size(); ++idx)
+      args[idx] = frame[osr.slots[idx]];
+
+    {
+      const std::lock_guard lock{m_statsMutex};
+      ++m_stats.numOsrEntries;
+    }
+    m_cache.touch(osr.code);
+    const StateScope scope{*this, State::kCompiled};
+    ArrayCall adapter = nullptr;
+    const auto *const code = osr.adapter.data();
+    std::memcpy(&adapter, &code, sizeof(adapter));
+    const auto *const live = args.data();
+    res = TrapScope::call([adapter, live] { return adapter(live); });
+    return true;
+  }
+
+  // Writes the compiled code to the AOT code cache
+  void saveAotCache() const
+  {
+    if (m_params.aotCache.empty())
+      throw std::runtime_error{"No AOT code cache file"};
+    m_aot.save(m_params.aotCache);
+  }
+
+  // Wait for the compiler to finish all requests
+  void waitForCompiles()
+  {
+    if (m_broker != nullptr)
+      m_broker->waitIdle();
+  }
+
+  [[nodiscard]] Tier getTier(const Function &func) const
+  {
+    const auto *const state = findState(func);
+    return state == nullptr || !state->isCompiled() ? Tier::kInterpreter
+                                                    : Tier::kCompiled;
+  }
+
+  [[nodiscard]] TieringStats getStats() const
+  {
+    const std::lock_guard lock{m_statsMutex};
+    return m_stats;
+  }
+
+  [[nodiscard]] CodeCacheStats getCodeCacheStats() const
+  {
+    return m_cache.getStats();
+  }
+
+  [[nodiscard]] BrokerStats getBrokerStats() const
+  {
+    return m_broker == nullptr ? BrokerStats{} : m_broker->getStats();
+  }
+
+  [[nodiscard]] auto &getInterpreter() noexcept
+  {
+    return m_interp;
+  }
+
+private:
+  // Compiled code calls it through the interpreter entry stub
+  static Word enterInterpreter(void *ctx, const Function *func,
+                               const Word *args)
+  {
+    auto &rt = *static_cast<TieredRuntime *>(ctx);
+    // Exceptions cannot be thrown through the compiled frames, traps are
+    // raised again after the interpreter frames are left
+    TrapKind kind{};
+    try
+    {
+      const StateScope scope{rt, State::kInterpreter};
+      return rt.m_interp.run(*func, args, func->getArgs().size());
+    }
+    catch (const TrapError &err)
+    {
+      kind = err.getKind();
+    }
+    catch (const std::exception &err)
+    {
+      LJIT_PRINT_ERR("Error in interpreted code: %s\n", err.what());
+      LJIT_ABORT();
+    }
+    TrapScope::raise(kind);
+  }
+
+  // Compiled code calls it on failed checks
+  static Word deoptimize(void *ctx, Word resume, const Word *vals)
+  {
+    auto &state = *static_cast<CodeState *>(ctx);
+    auto &rt = *state.rt;
+    rt.onDeopt(state);
+    if (resume == kNoResume)
+      return enterInterpreter(&rt, state.source, vals);
+
+    const Function *resumed = nullptr;
+    try
+    {
+      resumed = &rt.getResumed(*state.source, resume);
+    }
+    catch (const std::exception &err)
+    {
+      LJIT_PRINT_ERR("Cannot resume %s: %s\n", state.source->getName().c_str(),
+                     err.what());
+      LJIT_ABORT();
+    }
+    return enterInterpreter(&rt, resumed, vals);
+  }
+
+  // Continues the function from the loop header
+  const Function &getResumed(const Function &func, Word resume)
+  {
+    const auto &header = DeoptPlanner::getHeader(func, resume);
+    auto &osr = getOsrState(header);
+    buildOsrEntry(osr, func, header);
+    return *osr.func;
+  }
+
+  void onDeopt(CodeState &state)
+  {
+    {
+      const std::lock_guard lock{m_statsMutex};
+      ++m_stats.numDeopts;
+    }
+    if (++state.numDeopts < m_params.maxDeopts)
+      return;
+
+    state.speculate = false;
+    state.numDeopts = 0;
+    // Speculative code still being compiled is stale as well
+    cancelCompile(state);
+    // Code may be running, e.g. the one calling this. AOT code is not in
+    // the cache.
+    if (const auto code = state.code.exchange(CodeCache::kNoBlob);
+        code != CodeCache::kNoBlob)
+      m_cache.remove(code);
+    dropCode(state);
+  }
+
+  static void cancelCompile(CodeState &state)
+  {
+    if (state.task != nullptr)
+      state.task->cancel();
+    state.task.reset();
+  }
+
+  // Function falls back to the interpreter and warms up again
+  void dropCode(CodeState &state)
+  {
+    state.entry.store(state.noCode, std::memory_order_release);
+    auto &code = m_interp.getCode(*state.source);
+    code.numCalls = 0;
+    code.numBackEdges = 0;
+    state.queued = false;
+  }
+
+  // Called by the code cache on the commit, the compaction and the eviction
+  void relocate(CodeState &state, const void *code)
+  {
+    if (code != nullptr)
+    {
+      state.entry.store(code, std::memory_order_release);
+      return;
+    }
+    state.code = CodeCache::kNoBlob;
+    dropCode(state);
+  }
+
+  [[nodiscard]] const FuncState *findState(const Function &func) const
+  {
+    const std::lock_guard lock{m_funcsMutex};
+    const auto found = m_funcs.find(&func);
+    return found == m_funcs.end() ? nullptr : found->second.get();
+  }
+
+  OsrState &getOsrState(const BasicBlock &header)
+  {
+    const std::lock_guard lock{m_funcsMutex};
+    auto &state = m_osr[&header];
+    if (state == nullptr)
+    {
+      state = std::make_unique<OsrState>();
+      state->rt = this;
+    }
+    return *state;
+  }
+
+  FuncState &getState(const Function &func)
+  {
+    const std::lock_guard lock{m_funcsMutex};
+    auto &state = m_funcs[&func];
+    if (state != nullptr)
+      return *state;
+
+    state = std::make_unique<FuncState>();
+    state->rt = this;
+    state->source = &func;
+    state->stub =
+      ExecMemory{genInterpEntryStub(func, &enterInterpreter, this)};
+    state->noCode = state->stub.data();
+    state->entry = state->noCode;
+    state->adapter = ExecMemory{
+      genArrayCallAdapter(func.getArgs().size(), getCell(state->entry))};
+    return *state;
+  }
+
+  [[nodiscard]] static const void *const *getCell(
+    const std::atomic<const void *> &entry)
+  {
+    return reinterpret_cast<const void *const *>(&entry);
+  }
+
+  // Code depends on the function, its callees and the compiler settings
+  [[nodiscard]] AotCache::Key getAotKey(StructuralHash &hasher,
+                                        bool speculate) const
+  {
+    Fnv1a hash;
+    hash.mix(hasher.get());
+    const auto &inl = m_params.inlineParams;
+    for (const std::uint64_t val :
+         {inl.baseThreshold, inl.constArgBonus, inl.loopDepthBonus,
+          inl.hotCallBonus, inl.hotCallCount, inl.callerBudget})
+      hash.mix(val);
+    hash.mix(speculate ? 1U : 0U);
+    return hash.get();
+  }
+
+  // Publishes the code of the previous run, callees are taken from funcs
+  bool installAot(CodeState &state, AotCache::Key key,
+                  const std::vector<const Function *> &funcs)
+  {
+    const auto *const code = m_aot.install(
+      key,
+      [&](RelocKind kind, const std::string &callee) -> std::uintptr_t {
+        switch (kind)
+        {
+        case RelocKind::kCallCell: {
+          const auto found = std::find_if(
+            funcs.begin(), funcs.end(),
+            [&callee](const auto *func) { return func->getName() == callee; });
+          if (found == funcs.end())
+            return 0;
+          return reinterpret_cast<std::uintptr_t>(
+            getCell(getState(**found).entry));
+        }
+        case RelocKind::kTrapHandler:
+          return reinterpret_cast<std::uintptr_t>(&onCompiledTrap);
+        case RelocKind::kDeoptHandler:
+          return reinterpret_cast<std::uintptr_t>(&deoptimize);
+        case RelocKind::kDeoptCtx:
+          return reinterpret_cast<std::uintptr_t>(&state);
+        default:
+          return 0;
+        }
+      });
+    if (code == nullptr)
+      return false;
+    state.entry.store(code, std::memory_order_release);
+    return true;
+  }
+
+  // Optimizes the copy of the function and publishes its code.
+  // Returns true if the code is taken from the AOT code cache.
+  bool generateCode(CodeState &state, const Function &func,
+                    const CompileTask *task)
+  {
+    const bool speculate = state.speculate;
+    StructuralHash hasher{func};
+    const bool useAot = !m_params.aotCache.empty();
+    const auto key = useAot ? getAotKey(hasher, speculate) : 0;
+    if (useAot && installAot(state, key, hasher.getFunctions()))
+      return true;
+
+    auto optimized =
+      std::make_unique<Function>(func.getResType(), func.getArgs());
+    optimized->setName(func.getName());
+    Cloner cloner;
+    if (func.size() != 0)
+      cloner.cloneBody(func, optimized.get());
+    DeoptPlanner planner{func};
+    if (speculate)
+      trackResumes(planner, func, cloner);
+    optimizeFunction(*optimized, m_params.inlineParams, speculate);
+
+    CodeGenerator codegen{*optimized, [this](const Function &callee) {
+                            return getCell(getState(callee).entry);
+                          }};
+    if (speculate)
+    {
+      codegen.setDeoptHandler(&deoptimize, &state);
+      codegen.setDeoptBlocks(planner.plan(*optimized));
+    }
+    const auto code = codegen.generate();
+    if (task != nullptr && task->isCancelled())
+      return false;
+
+    auto batch = m_cache.beginBatch();
+    state.code = batch.add(
+      code, codegen.getImplicitChecks(),
+      [this, &state](const void *addr) { relocate(state, addr); });
+    batch.commit();
+    // Broker flushes the code once it has no requests
+    if (m_broker == nullptr)
+      m_cache.flush();
+
+    if (useAot)
+    {
+      AotCache::Entry entry{code, codegen.getPoolOffset(), {},
+                            codegen.getImplicitChecks()};
+      for (const auto &reloc : codegen.getRelocations())
+        entry.relocs.push_back(AotCache::Reloc{
+          reloc.kind, reloc.offset,
+          reloc.callee == nullptr ? std::string{} : reloc.callee->getName()});
+      m_aot.add(key, std::move(entry));
+    }
+    return false;
+  }
+
+  // Deoptimized code is resumed by the OSR entries of the loops
+  void trackResumes(DeoptPlanner &planner, const Function &func,
+                    const Cloner &cloner)
+  {
+    for (const auto *const header : planner.getResumableHeaders())
+    {
+      auto &osr = getOsrState(*header);
+      try
+      {
+        buildOsrEntry(osr, func, *header);
+      }
+      catch (const std::exception &)
+      {
+        // Function is restarted instead
+        continue;
+      }
+      planner.track(*header, osr.liveIns, cloner);
+    }
+  }
+
+  // Called by the compiler threads
+  void compile(const Function &func, const CompileTask *task)
+  {
+    auto &state = getState(func);
+    const auto start = Clock::now();
+    bool failed = false;
+    bool fromAot = false;
+    try
+    {
+      fromAot = generateCode(state, func, task);
+    }
+    catch (const std::exception &)
+    {
+      // Function stays in the interpreter
+      failed = true;
+    }
+    finishCompile(state, start, failed, task,
+                  fromAot ? &TieringStats::numAotLoaded
+                          : &TieringStats::numCompiled);
+  }
+
+  void requestOsr(const Function &func, const BasicBlock &header,
+                  std::uint64_t hotness)
+  {
+    if (m_broker == nullptr)
+    {
+      const StateScope scope{*this, State::kCompiling};
+      compileOsr(func, header, nullptr);
+      return;
+    }
+
+    auto &osr = getOsrState(header);
+    osr.task = m_broker->submit(func, hotness, &header);
+    if (osr.task == nullptr)
+      osr.queued = false;
+  }
+
+  // Called by the compiler threads
+  void compileOsr(const Function &func, const BasicBlock &header,
+                  const CompileTask *task)
+  {
+    auto &osr = getOsrState(header);
+    const auto start = Clock::now();
+    bool failed = false;
+    bool fromAot = false;
+    try
+    {
+      buildOsrEntry(osr, func, header);
+      fromAot = generateCode(osr, *osr.func, task);
+    }
+    catch (const std::exception &)
+    {
+      // Loop stays in the interpreter
+      failed = true;
+    }
+    finishCompile(osr, start, failed, task,
+                  fromAot ? &TieringStats::numAotLoaded
+                          : &TieringStats::numOsrCompiled);
+  }
+
+  // Entry is built by one thread, the failed build is retried
+  void buildOsrEntry(OsrState &osr, const Function &func,
+                     const BasicBlock &header)
+  {
+    std::call_once(osr.built, [this, &osr, &func, &header] {
+      auto entry = OsrBuilder{func, header}.build();
+      osr.adapter = ExecMemory{
+        genArrayCallAdapter(entry.liveIns.size(), getCell(osr.entry))};
+      osr.liveIns = std::move(entry.liveIns);
+      osr.func = std::move(entry.func);
+      osr.source = osr.func.get();
+
+      const std::lock_guard lock{m_funcsMutex};
+      m_osrFuncs.insert(osr.source);
+    });
+  }
+
+  [[nodiscard]] bool isOsrVariant(const Function &func) const
+  {
+    const std::lock_guard lock{m_funcsMutex};
+    return m_osrFuncs.count(&func) != 0;
+  }
+
+  void finishCompile(CodeState &state, Clock::time_point start, bool failed,
+                     const CompileTask *task,
+                     std::size_t TieringStats::*numDone)
+  {
+    const bool cancelled = !state.isCompiled() && task != nullptr &&
+                           task->isCancelled();
+    // Code may be requested again
+    if (cancelled)
+      state.queued = false;
+
+    const std::lock_guard lock{m_statsMutex};
+    m_stats.compileTime += Clock::now() - start;
+    if (failed)
+      ++m_stats.numFailed;
+    else if (!cancelled)
+      ++(m_stats.*numDone);
+  }
+
+  State switchState(State next)
+  {
+    const auto now = Clock::now();
+    const auto elapsed = now - m_stateStart;
+    m_stateStart = now;
+
+    const std::lock_guard lock{m_statsMutex};
+    switch (m_state)
+    {
+    case State::kInterpreter:
+      m_stats.interpTime += elapsed;
+      break;
+    case State::kCompiled:
+      m_stats.compiledTime += elapsed;
+      break;
+    case State::kCompiling:
+      // Accounted by the compiler
+    case State::kIdle:
+    default:
+      break;
+    }
+    return std::exchange(m_state, next);
+  }
+
+  TieringParams m_params{};
+  Interpreter m_interp{};
+  mutable std::mutex m_funcsMutex{};
+  std::unordered_map<const Function *, std::unique_ptr<FuncState>> m_funcs{};
+  std::unordered_map<const BasicBlock *, std::unique_ptr<OsrState>> m_osr{};
+  std::unordered_set<const Function *> m_osrFuncs{};
+  CodeCache m_cache{};
+  AotCache m_aot{};
+
+  mutable std::mutex m_statsMutex{};
+  TieringStats m_stats{};
+  State m_state{State::kIdle};
+  Clock::time_point m_stateStart{};
+
+  // Stopped first: its threads use the state above
+  std::unique_ptr<CompileBroker> m_broker{};
+};
+} // namespace ljit
+
+#endif /* LEECH_JIT_INCLUDE_RUNTIME_TIERED_RUNTIME_HH_INCLUDED */
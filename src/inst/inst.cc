@@ -8,6 +8,13 @@ Call::Call(Function *callee)
   : Inst(callee->getResType(), InstType::kCall), m_callee(callee)
 {}
 
+void Call::setCallee(Function *callee)
+{
+  LJIT_ASSERT(callee->getResType() == m_callee->getResType());
+  LJIT_ASSERT(callee->getArgs() == m_callee->getArgs());
+  m_callee = callee;
+}
+
 [[nodiscard]] bool Call::verify() const
 {
   if (m_callee->getResType() != getType())
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "../graph/graph_test_builder.hh"
+
+#include "analysis/block_frequency.hh"
+#include "ir/basic_block.hh"
+#include "ir/inst.hh"
+
+class BlockFrequencyTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  BlockFrequencyTest() = default;
+
+  void buildFreqs(const ljit::EdgeProfile &profile = {})
+  {
+    freqs =
+      std::make_unique<ljit::BlockFrequencyInfo>(func->makeBBGraph(), profile);
+  }
+
+  // bb0 branches to bb1 and bb2, both jump to bb3
+  void buildDiamond()
+  {
+    genBBs(4, ljit::Type::None, std::vector{ljit::Type::I1});
+    auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I1);
+    bbs[0]->pushInstBack<ljit::IfInstr>(v0, bbs[1], bbs[2]);
+    bbs[1]->pushInstBack<ljit::JumpInstr>(bbs[3]);
+    bbs[2]->pushInstBack<ljit::JumpInstr>(bbs[3]);
+    bbs[3]->pushInstBack<ljit::Ret>();
+  }
+
+  std::unique_ptr<ljit::BlockFrequencyInfo> freqs;
+};
+
+TEST_F(BlockFrequencyTest, diamond)
+{
+  // Assign
+  buildDiamond();
+
+  // Act
+  buildFreqs();
+
+  // Assert
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[0]), 1.);
+  EXPECT_DOUBLE_EQ(freqs->getProbability(bbs[0], bbs[1]), 0.5);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[1]), 0.5);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[2]), 0.5);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[3]), 1.);
+}
+
+TEST_F(BlockFrequencyTest, profile)
+{
+  // Assign
+  buildDiamond();
+
+  // Act
+  buildFreqs(ljit::EdgeProfile{{bbs[0], {30, 10}}});
+
+  // Assert
+  EXPECT_DOUBLE_EQ(freqs->getProbability(bbs[0], bbs[1]), 0.75);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[1]), 0.75);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[2]), 0.25);
+  EXPECT_DOUBLE_EQ(freqs->getEdgeFrequency(bbs[2], bbs[3]), 0.25);
+}
+
+TEST_F(BlockFrequencyTest, earlyReturn)
+{
+  // Assign
+  genBBs(4, ljit::Type::None, std::vector{ljit::Type::I1});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I1);
+  bbs[0]->pushInstBack<ljit::IfInstr>(v0, bbs[1], bbs[2]);
+  bbs[1]->pushInstBack<ljit::Ret>();
+  bbs[2]->pushInstBack<ljit::JumpInstr>(bbs[3]);
+  bbs[3]->pushInstBack<ljit::Ret>();
+
+  // Act
+  buildFreqs();
+
+  // Assert
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[1]),
+                   ljit::BlockFrequencyInfo::kReturnProb);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[2]),
+                   1. - ljit::BlockFrequencyInfo::kReturnProb);
+}
+
+TEST_F(BlockFrequencyTest, nestedLoops)
+{
+  // Assign
+  // bb1 is the outer header, bb2 is the inner one
+  genBBs(6, ljit::Type::None, std::vector{ljit::Type::I1});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I1);
+  bbs[0]->pushInstBack<ljit::JumpInstr>(bbs[1]);
+  bbs[1]->pushInstBack<ljit::IfInstr>(v0, bbs[2], bbs[5]);
+  bbs[2]->pushInstBack<ljit::IfInstr>(v0, bbs[3], bbs[4]);
+  bbs[3]->pushInstBack<ljit::JumpInstr>(bbs[2]);
+  bbs[4]->pushInstBack<ljit::JumpInstr>(bbs[1]);
+  bbs[5]->pushInstBack<ljit::Ret>();
+
+  // Act
+  buildFreqs();
+
+  // Assert
+  // Each loop is estimated to have 8 iterations
+  EXPECT_DOUBLE_EQ(freqs->getProbability(bbs[1], bbs[2]),
+                   ljit::BlockFrequencyInfo::kLoopBranchProb);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[1]), 8.);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[2]), 56.);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[3]), 49.);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[4]), 7.);
+  EXPECT_DOUBLE_EQ(freqs->getFrequency(bbs[5]), 1.);
+}
+
+TEST_F(BlockFrequencyTest, functionProfile)
+{
+  // Assign
+  buildDiamond();
+  ljit::FunctionProfile profile;
+  profile.branchCounts[bbs[0]->getId()] = {1, 3};
+  func->setProfile(profile);
+
+  // Act
+  const ljit::BlockFrequencyInfo info{*func};
+
+  // Assert
+  EXPECT_DOUBLE_EQ(info.getProbability(bbs[0], bbs[1]), 0.25);
+  EXPECT_DOUBLE_EQ(info.getFrequency(bbs[2]), 0.75);
+  EXPECT_DOUBLE_EQ(info.getFrequency(bbs[3]), 1.);
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "analysis/call_graph.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/module.hh"
+
+class CallGraphTest : public ::testing::Test
+{
+protected:
+  CallGraphTest() = default;
+
+  // void func() { callees()...; }
+  ljit::Function *makeFunc(const char *name,
+                           const std::vector<ljit::Function *> &callees)
+  {
+    auto *const func = module.createFunction(name);
+    auto *const bb = func->appendBB();
+    for (auto *const callee : callees)
+      bb->pushInstBack<ljit::Call>(callee);
+    bb->pushInstBack<ljit::Ret>();
+    return func;
+  }
+
+  ljit::Module module;
+};
+
+TEST_F(CallGraphTest, sccs)
+{
+  // Assign
+  auto *const funcD = makeFunc("d", {});
+  auto *const funcC = makeFunc("c", {});
+  auto *const funcB = makeFunc("b", {funcC, funcD});
+  auto *const funcA = makeFunc("a", {funcB, funcB});
+  // c <-> b
+  funcC->makeBBGraph().getRoot()->pushInstFront<ljit::Call>(funcB);
+
+  // Act
+  const ljit::CallGraph callGraph{module};
+
+  // Assert
+  const auto &sccs = callGraph.getSCCs();
+  ASSERT_EQ(sccs.size(), 3);
+  EXPECT_EQ(sccs[0], std::vector{funcD});
+  ASSERT_EQ(sccs[1].size(), 2);
+  EXPECT_NE(std::find(sccs[1].begin(), sccs[1].end(), funcB), sccs[1].end());
+  EXPECT_NE(std::find(sccs[1].begin(), sccs[1].end(), funcC), sccs[1].end());
+  EXPECT_EQ(sccs[2], std::vector{funcA});
+
+  EXPECT_EQ(callGraph.getSCCId(funcB), callGraph.getSCCId(funcC));
+  EXPECT_TRUE(callGraph.isRecursive(funcB));
+  EXPECT_FALSE(callGraph.isRecursive(funcA));
+  EXPECT_FALSE(callGraph.isRecursive(funcD));
+
+  EXPECT_EQ(callGraph.getCallSites(funcA).size(), 2);
+  EXPECT_EQ(callGraph.getCallees(funcA), std::vector{funcB});
+  EXPECT_EQ(callGraph.getCallees(funcB).size(), 2);
+}
+
+TEST_F(CallGraphTest, selfRecursion)
+{
+  // Assign
+  auto *const func = makeFunc("rec", {});
+  func->makeBBGraph().getRoot()->pushInstFront<ljit::Call>(func);
+  auto *const caller = makeFunc("main", {func});
+
+  // Act
+  const ljit::CallGraph callGraph{module};
+
+  // Assert
+  ASSERT_EQ(callGraph.getSCCs().size(), 2);
+  EXPECT_LT(callGraph.getSCCId(func), callGraph.getSCCId(caller));
+  EXPECT_TRUE(callGraph.isRecursive(func));
+  EXPECT_FALSE(callGraph.isRecursive(caller));
+}
@@ -0,0 +1,200 @@
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../graph/graph_test_builder.hh"
+
+#include "analysis/induction.hh"
+#include "analysis/loop_analyzer.hh"
+#include "ir/basic_block.hh"
+
+class InductionTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  InductionTest() = default;
+
+  using LoopAnalyzer = ljit::LoopAnalyzer<ljit::BasicBlockGraph>;
+  void buildAnalyzers()
+  {
+    loops = std::make_unique<LoopAnalyzer>(func->makeBBGraph());
+    ivs = std::make_unique<ljit::InductionAnalyzer>(*loops);
+  }
+
+  std::unique_ptr<LoopAnalyzer> loops;
+  std::unique_ptr<ljit::InductionAnalyzer> ivs;
+};
+
+TEST_F(InductionTest, countedLoop)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v3);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb3, bb2);
+
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v3);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v1, bb0);
+  v3->addNode(v6, bb2);
+  v4->addNode(v2, bb0);
+  v4->addNode(v7, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  buildAnalyzers();
+
+  // Assert
+  const auto *const iv = ivs->getIV(v3);
+  ASSERT_NE(iv, nullptr);
+  EXPECT_EQ(iv->start, v1);
+  EXPECT_EQ(iv->update, v6);
+  EXPECT_EQ(iv->step, 2);
+  EXPECT_EQ(ivs->getIV(v4), nullptr);
+
+  const auto *const exit = ivs->getExitTest(loops->getLoopInfo(bb1));
+  ASSERT_NE(exit, nullptr);
+  EXPECT_EQ(exit->iv, iv);
+  EXPECT_EQ(exit->limit, v0);
+  // !(v0 < v3) keeps the loop going
+  EXPECT_EQ(exit->cmp, ljit::ExitCmp::kLessEq);
+  EXPECT_EQ(exit->body, bb2);
+  EXPECT_EQ(exit->exit, bb3);
+}
+
+TEST_F(InductionTest, decreasing)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(0);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v2 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v2, v1);
+  bb1->pushInstBack<ljit::IfInstr>(v3, bb3, bb2);
+
+  auto *v4 = bb2->pushInstBack<ljit::ConstVal_I32>(1);
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v2, v4);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v2->addNode(v0, bb0);
+  v2->addNode(v5, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v2);
+
+  // Act
+  buildAnalyzers();
+
+  // Assert
+  const auto *const iv = ivs->getIV(v2);
+  ASSERT_NE(iv, nullptr);
+  EXPECT_EQ(iv->start, v0);
+  EXPECT_EQ(iv->step, -1);
+
+  const auto *const exit = ivs->getExitTest(loops->getLoopInfo(bb2));
+  ASSERT_NE(exit, nullptr);
+  EXPECT_EQ(exit->limit, v1);
+  EXPECT_EQ(exit->cmp, ljit::ExitCmp::kNotEq);
+  EXPECT_TRUE(ivs->isInvariant(loops->getLoopInfo(bb1), v0));
+  EXPECT_FALSE(ivs->isInvariant(loops->getLoopInfo(bb1), v4));
+}
+
+TEST_F(InductionTest, tripCount)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector<ljit::Type>{});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::ConstVal_I32>(1);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(10);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(3);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  auto *v4 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v1);
+  bb1->pushInstBack<ljit::IfInstr>(v4, bb2, bb3);
+
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v0, bb0);
+  v3->addNode(v5, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v3);
+
+  // Act
+  buildAnalyzers();
+
+  // Assert
+  // 1, 4, 7
+  EXPECT_EQ(ivs->getTripCount(loops->getLoopInfo(bb1)), 3);
+}
+
+TEST_F(InductionTest, computeTripCount)
+{
+  // Assign
+  using ljit::ExitCmp;
+  using ljit::InductionAnalyzer;
+  constexpr auto kMax = std::numeric_limits<std::int8_t>::max();
+
+  // Act & Assert
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, 10, 1, ExitCmp::kLess,
+                                                ljit::Type::I64),
+            10);
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, 10, 3, ExitCmp::kLessEq,
+                                                ljit::Type::I64),
+            4);
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(10, 0, -2, ExitCmp::kGreater,
+                                                ljit::Type::I64),
+            5);
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(
+              10, 0, -2, ExitCmp::kGreaterEq, ljit::Type::I64),
+            6);
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(5, 0, 1, ExitCmp::kLess,
+                                                ljit::Type::I64),
+            0);
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, 9, 3, ExitCmp::kNotEq,
+                                                ljit::Type::I64),
+            3);
+  // Limit is stepped over
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, 10, 3, ExitCmp::kNotEq,
+                                                ljit::Type::I64),
+            std::nullopt);
+  // Never ends
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, 10, -1, ExitCmp::kLess,
+                                                ljit::Type::I64),
+            std::nullopt);
+  // Induction variable overflows before the exit
+  EXPECT_EQ(InductionAnalyzer::computeTripCount(0, kMax, 1, ExitCmp::kLessEq,
+                                                ljit::Type::I8),
+            std::nullopt);
+}
@@ -73,7 +73,8 @@ TEST_F(LivenessTest, lecture)
   EXPECT_TRUE(checkLiveInterval(insns[4], {10, 20}));
   EXPECT_TRUE(checkLiveInterval(insns[5], {12, 14}));
   EXPECT_TRUE(checkLiveInterval(insns[6], {14, 14}));
-  EXPECT_TRUE(checkLiveInterval(insns[7], {18, 20}));
-  EXPECT_TRUE(checkLiveInterval(insns[8], {20, 22}));
+  // Phi inputs are live till the end of the latch
+  EXPECT_TRUE(checkLiveInterval(insns[7], {18, 24}));
+  EXPECT_TRUE(checkLiveInterval(insns[8], {20, 24}));
   EXPECT_TRUE(checkLiveInterval(insns[9], {26, 28}));
 }
@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "../graph/graph_test_builder.hh"
+
+#include "analysis/range_analysis.hh"
+#include "ir/basic_block.hh"
+
+class RangeAnalysisTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  RangeAnalysisTest() = default;
+
+  void buildRanges()
+  {
+    ranges = std::make_unique<ljit::RangeAnalyzer>(makeGraph());
+  }
+
+  std::unique_ptr<ljit::RangeAnalyzer> ranges;
+};
+
+TEST_F(RangeAnalysisTest, transfer)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(60);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v1);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(16);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v2, v3);
+  auto *v5 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v5);
+  auto *v7 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v6, v5);
+  auto *v8 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v7, v5);
+  auto *v9 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v2, v3);
+  bb0->pushInstBack<ljit::Ret>(v9);
+
+  // Act
+  buildRanges();
+
+  // Assert
+  EXPECT_EQ(ranges->getRange(v0),
+            ljit::Interval::makeFull(ljit::Type::I64));
+  EXPECT_EQ(ranges->getRange(v2), ljit::Interval(-8, 7));
+  EXPECT_EQ(ranges->getRange(v4), ljit::Interval(-8, 31));
+  EXPECT_EQ(ranges->getRange(v6), ljit::Interval(-3, 12));
+  EXPECT_EQ(ranges->getRange(v7), ljit::Interval(-1, 0));
+  EXPECT_EQ(ranges->getRange(v8), ljit::Interval(-1, 7));
+  EXPECT_EQ(ranges->getRange(v9), ljit::Interval::makeConst(1));
+}
+
+TEST_F(RangeAnalysisTest, edges)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(3);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  bb1->pushInstBack<ljit::Ret>(v3);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v1, v0);
+  bb2->pushInstBack<ljit::IfInstr>(v4, bb3, bb1);
+
+  auto *v5 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  buildRanges();
+
+  // Assert
+  // bb1 has two predecessors, so nothing is known
+  EXPECT_EQ(ranges->getInputRange(v3, 0),
+            ljit::Interval::makeFull(ljit::Type::I32));
+  EXPECT_EQ(ranges->getInputRange(v4, 1),
+            ljit::Interval::makeFull(ljit::Type::I32));
+  constexpr auto kMax = std::numeric_limits<std::int32_t>::max();
+  // v0 > 3 && v0 != 3
+  EXPECT_EQ(ranges->getInputRange(v5, 0), ljit::Interval(4, kMax));
+  EXPECT_EQ(ranges->getRange(v5), ljit::Interval(1, kMax - 3));
+}
+
+TEST_F(RangeAnalysisTest, loop)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64);
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v1);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v0, bb0);
+  v3->addNode(v6, bb2);
+  v4->addNode(v0, bb0);
+  v4->addNode(v7, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  buildRanges();
+
+  // Assert
+  EXPECT_EQ(ranges->getRange(v3), ljit::Interval(0, 11));
+  EXPECT_EQ(ranges->getInputRange(v6, 0), ljit::Interval(0, 9));
+  EXPECT_EQ(ranges->getRange(v6), ljit::Interval(2, 11));
+  // No bound for the second phi, so it is widened and may wrap around
+  EXPECT_EQ(ranges->getRange(v4), ljit::Interval::makeFull(ljit::Type::I64));
+}
@@ -0,0 +1,187 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "codegen/aot_cache.hh"
+#include "codegen/assembler.hh"
+#include "common/error.hh"
+
+namespace
+{
+// Function returning the callee cell of the pool
+ljit::AotCache::Entry genLoad(const std::string &callee)
+{
+  ljit::x86::Assembler masm;
+  const auto lit = masm.newLabel();
+  masm.mov(ljit::x86::Reg::kRax, lit);
+  masm.ret();
+  masm.align(sizeof(std::uint64_t));
+  const auto poolOffset = masm.size();
+  masm.bind(lit);
+  masm.data64(0xDEAD);
+
+  return ljit::AotCache::Entry{
+    masm.finalize(),
+    poolOffset,
+    {ljit::AotCache::Reloc{ljit::RelocKind::kCallCell, poolOffset, callee}},
+    {ljit::ImplicitCheck{0, 7}}};
+}
+
+std::uintptr_t call(const void *code)
+{
+  std::uintptr_t (*func)() = nullptr;
+  std::memcpy(&func, &code, sizeof(func));
+  return func();
+}
+
+// Cells of the callees are their name sizes
+std::uintptr_t resolve(ljit::RelocKind kind, const std::string &callee)
+{
+  return kind == ljit::RelocKind::kCallCell ? callee.size() : 0;
+}
+
+const auto kPageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+} // namespace
+
+TEST(AotCacheTest, roundTrip)
+{
+  // Assign
+  const auto path = ::testing::TempDir() + "ljit_round_trip.code";
+  ljit::AotCache src;
+  src.add(1, genLoad("f"));
+  src.add(2, genLoad("func"));
+  src.save(path);
+
+  // Act
+  ljit::AotCache cache;
+  cache.load(path);
+  const auto *const first = cache.install(1, &resolve);
+  const auto *const second = cache.install(2, &resolve);
+
+  // Assert
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(call(first), 1);
+  EXPECT_EQ(call(second), 4);
+  EXPECT_EQ(cache.install(1, &resolve), first);
+  EXPECT_EQ(cache.install(3, &resolve), nullptr);
+  // Pool starts the page
+  EXPECT_EQ((reinterpret_cast<std::uintptr_t>(first) + 8) % kPageSize, 0U);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(
+              reinterpret_cast<std::uintptr_t>(second)),
+            reinterpret_cast<std::uintptr_t>(second) + 7);
+}
+
+TEST(AotCacheTest, installTwice)
+{
+  // Assign
+  const auto path = ::testing::TempDir() + "ljit_install_twice.code";
+  {
+    ljit::AotCache src;
+    src.add(1, genLoad("f"));
+    src.save(path);
+  }
+  ljit::AotCache cache;
+  cache.load(path);
+  const auto *const first = cache.install(1, &resolve);
+
+  // Act
+  const auto *const second = cache.install(
+    1, [](ljit::RelocKind, const std::string &) { return 42U; });
+  const auto *const same = cache.install(1, &resolve);
+
+  // Assert
+  // Other relocation values are patched in a copy
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(same, first);
+  EXPECT_EQ(call(first), 1);
+  EXPECT_EQ(call(second), 42);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(
+              reinterpret_cast<std::uintptr_t>(second)),
+            reinterpret_cast<std::uintptr_t>(second) + 7);
+}
+
+TEST(AotCacheTest, resave)
+{
+  // Assign
+  const auto path = ::testing::TempDir() + "ljit_resave.code";
+  {
+    ljit::AotCache src;
+    src.add(1, genLoad("f"));
+    src.save(path);
+  }
+  ljit::AotCache cache;
+  cache.load(path);
+  const auto *const installed = cache.install(1, &resolve);
+
+  // Act
+  // Loaded file is replaced, installed code stays
+  cache.add(2, genLoad("func"));
+  cache.save(path);
+  ljit::AotCache other;
+  other.load(path);
+
+  // Assert
+  EXPECT_EQ(call(installed), 1);
+  EXPECT_TRUE(other.contains(1));
+  ASSERT_TRUE(other.contains(2));
+  const auto *const code = other.install(
+    1, [](ljit::RelocKind, const std::string &) { return 42U; });
+  ASSERT_NE(code, nullptr);
+  EXPECT_EQ(call(code), 42);
+}
+
+TEST(AotCacheTest, invalid)
+{
+  // Assign
+  const auto path = ::testing::TempDir() + "ljit_invalid.code";
+  const auto badPath = path + ".bad";
+  ljit::AotCache src;
+  src.add(1, genLoad("f"));
+  src.save(path);
+  std::vector<char> bytes;
+  {
+    std::ifstream ifs{path, std::ios::binary};
+    bytes.assign(std::istreambuf_iterator<char>{ifs},
+                 std::istreambuf_iterator<char>{});
+  }
+  auto writeBad = [&badPath](const std::vector<char> &data, std::size_t size) {
+    std::ofstream{badPath, std::ios::binary | std::ios::trunc}.write(
+      data.data(), static_cast<std::streamsize>(size));
+  };
+
+  // Act
+  ljit::AotCache cache;
+  cache.load(path);
+  const auto *const unresolved = cache.install(
+    1, [](ljit::RelocKind, const std::string &) { return 0U; });
+
+  // Code is corrupted
+  auto corrupt = bytes;
+  corrupt[2 * kPageSize - 2] = '\x90';
+  writeBad(corrupt, corrupt.size());
+  ljit::AotCache corrupted;
+  corrupted.load(badPath);
+
+  // Assert
+  EXPECT_EQ(unresolved, nullptr);
+  EXPECT_EQ(corrupted.install(1, &resolve), nullptr);
+  EXPECT_NE(cache.install(1, &resolve), nullptr);
+
+  corrupt = bytes;
+  corrupt[0] = 'X';
+  writeBad(corrupt, corrupt.size());
+  EXPECT_THROW(corrupted.load(badPath), ljit::AotCacheError);
+
+  // Blob is truncated
+  writeBad(bytes, kPageSize);
+  EXPECT_THROW(corrupted.load(badPath), ljit::AotCacheError);
+}
@@ -0,0 +1,116 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "codegen/assembler.hh"
+
+using ljit::x86::Reg;
+using Bytes = std::vector<std::uint8_t>;
+
+TEST(AssemblerTest, moves)
+{
+  // Assign
+  ljit::x86::Assembler masm;
+
+  // Act
+  masm.mov(Reg::kRax, Reg::kRcx);
+  masm.mov(Reg::kR12, Reg::kRbx);
+  masm.mov(Reg::kRax, ljit::x86::Mem{Reg::kRbp, -8});
+  masm.mov(ljit::x86::Mem{Reg::kR12, 0x100}, Reg::kR13);
+  masm.mov(Reg::kRax, std::int64_t{0x1122334455667788});
+  masm.mov(Reg::kR9, std::int64_t{-1});
+  masm.mov(Reg::kRdx, std::int64_t{0});
+
+  // Assert
+  EXPECT_EQ(masm.finalize(),
+            (Bytes{0x48, 0x89, 0xC8,                               //
+                   0x49, 0x89, 0xDC,                               //
+                   0x48, 0x8B, 0x45, 0xF8,                         //
+                   0x4D, 0x89, 0xAC, 0x24, 0x00, 0x01, 0x00, 0x00, //
+                   0x48, 0xB8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, //
+                   0x22, 0x11,                                     //
+                   0x49, 0xC7, 0xC1, 0xFF, 0xFF, 0xFF, 0xFF,       //
+                   0x31, 0xD2}));
+}
+
+TEST(AssemblerTest, arithmetic)
+{
+  // Assign
+  ljit::x86::Assembler masm;
+
+  // Act
+  masm.alu(ljit::x86::AluOp::kSub, Reg::kRax, Reg::kR8);
+  masm.alu(ljit::x86::AluOp::kCmp, Reg::kRcx, -1);
+  masm.alu(ljit::x86::AluOp::kAdd, Reg::kRsp, 0x1000);
+  masm.imul(Reg::kRax, Reg::kRcx);
+  masm.cqo();
+  masm.idiv(Reg::kRcx);
+  masm.shift(ljit::x86::ShiftOp::kSar, Reg::kRax);
+  masm.setcc(ljit::x86::Cond::kNE, Reg::kRsi);
+  masm.movzx8(Reg::kRax, Reg::kRax);
+  masm.movsx32(Reg::kRax, Reg::kRax);
+  masm.cmov(ljit::x86::Cond::kNE, Reg::kRax, Reg::kRcx);
+
+  // Assert
+  EXPECT_EQ(masm.finalize(),
+            (Bytes{0x4C, 0x29, 0xC0,                         //
+                   0x48, 0x83, 0xF9, 0xFF,                   //
+                   0x48, 0x81, 0xC4, 0x00, 0x10, 0x00, 0x00, //
+                   0x48, 0x0F, 0xAF, 0xC1,                   //
+                   0x48, 0x99,                               //
+                   0x48, 0xF7, 0xF9,                         //
+                   0x48, 0xD3, 0xF8,                         //
+                   0x40, 0x0F, 0x95, 0xC6,                   //
+                   0x0F, 0xB6, 0xC0,                         //
+                   0x48, 0x63, 0xC0,                         //
+                   0x48, 0x0F, 0x45, 0xC1}));
+}
+
+TEST(AssemblerTest, controlFlow)
+{
+  // Assign
+  ljit::x86::Assembler masm;
+  const auto back = masm.newLabel();
+  const auto forward = masm.newLabel();
+
+  // Act
+  masm.bind(back);
+  masm.push(Reg::kR13);
+  masm.jmp(forward);
+  masm.jcc(ljit::x86::Cond::kE, back);
+  masm.bind(forward);
+  masm.call(ljit::x86::Mem{Reg::kRax, 0});
+  masm.pop(Reg::kRbx);
+  masm.ret();
+
+  // Assert
+  EXPECT_TRUE(masm.isBound(forward));
+  EXPECT_EQ(masm.finalize(),
+            (Bytes{0x41, 0x55,                         //
+                   0xE9, 0x06, 0x00, 0x00, 0x00,       //
+                   0x0F, 0x84, 0xF3, 0xFF, 0xFF, 0xFF, //
+                   0xFF, 0x50, 0x00,                   //
+                   0x5B,                               //
+                   0xC3}));
+}
+
+TEST(AssemblerTest, literals)
+{
+  // Assign
+  ljit::x86::Assembler masm;
+  const auto literal = masm.newLabel();
+
+  // Act
+  masm.mov(Reg::kR9, literal);
+  masm.ret();
+  masm.align(8);
+  masm.bind(literal);
+  masm.data64(0x1122334455667788);
+
+  // Assert
+  EXPECT_EQ(masm.getOffset(literal), 8);
+  EXPECT_EQ(masm.finalize(),
+            (Bytes{0x4C, 0x8B, 0x0D, 0x01, 0x00, 0x00, 0x00, //
+                   0xC3,                                     //
+                   0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11}));
+}
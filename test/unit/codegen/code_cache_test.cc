@@ -0,0 +1,230 @@
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+#include "codegen/assembler.hh"
+#include "codegen/code_cache.hh"
+#include "codegen/fault_handler.hh"
+
+namespace
+{
+// Function returning the value
+std::vector<std::uint8_t> genConst(std::int64_t val)
+{
+  ljit::x86::Assembler masm;
+  masm.mov(ljit::x86::Reg::kRax, val);
+  masm.ret();
+  return masm.finalize();
+}
+
+std::int64_t call(const void *code)
+{
+  std::int64_t (*func)() = nullptr;
+  std::memcpy(&func, &code, sizeof(func));
+  return func();
+}
+
+const auto kPageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+} // namespace
+
+TEST(CodeCacheTest, batch)
+{
+  // Assign
+  ljit::CodeCache cache;
+  std::vector<const void *> addrs(2);
+  auto batch = cache.beginBatch();
+  const auto first = batch.add(genConst(1), {},
+                               [&](const void *code) { addrs[0] = code; });
+  const auto second = batch.add(genConst(2), {},
+                                [&](const void *code) { addrs[1] = code; });
+  const auto added = addrs;
+
+  // Act
+  batch.commit();
+  const auto committed = addrs;
+  cache.flush();
+
+  // Assert
+  // Code on the written page is published by the flush
+  EXPECT_EQ(added[0], nullptr);
+  EXPECT_EQ(committed[0], nullptr);
+  EXPECT_EQ(call(addrs[0]), 1);
+  EXPECT_EQ(call(addrs[1]), 2);
+  EXPECT_EQ(cache.getCode(first), addrs[0]);
+  EXPECT_EQ(cache.getCode(second), addrs[1]);
+
+  const auto stats = cache.getStats();
+  EXPECT_EQ(stats.numRegions, 1);
+  EXPECT_EQ(stats.numBlobs, 2);
+  EXPECT_EQ(stats.used, 32);
+  EXPECT_EQ(stats.wasted, kPageSize - 32);
+  // Written pages are sealed at once
+  EXPECT_EQ(stats.numFlips, 1);
+  EXPECT_FALSE(cache.needsCollect());
+}
+
+TEST(CodeCacheTest, sharedPage)
+{
+  // Assign
+  ljit::CodeCache cache;
+  std::vector<const void *> addrs;
+  const auto numBlobs = kPageSize / 16 + 1;
+
+  // Act
+  for (std::size_t idx = 0; idx < numBlobs; ++idx)
+  {
+    auto batch = cache.beginBatch();
+    static_cast<void>(
+      batch.add(genConst(static_cast<std::int64_t>(idx)), {},
+                [&](const void *code) { addrs.push_back(code); }));
+    batch.commit();
+  }
+  const auto committed = addrs.size();
+  cache.flush();
+
+  // Assert
+  // Commits fill the page and seal it once, the blob on the next page waits
+  // for the flush
+  EXPECT_EQ(committed, numBlobs - 1);
+  ASSERT_EQ(addrs.size(), numBlobs);
+  for (std::size_t idx = 0; idx < numBlobs; ++idx)
+  {
+    EXPECT_EQ(addrs[idx], static_cast<const std::uint8_t *>(addrs[0]) +
+                            idx * 16);
+    EXPECT_EQ(call(addrs[idx]), static_cast<std::int64_t>(idx));
+  }
+
+  const auto stats = cache.getStats();
+  EXPECT_EQ(stats.numRegions, 1);
+  EXPECT_EQ(stats.used, numBlobs * 16);
+  EXPECT_EQ(stats.wasted, kPageSize - 16);
+  EXPECT_EQ(stats.numFlips, 2);
+}
+
+TEST(CodeCacheTest, discard)
+{
+  // Assign
+  ljit::CodeCache cache;
+  const void *addr = nullptr;
+
+  // Act
+  {
+    auto batch = cache.beginBatch();
+    static_cast<void>(batch.add(genConst(1), {}, {}));
+  }
+  auto batch = cache.beginBatch();
+  const auto id =
+    batch.add(genConst(2), {}, [&](const void *code) { addr = code; });
+  batch.commit();
+  cache.flush();
+
+  // Assert
+  EXPECT_EQ(call(addr), 2);
+  EXPECT_EQ(cache.getCode(id), addr);
+  const auto stats = cache.getStats();
+  EXPECT_EQ(stats.numBlobs, 1);
+  EXPECT_EQ(stats.used, 16);
+}
+
+TEST(CodeCacheTest, evictAndCompact)
+{
+  // Assign
+  ljit::CodeCacheParams params;
+  params.regionSize = kPageSize;
+  params.budget = 32;
+  ljit::CodeCache cache{params};
+
+  std::unordered_map<std::int64_t, const void *> addrs;
+  std::vector<ljit::CodeCache::BlobId> ids;
+  for (std::int64_t val = 1; val <= 3; ++val)
+  {
+    auto batch = cache.beginBatch();
+    ids.push_back(batch.add(genConst(val), {ljit::ImplicitCheck{0, 8}},
+                            [&, val](const void *code) { addrs[val] = code; }));
+    batch.commit();
+    cache.flush();
+  }
+  const auto first = addrs[1];
+  cache.touch(ids[0]);
+  const auto before = cache.getStats();
+
+  // Act
+  const bool needed = cache.needsCollect();
+  cache.collect();
+
+  // Assert
+  // Least recently used blob is evicted, the rest is moved down
+  EXPECT_TRUE(needed);
+  EXPECT_EQ(before.numRegions, 3);
+  EXPECT_EQ(addrs[2], nullptr);
+  EXPECT_EQ(addrs[1], first);
+  EXPECT_EQ(static_cast<const std::uint8_t *>(addrs[3]),
+            static_cast<const std::uint8_t *>(first) + 16);
+  EXPECT_EQ(call(addrs[1]), 1);
+  EXPECT_EQ(call(addrs[3]), 3);
+
+  const auto slowPath = ljit::FaultHandler::findSlowPath(
+    reinterpret_cast<std::uintptr_t>(addrs[3]));
+  EXPECT_EQ(slowPath, reinterpret_cast<std::uintptr_t>(addrs[3]) + 8);
+
+  const auto stats = cache.getStats();
+  EXPECT_EQ(stats.numRegions, 1);
+  EXPECT_EQ(stats.numBlobs, 2);
+  EXPECT_EQ(stats.used, 32);
+  EXPECT_EQ(stats.numEvicted, 1);
+  EXPECT_EQ(stats.numCompactions, 1);
+  EXPECT_GT(before.getFragmentation(), stats.getFragmentation());
+  EXPECT_FALSE(cache.needsCollect());
+}
+
+TEST(CodeCacheTest, removed)
+{
+  // Assign
+  ljit::CodeCacheParams params;
+  params.regionSize = kPageSize;
+  ljit::CodeCache cache{params};
+  auto batch = cache.beginBatch();
+  const auto id = batch.add(genConst(1), {}, {});
+  batch.commit();
+  cache.flush();
+
+  // Act
+  cache.remove(id);
+  const auto removed = cache.getStats();
+  cache.collect();
+
+  // Assert
+  EXPECT_EQ(removed.used, 0);
+  EXPECT_EQ(removed.wasted, kPageSize);
+  const auto stats = cache.getStats();
+  EXPECT_EQ(stats.numRegions, 0);
+  EXPECT_EQ(stats.numBlobs, 0);
+  EXPECT_EQ(stats.wasted, 0);
+}
+
+TEST(CodeCacheTest, hugePages)
+{
+  // Assign
+  ljit::CodeCacheParams params;
+  params.regionSize = kPageSize;
+  params.hugePages = true;
+  ljit::CodeCache cache{params};
+  const void *addr = nullptr;
+
+  // Act
+  auto batch = cache.beginBatch();
+  static_cast<void>(
+    batch.add(genConst(1), {}, [&](const void *code) { addr = code; }));
+  batch.commit();
+  cache.flush();
+
+  // Assert
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(addr) % (std::size_t{2} << 20),
+            0U);
+  EXPECT_EQ(cache.getStats().reserved, std::size_t{2} << 20);
+  EXPECT_EQ(call(addr), 1);
+}
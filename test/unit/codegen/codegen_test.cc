@@ -0,0 +1,622 @@
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../graph/graph_test_builder.hh"
+
+#include "codegen/codegen.hh"
+#include "codegen/exec_memory.hh"
+#include "codegen/jit_compiler.hh"
+#include "common/error.hh"
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+
+class CodeGenTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  CodeGenTest() = default;
+
+  // n-th Fibonacci number, phis are updated in parallel
+  void buildLoop()
+  {
+    genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+    auto *bb0 = bbs[0];
+    auto *bb1 = bbs[1];
+    auto *bb2 = bbs[2];
+    auto *bb3 = bbs[3];
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    // i, fib(i), fib(i + 1)
+    auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v6, bb2, bb3);
+
+    auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v5);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v3->addNode(v1, bb0);
+    v3->addNode(v7, bb2);
+    v4->addNode(v1, bb0);
+    v4->addNode(v5, bb2);
+    v5->addNode(v2, bb0);
+    v5->addNode(v8, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v4);
+  }
+
+  ljit::JitCompiler jit;
+};
+
+TEST_F(CodeGenTest, arithmetic)
+{
+  // Assign
+  genBBs(1, ljit::Type::I8, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShl, v3, v2);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v4, v1);
+  auto *v6 = bb0->pushInstBack<ljit::Cast>(ljit::Type::I8, v5);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  auto *const compiled =
+    jit.getFunction<std::int8_t, std::int64_t, std::int64_t>(*func);
+
+  // Assert
+  EXPECT_TRUE(jit.isCompiled(*func));
+  EXPECT_GT(jit.getCodeSize(*func), 0);
+  // ((100 - 3) << 2) / 3 = 129, which wraps to -127 in I8
+  EXPECT_EQ(compiled(100, 3), -127);
+  EXPECT_EQ(compiled(-7, 1), -32);
+  EXPECT_EQ(compiled(0, -1), -4);
+}
+
+TEST_F(CodeGenTest, loop)
+{
+  // Assign
+  buildLoop();
+  ljit::Interpreter interp;
+
+  // Act
+  auto *const compiled = jit.getFunction<std::int64_t, std::int64_t>(*func);
+
+  // Assert
+  EXPECT_EQ(compiled(0), 0);
+  EXPECT_EQ(compiled(10), 55);
+  EXPECT_EQ(compiled(90), 2880067194370816120);
+  for (std::int64_t n = 0; n < 40; ++n)
+    EXPECT_EQ(compiled(n), interp.run(*func, {n}));
+}
+
+TEST_F(CodeGenTest, swap)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I64);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v4);
+  bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v4, v3);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  // Values are swapped on each iteration
+  v4->addNode(v0, bb0);
+  v4->addNode(v8, bb2);
+  v5->addNode(v1, bb0);
+  v5->addNode(v6, bb2);
+  v6->addNode(v2, bb0);
+  v6->addNode(v5, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  auto *const compiled =
+    jit.getFunction<std::int64_t, std::int64_t, std::int64_t, std::int64_t>(
+      *func);
+
+  // Assert
+  EXPECT_EQ(compiled(1, 5, 7), 5);
+  EXPECT_EQ(compiled(2, 5, 7), 7);
+  EXPECT_EQ(compiled(4, 5, 7), 7);
+}
+
+TEST_F(CodeGenTest, diamond)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(10);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::Select>(v2, v1, v0);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v5 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  v5->addNode(v3, bb1);
+  v5->addNode(v4, bb2);
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  auto *const compiled = jit.getFunction<std::int32_t, std::int32_t>(*func);
+
+  // Assert
+  EXPECT_EQ(compiled(3), 9);
+  EXPECT_EQ(compiled(-70000), 605032704);
+  EXPECT_EQ(compiled(42), 42);
+}
+
+TEST_F(CodeGenTest, switchInst)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(100);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(200);
+  bb0->pushInstBack<ljit::Switch>(
+    v0, bb3,
+    std::vector<ljit::Switch::Case>{
+      {1, bb1}, {-5, bb2}, {std::int64_t{1} << 40, bb1}});
+
+  bb1->pushInstBack<ljit::Ret>(v1);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v3 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v3->addNode(v0, bb0);
+  v3->addNode(v2, bb2);
+  bb3->pushInstBack<ljit::Ret>(v3);
+
+  // Act
+  auto *const compiled = jit.getFunction<std::int64_t, std::int64_t>(*func);
+
+  // Assert
+  EXPECT_EQ(compiled(1), 100);
+  EXPECT_EQ(compiled(std::int64_t{1} << 40), 100);
+  EXPECT_EQ(compiled(-5), 200);
+  EXPECT_EQ(compiled(3), 3);
+}
+
+TEST_F(CodeGenTest, spills)
+{
+  // Assign
+  const std::vector<ljit::Type> args(8, ljit::Type::I64);
+  genBBs(1, ljit::Type::I64, args);
+  auto *bb0 = bbs[0];
+
+  std::vector<ljit::Param *> params;
+  for (std::size_t idx = 0; idx < args.size(); ++idx)
+    params.push_back(bb0->pushInstBack<ljit::Param>(idx, ljit::Type::I64));
+
+  // a7 - (a6 - (... - (a1 - a0))), all params are live at once
+  ljit::Value *res = params.front();
+  for (std::size_t idx = 1; idx < params.size(); ++idx)
+    res = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, params[idx],
+                                         res);
+  bb0->pushInstBack<ljit::Ret>(res);
+
+  // Act
+  auto *const compiled =
+    jit.getFunction<std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+                    std::int64_t, std::int64_t, std::int64_t, std::int64_t,
+                    std::int64_t>(*func);
+
+  // Assert
+  EXPECT_EQ(compiled(1, 2, 4, 8, 16, 32, 64, 128), 128 - 64 + 32 - 16 + 8 - 4 +
+                                                     2 - 1);
+  EXPECT_EQ(compiled(0, 0, 0, 0, 0, 0, 0, -1), -1);
+}
+
+TEST_F(CodeGenTest, traps)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v3 =
+    bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  auto *v4 =
+    bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v0, v2);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v2, v4);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v5, v3);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  auto *const compiled =
+    jit.getFunction<std::int64_t, std::int64_t, std::int64_t>(*func);
+
+  // Assert
+  EXPECT_EQ(compiled(1, 5), 1);
+  EXPECT_EQ(compiled(0, -2), -5);
+  EXPECT_DEATH(compiled(1, 0), "Zero check failed");
+  EXPECT_DEATH(compiled(10, 1), "Bounds check failed");
+  EXPECT_DEATH(compiled(-1, 1), "Bounds check failed");
+}
+
+TEST_F(CodeGenTest, deopt)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v3 =
+    bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  auto *v4 =
+    bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v0, v2);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v4, v3);
+  bb0->pushInstBack<ljit::Ret>(v5);
+
+  std::vector<std::int64_t> deoptArgs;
+  ljit::CodeGenerator codegen{*func, [](const ljit::Function &) {
+                                return nullptr;
+                              }};
+  codegen.setDeoptHandler(
+    [](void *ctx, std::int64_t, const std::int64_t *args) -> std::int64_t {
+      auto &saved = *static_cast<std::vector<std::int64_t> *>(ctx);
+      saved.assign(args, args + 2);
+      return -1;
+    },
+    &deoptArgs);
+
+  // Act
+  const ljit::ExecMemory code{codegen.generate()};
+  std::int64_t (*compiled)(std::int64_t, std::int64_t) = nullptr;
+  const auto *const entry = code.data();
+  std::memcpy(&compiled, &entry, sizeof(compiled));
+
+  // Assert
+  const auto &sites = codegen.getDeoptSites();
+  ASSERT_GE(sites.size(), 3);
+  EXPECT_EQ(sites.front().kind, ljit::TrapKind::kZeroCheck);
+  EXPECT_EQ(sites.back().kind, ljit::TrapKind::kDivByZero);
+  for (std::size_t idx = 1; idx < sites.size(); ++idx)
+    EXPECT_LT(sites[idx - 1].offset, sites[idx].offset);
+
+  EXPECT_EQ(compiled(6, 3), 2);
+  EXPECT_TRUE(deoptArgs.empty());
+  EXPECT_EQ(compiled(1, 0), -1);
+  EXPECT_EQ(deoptArgs, (std::vector<std::int64_t>{1, 0}));
+  EXPECT_EQ(compiled(10, 1), -1);
+  EXPECT_EQ(deoptArgs, (std::vector<std::int64_t>{10, 1}));
+}
+
+TEST_F(CodeGenTest, implicitChecks)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I64);
+  auto *v3 =
+    bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v3);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v2);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v5);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  std::vector<std::int64_t> deoptArgs;
+  ljit::CodeGenerator codegen{*func, [](const ljit::Function &) {
+                                return nullptr;
+                              }};
+  codegen.setDeoptHandler(
+    [](void *ctx, std::int64_t, const std::int64_t *args) -> std::int64_t {
+      auto &saved = *static_cast<std::vector<std::int64_t> *>(ctx);
+      saved.assign(args, args + 3);
+      return -1;
+    },
+    &deoptArgs);
+
+  // Act
+  const auto code = codegen.generate();
+  const ljit::ExecMemory mem{code, codegen.getImplicitChecks()};
+  std::int64_t (*deoptimized)(std::int64_t, std::int64_t, std::int64_t) =
+    nullptr;
+  const auto *const entry = mem.data();
+  std::memcpy(&deoptimized, &entry, sizeof(deoptimized));
+  auto *const compiled =
+    jit.getFunction<std::int64_t, std::int64_t, std::int64_t, std::int64_t>(
+      *func);
+
+  // Assert
+  // Zero check is folded into the division
+  const auto &sites = codegen.getDeoptSites();
+  const auto checks = codegen.getImplicitChecks();
+  ASSERT_EQ(sites.size(), 2);
+  ASSERT_EQ(checks.size(), 2);
+  EXPECT_EQ(sites[0].kind, ljit::TrapKind::kZeroCheck);
+  EXPECT_EQ(sites[1].kind, ljit::TrapKind::kDivByZero);
+  for (std::size_t idx = 0; idx < checks.size(); ++idx)
+  {
+    EXPECT_EQ(checks[idx].offset, sites[idx].offset);
+    // REX.W idiv
+    EXPECT_EQ(code.at(checks[idx].offset + 1), 0xF7);
+  }
+
+  EXPECT_EQ(deoptimized(12, 3, 4), 7);
+  EXPECT_TRUE(deoptArgs.empty());
+  EXPECT_EQ(deoptimized(12, 0, 4), -1);
+  EXPECT_EQ(deoptArgs, (std::vector<std::int64_t>{12, 0, 4}));
+  EXPECT_EQ(deoptimized(12, 3, 0), -1);
+  EXPECT_EQ(deoptArgs, (std::vector<std::int64_t>{12, 3, 0}));
+
+  EXPECT_EQ(compiled(-12, -1, -1), 24);
+  EXPECT_DEATH(compiled(12, 0, 4), "Zero check failed");
+  EXPECT_DEATH(compiled(12, 3, 0), "Division by zero");
+}
+
+TEST_F(CodeGenTest, deoptBlocks)
+{
+  // Assign
+  genBBs(2, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(42);
+  bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+  auto *v4 = bb1->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v5 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v0, v4);
+  auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v5);
+  bb1->pushInstBack<ljit::Ret>(v6);
+
+  struct Deopt final
+  {
+    std::int64_t resume{};
+    std::vector<std::int64_t> vals{};
+  };
+  auto generate = [&](ljit::CodeGenerator &codegen, Deopt &deopt,
+                      std::vector<const ljit::Value *> resumeVals) {
+    codegen.setDeoptHandler(
+      [](void *ctx, std::int64_t resume,
+         const std::int64_t *vals) -> std::int64_t {
+        auto &saved = *static_cast<Deopt *>(ctx);
+        saved.resume = resume;
+        // Resuming values or the arguments
+        saved.vals.assign(vals, vals + (resume == ljit::kNoResume ? 2 : 3));
+        return -1;
+      },
+      &deopt);
+    codegen.setDeoptBlocks({ljit::DeoptBlock{bb0, 7, std::move(resumeVals)}});
+    return ljit::ExecMemory{codegen.generate()};
+  };
+  auto getEntry = [](const ljit::ExecMemory &code) {
+    std::int64_t (*compiled)(std::int64_t, std::int64_t) = nullptr;
+    const auto *const entry = code.data();
+    std::memcpy(&compiled, &entry, sizeof(compiled));
+    return compiled;
+  };
+  auto resolver = [](const ljit::Function &) { return nullptr; };
+
+  // Act
+  Deopt resumed;
+  ljit::CodeGenerator resumeGen{*func, resolver};
+  const auto resumeCode = generate(resumeGen, resumed, {v2, v3, v0});
+  auto *const compiled = getEntry(resumeCode);
+  Deopt restarted;
+  ljit::CodeGenerator restartGen{*func, resolver};
+  // Sum is not computed yet at the zero check
+  const auto restartCode = generate(restartGen, restarted, {v6, v3, v0});
+  auto *const restart = getEntry(restartCode);
+
+  // Assert
+  // Only the guard of the block deoptimizes
+  ASSERT_EQ(resumeGen.getDeoptSites().size(), 1);
+  EXPECT_EQ(resumeGen.getDeoptSites()[0].kind, ljit::TrapKind::kZeroCheck);
+
+  EXPECT_EQ(compiled(2, 3), 7);
+  EXPECT_EQ(compiled(3, 0), -1);
+  EXPECT_EQ(resumed.resume, 7);
+  EXPECT_EQ(resumed.vals, (std::vector<std::int64_t>{3, 42, 3}));
+  EXPECT_DEATH(compiled(10, 1), "Bounds check failed");
+
+  EXPECT_EQ(restart(4, 0), -1);
+  EXPECT_EQ(restarted.resume, ljit::kNoResume);
+  EXPECT_EQ(restarted.vals, (std::vector<std::int64_t>{4, 0}));
+}
+
+TEST_F(CodeGenTest, literalPool)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v1);
+  auto *v3 = bb0->pushInstBack<ljit::Call>(func.get());
+  v3->appendArg(v2);
+  v3->appendArg(v1);
+  bb0->pushInstBack<ljit::Ret>(v3);
+
+  const void *cell = nullptr;
+  ljit::CodeGenerator codegen{*func, [&](const ljit::Function &) {
+                                return &cell;
+                              }};
+  auto readLiteral = [](const std::vector<std::uint8_t> &code,
+                        std::size_t offset) {
+    std::uintptr_t res = 0;
+    std::memcpy(&res, code.data() + offset, sizeof(res));
+    return res;
+  };
+
+  // Act
+  const auto code = codegen.generate();
+  const auto relocs = codegen.getRelocations();
+  const auto refs = codegen.getLiteralRefs();
+  codegen.setDeoptHandler(
+    [](void *, std::int64_t, const std::int64_t *) -> std::int64_t {
+      return 0;
+    },
+    &cell);
+  const auto deoptCode = codegen.generate();
+  const auto deoptRelocs = codegen.getRelocations();
+
+  // Assert
+  // Pool of 8 byte entries ends the code
+  ASSERT_EQ(relocs.size(), 2);
+  EXPECT_EQ(codegen.getPoolOffset() % 8, 0);
+  EXPECT_EQ(relocs[0].kind, ljit::RelocKind::kCallCell);
+  EXPECT_EQ(relocs[0].callee, func.get());
+  EXPECT_EQ(readLiteral(code, relocs[0].offset),
+            reinterpret_cast<std::uintptr_t>(&cell));
+  EXPECT_EQ(relocs[1].kind, ljit::RelocKind::kTrapHandler);
+  EXPECT_EQ(relocs[1].offset + 8, code.size());
+
+  // Call and trap stub load the entries
+  ASSERT_EQ(refs.size(), 2);
+  for (const auto &ref : refs)
+  {
+    std::int32_t disp = 0;
+    std::memcpy(&disp, code.data() + ref.offset, sizeof(disp));
+    EXPECT_EQ(static_cast<std::int64_t>(ref.offset) + 4 + disp,
+              static_cast<std::int64_t>(ref.entry));
+  }
+  EXPECT_EQ(refs[0].entry, relocs[0].offset);
+  EXPECT_EQ(refs[1].entry, relocs[1].offset);
+
+  ASSERT_EQ(deoptRelocs.size(), 3);
+  EXPECT_EQ(deoptRelocs[1].kind, ljit::RelocKind::kDeoptCtx);
+  EXPECT_EQ(readLiteral(deoptCode, deoptRelocs[1].offset),
+            reinterpret_cast<std::uintptr_t>(&cell));
+  EXPECT_EQ(deoptRelocs[2].kind, ljit::RelocKind::kDeoptHandler);
+  EXPECT_EQ(codegen.getPoolOffset() + 3 * 8, deoptCode.size());
+}
+
+TEST_F(CodeGenTest, signature)
+{
+  // Assign
+  buildLoop();
+
+  // Act & Assert
+  EXPECT_THROW((jit.getFunction<std::int32_t, std::int64_t>(*func)),
+               ljit::CodeGenError);
+  EXPECT_THROW((jit.getFunction<std::int64_t, std::int64_t, bool>(*func)),
+               ljit::CodeGenError);
+  EXPECT_FALSE(jit.isCompiled(*func));
+}
+
+TEST(CodeGenModuleTest, call)
+{
+  // Assign
+  ljit::Module module;
+  // fact(n) = n <= 1 ? 1 : n * fact(n - 1)
+  auto *const fact = module.createFunction("fact", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  {
+    auto *const bb0 = fact->appendBB();
+    auto *const bb1 = fact->appendBB();
+    auto *const bb2 = fact->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+    bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+    bb1->pushInstBack<ljit::Ret>(v2);
+
+    auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+    auto *v5 = bb2->pushInstBack<ljit::Call>(fact);
+    v5->appendArg(v4);
+    auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v5);
+    bb2->pushInstBack<ljit::Ret>(v6);
+  }
+
+  // sum7(a0, ..., a6) = a0 + ... + a6, the last argument is on the stack
+  const std::vector<ljit::Type> args(7, ljit::Type::I16);
+  auto *const sum7 = module.createFunction("sum7", ljit::Type::I16, args);
+  {
+    auto *const bb0 = sum7->appendBB();
+    ljit::Value *res = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I16);
+    for (std::size_t idx = 1; idx < args.size(); ++idx)
+      res = bb0->pushInstBack<ljit::BinOp>(
+        ljit::BinOp::Oper::kAdd, res,
+        bb0->pushInstBack<ljit::Param>(idx, ljit::Type::I16));
+    bb0->pushInstBack<ljit::Ret>(res);
+  }
+
+  // caller(n) = sum7(fact(n), 1, 2, 3, 4, 5, n)
+  auto *const caller = module.createFunction("caller", ljit::Type::I16,
+                                             std::vector{ljit::Type::I16});
+  {
+    auto *const bb0 = caller->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I16);
+    std::vector<ljit::Value *> consts;
+    for (std::int16_t val = 1; val <= 5; ++val)
+      consts.push_back(bb0->pushInstBack<ljit::ConstVal_I16>(val));
+    auto *v1 = bb0->pushInstBack<ljit::Cast>(ljit::Type::I64, v0);
+    auto *v2 = bb0->pushInstBack<ljit::Call>(fact);
+    v2->appendArg(v1);
+    auto *v3 = bb0->pushInstBack<ljit::Cast>(ljit::Type::I16, v2);
+    auto *v4 = bb0->pushInstBack<ljit::Call>(sum7);
+    v4->appendArg(v3);
+    for (auto *const val : consts)
+      v4->appendArg(val);
+    v4->appendArg(v0);
+    bb0->pushInstBack<ljit::Ret>(v4);
+  }
+
+  auto *const undefined = module.createFunction("undefined", ljit::Type::None);
+  ljit::JitCompiler jit;
+
+  // Act
+  auto *const compiledFact = jit.getFunction<std::int64_t, std::int64_t>(*fact);
+  auto *const compiledCaller =
+    jit.getFunction<std::int16_t, std::int16_t>(*caller);
+
+  // Assert
+  EXPECT_EQ(compiledFact(5), 120);
+  EXPECT_EQ(compiledFact(20), 2432902008176640000);
+  EXPECT_TRUE(jit.isCompiled(*sum7));
+  EXPECT_EQ(compiledCaller(3), 6 + 15 + 3);
+  // 8! = 40320 wraps to -25216 in I16
+  EXPECT_EQ(compiledCaller(8), -25216 + 15 + 8);
+  EXPECT_THROW(jit.getFunction<void>(*undefined), ljit::CodeGenError);
+  EXPECT_FALSE(jit.isCompiled(*undefined));
+}
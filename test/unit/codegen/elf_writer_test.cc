@@ -0,0 +1,239 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <elf.h>
+#include <sys/mman.h>
+
+#include "codegen/elf_writer.hh"
+#include "common/error.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+
+namespace
+{
+std::int64_t inc(std::int64_t val)
+{
+  return val + 1;
+}
+
+template <class T>
+T get(const std::vector<unsigned char> &obj, std::size_t offset)
+{
+  T res;
+  std::memcpy(&res, obj.data() + offset, sizeof(T));
+  return res;
+}
+
+Elf64_Shdr getSection(const std::vector<unsigned char> &obj, std::size_t idx)
+{
+  const auto ehdr = get<Elf64_Ehdr>(obj, 0);
+  return get<Elf64_Shdr>(obj, ehdr.e_shoff + idx * sizeof(Elf64_Shdr));
+}
+
+// Links the object in memory: .text and .data.rel.ro are mapped together,
+// undefined symbols are taken from the host
+class ObjectLoader final
+{
+  std::vector<unsigned char> m_obj{};
+  std::unordered_map<std::string, std::uintptr_t> m_symbols{};
+  unsigned char *m_mem{};
+  std::size_t m_size{};
+
+public:
+  ObjectLoader(std::vector<unsigned char> obj,
+               const std::unordered_map<std::string, std::uintptr_t> &host)
+    : m_obj(std::move(obj))
+  {
+    const auto text = getSection(m_obj, 1);
+    const auto data = getSection(m_obj, 2);
+    const auto dataOffset = (text.sh_size + 15) / 16 * 16;
+    m_size = dataOffset + data.sh_size;
+    m_mem = static_cast<unsigned char *>(::mmap(nullptr, m_size,
+                                                PROT_READ | PROT_WRITE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS,
+                                                -1, 0));
+    std::memcpy(m_mem, m_obj.data() + text.sh_offset, text.sh_size);
+    std::memcpy(m_mem + dataOffset, m_obj.data() + data.sh_offset,
+                data.sh_size);
+    const std::uintptr_t bases[] = {0, reinterpret_cast<std::uintptr_t>(m_mem),
+                                    reinterpret_cast<std::uintptr_t>(m_mem) +
+                                      dataOffset};
+
+    const auto symtab = getSection(m_obj, 5);
+    const auto *const strtab = reinterpret_cast<const char *>(
+      m_obj.data() + getSection(m_obj, symtab.sh_link).sh_offset);
+    std::vector<std::uintptr_t> addrs;
+    for (std::size_t idx = 0; idx < symtab.sh_size / sizeof(Elf64_Sym); ++idx)
+    {
+      const auto sym = get<Elf64_Sym>(m_obj, symtab.sh_offset +
+                                             idx * sizeof(Elf64_Sym));
+      const std::string name = strtab + sym.st_name;
+      const auto addr = sym.st_shndx == SHN_UNDEF
+                          ? (name.empty() ? 0 : host.at(name))
+                          : bases[sym.st_shndx] + sym.st_value;
+      addrs.push_back(addr);
+      if (!name.empty())
+        m_symbols[name] = addr;
+    }
+
+    for (const std::size_t relaIdx : {3U, 4U})
+    {
+      const auto rela = getSection(m_obj, relaIdx);
+      for (std::size_t off = 0; off < rela.sh_size; off += sizeof(Elf64_Rela))
+      {
+        const auto reloc = get<Elf64_Rela>(m_obj, rela.sh_offset + off);
+        const auto place = bases[rela.sh_info] + reloc.r_offset;
+        const auto val = addrs.at(ELF64_R_SYM(reloc.r_info)) +
+                         static_cast<std::uintptr_t>(reloc.r_addend);
+        if (ELF64_R_TYPE(reloc.r_info) == R_X86_64_PC32)
+        {
+          const auto disp = static_cast<std::int32_t>(val - place);
+          std::memcpy(reinterpret_cast<void *>(place), &disp, sizeof(disp));
+        }
+        else
+          std::memcpy(reinterpret_cast<void *>(place), &val, sizeof(val));
+      }
+    }
+    ::mprotect(m_mem, m_size, PROT_READ | PROT_EXEC);
+  }
+  ObjectLoader(const ObjectLoader &) = delete;
+  ObjectLoader &operator=(const ObjectLoader &) = delete;
+  ObjectLoader(ObjectLoader &&) = delete;
+  ObjectLoader &operator=(ObjectLoader &&) = delete;
+  ~ObjectLoader()
+  {
+    ::munmap(m_mem, m_size);
+  }
+
+  template <class Ret, class... Args>
+  [[nodiscard]] auto getFunction(const std::string &name) const
+  {
+    Ret (*func)(Args...) = nullptr;
+    const auto addr = m_symbols.at(name);
+    std::memcpy(&func, &addr, sizeof(func));
+    return func;
+  }
+};
+} // namespace
+
+class ElfWriterTest : public ::testing::Test
+{
+protected:
+  ElfWriterTest() = default;
+
+  // fact(n) = n <= 2 ? n : n * fact(n - 1)
+  // inc(n) is external
+  // factInc(a, b) = fact(inc(a / b))
+  void buildModule()
+  {
+    auto *const fact = module.createFunction("fact", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = fact->appendBB();
+    auto *const bb1 = fact->appendBB();
+    auto *const bb2 = fact->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+    bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+    bb1->pushInstBack<ljit::Ret>(v0);
+    auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+    auto *v5 = bb2->pushInstBack<ljit::Call>(fact);
+    v5->appendArg(v4);
+    auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v5);
+    bb2->pushInstBack<ljit::Ret>(v6);
+
+    auto *const ext = module.createFunction("inc", ljit::Type::I64,
+                                            std::vector{ljit::Type::I64});
+    auto *const factInc = module.createFunction(
+      "factInc", ljit::Type::I64,
+      std::vector{ljit::Type::I64, ljit::Type::I64});
+    auto *const bb = factInc->appendBB();
+    auto *v7 = bb->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v8 = bb->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+    auto *v9 = bb->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck,
+                                               v8);
+    auto *v10 = bb->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v7, v9);
+    auto *v11 = bb->pushInstBack<ljit::Call>(ext);
+    v11->appendArg(v10);
+    auto *v12 = bb->pushInstBack<ljit::Call>(fact);
+    v12->appendArg(v11);
+    bb->pushInstBack<ljit::Ret>(v12);
+  }
+
+  ljit::Module module;
+};
+
+TEST_F(ElfWriterTest, symbols)
+{
+  // Assign
+  buildModule();
+  ljit::ElfWriter writer;
+
+  // Act
+  writer.addModule(module);
+  const auto obj = writer.serialize();
+
+  // Assert
+  ASSERT_GE(obj.size(), sizeof(Elf64_Ehdr));
+  const auto ehdr = get<Elf64_Ehdr>(obj, 0);
+  EXPECT_EQ(std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG), 0);
+  EXPECT_EQ(ehdr.e_ident[EI_CLASS], ELFCLASS64);
+  EXPECT_EQ(ehdr.e_type, ET_REL);
+  EXPECT_EQ(ehdr.e_machine, EM_X86_64);
+
+  const auto symtab = getSection(obj, 5);
+  EXPECT_EQ(symtab.sh_type, SHT_SYMTAB);
+  std::unordered_map<std::string, Elf64_Sym> syms;
+  const auto strtab = getSection(obj, symtab.sh_link);
+  for (std::size_t off = 0; off < symtab.sh_size; off += sizeof(Elf64_Sym))
+  {
+    const auto sym = get<Elf64_Sym>(obj, symtab.sh_offset + off);
+    syms[reinterpret_cast<const char *>(obj.data() + strtab.sh_offset +
+                                        sym.st_name)] = sym;
+  }
+  // Functions are defined, external callees are not
+  EXPECT_EQ(ELF64_ST_TYPE(syms.at("fact").st_info), STT_FUNC);
+  EXPECT_EQ(ELF64_ST_BIND(syms.at("fact").st_info), STB_GLOBAL);
+  EXPECT_NE(syms.at("factInc").st_size, 0);
+  EXPECT_EQ(syms.at("inc").st_shndx, SHN_UNDEF);
+  EXPECT_EQ(syms.at(ljit::ElfWriter::kTrapHandler).st_shndx, SHN_UNDEF);
+}
+
+TEST_F(ElfWriterTest, link)
+{
+  // Assign
+  buildModule();
+  ljit::ElfWriter writer;
+  writer.addModule(module);
+
+  // Act
+  const ObjectLoader loader{
+    writer.serialize(),
+    {{"inc", reinterpret_cast<std::uintptr_t>(&inc)},
+     {"abort", reinterpret_cast<std::uintptr_t>(&std::abort)}}};
+
+  // Assert
+  const auto fact = loader.getFunction<std::int64_t, std::int64_t>("fact");
+  const auto factInc =
+    loader.getFunction<std::int64_t, std::int64_t, std::int64_t>("factInc");
+  EXPECT_EQ(fact(20), 2432902008176640000);
+  EXPECT_EQ(factInc(12, 3), 120);
+}
+
+TEST_F(ElfWriterTest, duplicate)
+{
+  // Assign
+  buildModule();
+  ljit::ElfWriter writer;
+  writer.addModule(module);
+
+  // Act & Assert
+  EXPECT_THROW(writer.addFunction(*module.findFunction("fact")),
+               ljit::CodeGenError);
+}
@@ -0,0 +1,98 @@
+#include <csignal>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+
+#include "codegen/fault_handler.hh"
+
+namespace
+{
+volatile std::sig_atomic_t gNumForeign = 0;
+
+void onForeignSignal(int /* sig */)
+{
+  gNumForeign = gNumForeign + 1;
+}
+} // namespace
+
+// Must go first: the handler is installed by the first registration
+TEST(FaultHandlerTest, chainsForeignSignals)
+{
+  // Assign
+  struct sigaction action{};
+  action.sa_handler = &onForeignSignal;
+  ::sigemptyset(&action.sa_mask);
+  ASSERT_EQ(::sigaction(SIGFPE, &action, nullptr), 0);
+  const std::vector<std::uint8_t> code(16);
+
+  // Act
+  const auto reg = ljit::FaultHandler::add(code.data(), code.size(),
+                                           {ljit::ImplicitCheck{4, 12}});
+  ::raise(SIGFPE);
+
+  // Assert
+  EXPECT_EQ(gNumForeign, 1);
+  struct sigaction installed{};
+  ASSERT_EQ(::sigaction(SIGFPE, nullptr, &installed), 0);
+  EXPECT_NE(installed.sa_flags & SA_SIGINFO, 0);
+}
+
+TEST(FaultHandlerTest, lookup)
+{
+  // Assign
+  const std::vector<std::uint8_t> first(16);
+  const std::vector<std::uint8_t> second(32);
+  const auto begin = reinterpret_cast<std::uintptr_t>(second.data());
+
+  // Act
+  auto firstReg = ljit::FaultHandler::add(first.data(), first.size(),
+                                          {ljit::ImplicitCheck{2, 10}});
+  auto secondReg = ljit::FaultHandler::add(
+    second.data(), second.size(),
+    {ljit::ImplicitCheck{20, 30}, ljit::ImplicitCheck{4, 24}});
+  const auto empty = ljit::FaultHandler::add(first.data(), first.size(), {});
+
+  // Assert
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 4), begin + 24);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 20), begin + 30);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 5), 0U);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(
+              reinterpret_cast<std::uintptr_t>(first.data()) + 2),
+            reinterpret_cast<std::uintptr_t>(first.data()) + 10);
+
+  secondReg.reset();
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 4), 0U);
+  firstReg = std::move(secondReg);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(
+              reinterpret_cast<std::uintptr_t>(first.data()) + 2),
+            0U);
+}
+
+TEST(FaultHandlerTest, removeInterleaved)
+{
+  // Assign
+  constexpr std::size_t kNumCodes = 8;
+  const std::vector<std::uint8_t> code(kNumCodes * 16);
+  const auto begin = reinterpret_cast<std::uintptr_t>(code.data());
+  std::vector<ljit::FaultHandler::Registration> regs;
+  for (std::size_t idx = 0; idx < kNumCodes; ++idx)
+    regs.push_back(ljit::FaultHandler::add(code.data() + idx * 16, 16,
+                                           {ljit::ImplicitCheck{2, 8}}));
+
+  // Act
+  // Odd ones are removed, the first one is registered again
+  for (std::size_t idx = 1; idx < kNumCodes; idx += 2)
+    regs[idx].reset();
+  regs[0] = ljit::FaultHandler::add(code.data(), 16,
+                                    {ljit::ImplicitCheck{4, 12}});
+
+  // Assert
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 2), 0U);
+  EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + 4), begin + 12);
+  for (std::size_t idx = 1; idx < kNumCodes; ++idx)
+    EXPECT_EQ(ljit::FaultHandler::findSlowPath(begin + idx * 16 + 2),
+              idx % 2 == 0 ? begin + idx * 16 + 8 : 0U);
+}
@@ -130,3 +130,26 @@ TEST_F(DomTreeTest, example3)
   EXPECT_TRUE(isDom(5, 7));
   EXPECT_FALSE(isDom(7, 6));
 }
+
+TEST_F(DomTreeTest, earlyExit)
+{
+  // Assign
+  genBBs(5);
+  makeEdge(0, 1);
+  makeEdge(1, 2);
+  makeEdge(1, 4);
+  // Node 3 is visited after 4, but its parent in DFS tree is 2
+  makeEdge(2, 4);
+  makeEdge(2, 3);
+  makeEdge(3, 1);
+
+  // Act
+  buildDomTree();
+
+  // Assert
+  EXPECT_TRUE(isDom(1, 2));
+  EXPECT_TRUE(isDom(1, 4));
+  EXPECT_TRUE(isDom(2, 3));
+  EXPECT_FALSE(isDom(2, 4));
+  EXPECT_FALSE(isDom(4, 3));
+}
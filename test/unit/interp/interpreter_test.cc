@@ -0,0 +1,285 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../graph/graph_test_builder.hh"
+
+#include "common/error.hh"
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "opt/gcm.hh"
+
+class InterpreterTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  InterpreterTest() = default;
+
+  // n-th Fibonacci number, phis are updated in parallel
+  void buildLoop()
+  {
+    genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+    auto *bb0 = bbs[0];
+    auto *bb1 = bbs[1];
+    auto *bb2 = bbs[2];
+    auto *bb3 = bbs[3];
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    // i, fib(i), fib(i + 1)
+    auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v6, bb2, bb3);
+
+    auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v5);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v3->addNode(v1, bb0);
+    v3->addNode(v7, bb2);
+    v4->addNode(v1, bb0);
+    v4->addNode(v5, bb2);
+    v5->addNode(v2, bb0);
+    v5->addNode(v8, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v4);
+  }
+
+  ljit::Interpreter interp;
+};
+
+TEST_F(InterpreterTest, arithmetic)
+{
+  // Assign
+  genBBs(1, ljit::Type::I8, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShl, v3, v2);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v4, v1);
+  auto *v6 = bb0->pushInstBack<ljit::Cast>(ljit::Type::I8, v5);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  // Act & Assert
+  // ((100 - 3) << 2) / 3 = 129, which wraps to -127 in I8
+  EXPECT_EQ(interp.run(*func, {100, 3}), -127);
+  EXPECT_EQ(interp.run(*func, {-7, 1}), -32);
+  EXPECT_EQ(interp.run(*func, {0, -1}), -4);
+}
+
+TEST_F(InterpreterTest, loop)
+{
+  // Assign
+  buildLoop();
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*func, {0}), 0);
+  EXPECT_EQ(interp.run(*func, {1}), 1);
+  EXPECT_EQ(interp.run(*func, {10}), 55);
+  EXPECT_EQ(interp.run(*func, {90}), 2880067194370816120);
+  EXPECT_GT(interp.getNumExecuted(), 90 * 4);
+}
+
+TEST_F(InterpreterTest, swap)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I64);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v4);
+  bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v4, v3);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  // Values are swapped on each iteration
+  v4->addNode(v0, bb0);
+  v4->addNode(v8, bb2);
+  v5->addNode(v1, bb0);
+  v5->addNode(v6, bb2);
+  v6->addNode(v2, bb0);
+  v6->addNode(v5, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*func, {1, 5, 7}), 5);
+  EXPECT_EQ(interp.run(*func, {2, 5, 7}), 7);
+  EXPECT_EQ(interp.run(*func, {4, 5, 7}), 7);
+}
+
+TEST_F(InterpreterTest, gcm)
+{
+  // Assign
+  buildLoop();
+  std::vector<std::int64_t> expected;
+  for (std::int64_t n = 0; n < 20; ++n)
+    expected.push_back(interp.run(*func, {n}));
+
+  // Act
+  ljit::GCM{func.get()}.run();
+  interp.invalidate(*func);
+
+  // Assert
+  for (std::int64_t n = 0; n < 20; ++n)
+    EXPECT_EQ(interp.run(*func, {n}),
+              expected[static_cast<std::size_t>(n)]);
+}
+
+TEST_F(InterpreterTest, diamond)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(10);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::Select>(v2, v1, v0);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v5 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  v5->addNode(v3, bb1);
+  v5->addNode(v4, bb2);
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*func, {3}), 9);
+  EXPECT_EQ(interp.run(*func, {-70000}), 605032704);
+  EXPECT_EQ(interp.run(*func, {42}), 42);
+  // Argument is truncated to I32
+  EXPECT_EQ(interp.run(*func, {(std::int64_t{1} << 32) + 5}), 25);
+}
+
+TEST_F(InterpreterTest, switchInst)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(100);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(200);
+  bb0->pushInstBack<ljit::Switch>(
+    v0, bb3, std::vector<ljit::Switch::Case>{{1, bb1}, {-5, bb2}, {7, bb1}});
+
+  bb1->pushInstBack<ljit::Ret>(v1);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v3 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v3->addNode(v0, bb0);
+  v3->addNode(v2, bb2);
+  bb3->pushInstBack<ljit::Ret>(v3);
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*func, {1}), 100);
+  EXPECT_EQ(interp.run(*func, {7}), 100);
+  EXPECT_EQ(interp.run(*func, {-5}), 200);
+  EXPECT_EQ(interp.run(*func, {3}), 3);
+}
+
+TEST_F(InterpreterTest, traps)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v3 =
+    bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  auto *v4 =
+    bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v0, v2);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v2, v4);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v5, v3);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  auto expectTrap = [&](std::int64_t lhs, std::int64_t rhs,
+                        ljit::TrapKind kind) {
+    try
+    {
+      interp.run(*func, {lhs, rhs});
+      FAIL() << "No trap";
+    }
+    catch (const ljit::TrapError &err)
+    {
+      EXPECT_EQ(err.getKind(), kind);
+    }
+  };
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*func, {1, 5}), 1);
+  EXPECT_EQ(interp.run(*func, {0, -2}), -5);
+  expectTrap(1, 0, ljit::TrapKind::kZeroCheck);
+  expectTrap(10, 1, ljit::TrapKind::kBoundsCheck);
+  expectTrap(-1, 1, ljit::TrapKind::kBoundsCheck);
+}
+
+TEST(InterpreterModuleTest, call)
+{
+  // Assign
+  ljit::Module module;
+  // fact(n) = n <= 1 ? 1 : n * fact(n - 1)
+  auto *const fact = module.createFunction("fact", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  {
+    auto *const bb0 = fact->appendBB();
+    auto *const bb1 = fact->appendBB();
+    auto *const bb2 = fact->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+    bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+    bb1->pushInstBack<ljit::Ret>(v2);
+
+    auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+    auto *v5 = bb2->pushInstBack<ljit::Call>(fact);
+    v5->appendArg(v4);
+    auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v5);
+    bb2->pushInstBack<ljit::Ret>(v6);
+  }
+
+  auto *const undefined = module.createFunction("undefined", ljit::Type::None);
+  ljit::Interpreter interp;
+
+  // Act & Assert
+  EXPECT_EQ(interp.run(*fact, {1}), 1);
+  EXPECT_EQ(interp.run(*fact, {5}), 120);
+  EXPECT_EQ(interp.run(*fact, {20}), 2432902008176640000);
+  EXPECT_THROW(interp.run(*fact, {100000}), std::runtime_error);
+  EXPECT_THROW(interp.run(*undefined), std::runtime_error);
+}
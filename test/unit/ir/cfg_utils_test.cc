@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include <iterator>
+#include <vector>
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/basic_block.hh"
+#include "ir/cfg_utils.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+class CFGUtilsTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  CFGUtilsTest() = default;
+};
+
+TEST_F(CFGUtilsTest, splitCriticalEdges)
+{
+  // Assign
+  // Triangle, edge bb0 -> bb2 is critical
+  genBBs(3, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  bb1->pushInstBack<ljit::JumpInstr>(bb2);
+
+  auto *v3 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v3->addNode(v0, bb0);
+  v3->addNode(v1, bb1);
+  bb2->pushInstBack<ljit::Ret>(v3);
+
+  ASSERT_TRUE(ljit::isCriticalEdge(bb0, bb2));
+  ASSERT_FALSE(ljit::isCriticalEdge(bb0, bb1));
+  ASSERT_FALSE(ljit::isCriticalEdge(bb1, bb2));
+
+  // Act
+  const auto numSplit = ljit::splitCriticalEdges(func.get());
+
+  // Assert
+  EXPECT_EQ(numSplit, 1);
+  ASSERT_EQ(func->size(), 4);
+  // New block follows the predecessor
+  auto *const newBB = &*std::next(func->begin());
+  EXPECT_NE(newBB, bb1);
+  EXPECT_EQ(&*std::next(func->begin(), 2), bb1);
+
+  EXPECT_EQ(bb0->getSucc(), (std::vector{bb1, newBB}));
+  EXPECT_EQ(newBB->getSucc(), std::vector{bb2});
+  EXPECT_EQ(newBB->getLast().getInstType(), ljit::InstType::kJump);
+  ASSERT_EQ(v3->numEntries(), 2);
+  EXPECT_EQ(v3->begin()->bb, newBB);
+  EXPECT_EQ(v3->begin()->m_val, v0);
+  EXPECT_FALSE(ljit::isCriticalEdge(bb0, newBB));
+  EXPECT_FALSE(ljit::isCriticalEdge(newBB, bb2));
+}
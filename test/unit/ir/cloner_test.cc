@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "../graph/graph_test_builder.hh"
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+
+class ClonerTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  ClonerTest() = default;
+};
+
+TEST_F(ClonerTest, loop)
+{
+  // Assign
+  const auto &&vals = buildLivLectureExample();
+  func->setName("lecture");
+
+  // Act
+  const auto clone = ljit::cloneFunction(*func);
+
+  // Assert
+  EXPECT_EQ(clone->getName(), "lecture");
+  EXPECT_EQ(clone->getResType(), func->getResType());
+  ASSERT_EQ(clone->size(), 4);
+
+  const auto &&srcBBs =
+    ljit::graph::depthFirstSearchReversePostOrder(func->makeBBGraph());
+  const auto &&newBBs =
+    ljit::graph::depthFirstSearchReversePostOrder(clone->makeBBGraph());
+  ASSERT_EQ(srcBBs.size(), newBBs.size());
+
+  for (std::size_t idx = 0; idx < srcBBs.size(); ++idx)
+  {
+    const auto *const srcBB = srcBBs[idx];
+    const auto *const newBB = newBBs[idx];
+    ASSERT_EQ(srcBB->size(), newBB->size());
+    EXPECT_EQ(srcBB->numPred(), newBB->numPred());
+    EXPECT_EQ(srcBB->numSucc(), newBB->numSucc());
+
+    for (auto srcIt = srcBB->begin(), newIt = newBB->begin();
+         srcIt != srcBB->end(); ++srcIt, ++newIt)
+    {
+      EXPECT_EQ(srcIt->getInstType(), newIt->getInstType());
+      EXPECT_EQ(srcIt->getType(), newIt->getType());
+      EXPECT_EQ(newIt->getBB(), newBB);
+      for (auto inp = newIt->inputBegin(); inp != newIt->inputEnd(); ++inp)
+      {
+        // Clone does not refer to the source function
+        const auto *const inpInst = static_cast<const ljit::Inst *>(*inp);
+        EXPECT_NE(std::find(newBBs.begin(), newBBs.end(), inpInst->getBB()),
+                  newBBs.end());
+      }
+    }
+  }
+
+  // Phi entries refer to the cloned blocks
+  const auto &phi = static_cast<const ljit::Phi &>(newBBs[1]->getFirst());
+  ASSERT_EQ(phi.numEntries(), 2);
+  EXPECT_EQ(phi.begin()->bb, newBBs[0]);
+  EXPECT_EQ(std::next(phi.begin())->bb, newBBs[2]);
+  ASSERT_TRUE(std::next(phi.begin())->m_val->isInst());
+  EXPECT_EQ(
+    static_cast<const ljit::Inst *>(std::next(phi.begin())->m_val)->getBB(),
+    newBBs[2]);
+
+  // Source is intact
+  EXPECT_EQ(vals[3]->users().size(), 2);
+  EXPECT_EQ(func->size(), 4);
+}
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <vector>
 
 #include "ir/basic_block.hh"
 #include "ir/function.hh"
@@ -119,3 +120,37 @@ TEST(Builder, Fibonacci)
   v5->addNode(v1, bb0);
   v5->addNode(v7, bb2);
 }
+
+TEST(Builder, Switch)
+{
+  auto func = ljit::Function{ljit::Type::I32, {ljit::Type::I32}};
+
+  auto *bb0 = func.appendBB();
+  auto *bb1 = func.appendBB();
+  auto *bb2 = func.appendBB();
+  auto *bb3 = func.appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *sw = bb0->pushInstBack<ljit::Switch>(
+    v0, bb3, std::vector<ljit::Switch::Case>{{7, bb2}, {1, bb1}, {3, bb1}});
+
+  {
+    ASSERT_EQ(sw->getVal(), v0);
+    ASSERT_EQ(sw->numCases(), 3);
+    ASSERT_EQ(sw->getCases().front().val, 1);
+    ASSERT_EQ(sw->getCases().back().val, 7);
+    ASSERT_EQ(sw->getTarget(3), bb1);
+    ASSERT_EQ(sw->getTarget(7), bb2);
+    ASSERT_EQ(sw->getTarget(2), bb3);
+    // Edge to bb1 is shared by two cases
+    ASSERT_EQ(bb0->getSucc(), (std::vector{bb3, bb1, bb2}));
+    ASSERT_EQ(bb1->getPred(), std::vector{bb0});
+  }
+
+  bb0->replaceSucc(bb1, bb2);
+  {
+    ASSERT_EQ(sw->getTarget(1), bb2);
+    ASSERT_EQ(bb0->getSucc(), (std::vector{bb3, bb2}));
+    ASSERT_TRUE(bb1->getPred().empty());
+  }
+}
@@ -0,0 +1,120 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "ir/basic_block.hh"
+#include "ir/cloner.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "ir/structural_hash.hh"
+
+namespace
+{
+using Oper = ljit::BinOp::Oper;
+} // namespace
+
+class StructuralHashTest : public ::testing::Test
+{
+protected:
+  StructuralHashTest() = default;
+
+  struct Shape final
+  {
+    std::int64_t val{1};
+    Oper oper{Oper::kAdd};
+    bool swapped{false};
+    ljit::Function *callee{nullptr};
+  };
+
+  // i64 name(i64 a) { return a <= val ? callee(a) : oper(a, val); }
+  ljit::Function *makeFunc(const char *name, const Shape &shape)
+  {
+    auto *const func = module.createFunction(name, ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    auto *const bb1 = func->appendBB();
+    auto *const bb2 = func->appendBB();
+
+    auto *const v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *const v1 = bb0->pushInstBack<ljit::ConstVal_I64>(shape.val);
+    auto *const v2 = bb0->pushInstBack<ljit::BinOp>(Oper::kLE, v0, v1);
+    if (shape.swapped)
+      bb0->pushInstBack<ljit::IfInstr>(v2, bb2, bb1);
+    else
+      bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+    if (shape.callee != nullptr)
+    {
+      auto *const call = bb1->pushInstBack<ljit::Call>(shape.callee);
+      call->appendArg(v0);
+      bb1->pushInstBack<ljit::Ret>(call);
+    }
+    else
+      bb1->pushInstBack<ljit::Ret>(v0);
+
+    auto *const v3 = bb2->pushInstBack<ljit::BinOp>(shape.oper, v0, v1);
+    bb2->pushInstBack<ljit::Ret>(v3);
+    return func;
+  }
+
+  ljit::Module module;
+};
+
+TEST_F(StructuralHashTest, equal)
+{
+  // Assign
+  const auto *const first = makeFunc("f", {});
+  const auto *const second = makeFunc("f", {});
+
+  // Act
+  const auto clone = ljit::cloneFunction(*first);
+
+  // Assert
+  EXPECT_EQ(ljit::getStructuralHash(*first),
+            ljit::getStructuralHash(*second));
+  EXPECT_EQ(ljit::getStructuralHash(*first), ljit::getStructuralHash(*clone));
+}
+
+TEST_F(StructuralHashTest, differs)
+{
+  // Assign
+  const auto *const func = makeFunc("f", {});
+  const auto *const renamed = makeFunc("g", {});
+  const auto *const constant = makeFunc("f", {2, Oper::kAdd, false, nullptr});
+  const auto *const opcode = makeFunc("f", {1, Oper::kSub, false, nullptr});
+  const auto *const swapped = makeFunc("f", {1, Oper::kAdd, true, nullptr});
+
+  // Act
+  const auto hash = ljit::getStructuralHash(*func);
+
+  // Assert
+  EXPECT_NE(hash, ljit::getStructuralHash(*renamed));
+  EXPECT_NE(hash, ljit::getStructuralHash(*constant));
+  EXPECT_NE(hash, ljit::getStructuralHash(*opcode));
+  EXPECT_NE(hash, ljit::getStructuralHash(*swapped));
+}
+
+TEST_F(StructuralHashTest, callees)
+{
+  // Assign
+  auto *const first = makeFunc("callee", {});
+  auto *const second = makeFunc("callee", {2, Oper::kAdd, false, nullptr});
+  auto *const rec = makeFunc("rec", {});
+  rec->makeBBGraph().getRoot()->pushInstFront<ljit::Call>(rec);
+
+  // Act
+  const auto *const firstCaller =
+    makeFunc("caller", {0, Oper::kAdd, false, first});
+  const auto *const secondCaller =
+    makeFunc("caller", {0, Oper::kAdd, false, second});
+  const auto *const recCaller = makeFunc("caller", {0, Oper::kAdd, false, rec});
+
+  // Assert
+  // Callee bodies may be inlined
+  EXPECT_NE(ljit::getStructuralHash(*firstCaller),
+            ljit::getStructuralHash(*secondCaller));
+  // Recursion terminates
+  EXPECT_NE(ljit::getStructuralHash(*recCaller),
+            ljit::getStructuralHash(*firstCaller));
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "opt/block_layout.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class BlockLayoutTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  BlockLayoutTest() = default;
+
+  void runLayout()
+  {
+    ljit::BlockLayout layout{func.get()};
+    layout.run();
+    numFallThrough = layout.getNumFallThrough();
+  }
+
+  [[nodiscard]] std::vector<ljit::BasicBlock *> getLayout() const
+  {
+    std::vector<ljit::BasicBlock *> res;
+    for (auto &bb : *func)
+      res.push_back(&bb);
+    return res;
+  }
+
+  std::size_t numFallThrough{};
+};
+
+TEST_F(BlockLayoutTest, chain)
+{
+  // Assign
+  genBBs(4, ljit::Type::None);
+  bbs[0]->pushInstBack<ljit::JumpInstr>(bbs[3]);
+  bbs[3]->pushInstBack<ljit::JumpInstr>(bbs[1]);
+  bbs[1]->pushInstBack<ljit::JumpInstr>(bbs[2]);
+  bbs[2]->pushInstBack<ljit::Ret>();
+
+  // Act
+  runLayout();
+
+  // Assert
+  EXPECT_EQ(getLayout(), (std::vector{bbs[0], bbs[3], bbs[1], bbs[2]}));
+  EXPECT_EQ(numFallThrough, 3);
+}
+
+TEST_F(BlockLayoutTest, loop)
+{
+  // Assign
+  // for (i = 0; i < n; ++i);
+  genBBs(4, ljit::Type::None, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v4, bb3, bb2);
+
+  bb2->pushInstBack<ljit::Ret>();
+
+  auto *v5 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  bb3->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v1, bb0);
+  v3->addNode(v5, bb3);
+
+  // Act
+  runLayout();
+
+  // Assert
+  // Loop body falls through from the header, exit goes last
+  EXPECT_EQ(getLayout(), (std::vector{bb0, bb1, bb3, bb2}));
+  EXPECT_EQ(numFallThrough, 2);
+  EXPECT_EQ(bb1->getSucc(), (std::vector{bb3, bb2}));
+}
+
+TEST_F(BlockLayoutTest, profile)
+{
+  // Assign
+  // Diamond w/ the hot false arm
+  genBBs(4, ljit::Type::None, std::vector{ljit::Type::I1});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I1);
+  bb0->pushInstBack<ljit::IfInstr>(v0, bb1, bb2);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+  bb3->pushInstBack<ljit::Ret>();
+
+  // Act
+  ljit::BlockLayout layout{func.get(), ljit::EdgeProfile{{bb0, {10, 90}}}};
+  layout.run();
+
+  // Assert
+  EXPECT_EQ(getLayout(), (std::vector{bb0, bb2, bb3, bb1}));
+  EXPECT_EQ(layout.getNumFallThrough(), 2);
+}
@@ -93,3 +93,56 @@ TEST_F(ChecksEliminationTest, bound)
   EXPECT_EQ(v6, &bb2->getFirst());
   EXPECT_EQ(v7->getNext(), check2);
 }
+
+TEST_F(ChecksEliminationTest, ranges)
+{
+  // Assign
+  genBBs(5, ljit::Type::I64, std::vector{ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+  auto *bb4 = bbs[4];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v1, v0);
+  bb0->pushInstBack<ljit::IfInstr>(v4, bb1, bb4);
+
+  // 0 < v0
+  auto *check0 =
+    bb1->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v0);
+  auto *v5 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v2, check0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb2);
+
+  auto *v6 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v6, v2);
+  bb2->pushInstBack<ljit::IfInstr>(v7, bb3, bb4);
+
+  // 0 <= v6 < 10
+  [[maybe_unused]] auto *check1 =
+    bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v6, v2);
+  auto *check2 =
+    bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v6, v5);
+  auto *v8 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v3);
+  bb3->pushInstBack<ljit::JumpInstr>(bb2);
+
+  v6->addNode(v1, bb1);
+  v6->addNode(v8, bb3);
+
+  bb4->pushInstBack<ljit::Ret>(v1);
+
+  // Act
+  elim.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(bb1->size(), 2);
+  EXPECT_EQ(v5->getRight(), v0);
+  ASSERT_EQ(bb3->size(), 3);
+  EXPECT_EQ(&bb3->getFirst(), check2);
+  EXPECT_EQ(v8->getPrev(), check2);
+}
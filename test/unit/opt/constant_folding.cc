@@ -1,4 +1,7 @@
+#include <cstdint>
 #include <gtest/gtest.h>
+#include <limits>
+#include <vector>
 
 #include "opt/constant_folding.hh"
 
@@ -51,6 +54,43 @@ TEST_F(ConstFoldTest, shrSimple)
   EXPECT_EQ(const_.getVal(), 8);
 }
 
+TEST_F(ConstFoldTest, shrOutOfRange)
+{
+  // Assign
+  genBBs(1);
+  auto *const lval = bbs[0]->pushInstBack<ljit::ConstVal_I64>(32);
+  auto *const rval = bbs[0]->pushInstBack<ljit::ConstVal_I64>(64);
+  auto *const shr =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, lval, rval);
+  const auto &graph = makeGraph();
+  // Act
+  cFold.run(graph);
+  // Assert
+  // Shift traps at run time
+  ASSERT_EQ(bbs[0]->size(), 3);
+  EXPECT_EQ(&bbs[0]->getLast(), shr);
+}
+
+TEST_F(ConstFoldTest, shlSimple)
+{
+  // Assign
+  genBBs(1);
+  auto *const lval = bbs[0]->pushInstBack<ljit::ConstVal_I8>(std::int8_t{-3});
+  auto *const rval = bbs[0]->pushInstBack<ljit::ConstVal_I8>(std::int8_t{6});
+  bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShl, lval, rval);
+  const auto &graph = makeGraph();
+  // Act
+  cFold.run(graph);
+  // Assert
+  ASSERT_EQ(bbs[0]->size(), 3);
+  const auto &inst = bbs[0]->getLast();
+  ASSERT_EQ(inst.getInstType(), ljit::InstType::kConst);
+  ASSERT_EQ(inst.getType(), ljit::Type::I8);
+  const auto &const_ = static_cast<const ljit::ConstVal_I8 &>(inst);
+  // -192 wraps around
+  EXPECT_EQ(const_.getVal(), 64);
+}
+
 TEST_F(ConstFoldTest, orSimple)
 {
   // Assign
@@ -69,3 +109,86 @@ TEST_F(ConstFoldTest, orSimple)
   const auto &const_ = static_cast<const ljit::ConstVal_I64 &>(inst);
   EXPECT_EQ(const_.getVal(), 34);
 }
+
+TEST_F(ConstFoldTest, chain)
+{
+  // Assign
+  genBBs(1);
+  auto *const v0 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(3);
+  auto *const v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(4);
+  auto *const v2 =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  auto *const v3 =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v2, v0);
+  auto *const v4 =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v3, v1);
+  bbs[0]->pushInstBack<ljit::Ret>(v4);
+  const auto &graph = makeGraph();
+  // Act
+  cFold.run(graph);
+  // Assert
+  ASSERT_EQ(bbs[0]->size(), 6);
+  // Division may trap, so it is not folded
+  ASSERT_TRUE(v4->getLeft()->isInst());
+  const auto *const inst = static_cast<const ljit::Inst *>(v4->getLeft());
+  ASSERT_EQ(inst->getInstType(), ljit::InstType::kConst);
+  EXPECT_EQ(ljit::retrieveConstVal(inst), 9);
+}
+
+TEST_F(ConstFoldTest, select)
+{
+  // Assign
+  genBBs(1, ljit::Type::I32, std::vector{ljit::Type::I32});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I1>(false);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(7);
+  auto *v3 = bb0->pushInstBack<ljit::Select>(v1, v0, v2);
+  auto *v4 = bb0->pushInstBack<ljit::Select>(v0, v3, v3);
+  auto *v5 = bb0->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  cFold.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(v5->getVal(), v2);
+  EXPECT_EQ(bb0->size(), 4);
+}
+
+TEST_F(ConstFoldTest, mulWraps)
+{
+  // Assign
+  genBBs(1);
+  auto *const lval = bbs[0]->pushInstBack<ljit::ConstVal_I64>(
+    std::numeric_limits<std::int64_t>::max());
+  auto *const rval = bbs[0]->pushInstBack<ljit::ConstVal_I64>(2);
+  bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, lval, rval);
+  const auto &graph = makeGraph();
+  // Act
+  cFold.run(graph);
+  // Assert
+  ASSERT_EQ(bbs[0]->size(), 3);
+  const auto &inst = bbs[0]->getLast();
+  ASSERT_EQ(inst.getInstType(), ljit::InstType::kConst);
+  const auto &const_ = static_cast<const ljit::ConstVal_I64 &>(inst);
+  EXPECT_EQ(const_.getVal(), -2);
+}
+
+TEST_F(ConstFoldTest, castWiden)
+{
+  // Assign
+  genBBs(1);
+  auto *const val = bbs[0]->pushInstBack<ljit::ConstVal_I32>(-5);
+  bbs[0]->pushInstBack<ljit::Cast>(ljit::Type::I64, val);
+  const auto &graph = makeGraph();
+  // Act
+  cFold.run(graph);
+  // Assert
+  ASSERT_EQ(bbs[0]->size(), 2);
+  const auto &inst = bbs[0]->getLast();
+  ASSERT_EQ(inst.getInstType(), ljit::InstType::kConst);
+  ASSERT_EQ(inst.getType(), ljit::Type::I64);
+  const auto &const_ = static_cast<const ljit::ConstVal_I64 &>(inst);
+  EXPECT_EQ(const_.getVal(), -5);
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "opt/dce.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class DCETest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  DCETest() = default;
+
+  void runDCE()
+  {
+    dce = std::make_unique<ljit::DCE>(func.get());
+    dce->run();
+  }
+
+  std::unique_ptr<ljit::DCE> dce;
+};
+
+TEST_F(DCETest, deadInsts)
+{
+  // Assign
+  genBBs(2, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  // Dead, but has side effect
+  bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v0, v2);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v2, v2);
+  bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v4, v1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  // Dead loop-carried value
+  auto *v7 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v8 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v1);
+  v7->addNode(v1, bb0);
+  v7->addNode(v8, bb1);
+  auto *v9 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb1->pushInstBack<ljit::IfInstr>(v9, bb1, bb1);
+
+  // Act
+  runDCE();
+
+  // Assert
+  EXPECT_EQ(dce->getNumRemovedInsts(), 4);
+  EXPECT_EQ(dce->getNumRemovedBBs(), 0);
+  EXPECT_EQ(bb0->size(), 5);
+  EXPECT_EQ(bb1->size(), 2);
+  EXPECT_EQ(v1->users().size(), 2);
+}
+
+TEST_F(DCETest, deadTraps)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(3);
+  // Dead, but may trap
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShl, v0, v1);
+  // Dead, amount is in range
+  bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v2);
+  bb0->pushInstBack<ljit::Ret>(v0);
+
+  // Act
+  runDCE();
+
+  // Assert
+  // Shift and its amount
+  EXPECT_EQ(dce->getNumRemovedInsts(), 2);
+  EXPECT_EQ(v3->getBB(), bb0);
+  EXPECT_EQ(v4->getBB(), bb0);
+  EXPECT_EQ(bb0->size(), 5);
+}
+
+TEST_F(DCETest, constBranch)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  bb0->pushInstBack<ljit::IfInstr>(v1, bb1, bb2);
+
+  auto *v2 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v3 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v0);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v4->addNode(v2, bb1);
+  v4->addNode(v3, bb2);
+  auto *v5 = bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runDCE();
+
+  // Assert
+  EXPECT_EQ(dce->getNumRemovedBBs(), 1);
+  // Phi and the constant
+  EXPECT_EQ(dce->getNumRemovedInsts(), 2);
+  EXPECT_EQ(func->size(), 3);
+
+  ASSERT_EQ(bb0->size(), 2);
+  EXPECT_EQ(bb0->getLast().getInstType(), ljit::InstType::kJump);
+  ASSERT_EQ(bb0->getSucc().size(), 1);
+  EXPECT_EQ(bb0->getSucc().front(), bb2);
+
+  ASSERT_EQ(bb3->size(), 1);
+  ASSERT_EQ(bb3->getPred().size(), 1);
+  EXPECT_EQ(bb3->getPred().front(), bb2);
+  EXPECT_EQ(v5->getVal(), v3);
+  EXPECT_EQ(v0->users().size(), 1);
+}
+
+TEST_F(DCETest, constSwitch)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  bb0->pushInstBack<ljit::Switch>(
+    v1, bb3, std::vector<ljit::Switch::Case>{{1, bb1}, {2, bb2}, {3, bb2}});
+
+  auto *v2 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v3 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v0);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v4->addNode(v0, bb0);
+  v4->addNode(v2, bb1);
+  v4->addNode(v3, bb2);
+  auto *v5 = bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runDCE();
+
+  // Assert
+  EXPECT_EQ(dce->getNumRemovedBBs(), 1);
+  EXPECT_EQ(func->size(), 3);
+
+  EXPECT_EQ(bb0->getLast().getInstType(), ljit::InstType::kJump);
+  ASSERT_EQ(bb0->getSucc().size(), 1);
+  EXPECT_EQ(bb0->getSucc().front(), bb2);
+
+  ASSERT_EQ(bb3->getPred().size(), 1);
+  EXPECT_EQ(bb3->getPred().front(), bb2);
+  EXPECT_EQ(v5->getVal(), v3);
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "opt/gcm.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class GCMTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  GCMTest() = default;
+
+  void runGCM()
+  {
+    gcm = std::make_unique<ljit::GCM>(func.get());
+    gcm->run();
+  }
+
+  static std::vector<const ljit::Inst *> getInsts(const ljit::BasicBlock *bb)
+  {
+    std::vector<const ljit::Inst *> res;
+    for (const auto &inst : *bb)
+      res.push_back(&inst);
+    return res;
+  }
+
+  std::unique_ptr<ljit::GCM> gcm;
+};
+
+TEST_F(GCMTest, sinkToUse)
+{
+  // Assign
+  genBBs(3, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I1});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I1);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v3, v3);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v5);
+  auto *ret1 = bb1->pushInstBack<ljit::Ret>(v6);
+
+  auto *ret2 = bb2->pushInstBack<ljit::Ret>(v0);
+
+  // Act
+  runGCM();
+
+  // Assert
+  EXPECT_EQ(gcm->getNumMoved(), 2);
+  // Division may trap, so it is pinned
+  EXPECT_EQ(v5->getBB(), bb0);
+  EXPECT_EQ(bb0->size(), 5);
+
+  EXPECT_EQ(getInsts(bb1),
+            (std::vector<const ljit::Inst *>{v3, v4, v6, ret1}));
+  EXPECT_EQ(getInsts(bb2), (std::vector<const ljit::Inst *>{ret2}));
+}
+
+TEST_F(GCMTest, hoistFromLoop)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v2 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v2, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v3, bb2, bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v4);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v2->addNode(v1, bb0);
+  v2->addNode(v5, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v2);
+
+  // Act
+  runGCM();
+
+  // Assert
+  EXPECT_EQ(gcm->getNumMoved(), 1);
+  EXPECT_EQ(v4->getBB(), bb0);
+  EXPECT_EQ(std::next(ljit::BasicBlock::iterator{v4})->getInstType(),
+            ljit::InstType::kJump);
+  // Phi input stays in the latch, header is more frequent
+  EXPECT_EQ(v5->getBB(), bb2);
+  EXPECT_EQ(v3->getBB(), bb1);
+  EXPECT_EQ(v1->getBB(), bb0);
+}
+
+TEST_F(GCMTest, shiftAmount)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(3);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+  // Amount is checked only at run time, so the shift may trap
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v1);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShl, v0, v3);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v7);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v8);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v4->addNode(v2, bb0);
+  v4->addNode(v9, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runGCM();
+
+  // Assert
+  EXPECT_EQ(v6->getBB(), bb2);
+  EXPECT_EQ(v7->getBB(), bb0);
+}
@@ -0,0 +1,324 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "opt/guard_hoisting.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+
+class GuardHoistingTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  GuardHoistingTest() = default;
+
+  void runGuardHoisting(bool speculative = false)
+  {
+    hoisting = std::make_unique<ljit::GuardHoisting>(func.get(), speculative);
+    hoisting->run();
+  }
+
+  // for (i = start; i < limit; i += step) check(i + off, bound)
+  // Returns the check
+  ljit::BinOp *buildLoop(ljit::Value *start, ljit::Value *limit,
+                         ljit::Value *bound, std::int64_t off = 0,
+                         std::int64_t step = 1)
+  {
+    auto *bb0 = bbs[0];
+    auto *bb1 = bbs[1];
+    auto *bb2 = bbs[2];
+    auto *bb3 = bbs[3];
+
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v0 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v1 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v2 =
+      bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, limit);
+    bb1->pushInstBack<ljit::IfInstr>(v2, bb2, bb3);
+
+    ljit::Value *idx = v0;
+    if (off != 0)
+    {
+      auto *offVal = bb2->pushInstBack<ljit::ConstVal_I64>(off);
+      idx = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, offVal);
+    }
+    auto *check = bb2->pushInstBack<ljit::BinOp>(
+      ljit::BinOp::Oper::kBoundsCheck, idx, bound);
+    auto *v3 =
+      bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v1, check);
+    auto *v4 = bb2->pushInstBack<ljit::ConstVal_I64>(step);
+    auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v4);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v0->addNode(start, bb0);
+    v0->addNode(v5, bb2);
+    v1->addNode(start, bb0);
+    v1->addNode(v3, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v1);
+
+    return check;
+  }
+
+  std::unique_ptr<ljit::GuardHoisting> hoisting;
+};
+
+TEST_F(GuardHoistingTest, removeByLimit)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *check = buildLoop(v1, v0, v0);
+  auto *idx = check->getLeft();
+  auto *sum = static_cast<ljit::Inst *>(check->getNext());
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumRemoved(), 1);
+  EXPECT_EQ(hoisting->getNumHoisted(), 0);
+  EXPECT_EQ(func->size(), 4);
+  EXPECT_EQ(bbs[2]->size(), 4);
+  EXPECT_EQ(sum->inputAt(1), idx);
+}
+
+TEST_F(GuardHoistingTest, removeConst)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64);
+  auto *v0 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(16);
+  buildLoop(v0, v1, v2, 6);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumRemoved(), 1);
+  EXPECT_EQ(bbs[2]->collectInsts(ljit::InstType::kBinOp).size(), 3);
+}
+
+TEST_F(GuardHoistingTest, hoistConst)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64);
+  auto *v0 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(16);
+  buildLoop(v0, v1, v2, 8);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumRemoved(), 0);
+  EXPECT_EQ(hoisting->getNumHoisted(), 1);
+  // Loop is always entered, so no guard is needed
+  EXPECT_EQ(func->size(), 4);
+
+  auto *const bb0 = bbs[0];
+  ASSERT_EQ(bb0->size(), 6);
+  ASSERT_EQ(bb0->getLast().getInstType(), ljit::InstType::kJump);
+  const auto &check =
+    static_cast<const ljit::BinOp &>(*bb0->getLast().getPrev());
+  EXPECT_EQ(check.getOper(), ljit::BinOp::Oper::kBoundsCheck);
+  EXPECT_EQ(check.getRight(), v2);
+  EXPECT_EQ(ljit::retrieveConstVal(static_cast<ljit::Inst *>(check.getLeft())),
+            17);
+  EXPECT_TRUE(bbs[1]->getPred().front() == bb0 ||
+              bbs[1]->getPred().back() == bb0);
+}
+
+TEST_F(GuardHoistingTest, hoistGuarded)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  buildLoop(v2, v0, v1);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumHoisted(), 1);
+  ASSERT_EQ(func->size(), 6);
+  EXPECT_EQ(bbs[2]->collectInsts(ljit::InstType::kBinOp).size(), 2);
+
+  auto *const bb0 = bbs[0];
+  ASSERT_EQ(bb0->getLast().getInstType(), ljit::InstType::kIf);
+  const auto &branch = static_cast<const ljit::IfInstr &>(bb0->getLast());
+  const auto &cond = static_cast<const ljit::BinOp &>(*branch.getCond());
+  EXPECT_EQ(cond.getOper(), ljit::BinOp::Oper::kLE);
+  EXPECT_EQ(cond.getLeft(), v2);
+  EXPECT_EQ(cond.getRight(), v0);
+
+  auto *const checkBB = branch.getTrueBB();
+  auto *const joinBB = branch.getFalseBB();
+  ASSERT_EQ(checkBB->size(), 4);
+  ASSERT_EQ(checkBB->getSucc().size(), 1);
+  EXPECT_EQ(checkBB->getSucc().front(), joinBB);
+  ASSERT_EQ(joinBB->getSucc().size(), 1);
+  EXPECT_EQ(joinBB->getSucc().front(), bbs[1]);
+
+  // check(v0 - 1, v1)
+  const auto &check =
+    static_cast<const ljit::BinOp &>(*checkBB->getLast().getPrev());
+  EXPECT_EQ(check.getOper(), ljit::BinOp::Oper::kBoundsCheck);
+  EXPECT_EQ(check.getRight(), v1);
+  const auto &hi = static_cast<const ljit::BinOp &>(*check.getLeft());
+  EXPECT_EQ(hi.getLeft(), v0);
+  EXPECT_EQ(ljit::retrieveConstVal(static_cast<ljit::Inst *>(hi.getRight())),
+            -1);
+
+  for (const auto &phi : bbs[1]->collectInsts(ljit::InstType::kPhi))
+  {
+    const auto &entries = static_cast<const ljit::Phi &>(phi.get());
+    EXPECT_EQ(entries.begin()->bb, joinBB);
+  }
+}
+
+TEST_F(GuardHoistingTest, conditionalCheck)
+{
+  // Assign
+  genBBs(6, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+  auto *bb4 = bbs[4];
+  auto *bb5 = bbs[5];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb5);
+
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v1);
+  bb2->pushInstBack<ljit::IfInstr>(v6, bb3, bb4);
+
+  // Executed only if i < v1
+  bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v4, v1);
+  bb3->pushInstBack<ljit::JumpInstr>(bb4);
+
+  auto *v7 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v3);
+  bb4->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v4->addNode(v2, bb0);
+  v4->addNode(v7, bb4);
+
+  bb5->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumRemoved(), 0);
+  EXPECT_EQ(hoisting->getNumHoisted(), 0);
+  EXPECT_EQ(func->size(), 6);
+  EXPECT_EQ(bb3->size(), 2);
+}
+
+TEST_F(GuardHoistingTest, speculative)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *check = buildLoop(v2, v0, v1);
+  // Call before the check may trap
+  auto *call = check->getBB()->insertInstBefore<ljit::Call>(check, func.get());
+  call->appendArg(v0);
+  call->appendArg(v1);
+
+  // Act
+  runGuardHoisting();
+  const auto numHoisted = hoisting->getNumHoisted();
+  runGuardHoisting(true);
+
+  // Assert
+  EXPECT_EQ(numHoisted, 0);
+  EXPECT_EQ(hoisting->getNumHoisted(), 1);
+  EXPECT_EQ(func->size(), 6);
+  EXPECT_EQ(bbs[2]->collectInsts(ljit::InstType::kBinOp).size(), 2);
+  EXPECT_EQ(bbs[2]->collectInsts(ljit::InstType::kCall).size(), 1);
+}
+
+TEST_F(GuardHoistingTest, removeStepped)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64);
+  auto *v0 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(6);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(5);
+  buildLoop(v0, v1, v2, 0, 2);
+  ljit::Interpreter interp;
+  const auto expected = interp.run(*func);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  // Last value of IV is 4, not 5
+  EXPECT_EQ(expected, 6);
+  EXPECT_EQ(hoisting->getNumRemoved(), 1);
+  EXPECT_EQ(hoisting->getNumHoisted(), 0);
+  EXPECT_EQ(interp.run(*func), expected);
+}
+
+TEST_F(GuardHoistingTest, hoistStepped)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(6);
+  buildLoop(v1, v2, v0, 0, 2);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  EXPECT_EQ(hoisting->getNumHoisted(), 1);
+  const auto &check =
+    static_cast<const ljit::BinOp &>(*bbs[0]->getLast().getPrev());
+  EXPECT_EQ(check.getOper(), ljit::BinOp::Oper::kBoundsCheck);
+  EXPECT_EQ(ljit::retrieveConstVal(static_cast<ljit::Inst *>(check.getLeft())),
+            4);
+  ljit::Interpreter interp;
+  EXPECT_EQ(interp.run(*func, {5}), 6);
+}
+
+TEST_F(GuardHoistingTest, steppedParam)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(6);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(5);
+  auto *check = buildLoop(v0, v1, v2, 0, 2);
+
+  // Act
+  runGuardHoisting();
+
+  // Assert
+  // Last value of IV depends on the start, so the check stays
+  EXPECT_EQ(hoisting->getNumHoisted(), 0);
+  EXPECT_EQ(check->getBB(), bbs[2]);
+  ljit::Interpreter interp;
+  EXPECT_EQ(interp.run(*func, {0}), 6);
+}
@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "opt/gvn.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class GVNTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  GVNTest() = default;
+
+  ljit::GVN gvn;
+};
+
+TEST_F(GVNTest, simple)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bbs[0]->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  auto *v3 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v1, v0);
+  auto *v4 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  auto *v5 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v1, v0);
+  auto *v6 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v2, v3);
+  auto *v7 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v5);
+  auto *v8 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v6, v7);
+  bbs[0]->pushInstBack<ljit::Ret>(v8);
+
+  // Act
+  gvn.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(gvn.getNumReplaced(), 1);
+  ASSERT_EQ(bbs[0]->size(), 9);
+  EXPECT_EQ(v6->getLeft(), v2);
+  EXPECT_EQ(v6->getRight(), v2);
+  EXPECT_EQ(v7->getLeft(), v4);
+  EXPECT_EQ(v7->getRight(), v5);
+  EXPECT_EQ(v2->users().size(), 1);
+}
+
+TEST_F(GVNTest, consts)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64);
+  auto *v0 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(42);
+  auto *v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(42);
+  auto *v2 = bbs[0]->pushInstBack<ljit::ConstVal_I32>(42);
+  auto *v3 = bbs[0]->pushInstBack<ljit::Cast>(ljit::Type::I64, v2);
+  auto *v4 = bbs[0]->pushInstBack<ljit::Cast>(ljit::Type::I64, v2);
+  auto *v5 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  auto *v6 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v4);
+  auto *v7 = bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v5, v6);
+  bbs[0]->pushInstBack<ljit::Ret>(v7);
+
+  // Act
+  gvn.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(gvn.getNumReplaced(), 2);
+  EXPECT_EQ(v5->getLeft(), v0);
+  EXPECT_EQ(v5->getRight(), v0);
+  EXPECT_EQ(v6->getLeft(), v3);
+  EXPECT_EQ(v6->getRight(), v3);
+}
+
+TEST_F(GVNTest, dominance)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v5);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v7 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v7->addNode(v3, bb1);
+  v7->addNode(v6, bb2);
+  auto *v8 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v1, v0);
+  auto *v9 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v8);
+  bb3->pushInstBack<ljit::Ret>(v9);
+
+  // Act
+  gvn.run(makeGraph());
+
+  // Assert
+  // Sibling computations are not merged
+  EXPECT_EQ(gvn.getNumReplaced(), 1);
+  EXPECT_EQ(v6->getLeft(), v4);
+  EXPECT_EQ(v6->getRight(), v2);
+  EXPECT_EQ(bb2->size(), 3);
+  EXPECT_EQ(v9->getRight(), v8);
+}
+
+TEST_F(GVNTest, phiUsers)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v4->addNode(v3, bb1);
+  v4->addNode(v1, bb2);
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  gvn.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(gvn.getNumReplaced(), 1);
+  ASSERT_TRUE(bb1->collectInsts(ljit::InstType::kBinOp).empty());
+  std::vector<ljit::Phi::Entry> entries{v4->begin(), v4->end()};
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].m_val, v2);
+  EXPECT_EQ(entries[0].bb, bb1);
+  EXPECT_EQ(v4->inputAt(0), v2);
+}
+
+TEST_F(GVNTest, checks)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(10);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *check0 =
+    bb1->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v0);
+  auto *check1 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v1, v2);
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v1, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v3, bb2, bb3);
+
+  [[maybe_unused]] auto *check2 =
+    bb2->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v0);
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v2, v0);
+  bb2->pushInstBack<ljit::Ret>(v4);
+
+  auto *v5 = bb3->pushInstBack<ljit::ConstVal_I64>(10);
+  [[maybe_unused]] auto *check3 =
+    bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v1, v5);
+  auto *check4 =
+    bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v2, v1);
+  bb3->pushInstBack<ljit::Ret>(v1);
+
+  // Act
+  gvn.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(gvn.getNumReplaced(), 3);
+  EXPECT_EQ(check0->getNext(), check1);
+  EXPECT_EQ(v4, &bb2->getFirst());
+  EXPECT_EQ(check4, &bb3->getFirst());
+}
@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "opt/if_conversion.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+
+class IfConversionTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  IfConversionTest() = default;
+
+  void runIfConv(const ljit::IfConversionParams &params = {})
+  {
+    ifConv = std::make_unique<ljit::IfConversion>(func.get(), params);
+    ifConv->run();
+  }
+
+  std::unique_ptr<ljit::IfConversion> ifConv;
+};
+
+TEST_F(IfConversionTest, diamond)
+{
+  // Assign
+  // min(a, b) + 1
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32, ljit::Type::I32});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I32);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(1);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+  auto *v4 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v2);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v1, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v6 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  v6->addNode(v4, bb1);
+  v6->addNode(v5, bb2);
+  auto *v7 = bb3->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  runIfConv();
+
+  // Assert
+  EXPECT_EQ(ifConv->getNumConverted(), 1);
+  EXPECT_EQ(func->size(), 2);
+  EXPECT_EQ(bb0->getLast().getInstType(), ljit::InstType::kJump);
+  EXPECT_EQ(v4->getBB(), bb0);
+  EXPECT_EQ(v5->getBB(), bb0);
+
+  ASSERT_EQ(bb3->size(), 1);
+  const auto *const select = static_cast<const ljit::Select *>(v7->getVal());
+  ASSERT_EQ(select->getInstType(), ljit::InstType::kSelect);
+  EXPECT_EQ(select->getCond(), v3);
+  EXPECT_EQ(select->getTrueVal(), v4);
+  EXPECT_EQ(select->getFalseVal(), v5);
+}
+
+TEST_F(IfConversionTest, triangle)
+{
+  // Assign
+  // x < 0 ? 0 : x
+  genBBs(3, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::ConstVal_I64>(0);
+  bb1->pushInstBack<ljit::JumpInstr>(bb2);
+
+  auto *v4 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v4->addNode(v0, bb0);
+  v4->addNode(v3, bb1);
+  auto *v5 = bb2->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runIfConv();
+
+  // Assert
+  EXPECT_EQ(ifConv->getNumConverted(), 1);
+  EXPECT_EQ(func->size(), 2);
+
+  const auto *const select = static_cast<const ljit::Select *>(v5->getVal());
+  ASSERT_EQ(select->getInstType(), ljit::InstType::kSelect);
+  EXPECT_EQ(select->getTrueVal(), v3);
+  EXPECT_EQ(select->getFalseVal(), v0);
+}
+
+TEST_F(IfConversionTest, notProfitable)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32, ljit::Type::I32});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I32);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  // Division may trap
+  auto *v3 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v1);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  auto *v5 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v1);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v6 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I32);
+  v6->addNode(v3, bb1);
+  v6->addNode(v5, bb2);
+  bb3->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  runIfConv();
+
+  // Assert
+  EXPECT_EQ(ifConv->getNumConverted(), 0);
+  EXPECT_EQ(func->size(), 4);
+
+  // Replace division, but lower the threshold
+  v6->clearInputs();
+  bb3->eraseInst(v6);
+  v3->clearInputs();
+  bb1->replaceInst(v3, ljit::makeConst(ljit::Type::I32, 1).release());
+  auto *v7 = bb3->pushInstFront<ljit::Phi>(ljit::Type::I32);
+  v7->addNode(&bb1->getFirst(), bb1);
+  v7->addNode(v5, bb2);
+  runIfConv(ljit::IfConversionParams{2, 2});
+
+  EXPECT_EQ(ifConv->getNumConverted(), 0);
+  runIfConv(ljit::IfConversionParams{3, 2});
+  EXPECT_EQ(ifConv->getNumConverted(), 1);
+}
+
+TEST_F(IfConversionTest, shiftAmount)
+{
+  // Assign
+  // s < 64 ? a >> s : 0
+  genBBs(3, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(64);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v1, v2);
+  bb0->pushInstBack<ljit::IfInstr>(v4, bb1, bb2);
+
+  // Shift by the amount out of range traps
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v1);
+  bb1->pushInstBack<ljit::JumpInstr>(bb2);
+
+  auto *v6 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v6->addNode(v3, bb0);
+  v6->addNode(v5, bb1);
+  bb2->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  runIfConv();
+
+  // Assert
+  EXPECT_EQ(ifConv->getNumConverted(), 0);
+  EXPECT_EQ(v5->getBB(), bb1);
+  ljit::Interpreter interp;
+  EXPECT_EQ(interp.run(*func, {1, 100}), 0);
+  EXPECT_EQ(interp.run(*func, {16, 2}), 4);
+}
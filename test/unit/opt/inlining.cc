@@ -1,12 +1,16 @@
 #include <algorithm>
+#include <cstddef>
 #include <functional>
 #include <gtest/gtest.h>
 #include <iterator>
 #include <memory>
+#include <sstream>
+#include <vector>
 
 #include "../graph/graph_test_builder.hh"
 #include "graph/dfs.hh"
 #include "ir/inst.hh"
+#include "ir/module.hh"
 
 #include "opt/inlining.hh"
 
@@ -217,3 +221,278 @@ TEST_F(InliningTest, lecture)
     ASSERT_EQ(insns.back()->getInstType(), ljit::InstType::kRet);
   }
 }
+
+class ModuleInliningTest : public ::testing::Test
+{
+protected:
+  ModuleInliningTest() = default;
+
+  // f(x) = (x + 2) * 2
+  ljit::Function *makeCallee()
+  {
+    auto *const func = module.createFunction("callee", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v2, v1);
+    bb0->pushInstBack<ljit::Ret>(v3);
+    return func;
+  }
+
+  static ljit::Call *makeCall(ljit::BasicBlock *bb, ljit::Function *callee,
+                              ljit::Value *arg)
+  {
+    auto *const call = bb->pushInstBack<ljit::Call>(callee);
+    call->appendArg(arg);
+    return call;
+  }
+
+  static std::size_t countInsts(const ljit::Function *func,
+                                ljit::InstType type)
+  {
+    std::size_t res = 0;
+    ljit::graph::depthFirstSearchPreOrder(
+      func->makeBBGraph(), [&](ljit::BasicBlock *bb) {
+        res += bb->collectInsts(type).size();
+      });
+    return res;
+  }
+
+  ljit::Module module;
+};
+
+TEST_F(ModuleInliningTest, bottomUp)
+{
+  // Assign
+  auto *const leaf = makeCallee();
+
+  auto *const mid = module.createFunction("mid", ljit::Type::I64,
+                                          std::vector{ljit::Type::I64});
+  {
+    auto *const bb0 = mid->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = makeCall(bb0, leaf, v0);
+    auto *v2 = makeCall(bb0, leaf, v1);
+    bb0->pushInstBack<ljit::Ret>(v2);
+  }
+
+  auto *const top = module.createFunction("top", ljit::Type::I64);
+  {
+    auto *const bb0 = top->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+    auto *v1 = makeCall(bb0, mid, v0);
+    bb0->pushInstBack<ljit::Ret>(v1);
+  }
+  ljit::Inlining inlining{&module};
+
+  // Act
+  inlining.run();
+
+  // Assert
+  EXPECT_EQ(inlining.getNumInlined(), 3);
+  const auto &decisions = inlining.getDecisions();
+  ASSERT_EQ(decisions.size(), 3);
+  EXPECT_EQ(decisions[0].caller, mid);
+  EXPECT_EQ(decisions[1].caller, mid);
+  EXPECT_EQ(decisions[2].caller, top);
+  EXPECT_EQ(decisions[2].callee, mid);
+  // Callee is inlined w/ calls already inlined into it
+  EXPECT_EQ(decisions[2].cost, ljit::getInlineSize(*mid));
+
+  // Callees stay intact
+  EXPECT_EQ(ljit::getInlineSize(*leaf), 4);
+  EXPECT_EQ(countInsts(mid, ljit::InstType::kCall), 0);
+  EXPECT_EQ(countInsts(mid, ljit::InstType::kBinOp), 4);
+
+  EXPECT_EQ(countInsts(top, ljit::InstType::kCall), 0);
+  EXPECT_EQ(countInsts(top, ljit::InstType::kBinOp), 4);
+  EXPECT_EQ(countInsts(top, ljit::InstType::kParam), 0);
+  EXPECT_EQ(countInsts(top, ljit::InstType::kRet), 1);
+}
+
+TEST_F(ModuleInliningTest, recursive)
+{
+  // Assign
+  auto *const rec = module.createFunction("rec", ljit::Type::I64,
+                                          std::vector{ljit::Type::I64});
+  {
+    auto *const bb0 = rec->appendBB();
+    auto *const bb1 = rec->appendBB();
+    auto *const bb2 = rec->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v0, v1);
+    bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+    bb1->pushInstBack<ljit::Ret>(v0);
+
+    auto *v3 = bb2->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v3);
+    auto *v5 = makeCall(bb2, rec, v4);
+    bb2->pushInstBack<ljit::Ret>(v5);
+  }
+
+  auto *const top = module.createFunction("top", ljit::Type::I64);
+  {
+    auto *const bb0 = top->appendBB();
+    auto *v0 = bb0->pushInstBack<ljit::ConstVal_I64>(3);
+    auto *v1 = makeCall(bb0, rec, v0);
+    bb0->pushInstBack<ljit::Ret>(v1);
+  }
+  ljit::Inlining inlining{&module};
+
+  // Act
+  inlining.run();
+
+  // Assert
+  const auto &decisions = inlining.getDecisions();
+  ASSERT_EQ(decisions.size(), 2);
+  EXPECT_EQ(decisions[0].reason, ljit::InlineReason::kRecursive);
+  EXPECT_EQ(decisions[1].reason, ljit::InlineReason::kInlined);
+
+  EXPECT_EQ(rec->size(), 3);
+  EXPECT_EQ(countInsts(rec, ljit::InstType::kCall), 1);
+  // One level of recursion is unrolled
+  EXPECT_EQ(countInsts(top, ljit::InstType::kCall), 1);
+  EXPECT_EQ(countInsts(top, ljit::InstType::kPhi), 1);
+}
+
+TEST_F(ModuleInliningTest, costModel)
+{
+  // Assign
+  auto *const callee = makeCallee();
+  auto *const caller = module.createFunction("caller", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+  auto *const bb0 = caller->appendBB();
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(7);
+  auto *v2 = makeCall(bb0, callee, v0);
+  auto *v3 = makeCall(bb0, callee, v1);
+  auto *v4 = makeCall(bb0, callee, v1);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v3);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v4);
+  bb0->pushInstBack<ljit::Ret>(v6);
+
+  ljit::InlineParams params;
+  params.baseThreshold = 3;
+  params.constArgBonus = 1;
+  params.callerBudget = 12;
+  ljit::Inlining inlining{&module, params};
+
+  // Act
+  inlining.run();
+
+  // Assert
+  const auto &decisions = inlining.getDecisions();
+  ASSERT_EQ(decisions.size(), 3);
+  EXPECT_EQ(decisions[0].reason, ljit::InlineReason::kTooBig);
+  EXPECT_EQ(decisions[0].cost, 4);
+  EXPECT_EQ(decisions[0].threshold, 3);
+  EXPECT_EQ(decisions[1].reason, ljit::InlineReason::kInlined);
+  EXPECT_EQ(decisions[1].threshold, 4);
+  EXPECT_EQ(decisions[2].reason, ljit::InlineReason::kCallerBudget);
+
+  EXPECT_EQ(countInsts(caller, ljit::InstType::kCall), 2);
+  ASSERT_TRUE(v5->getRight()->isInst());
+  EXPECT_EQ(static_cast<ljit::Inst *>(v5->getRight())->getInstType(),
+            ljit::InstType::kBinOp);
+
+  std::ostringstream ss;
+  inlining.printDecisions(ss);
+  EXPECT_EQ(ss.str(),
+            "caller -> callee: callee is too big (cost 4, threshold 3)\n"
+            "caller -> callee: inlined (cost 4, threshold 4)\n"
+            "caller -> callee: caller budget exceeded (cost 4, threshold 4)\n");
+}
+
+TEST_F(ModuleInliningTest, loopDepth)
+{
+  // Assign
+  auto *const callee = makeCallee();
+  auto *const caller = module.createFunction("caller", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+  auto *const bb0 = caller->appendBB();
+  auto *const bb1 = caller->appendBB();
+  auto *const bb2 = caller->appendBB();
+  auto *const bb3 = caller->appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v1 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v2 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v1, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v2, bb2, bb3);
+
+  auto *v3 = makeCall(bb2, callee, v1);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v1->addNode(v0, bb0);
+  v1->addNode(v3, bb2);
+
+  auto *v4 = makeCall(bb3, callee, v1);
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  ljit::InlineParams params;
+  params.baseThreshold = 3;
+  params.loopDepthBonus = 1;
+  ljit::Inlining inlining{&module, params};
+
+  // Act
+  inlining.run();
+
+  // Assert
+  EXPECT_EQ(inlining.getNumInlined(), 1);
+  EXPECT_EQ(bb3->collectInsts(ljit::InstType::kCall).size(), 1);
+  EXPECT_TRUE(bb2->collectInsts(ljit::InstType::kCall).empty());
+
+  // Back edge comes from the block after the call now
+  const auto &entry = *std::next(v1->begin());
+  EXPECT_NE(entry.bb, bb2);
+  const auto &preds = bb1->getPred();
+  EXPECT_NE(std::find(preds.begin(), preds.end(), entry.bb), preds.end());
+  ASSERT_TRUE(entry.m_val->isInst());
+  EXPECT_EQ(static_cast<ljit::Inst *>(entry.m_val)->getInstType(),
+            ljit::InstType::kBinOp);
+}
+
+TEST_F(ModuleInliningTest, profile)
+{
+  // Assign
+  auto *const callee = makeCallee();
+  auto *const caller = module.createFunction("caller", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+  auto *const bb0 = caller->appendBB();
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = makeCall(bb0, callee, v0);
+  auto *v2 = makeCall(bb0, callee, v1);
+  auto *v3 = makeCall(bb0, callee, v2);
+  bb0->pushInstBack<ljit::Ret>(v3);
+
+  ljit::FunctionProfile profile;
+  profile.callCounts[{bb0->getId(), 0}] = 0;
+  profile.callCounts[{bb0->getId(), 1}] = 5000;
+  caller->setProfile(profile);
+
+  ljit::InlineParams params;
+  params.baseThreshold = 3;
+  params.hotCallBonus = 1;
+  ljit::Inlining inlining{&module, params};
+
+  // Act
+  inlining.run();
+
+  // Assert
+  const auto &decisions = inlining.getDecisions();
+  ASSERT_EQ(decisions.size(), 3);
+  EXPECT_EQ(decisions[0].reason, ljit::InlineReason::kColdCallSite);
+  EXPECT_EQ(decisions[1].reason, ljit::InlineReason::kInlined);
+  EXPECT_EQ(decisions[1].threshold, 4);
+  // No counts for the site
+  EXPECT_EQ(decisions[2].reason, ljit::InlineReason::kTooBig);
+  EXPECT_EQ(decisions[2].threshold, 3);
+
+  EXPECT_EQ(countInsts(caller, ljit::InstType::kCall), 2);
+}
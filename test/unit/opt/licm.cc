@@ -0,0 +1,325 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "opt/licm.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+
+class LICMTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  LICMTest() = default;
+
+  void runLICM(bool speculative = false)
+  {
+    licm = std::make_unique<ljit::LICM>(func.get(), speculative);
+    licm->run();
+  }
+
+  std::unique_ptr<ljit::LICM> licm;
+};
+
+TEST_F(LICMTest, simple)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *jmp0 = bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+  auto *v6 = bb2->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v2);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v6);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v8);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v6);
+  auto *v11 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v9);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v2, bb0);
+  v3->addNode(v10, bb2);
+  v4->addNode(v1, bb0);
+  v4->addNode(v11, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+
+  // Act
+  runLICM();
+
+  // Assert
+  EXPECT_EQ(licm->getNumHoisted(), 3);
+  EXPECT_EQ(func->size(), 4);
+
+  ASSERT_EQ(bb0->size(), 7);
+  EXPECT_EQ(v6->getBB(), bb0);
+  EXPECT_EQ(v7->getBB(), bb0);
+  EXPECT_EQ(v8->getBB(), bb0);
+  EXPECT_EQ(&bb0->getLast(), jmp0);
+  EXPECT_EQ(v8->getNext(), jmp0);
+
+  ASSERT_EQ(bb2->size(), 4);
+  EXPECT_EQ(&bb2->getFirst(), v9);
+  EXPECT_EQ(v9->getNext(), v10);
+}
+
+TEST_F(LICMTest, newPreheader)
+{
+  // Assign
+  genBBs(6, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+  auto *bb4 = bbs[4];
+  auto *bb5 = bbs[5];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  auto *v3 = bb1->pushInstBack<ljit::ConstVal_I64>(5);
+  bb1->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v4 = bb2->pushInstBack<ljit::ConstVal_I64>(7);
+  bb2->pushInstBack<ljit::JumpInstr>(bb3);
+
+  auto *v5 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v1);
+  bb3->pushInstBack<ljit::IfInstr>(v6, bb4, bb5);
+
+  auto *v7 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  auto *v8 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v7);
+  bb4->pushInstBack<ljit::JumpInstr>(bb3);
+
+  v5->addNode(v3, bb1);
+  v5->addNode(v4, bb2);
+  v5->addNode(v8, bb4);
+
+  bb5->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  runLICM();
+
+  // Assert
+  EXPECT_EQ(licm->getNumHoisted(), 1);
+  ASSERT_EQ(func->size(), 7);
+
+  auto *const preheader = v7->getBB();
+  ASSERT_NE(preheader, bb4);
+  ASSERT_EQ(preheader->size(), 3);
+  ASSERT_EQ(preheader->getFirst().getInstType(), ljit::InstType::kPhi);
+  auto &newPhi = static_cast<ljit::Phi &>(preheader->getFirst());
+  ASSERT_EQ(newPhi.numEntries(), 2);
+  EXPECT_EQ(newPhi.inputAt(0), v4);
+  EXPECT_EQ(newPhi.inputAt(1), v3);
+
+  const std::vector<ljit::Phi::Entry> entries{v5->begin(), v5->end()};
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].m_val, v8);
+  EXPECT_EQ(entries[0].bb, bb4);
+  EXPECT_EQ(entries[1].m_val, &newPhi);
+  EXPECT_EQ(entries[1].bb, preheader);
+  EXPECT_EQ(v3->users().size(), 1);
+
+  ASSERT_EQ(bb1->getSucc().size(), 1);
+  EXPECT_EQ(bb1->getSucc().front(), preheader);
+  ASSERT_EQ(bb2->getSucc().size(), 1);
+  EXPECT_EQ(bb2->getSucc().front(), preheader);
+  ASSERT_EQ(preheader->getSucc().size(), 1);
+  EXPECT_EQ(preheader->getSucc().front(), bb3);
+  EXPECT_EQ(bb3->numPred(), 2);
+}
+
+TEST_F(LICMTest, nested)
+{
+  // Assign
+  genBBs(6, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+  auto *bb4 = bbs[4];
+  auto *bb5 = bbs[5];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  // Outer loop header
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v1);
+  bb1->pushInstBack<ljit::IfInstr>(v4, bb2, bb5);
+
+  // Inner loop header
+  auto *v5 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v1);
+  bb2->pushInstBack<ljit::IfInstr>(v6, bb3, bb4);
+
+  // Inner loop body
+  auto *v7 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  auto *v8 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v3);
+  auto *v9 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v8);
+  bb3->pushInstBack<ljit::JumpInstr>(bb2);
+
+  // Outer loop latch
+  auto *v10 = bb4->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v11 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v10);
+  bb4->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v2, bb0);
+  v3->addNode(v11, bb4);
+  v5->addNode(v2, bb1);
+  v5->addNode(v9, bb3);
+
+  bb5->pushInstBack<ljit::Ret>(v3);
+
+  // Act
+  runLICM();
+
+  // Assert
+  EXPECT_EQ(licm->getNumHoisted(), 4);
+  ASSERT_EQ(func->size(), 7);
+
+  EXPECT_EQ(v7->getBB(), bb0);
+  EXPECT_EQ(v10->getBB(), bb0);
+
+  auto *const innerPreheader = v8->getBB();
+  ASSERT_NE(innerPreheader, bb3);
+  ASSERT_EQ(innerPreheader->numPred(), 1);
+  EXPECT_EQ(innerPreheader->getPred().front(), bb1);
+  ASSERT_EQ(innerPreheader->numSucc(), 1);
+  EXPECT_EQ(innerPreheader->getSucc().front(), bb2);
+
+  const std::vector<ljit::Phi::Entry> entries{v5->begin(), v5->end()};
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_EQ(entries[0].bb, innerPreheader);
+
+  EXPECT_EQ(&bb3->getFirst(), v9);
+  EXPECT_EQ(&bb4->getFirst(), v11);
+}
+
+TEST_F(LICMTest, speculative)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v6, bb2, bb3);
+
+  auto *v7 = bb2->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck,
+                                              v1);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v7);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v8);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v3);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v4->addNode(v2, bb0);
+  v4->addNode(v10, bb2);
+  v5->addNode(v2, bb0);
+  v5->addNode(v9, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  runLICM();
+  const auto numHoisted = licm->getNumHoisted();
+  runLICM(true);
+
+  // Assert
+  // Loop may be not entered, so the check and the division stay w/o
+  // speculation
+  EXPECT_EQ(numHoisted, 0);
+  EXPECT_EQ(licm->getNumHoisted(), 2);
+  EXPECT_EQ(v7->getBB(), bb0);
+  EXPECT_EQ(v8->getBB(), bb0);
+  EXPECT_EQ(bb2->size(), 3);
+}
+
+TEST_F(LICMTest, shiftAmount)
+{
+  // Assign
+  // for (i = 0; i < n; ++i) if (s < 64) sum += a >> s
+  genBBs(6, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I64});
+
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+  auto *bb4 = bbs[4];
+  auto *bb5 = bbs[5];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I64);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v4 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v5 = bb0->pushInstBack<ljit::ConstVal_I64>(64);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v7 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v8 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v6, v2);
+  bb1->pushInstBack<ljit::IfInstr>(v8, bb2, bb5);
+
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v1, v5);
+  bb2->pushInstBack<ljit::IfInstr>(v9, bb3, bb4);
+
+  // Shift by the amount out of range traps
+  auto *v10 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v1);
+  auto *v11 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v10);
+  bb3->pushInstBack<ljit::JumpInstr>(bb4);
+
+  auto *v12 = bb4->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v13 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v4);
+  bb4->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v6->addNode(v3, bb0);
+  v6->addNode(v13, bb4);
+  v7->addNode(v3, bb0);
+  v7->addNode(v12, bb4);
+  v12->addNode(v7, bb2);
+  v12->addNode(v11, bb3);
+
+  bb5->pushInstBack<ljit::Ret>(v7);
+
+  // Act
+  runLICM();
+
+  // Assert
+  EXPECT_EQ(v10->getBB(), bb3);
+  ljit::Interpreter interp;
+  EXPECT_EQ(interp.run(*func, {1, 100, 3}), 0);
+  EXPECT_EQ(interp.run(*func, {16, 2, 3}), 12);
+}
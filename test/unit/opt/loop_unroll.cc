@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "opt/loop_unroll.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "analysis/loop_analyzer.hh"
+#include "ir/inst.hh"
+#include "opt/constant_folding.hh"
+#include "opt/dce.hh"
+
+class LoopUnrollTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  LoopUnrollTest() = default;
+
+  void runUnroll(const ljit::UnrollParams &params = {})
+  {
+    unroll = std::make_unique<ljit::LoopUnroll>(func.get(), params);
+    unroll->run();
+  }
+
+  [[nodiscard]] auto getNumLoops() const
+  {
+    const ljit::LoopAnalyzer<ljit::BasicBlockGraph> loops{makeGraph()};
+    return loops.getLoopsInnerFirst().size();
+  }
+
+  // sum = 0
+  // for (i = 0; i < limit; ++i)
+  //   sum += i;
+  // return sum;
+  // Returns the limit value
+  ljit::Inst *buildSumLoop(ljit::Inst *limit = nullptr)
+  {
+    auto *bb0 = bbs[0];
+    auto *bb1 = bbs[1];
+    auto *bb2 = bbs[2];
+    auto *bb3 = bbs[3];
+
+    if (limit == nullptr)
+      limit = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(1);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I32);
+    auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I32);
+    auto *v5 =
+      bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, limit);
+    bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+    auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v3);
+    auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v3->addNode(v1, bb0);
+    v3->addNode(v7, bb2);
+    v4->addNode(v1, bb0);
+    v4->addNode(v6, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v4);
+    return limit;
+  }
+
+  std::unique_ptr<ljit::LoopUnroll> unroll;
+};
+
+TEST_F(LoopUnrollTest, full)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector<ljit::Type>{});
+  buildSumLoop(bbs[0]->pushInstBack<ljit::ConstVal_I32>(4));
+
+  // Act
+  runUnroll();
+  ljit::ConstantFolding{}.run(makeGraph());
+  ljit::DCE{func.get()}.run();
+
+  // Assert
+  EXPECT_EQ(unroll->getNumFull(), 1);
+  EXPECT_EQ(unroll->getNumPartial(), 0);
+  EXPECT_EQ(getNumLoops(), 0);
+
+  // 0 + 1 + 2 + 3
+  const auto &ret = bbs[3]->getLast();
+  ASSERT_EQ(ret.getInstType(), ljit::InstType::kRet);
+  const auto *const res = ljit::tryRetrieveConst(ret.inputAt(0));
+  ASSERT_NE(res, nullptr);
+  EXPECT_EQ(ljit::retrieveConstVal(res), 6);
+}
+
+TEST_F(LoopUnrollTest, tooManyIterations)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector<ljit::Type>{});
+  buildSumLoop(bbs[0]->pushInstBack<ljit::ConstVal_I32>(100));
+
+  // Act
+  runUnroll(ljit::UnrollParams{8, 64, 1});
+
+  // Assert
+  EXPECT_EQ(unroll->getNumFull(), 0);
+  EXPECT_EQ(unroll->getNumPartial(), 0);
+  EXPECT_EQ(func->size(), 4);
+}
+
+TEST_F(LoopUnrollTest, partial)
+{
+  // Assign
+  genBBs(4, ljit::Type::I32, std::vector{ljit::Type::I32});
+  auto *limit = buildSumLoop();
+  const auto *bb0 = bbs[0];
+
+  // Act
+  runUnroll(ljit::UnrollParams{8, 64, 2});
+  // Exit tests of the copied headers are dead
+  ljit::DCE{func.get()}.run();
+
+  // Assert
+  EXPECT_EQ(unroll->getNumFull(), 0);
+  EXPECT_EQ(unroll->getNumPartial(), 1);
+  // Main loop and the remainder one
+  EXPECT_EQ(getNumLoops(), 2);
+
+  // Main loop is skipped if adjusted limit overflows
+  const auto &guard = bb0->getLast();
+  ASSERT_EQ(guard.getInstType(), ljit::InstType::kIf);
+  const auto &branch = static_cast<const ljit::IfInstr &>(guard);
+  EXPECT_EQ(branch.getFalseBB(), bbs[1]);
+  EXPECT_EQ(limit->users().size(), 3);
+
+  // Original loop is entered from the preheader and the main loop
+  auto *const mainHeader = branch.getTrueBB();
+  EXPECT_EQ(bbs[1]->numPred(), 3);
+  EXPECT_EQ(mainHeader->numPred(), 2);
+  for (const auto &phi : bbs[1]->collectInsts(ljit::InstType::kPhi))
+    EXPECT_EQ(static_cast<const ljit::Phi &>(phi.get()).numEntries(), 3);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <type_traits>
+#include <vector>
 
 #include "opt/peephole.hh"
 
@@ -100,6 +101,29 @@ TEST_F(PeepHoleTest, shr2)
   EXPECT_EQ(shr.getRight(), &add);
 }
 
+TEST_F(PeepHoleTest, shrWide)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *const v0 = bbs[0]->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *const v1 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(40);
+  auto *const fst =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v0, v1);
+  auto *const v2 = bbs[0]->pushInstBack<ljit::ConstVal_I64>(30);
+  auto *const sec =
+    bbs[0]->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, fst, v2);
+  bbs[0]->pushInstBack<ljit::Ret>(sec);
+
+  const auto &graph = makeGraph();
+  // Act
+  pHole.run(graph);
+  // Assert
+  // Shift by 70 would be out of range
+  ASSERT_EQ(bbs[0]->size(), 6);
+  EXPECT_EQ(sec->getLeft(), fst);
+  EXPECT_EQ(sec->getRight(), v2);
+}
+
 TEST_F(PeepHoleTest, or)
 {
   // Assign
@@ -145,3 +169,82 @@ TEST_F(PeepHoleTest, or2)
   EXPECT_EQ(op.getOper(), ljit::BinOp::Oper::kMul);
   EXPECT_EQ(op.getLeft(), rval);
 }
+
+TEST_F(PeepHoleTest, cmpRanges)
+{
+  // Assign
+  genBBs(3, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *const v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *const v1 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+  auto *const v2 =
+    bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+  bb0->pushInstBack<ljit::IfInstr>(v2, bb1, bb2);
+
+  // v0 < 5
+  auto *const v3 = bb1->pushInstBack<ljit::ConstVal_I64>(10);
+  auto *const v4 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v3);
+  auto *const v5 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v3, v0);
+  auto *const v6 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v0);
+  auto *const v7 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v4, v5);
+  auto *const v8 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v7, v6);
+  bb1->pushInstBack<ljit::Ret>(v8);
+
+  bb2->pushInstBack<ljit::Ret>(v0);
+  const auto &graph = makeGraph();
+  // Act
+  pHole.run(graph);
+  // Assert
+  ASSERT_EQ(bb1->size(), 7);
+  const auto *const lhs = static_cast<const ljit::Inst *>(v7->getLeft());
+  const auto *const rhs = static_cast<const ljit::Inst *>(v7->getRight());
+  ASSERT_EQ(lhs->getInstType(), ljit::InstType::kConst);
+  ASSERT_EQ(rhs->getInstType(), ljit::InstType::kConst);
+  EXPECT_EQ(ljit::retrieveConstVal(lhs), 1);
+  EXPECT_EQ(ljit::retrieveConstVal(rhs), 0);
+  EXPECT_EQ(v8->getRight(), v6);
+}
+
+TEST_F(PeepHoleTest, switchOutOfRange)
+{
+  // Assign
+  genBBs(4, ljit::Type::I8, std::vector{ljit::Type::I8});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *const v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I8);
+  // 300 does not fit into i8
+  bb0->pushInstBack<ljit::Switch>(
+    v0, bb3, std::vector<ljit::Switch::Case>{{5, bb1}, {300, bb2}});
+
+  bb1->pushInstBack<ljit::Ret>(v0);
+  bb2->pushInstBack<ljit::Ret>(v0);
+  bb3->pushInstBack<ljit::Ret>(v0);
+  const auto &graph = makeGraph();
+  // Act
+  pHole.run(graph);
+  // Assert
+  ASSERT_EQ(bb0->getLast().getInstType(), ljit::InstType::kIf);
+  const auto &branch = static_cast<const ljit::IfInstr &>(bb0->getLast());
+  EXPECT_EQ(branch.getTrueBB(), bb1);
+  EXPECT_EQ(branch.getFalseBB(), bb3);
+  EXPECT_TRUE(bb2->getPred().empty());
+
+  const auto *const cmp = static_cast<const ljit::BinOp *>(branch.getCond());
+  ASSERT_EQ(cmp->getInstType(), ljit::InstType::kBinOp);
+  EXPECT_EQ(cmp->getOper(), ljit::BinOp::Oper::kEQ);
+  EXPECT_EQ(cmp->getLeft(), v0);
+  const auto *const cst = static_cast<const ljit::Inst *>(cmp->getRight());
+  ASSERT_EQ(cst->getInstType(), ljit::InstType::kConst);
+  EXPECT_EQ(ljit::retrieveConstVal(cst), 5);
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+
+#include "opt/reassociation.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+#include "opt/gvn.hh"
+
+class ReassociationTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  ReassociationTest() = default;
+
+  [[nodiscard]] static auto getConst(const ljit::Value *val)
+  {
+    return ljit::retrieveConstVal(static_cast<const ljit::Inst *>(val));
+  }
+
+  ljit::Reassociation reassoc;
+};
+
+TEST_F(ReassociationTest, foldConsts)
+{
+  // Assign
+  genBBs(1, ljit::Type::I32, std::vector{ljit::Type::I32});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I32>(1);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(2);
+  // (1 + v0) + 2
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v1, v0);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  // (v4 | 1) | 2
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v4, v1);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v5, v2);
+  auto *v7 = bb0->pushInstBack<ljit::Ret>(v6);
+
+  // Act
+  reassoc.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(reassoc.getNumRewritten(), 2);
+
+  const auto *const orOp = static_cast<const ljit::BinOp *>(v7->getVal());
+  EXPECT_EQ(orOp->getOper(), ljit::BinOp::Oper::kOr);
+  EXPECT_EQ(getConst(orOp->getRight()), 3);
+
+  const auto *const add = static_cast<const ljit::BinOp *>(orOp->getLeft());
+  EXPECT_EQ(add->getOper(), ljit::BinOp::Oper::kAdd);
+  EXPECT_EQ(add->getLeft(), v0);
+  EXPECT_EQ(getConst(add->getRight()), 3);
+
+  // Param, 2 constants, 2 ops + constants for them, ret
+  EXPECT_EQ(bb0->size(), 8);
+}
+
+TEST_F(ReassociationTest, absorbing)
+{
+  // Assign
+  genBBs(1, ljit::Type::I8, std::vector{ljit::Type::I8});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I8);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I8>(std::int8_t{16});
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v1, v0);
+  // 16 * 16 wraps around to 0
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v2, v1);
+  auto *v4 = bb0->pushInstBack<ljit::Ret>(v3);
+
+  // Act
+  reassoc.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(reassoc.getNumRewritten(), 1);
+  EXPECT_EQ(getConst(v4->getVal()), 0);
+  EXPECT_TRUE(v0->users().empty());
+}
+
+TEST_F(ReassociationTest, canonical)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v1);
+  bb0->pushInstBack<ljit::Ret>(v2);
+
+  // Act
+  reassoc.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(reassoc.getNumRewritten(), 0);
+  EXPECT_EQ(bb0->size(), 4);
+}
+
+TEST_F(ReassociationTest, commonSubexpr)
+{
+  // Assign
+  genBBs(1, ljit::Type::I64,
+         std::vector{ljit::Type::I64, ljit::Type::I64, ljit::Type::I64});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::Param>(2U, ljit::Type::I64);
+  // (v0 + v2) + v1
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v2);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v1);
+  // (v2 + v1) + v0
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v1);
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v0);
+  auto *v7 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v6);
+  auto *v8 = bb0->pushInstBack<ljit::Ret>(v7);
+
+  // Act
+  reassoc.run(makeGraph());
+  ljit::GVN gvn;
+  gvn.run(makeGraph());
+
+  // Assert
+  EXPECT_EQ(reassoc.getNumRewritten(), 2);
+  EXPECT_EQ(gvn.getNumReplaced(), 2);
+
+  // Both sums are (v0 + v1) + v2
+  const auto *const mul = static_cast<const ljit::BinOp *>(v8->getVal());
+  EXPECT_EQ(mul->getLeft(), mul->getRight());
+  const auto *const sum = static_cast<const ljit::BinOp *>(mul->getLeft());
+  EXPECT_EQ(sum->getRight(), v2);
+  const auto *const part = static_cast<const ljit::BinOp *>(sum->getLeft());
+  EXPECT_EQ(part->getLeft(), v0);
+  EXPECT_EQ(part->getRight(), v1);
+}
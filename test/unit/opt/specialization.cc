@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <iterator>
+#include <vector>
+
+#include "opt/specialization.hh"
+
+#include "graph/dfs.hh"
+#include "ir/basic_block.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+
+class SpecializationTest : public ::testing::Test
+{
+protected:
+  SpecializationTest()
+  {
+    fillCallee();
+    fillCaller();
+  }
+
+  ljit::Module module;
+  ljit::Function *callee{};
+  std::vector<ljit::Call *> calls{};
+
+private:
+  // f(flag, x) = flag == 0 ? x + 1 : x * 2
+  void fillCallee()
+  {
+    callee = module.createFunction(
+      "f", ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+    auto *bb0 = callee->appendBB();
+    auto *bb1 = callee->appendBB();
+    auto *bb2 = callee->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v0, v2);
+    bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+    auto *v4 = bb1->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v1, v4);
+    bb1->pushInstBack<ljit::Ret>(v5);
+
+    auto *v6 = bb2->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v1, v6);
+    bb2->pushInstBack<ljit::Ret>(v7);
+  }
+
+  // f(1, y) + f(1, y) + f(0, y) + f(y, y)
+  void fillCaller()
+  {
+    auto *const caller = module.createFunction(
+      "g", ljit::Type::I64, std::vector{ljit::Type::I64});
+    auto *bb0 = caller->appendBB();
+
+    ljit::Inst *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    ljit::Inst *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    ljit::Inst *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    for (auto *flag : {v1, v1, v2, v0})
+    {
+      auto *const call = bb0->pushInstBack<ljit::Call>(callee);
+      call->appendArg(flag);
+      call->appendArg(v0);
+      calls.push_back(call);
+    }
+
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd,
+                                              calls[0], calls[1]);
+    auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd,
+                                              calls[2], calls[3]);
+    auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v4);
+    bb0->pushInstBack<ljit::Ret>(v5);
+  }
+};
+
+TEST_F(SpecializationTest, constFlag)
+{
+  // Assign
+  ljit::Specialization spec{&module};
+
+  // Act
+  spec.run();
+
+  // Assert
+  EXPECT_EQ(spec.getNumRedirected(), 3);
+  ASSERT_EQ(module.size(), 4);
+
+  auto *const spec0 = module.findFunction("f.spec0");
+  auto *const spec1 = module.findFunction("f.spec1");
+  ASSERT_NE(spec0, nullptr);
+  ASSERT_NE(spec1, nullptr);
+  EXPECT_EQ(calls[0]->getCallee(), spec0);
+  EXPECT_EQ(calls[1]->getCallee(), spec0);
+  EXPECT_EQ(calls[2]->getCallee(), spec1);
+  EXPECT_EQ(calls[3]->getCallee(), callee);
+  EXPECT_TRUE(calls[0]->verify());
+
+  // Generic version is intact
+  EXPECT_EQ(callee->size(), 3);
+
+  // flag != 0: x * 2
+  ASSERT_EQ(spec0->size(), 2);
+  auto *const entry = spec0->makeBBGraph().getRoot();
+  ASSERT_EQ(entry->size(), 2);
+  EXPECT_EQ(entry->getFirst().getInstType(), ljit::InstType::kParam);
+  EXPECT_EQ(entry->getLast().getInstType(), ljit::InstType::kJump);
+  ASSERT_EQ(entry->getSucc().size(), 1);
+  const auto *const body = entry->getSucc().front();
+  ASSERT_EQ(body->size(), 3);
+  const auto &mul = static_cast<const ljit::BinOp &>(*std::next(body->begin()));
+  EXPECT_EQ(mul.getOper(), ljit::BinOp::Oper::kMul);
+  EXPECT_EQ(mul.getLeft(), &entry->getFirst());
+
+  // flag == 0: x + 1
+  ASSERT_EQ(spec1->size(), 2);
+  const auto *const body1 = spec1->makeBBGraph().getRoot()->getSucc().front();
+  const auto &add =
+    static_cast<const ljit::BinOp &>(*std::next(body1->begin()));
+  EXPECT_EQ(add.getOper(), ljit::BinOp::Oper::kAdd);
+}
+
+TEST_F(SpecializationTest, maxClones)
+{
+  // Assign
+  ljit::Specialization spec{&module, 1};
+
+  // Act
+  spec.run();
+
+  // Assert
+  EXPECT_EQ(spec.getNumRedirected(), 2);
+  EXPECT_EQ(module.size(), 3);
+  EXPECT_EQ(calls[1]->getCallee(), calls[0]->getCallee());
+  EXPECT_EQ(calls[2]->getCallee(), callee);
+}
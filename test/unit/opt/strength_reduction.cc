@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+#include "opt/strength_reduction.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class StrengthReductionTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  StrengthReductionTest() = default;
+
+  void runSR()
+  {
+    sr = std::make_unique<ljit::StrengthReduction>(func.get());
+    sr->run();
+  }
+
+  [[nodiscard]] static auto getConst(const ljit::Value *val)
+  {
+    return ljit::retrieveConstVal(static_cast<const ljit::Inst *>(val));
+  }
+
+  std::unique_ptr<ljit::StrengthReduction> sr;
+};
+
+TEST_F(StrengthReductionTest, shifts)
+{
+  // Assign
+  genBBs(1, ljit::Type::I32, std::vector{ljit::Type::I32, ljit::Type::I32});
+  auto *bb0 = bbs[0];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I32);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I32>(8);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I32>(3);
+  auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v2, v0);
+  auto *v5 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v3);
+  // Sign of v0 is unknown
+  auto *v6 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v2);
+  auto *v7 =
+    bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck, v5, v1);
+  // Checked index is not negative
+  auto *v8 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v7, v2);
+  auto *v9 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v8);
+  bb0->pushInstBack<ljit::Ret>(v9);
+
+  // Act
+  runSR();
+
+  // Assert
+  EXPECT_EQ(sr->getNumShifts(), 2);
+
+  const auto *const shl = static_cast<const ljit::BinOp *>(v5->getLeft());
+  EXPECT_EQ(shl->getOper(), ljit::BinOp::Oper::kShl);
+  EXPECT_EQ(shl->getLeft(), v0);
+  EXPECT_EQ(getConst(shl->getRight()), 3);
+  EXPECT_EQ(v5->getOper(), ljit::BinOp::Oper::kMul);
+
+  EXPECT_EQ(v6->getOper(), ljit::BinOp::Oper::kDiv);
+  const auto *const shr = static_cast<const ljit::BinOp *>(v9->getRight());
+  EXPECT_EQ(shr->getOper(), ljit::BinOp::Oper::kShr);
+  EXPECT_EQ(shr->getLeft(), v7);
+  EXPECT_EQ(getConst(shr->getRight()), 3);
+}
+
+TEST_F(StrengthReductionTest, ivMul)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(12);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v6, bb2, bb3);
+
+  // Address-like arithmetic: base + i * 12
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v4, v3);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v7);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v3, v4);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v8, v9);
+  auto *v11 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v10);
+  auto *v12 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v1);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v4->addNode(v2, bb0);
+  v4->addNode(v12, bb2);
+  v5->addNode(v2, bb0);
+  v5->addNode(v11, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  runSR();
+
+  // Assert
+  EXPECT_EQ(sr->getNumReducedMuls(), 2);
+  EXPECT_EQ(sr->getNumShifts(), 0);
+
+  // Both products are replaced w/ the same recurrence
+  auto *const phi = static_cast<ljit::Phi *>(v8->getRight());
+  ASSERT_EQ(phi->getInstType(), ljit::InstType::kPhi);
+  EXPECT_EQ(phi->getBB(), bb1);
+  EXPECT_EQ(v10->getRight(), phi);
+  EXPECT_EQ(bb1->collectInsts(ljit::InstType::kPhi).size(), 3);
+
+  ASSERT_EQ(phi->numEntries(), 2);
+  for (const auto &entry : *phi)
+  {
+    if (entry.bb == bb0)
+    {
+      EXPECT_EQ(getConst(entry.m_val), 12);
+      continue;
+    }
+    ASSERT_EQ(entry.bb, bb2);
+    const auto *const upd = static_cast<const ljit::BinOp *>(entry.m_val);
+    EXPECT_EQ(upd->getOper(), ljit::BinOp::Oper::kAdd);
+    EXPECT_EQ(upd->getLeft(), phi);
+    EXPECT_EQ(getConst(upd->getRight()), 24);
+  }
+}
+
+TEST_F(StrengthReductionTest, redundantIV)
+{
+  // Assign
+  genBBs(4, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+  auto *bb3 = bbs[3];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v4, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v6, bb2, bb3);
+
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v2);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v2, v5);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v4->addNode(v1, bb0);
+  v4->addNode(v7, bb2);
+  v5->addNode(v3, bb0);
+  v5->addNode(v8, bb2);
+
+  auto *v9 = bb3->pushInstBack<ljit::Ret>(v5);
+
+  // Act
+  runSR();
+
+  // Assert
+  EXPECT_EQ(sr->getNumRemovedIVs(), 1);
+  EXPECT_EQ(bb1->collectInsts(ljit::InstType::kPhi).size(), 1);
+  EXPECT_EQ(bb2->size(), 2);
+  EXPECT_EQ(v9->getVal(), v4);
+  EXPECT_EQ(v4->users().size(), 3);
+}
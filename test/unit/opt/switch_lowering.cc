@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "opt/switch_lowering.hh"
+
+#include "../graph/graph_test_builder.hh"
+#include "ir/inst.hh"
+
+class SwitchLoweringTest : public ljit::testing::GraphTestBuilder
+{
+protected:
+  using Kind = ljit::SwitchLowering::ClusterKind;
+
+  SwitchLoweringTest() = default;
+
+  void runLowering(const ljit::SwitchLoweringParams &params = {})
+  {
+    lowering = std::make_unique<ljit::SwitchLowering>(func.get(), params);
+    lowering->run();
+  }
+
+  // bb0 switches on the parameter, each target returns its number
+  ljit::Switch *buildSwitch(ljit::Type type,
+                            const std::vector<std::int64_t> &vals,
+                            const std::vector<std::size_t> &targets)
+  {
+    const auto numTargets =
+      *std::max_element(targets.begin(), targets.end()) + 1;
+    genBBs(numTargets + 2, type, std::vector{type});
+    auto *const param = bbs[0]->pushInstBack<ljit::Param>(0U, type);
+
+    std::vector<ljit::Switch::Case> cases;
+    for (std::size_t idx = 0; idx < vals.size(); ++idx)
+      cases.push_back({vals[idx], bbs[targets[idx] + 2]});
+    auto *const sw =
+      bbs[0]->pushInstBack<ljit::Switch>(param, bbs[1], std::move(cases));
+
+    for (std::size_t idx = 1; idx < bbs.size(); ++idx)
+      bbs[idx]->pushInstBack<ljit::Ret>(
+        bbs[idx]->pushConstBack(type, static_cast<std::int64_t>(idx)));
+    return sw;
+  }
+
+  static std::int64_t eval(const ljit::Value *val, std::int64_t arg)
+  {
+    const auto *const inst = static_cast<const ljit::Inst *>(val);
+    switch (inst->getInstType())
+    {
+    case ljit::InstType::kParam:
+      return arg;
+    case ljit::InstType::kConst:
+      return ljit::retrieveConstVal(inst);
+    case ljit::InstType::kCast:
+      return eval(static_cast<const ljit::Cast *>(inst)->getSrc(), arg);
+    case ljit::InstType::kBinOp: {
+      const auto *const binOp = static_cast<const ljit::BinOp *>(inst);
+      const auto lhs = eval(binOp->getLeft(), arg);
+      const auto rhs = eval(binOp->getRight(), arg);
+      switch (binOp->getOper())
+      {
+      case ljit::BinOp::Oper::kSub:
+        return lhs - rhs;
+      case ljit::BinOp::Oper::kShl:
+        return static_cast<std::int64_t>(static_cast<std::uint64_t>(lhs)
+                                         << rhs);
+      case ljit::BinOp::Oper::kLE:
+        return lhs < rhs ? 1 : 0;
+      case ljit::BinOp::Oper::kEQ:
+        return lhs == rhs ? 1 : 0;
+      case ljit::BinOp::Oper::kAdd:
+      case ljit::BinOp::Oper::kMul:
+      case ljit::BinOp::Oper::kDiv:
+      case ljit::BinOp::Oper::kShr:
+      case ljit::BinOp::Oper::kOr:
+      case ljit::BinOp::Oper::kBoundsCheck:
+      default:
+        break;
+      }
+      break;
+    }
+    case ljit::InstType::kUnknown:
+    case ljit::InstType::kIf:
+    case ljit::InstType::kJump:
+    case ljit::InstType::kRet:
+    case ljit::InstType::kPhi:
+    case ljit::InstType::kCall:
+    case ljit::InstType::kUnaryOp:
+    case ljit::InstType::kSelect:
+    case ljit::InstType::kSwitch:
+    default:
+      break;
+    }
+    ADD_FAILURE() << "Unexpected instruction";
+    return 0;
+  }
+
+  // Original block reached from bb0 for the given parameter
+  ljit::BasicBlock *dispatch(std::int64_t arg) const
+  {
+    auto *bb = bbs[0];
+    for (;;)
+    {
+      if (bb != bbs[0] && std::find(bbs.begin(), bbs.end(), bb) != bbs.end())
+        return bb;
+
+      const auto &last = bb->getLast();
+      switch (last.getInstType())
+      {
+      case ljit::InstType::kJump:
+        bb = static_cast<const ljit::JumpInstr &>(last).getTarget();
+        break;
+      case ljit::InstType::kIf: {
+        const auto &branch = static_cast<const ljit::IfInstr &>(last);
+        bb = eval(branch.getCond(), arg) != 0 ? branch.getTrueBB()
+                                              : branch.getFalseBB();
+        break;
+      }
+      case ljit::InstType::kSwitch: {
+        const auto &sw = static_cast<const ljit::Switch &>(last);
+        bb = sw.getTarget(eval(sw.getVal(), arg));
+        break;
+      }
+      case ljit::InstType::kUnknown:
+      case ljit::InstType::kConst:
+      case ljit::InstType::kBinOp:
+      case ljit::InstType::kRet:
+      case ljit::InstType::kCast:
+      case ljit::InstType::kPhi:
+      case ljit::InstType::kCall:
+      case ljit::InstType::kParam:
+      case ljit::InstType::kUnaryOp:
+      case ljit::InstType::kSelect:
+      default:
+        return bb;
+      }
+    }
+  }
+
+  // Lowered code dispatches as the original switch
+  void checkDispatch(const std::vector<ljit::BasicBlock *> &expected,
+                     std::int64_t from)
+  {
+    for (std::size_t idx = 0; idx < expected.size(); ++idx)
+      EXPECT_EQ(dispatch(from + static_cast<std::int64_t>(idx)),
+                expected[idx])
+        << "value " << from + static_cast<std::int64_t>(idx);
+  }
+
+  std::unique_ptr<ljit::SwitchLowering> lowering;
+};
+
+TEST_F(SwitchLoweringTest, clusters)
+{
+  // Assign
+  // 0..4 are dense, 100..120 have 2 targets, 300..304 is the range
+  // 1000 and 10000 are sparse
+  auto *const sw = buildSwitch(
+    ljit::Type::I32,
+    {0, 1, 2, 3, 4, 100, 105, 120, 300, 301, 302, 303, 304, 1000, 10000},
+    {0, 1, 2, 3, 0, 5, 6, 5, 4, 4, 4, 4, 4, 7, 8});
+
+  // Act
+  const auto clusters = ljit::SwitchLowering::clusterize(*sw, {});
+
+  // Assert
+  ASSERT_EQ(clusters.size(), 5);
+  EXPECT_EQ(clusters[0].kind, Kind::kJumpTable);
+  EXPECT_EQ(clusters[0].lo, 0);
+  EXPECT_EQ(clusters[0].hi, 4);
+  EXPECT_EQ(clusters[1].kind, Kind::kBitTest);
+  EXPECT_EQ(clusters[1].lo, 100);
+  EXPECT_EQ(clusters[1].hi, 120);
+  EXPECT_EQ(clusters[2].kind, Kind::kRange);
+  EXPECT_EQ(clusters[2].lo, 300);
+  EXPECT_EQ(clusters[2].hi, 304);
+  EXPECT_EQ(clusters[3].kind, Kind::kRange);
+  EXPECT_EQ(clusters[3].lo, 1000);
+  EXPECT_EQ(clusters[4].kind, Kind::kRange);
+  EXPECT_EQ(clusters[4].lo, 10000);
+}
+
+TEST_F(SwitchLoweringTest, dense)
+{
+  // Assign
+  buildSwitch(ljit::Type::I64, {3, 4, 5, 7, 8}, {0, 1, 2, 0, 1});
+
+  // Act
+  runLowering();
+
+  // Assert
+  EXPECT_EQ(lowering->getNumLowered(), 0);
+  EXPECT_EQ(bbs[0]->getLast().getInstType(), ljit::InstType::kSwitch);
+}
+
+TEST_F(SwitchLoweringTest, mixed)
+{
+  // Assign
+  auto *const sw = buildSwitch(
+    ljit::Type::I32,
+    {0, 1, 2, 3, 4, 100, 105, 120, 300, 301, 302, 303, 304, 1000, 10000},
+    {0, 1, 2, 3, 0, 5, 6, 5, 4, 4, 4, 4, 4, 7, 8});
+
+  std::vector<ljit::BasicBlock *> expected;
+  for (std::int64_t val = -5; val <= 10005; ++val)
+    expected.push_back(sw->getTarget(val));
+
+  // Act
+  runLowering();
+
+  // Assert
+  EXPECT_EQ(lowering->getNumLowered(), 1);
+  EXPECT_EQ(lowering->getNumJumpTables(), 1);
+  EXPECT_EQ(lowering->getNumBitTests(), 1);
+  EXPECT_EQ(bbs[0]->getLast().getInstType(), ljit::InstType::kIf);
+  checkDispatch(expected, -5);
+  EXPECT_EQ(dispatch(std::numeric_limits<std::int32_t>::min()), bbs[1]);
+  EXPECT_EQ(dispatch(std::numeric_limits<std::int32_t>::max()), bbs[1]);
+}
+
+TEST_F(SwitchLoweringTest, fullRange)
+{
+  // Assign
+  // All values of i8 are covered, so there are no checks for the default
+  std::vector<std::int64_t> vals;
+  std::vector<std::size_t> targets;
+  for (std::int64_t val = -128; val < 128; ++val)
+  {
+    vals.push_back(val);
+    targets.push_back(val < 0 ? 0 : 1);
+  }
+  buildSwitch(ljit::Type::I8, vals, targets);
+
+  // Act
+  runLowering();
+
+  // Assert
+  EXPECT_EQ(lowering->getNumLowered(), 1);
+  EXPECT_TRUE(bbs[1]->getPred().empty());
+  EXPECT_EQ(dispatch(-128), bbs[2]);
+  EXPECT_EQ(dispatch(-1), bbs[2]);
+  EXPECT_EQ(dispatch(0), bbs[3]);
+  EXPECT_EQ(dispatch(127), bbs[3]);
+}
+
+TEST_F(SwitchLoweringTest, phis)
+{
+  // Assign
+  genBBs(3, ljit::Type::I64, std::vector{ljit::Type::I64});
+  auto *bb0 = bbs[0];
+  auto *bb1 = bbs[1];
+  auto *bb2 = bbs[2];
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::Switch>(
+    v0, bb2, std::vector<ljit::Switch::Case>{{10, bb1}, {1000, bb1}});
+
+  ljit::Value *v2 =
+    bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v0, v1);
+  bb1->pushInstBack<ljit::JumpInstr>(bb2);
+
+  auto *v3 = bb2->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  v3->addNode(v0, bb0);
+  v3->addNode(v2, bb1);
+  bb2->pushInstBack<ljit::Ret>(v3);
+
+  // Act
+  runLowering();
+
+  // Assert
+  EXPECT_EQ(lowering->getNumLowered(), 1);
+  EXPECT_EQ(dispatch(10), bb1);
+  EXPECT_EQ(dispatch(1000), bb1);
+  EXPECT_EQ(dispatch(11), bb2);
+
+  // Each predecessor has its entry
+  ASSERT_EQ(v3->numEntries(), bb2->numPred());
+  for (const auto &entry : *v3)
+  {
+    EXPECT_NE(std::find(bb2->getPred().begin(), bb2->getPred().end(),
+                        entry.bb),
+              bb2->getPred().end());
+    const auto *const expected = entry.bb == bb1 ? v2 : v0;
+    EXPECT_EQ(entry.m_val, expected);
+  }
+}
@@ -0,0 +1,148 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "common/error.hh"
+#include "ir/function.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "ir/profile.hh"
+
+#include "profile/profile_data.hh"
+
+class ProfileDataTest : public ::testing::Test
+{
+protected:
+  ProfileDataTest() = default;
+
+  static void fillModule(ljit::Module &module)
+  {
+    module.createFunction("foo", ljit::Type::I64,
+                          std::vector{ljit::Type::I64});
+    module.createFunction("bar", ljit::Type::None);
+  }
+
+  static ljit::FunctionProfile makeProfile()
+  {
+    ljit::FunctionProfile profile;
+    profile.blockCounts[0] = 1;
+    profile.blockCounts[1] = 300;
+    profile.blockCounts[2] = 1ULL << 40U;
+    profile.branchCounts[1] = {299, 1};
+    profile.callCounts[{2, 0}] = 0;
+    profile.callCounts[{2, 1}] = 42;
+    return profile;
+  }
+
+  static void expectProfile(const ljit::FunctionProfile *profile)
+  {
+    ASSERT_NE(profile, nullptr);
+    EXPECT_EQ(profile->blockCounts.size(), 3);
+    EXPECT_EQ(profile->getBlockCount(1), 300);
+    EXPECT_EQ(profile->getBlockCount(2), 1ULL << 40U);
+    EXPECT_FALSE(profile->getBlockCount(3).has_value());
+
+    const auto *const counts = profile->getBranchCounts(1);
+    ASSERT_NE(counts, nullptr);
+    EXPECT_EQ((*counts)[0], 299);
+    EXPECT_EQ((*counts)[1], 1);
+    EXPECT_EQ(profile->getBranchCounts(0), nullptr);
+
+    EXPECT_EQ(profile->getCallCount(2, 0), 0);
+    EXPECT_EQ(profile->getCallCount(2, 1), 42);
+    EXPECT_FALSE(profile->getCallCount(1, 0).has_value());
+  }
+};
+
+TEST_F(ProfileDataTest, hash)
+{
+  // Assign
+  ljit::Function f1{ljit::Type::I64, std::vector{ljit::Type::I64}};
+  f1.setName("foo");
+  ljit::Function f2{ljit::Type::I64, std::vector{ljit::Type::I64}};
+  f2.setName("foo");
+  f2.appendBB();
+  ljit::Function f3{ljit::Type::I64, std::vector{ljit::Type::I32}};
+  f3.setName("foo");
+  ljit::Function f4{ljit::Type::I64, std::vector{ljit::Type::I64}};
+  f4.setName("fo");
+
+  // Act
+  const auto h1 = ljit::getFunctionHash(f1);
+
+  // Assert
+  EXPECT_EQ(h1, ljit::getFunctionHash(f2));
+  EXPECT_NE(h1, ljit::getFunctionHash(f3));
+  EXPECT_NE(h1, ljit::getFunctionHash(f4));
+}
+
+TEST_F(ProfileDataTest, roundTrip)
+{
+  // Assign
+  ljit::Module src;
+  fillModule(src);
+  src.findFunction("foo")->setProfile(makeProfile());
+  const auto path = ::testing::TempDir() + "ljit_round_trip.prof";
+
+  // Act
+  ljit::ProfileData::collect(src).write(path);
+  const auto data = ljit::ProfileData::read(path);
+  ljit::Module dst;
+  fillModule(dst);
+  const auto numAttached = data.attach(dst);
+
+  // Assert
+  EXPECT_EQ(data.size(), 1);
+  EXPECT_EQ(numAttached, 1);
+  expectProfile(dst.findFunction("foo")->getProfile());
+  EXPECT_EQ(dst.findFunction("bar")->getProfile(), nullptr);
+}
+
+TEST_F(ProfileDataTest, merge)
+{
+  // Assign
+  ljit::ProfileData data;
+  ljit::FunctionProfile profile;
+  profile.blockCounts[0] = 2;
+  profile.branchCounts[0] = {1, 1};
+
+  // Act
+  data.add(7, profile);
+  data.add(7, profile);
+
+  // Assert
+  EXPECT_EQ(data.size(), 1);
+  const auto *const res = data.find(7);
+  ASSERT_NE(res, nullptr);
+  EXPECT_EQ(res->getBlockCount(0), 4);
+  EXPECT_EQ(res->getBranchCounts(0)->at(1), 2);
+  EXPECT_EQ(data.find(8), nullptr);
+}
+
+TEST_F(ProfileDataTest, malformed)
+{
+  // Assign
+  ljit::ProfileData data;
+  data.add(7, makeProfile());
+  const auto bytes = data.serialize();
+
+  auto truncated = bytes;
+  truncated.pop_back();
+  auto trailing = bytes;
+  trailing.push_back(0);
+  auto badMagic = bytes;
+  badMagic[0] = 'X';
+  auto badVersion = bytes;
+  badVersion[ljit::ProfileData::kMagicSize] = 2;
+
+  // Act & Assert
+  EXPECT_NO_THROW(
+    expectProfile(ljit::ProfileData::deserialize(bytes.data(), bytes.size())
+                    .find(7)));
+  for (const auto &bad : {truncated, trailing, badMagic, badVersion})
+    EXPECT_THROW(ljit::ProfileData::deserialize(bad.data(), bad.size()),
+                 ljit::ProfileError);
+  EXPECT_THROW(ljit::ProfileData::read(::testing::TempDir() + "no.prof"),
+               ljit::ProfileError);
+}
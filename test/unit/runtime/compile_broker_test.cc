@@ -0,0 +1,220 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ir/module.hh"
+#include "runtime/compile_broker.hh"
+
+class CompileBrokerTest : public ::testing::Test
+{
+protected:
+  CompileBrokerTest()
+  {
+    for (std::size_t idx = 0; idx < kNumFuncs; ++idx)
+      funcs.push_back(module.createFunction("f" + std::to_string(idx),
+                                            ljit::Type::None,
+                                            std::vector<ljit::Type>{}));
+  }
+
+  // The first compilation waits for release()
+  void compile(const ljit::CompileTask &task)
+  {
+    std::unique_lock lock{mutex};
+    order.push_back(&task.getFunc());
+    started = true;
+    startedCv.notify_all();
+    releasedCv.wait(lock, [this] { return released; });
+  }
+
+  void waitStarted()
+  {
+    std::unique_lock lock{mutex};
+    startedCv.wait(lock, [this] { return started; });
+  }
+
+  void release()
+  {
+    const std::lock_guard lock{mutex};
+    released = true;
+    releasedCv.notify_all();
+  }
+
+  static constexpr std::size_t kNumFuncs = 4;
+
+  ljit::Module module;
+  std::vector<const ljit::Function *> funcs;
+
+  std::mutex mutex;
+  std::condition_variable startedCv;
+  std::condition_variable releasedCv;
+  bool started = false;
+  bool released = false;
+  std::vector<const ljit::Function *> order;
+};
+
+TEST_F(CompileBrokerTest, priorities)
+{
+  // Assign
+  ljit::CompileBroker broker{
+    1, 16, [this](const ljit::CompileTask &task) { compile(task); }};
+
+  // Act
+  ASSERT_NE(broker.submit(*funcs[0], 1), nullptr);
+  waitStarted();
+  ASSERT_NE(broker.submit(*funcs[1], 10), nullptr);
+  ASSERT_NE(broker.submit(*funcs[2], 30), nullptr);
+  ASSERT_NE(broker.submit(*funcs[3], 20), nullptr);
+  release();
+  broker.waitIdle();
+
+  // Assert
+  // Hottest function goes first
+  EXPECT_EQ(order, (std::vector{funcs[0], funcs[2], funcs[3], funcs[1]}));
+  EXPECT_EQ(broker.getStats().numCompleted, 4);
+}
+
+TEST_F(CompileBrokerTest, cancel)
+{
+  // Assign
+  ljit::CompileBroker broker{
+    1, 16, [this](const ljit::CompileTask &task) { compile(task); }};
+
+  // Act
+  const auto running = broker.submit(*funcs[0], 1);
+  waitStarted();
+  const auto pending = broker.submit(*funcs[1], 1);
+  ASSERT_NE(broker.submit(*funcs[2], 1), nullptr);
+  running->cancel();
+  pending->cancel();
+  release();
+  broker.waitIdle();
+
+  // Assert
+  // Cancelled task is not started
+  EXPECT_EQ(order, (std::vector{funcs[0], funcs[2]}));
+  const auto stats = broker.getStats();
+  EXPECT_EQ(stats.numCancelled, 2);
+  EXPECT_EQ(stats.numCompleted, 1);
+}
+
+TEST_F(CompileBrokerTest, cancelOnStop)
+{
+  // Assign
+  std::shared_ptr<ljit::CompileTask> pending;
+
+  // Act
+  {
+    // No workers, the request is never started
+    ljit::CompileBroker broker{
+      0, 16, [this](const ljit::CompileTask &task) { compile(task); }};
+    pending = broker.submit(*funcs[0], 1);
+    ASSERT_NE(pending, nullptr);
+  }
+
+  // Assert
+  EXPECT_TRUE(pending->isCancelled());
+}
+
+TEST_F(CompileBrokerTest, bounded)
+{
+  // Assign
+  ljit::CompileBroker broker{
+    1, 1, [this](const ljit::CompileTask &task) { compile(task); }};
+
+  // Act
+  ASSERT_NE(broker.submit(*funcs[0], 1), nullptr);
+  waitStarted();
+  const auto accepted = broker.submit(*funcs[1], 1);
+  const auto rejected = broker.submit(*funcs[2], 1);
+  release();
+  broker.waitIdle();
+
+  // Assert
+  EXPECT_NE(accepted, nullptr);
+  EXPECT_EQ(rejected, nullptr);
+  EXPECT_EQ(broker.getStats().numRejected, 1);
+  EXPECT_EQ(order, (std::vector{funcs[0], funcs[1]}));
+}
+
+TEST_F(CompileBrokerTest, producers)
+{
+  // Assign
+  constexpr std::size_t kNumProducers = 4;
+  constexpr std::size_t kNumTasks = 200;
+  std::atomic<std::size_t> numCompiled{};
+  ljit::CompileBroker broker{4, kNumProducers * kNumTasks,
+                             [&numCompiled](const ljit::CompileTask &) {
+                               numCompiled.fetch_add(1);
+                             }};
+  std::vector<std::thread> producers;
+
+  // Act
+  for (std::size_t id = 0; id < kNumProducers; ++id)
+    producers.emplace_back([&broker, this, id] {
+      for (std::size_t idx = 0; idx < kNumTasks; ++idx)
+        broker.submit(*funcs[id], idx);
+    });
+  for (auto &producer : producers)
+    producer.join();
+  broker.waitIdle();
+
+  // Assert
+  EXPECT_EQ(numCompiled.load(), kNumProducers * kNumTasks);
+  EXPECT_EQ(broker.getStats().numSubmitted, kNumProducers * kNumTasks);
+}
+
+TEST_F(CompileBrokerTest, wakeup)
+{
+  // Assign
+  constexpr std::size_t kNumRounds = 1000;
+  std::atomic<std::size_t> numCompiled{};
+  ljit::CompileBroker broker{
+    2, 1, [&numCompiled](const ljit::CompileTask &) {
+      numCompiled.fetch_add(1);
+    }};
+
+  // Act
+  // Each request is submitted to the waiting workers, lost wakeup hangs
+  for (std::size_t idx = 0; idx < kNumRounds; ++idx)
+  {
+    ASSERT_NE(broker.submit(*funcs[0], idx), nullptr);
+    broker.waitIdle();
+  }
+
+  // Assert
+  EXPECT_EQ(numCompiled.load(), kNumRounds);
+  EXPECT_EQ(broker.getStats().numCompleted, kNumRounds);
+}
+
+TEST_F(CompileBrokerTest, idle)
+{
+  // Assign
+  std::vector<std::size_t> idleAt;
+  std::size_t numCompiled = 0;
+  ljit::CompileBroker broker{
+    1, 16,
+    [this, &numCompiled](const ljit::CompileTask &task) {
+      compile(task);
+      ++numCompiled;
+    },
+    [&idleAt, &numCompiled] { idleAt.push_back(numCompiled); }};
+
+  // Act
+  ASSERT_NE(broker.submit(*funcs[0], 1), nullptr);
+  waitStarted();
+  ASSERT_NE(broker.submit(*funcs[1], 1), nullptr);
+  ASSERT_NE(broker.submit(*funcs[2], 1), nullptr);
+  release();
+  broker.waitIdle();
+
+  // Assert
+  // Idle function is called once the queue is drained, before waitIdle
+  // returns
+  EXPECT_EQ(idleAt, (std::vector<std::size_t>{3}));
+}
@@ -0,0 +1,62 @@
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "runtime/mpsc_queue.hh"
+
+TEST(MPSCQueueTest, fifo)
+{
+  // Assign
+  ljit::MPSCQueue<int> queue;
+
+  // Act
+  queue.push(1);
+  queue.push(2);
+  const auto fst = queue.pop();
+  queue.push(3);
+
+  // Assert
+  EXPECT_EQ(fst, 1);
+  EXPECT_EQ(queue.pop(), 2);
+  EXPECT_EQ(queue.pop(), 3);
+  EXPECT_FALSE(queue.pop().has_value());
+}
+
+TEST(MPSCQueueTest, producers)
+{
+  // Assign
+  constexpr std::size_t kNumProducers = 4;
+  constexpr std::size_t kNumItems = 10000;
+  ljit::MPSCQueue<std::pair<std::size_t, std::size_t>> queue;
+  std::vector<std::thread> producers;
+
+  // Act
+  for (std::size_t id = 0; id < kNumProducers; ++id)
+    producers.emplace_back([&queue, id] {
+      for (std::size_t idx = 0; idx < kNumItems; ++idx)
+        queue.push({id, idx});
+    });
+
+  // Next expected item of each producer
+  std::vector<std::size_t> next(kNumProducers);
+  std::size_t numPopped = 0;
+  bool ordered = true;
+  while (numPopped != kNumProducers * kNumItems)
+  {
+    const auto item = queue.pop();
+    if (!item.has_value())
+      continue;
+    const auto [id, idx] = *item;
+    ordered = ordered && next[id] == idx;
+    next[id] = idx + 1;
+    ++numPopped;
+  }
+  for (auto &producer : producers)
+    producer.join();
+
+  // Assert
+  EXPECT_TRUE(ordered);
+  EXPECT_FALSE(queue.pop().has_value());
+}
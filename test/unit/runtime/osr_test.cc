@@ -0,0 +1,167 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "runtime/osr.hh"
+
+class OsrTest : public ::testing::Test
+{
+protected:
+  OsrTest() = default;
+
+  // sumTo(n) = (0 + k) + ... + (n - 1 + k), where k = 3 * n
+  ljit::Function *buildSumTo()
+  {
+    auto *const func = module.createFunction("sumTo", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    header = func->appendBB();
+    auto *const bb2 = func->appendBB();
+    auto *const bb3 = func->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(3);
+    auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v3);
+    bb0->pushInstBack<ljit::JumpInstr>(header);
+
+    auto *v5 = header->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = header->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v7 =
+      header->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v0);
+    header->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v4);
+    auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v8);
+    auto *v10 =
+      bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v2);
+    bb2->pushInstBack<ljit::JumpInstr>(header);
+
+    v5->addNode(v1, bb0);
+    v5->addNode(v10, bb2);
+    v6->addNode(v1, bb0);
+    v6->addNode(v9, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v6);
+    return func;
+  }
+
+  // sumNested(n) = sum of j for 0 <= i, j < n
+  ljit::Function *buildSumNested()
+  {
+    auto *const func = module.createFunction("sumNested", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    header = func->appendBB();
+    auto *const bb2 = func->appendBB();
+    innerHeader = func->appendBB();
+    auto *const bb4 = func->appendBB();
+    auto *const bb5 = func->appendBB();
+    auto *const bb6 = func->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    bb0->pushInstBack<ljit::JumpInstr>(header);
+
+    auto *v3 = header->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v4 = header->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v5 =
+      header->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+    header->pushInstBack<ljit::IfInstr>(v5, bb2, bb6);
+
+    bb2->pushInstBack<ljit::JumpInstr>(innerHeader);
+
+    auto *v6 = innerHeader->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v7 = innerHeader->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v8 =
+      innerHeader->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v6, v0);
+    innerHeader->pushInstBack<ljit::IfInstr>(v8, bb4, bb5);
+
+    auto *v9 = bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v7, v6);
+    auto *v10 =
+      bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v2);
+    bb4->pushInstBack<ljit::JumpInstr>(innerHeader);
+
+    auto *v11 =
+      bb5->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+    bb5->pushInstBack<ljit::JumpInstr>(header);
+
+    v3->addNode(v1, bb0);
+    v3->addNode(v11, bb5);
+    v4->addNode(v1, bb0);
+    v4->addNode(v7, bb5);
+    v6->addNode(v1, bb2);
+    v6->addNode(v10, bb4);
+    v7->addNode(v4, bb2);
+    v7->addNode(v9, bb4);
+
+    bb6->pushInstBack<ljit::Ret>(v4);
+    return func;
+  }
+
+  ljit::Module module;
+  ljit::BasicBlock *header{};
+  ljit::BasicBlock *innerHeader{};
+};
+
+TEST_F(OsrTest, liveIns)
+{
+  // Assign
+  auto *const func = buildSumTo();
+  auto phi = header->begin();
+
+  // Act
+  const auto entry = ljit::OsrBuilder{*func, *header}.build();
+
+  // Assert
+  // Phis of the header, the param and the value computed before the loop
+  ASSERT_EQ(entry.liveIns.size(), 4);
+  EXPECT_EQ(entry.liveIns[0], &*phi++);
+  EXPECT_EQ(entry.liveIns[1], &*phi);
+  EXPECT_EQ(entry.liveIns[2], &*func->begin()->begin());
+  EXPECT_EQ(entry.liveIns[3]->getInstType(), ljit::InstType::kBinOp);
+  EXPECT_EQ(entry.func->getArgs().size(), 4);
+  EXPECT_EQ(entry.func->getName(), "sumTo.osr");
+  // Source function is not changed
+  EXPECT_EQ(func->size(), 4);
+}
+
+TEST_F(OsrTest, continuesLoop)
+{
+  // Assign
+  auto *const func = buildSumTo();
+  const auto entry = ljit::OsrBuilder{*func, *header}.build();
+  ljit::Interpreter interp;
+
+  // Act
+  // Loop of sumTo(10) after four iterations
+  const auto res = interp.run(*entry.func, {4, 6 + 4 * 30, 10, 30});
+
+  // Assert
+  EXPECT_EQ(res, interp.run(*func, {10}));
+  EXPECT_EQ(res, 345);
+}
+
+TEST_F(OsrTest, nested)
+{
+  // Assign
+  auto *const func = buildSumNested();
+  ljit::Interpreter interp;
+
+  // Act
+  const auto entry = ljit::OsrBuilder{*func, *header}.build();
+  // Outer loop after two iterations
+  const auto res = interp.run(*entry.func, {2, 90, 10});
+
+  // Assert
+  EXPECT_EQ(res, interp.run(*func, {10}));
+  // Counter of the outer loop is redefined after the inner header
+  EXPECT_THROW(ljit::OsrBuilder(*func, *innerHeader).build(),
+               std::runtime_error);
+}
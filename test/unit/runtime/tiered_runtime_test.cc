@@ -0,0 +1,640 @@
+#include <cstdio>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "common/error.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "runtime/tiered_runtime.hh"
+
+class TieredRuntimeTest : public ::testing::Test
+{
+protected:
+  TieredRuntimeTest() = default;
+
+  // fact(n) = n < 2 ? 1 : n * fact(n - 1)
+  ljit::Function *buildFact()
+  {
+    auto *const fact = module.createFunction("fact", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = fact->appendBB();
+    auto *const bb1 = fact->appendBB();
+    auto *const bb2 = fact->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v1);
+    bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+    bb1->pushInstBack<ljit::Ret>(v2);
+
+    auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+    auto *v5 = bb2->pushInstBack<ljit::Call>(fact);
+    v5->appendArg(v4);
+    auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v5);
+    bb2->pushInstBack<ljit::Ret>(v6);
+    return fact;
+  }
+
+  // sumSq(n) = sq(0) + ... + sq(n - 1), where sq(x) = x * x
+  ljit::Function *buildSumSq()
+  {
+    auto *const sq = module.createFunction("sq", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+    {
+      auto *const bb0 = sq->appendBB();
+      auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+      auto *v1 =
+        bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v0);
+      bb0->pushInstBack<ljit::Ret>(v1);
+    }
+
+    auto *const sumSq = module.createFunction("sumSq", ljit::Type::I64,
+                                              std::vector{ljit::Type::I64});
+    auto *const bb0 = sumSq->appendBB();
+    auto *const bb1 = sumSq->appendBB();
+    auto *const bb2 = sumSq->appendBB();
+    auto *const bb3 = sumSq->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+    auto *v6 = bb2->pushInstBack<ljit::Call>(sq);
+    v6->appendArg(v3);
+    auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v6);
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v3->addNode(v1, bb0);
+    v3->addNode(v8, bb2);
+    v4->addNode(v1, bb0);
+    v4->addNode(v7, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v4);
+    return sumSq;
+  }
+
+  // sumTo(n) = (0 + k) + ... + (n - 1 + k), where k = 3 * n
+  ljit::Function *buildSumTo()
+  {
+    auto *const func = module.createFunction("sumTo", ljit::Type::I64,
+                                             std::vector{ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    auto *const bb1 = func->appendBB();
+    auto *const bb2 = func->appendBB();
+    auto *const bb3 = func->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(3);
+    auto *v4 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v0, v3);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v4);
+    auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v8);
+    auto *v10 =
+      bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v2);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v5->addNode(v1, bb0);
+    v5->addNode(v10, bb2);
+    v6->addNode(v1, bb0);
+    v6->addNode(v9, bb2);
+
+    bb3->pushInstBack<ljit::Ret>(v6);
+    return func;
+  }
+
+  // sumUntil(n, len) = check(0, len) + ... + check(m - 1, len), where
+  // m = min(n, 5)
+  ljit::Function *buildSumUntil()
+  {
+    auto *const func =
+      module.createFunction("sumUntil", ljit::Type::I64,
+                            std::vector{ljit::Type::I64, ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    auto *const bb1 = func->appendBB();
+    auto *const bb2 = func->appendBB();
+    auto *const bb3 = func->appendBB();
+    auto *const bb4 = func->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v4 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb4);
+
+    // Early exit
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v5, v4);
+    bb2->pushInstBack<ljit::IfInstr>(v8, bb4, bb3);
+
+    auto *v9 = bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kBoundsCheck,
+                                              v5, v1);
+    auto *v10 =
+      bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v9);
+    auto *v11 =
+      bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v3);
+    bb3->pushInstBack<ljit::JumpInstr>(bb1);
+
+    v5->addNode(v2, bb0);
+    v5->addNode(v11, bb3);
+    v6->addNode(v2, bb0);
+    v6->addNode(v10, bb3);
+
+    bb4->pushInstBack<ljit::Ret>(v6);
+    return func;
+  }
+
+  // sumTwice(n, len) = (0 + ... + n - 1) + sumUntil(n, len)
+  ljit::Function *buildSumTwice()
+  {
+    auto *const func =
+      module.createFunction("sumTwice", ljit::Type::I64,
+                            std::vector{ljit::Type::I64, ljit::Type::I64});
+    auto *const bb0 = func->appendBB();
+    auto *const bb1 = func->appendBB();
+    auto *const bb2 = func->appendBB();
+    auto *const bb3 = func->appendBB();
+    auto *const bb4 = func->appendBB();
+    auto *const bb5 = func->appendBB();
+    auto *const bb6 = func->appendBB();
+
+    auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+    auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+    auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+    auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+    auto *v4 = bb0->pushInstBack<ljit::ConstVal_I64>(5);
+    bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v0);
+    bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+
+    auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v5);
+    auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v3);
+    bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+    auto *v10 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v11 = bb3->pushInstBack<ljit::Phi>(ljit::Type::I64);
+    auto *v12 =
+      bb3->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v10, v0);
+    bb3->pushInstBack<ljit::IfInstr>(v12, bb4, bb6);
+
+    // Early exit
+    auto *v13 =
+      bb4->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kEQ, v10, v4);
+    bb4->pushInstBack<ljit::IfInstr>(v13, bb6, bb5);
+
+    auto *v14 = bb5->pushInstBack<ljit::BinOp>(
+      ljit::BinOp::Oper::kBoundsCheck, v10, v1);
+    auto *v15 =
+      bb5->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v11, v14);
+    auto *v16 =
+      bb5->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v10, v3);
+    bb5->pushInstBack<ljit::JumpInstr>(bb3);
+
+    v5->addNode(v2, bb0);
+    v5->addNode(v9, bb2);
+    v6->addNode(v2, bb0);
+    v6->addNode(v8, bb2);
+    v10->addNode(v2, bb1);
+    v10->addNode(v16, bb5);
+    v11->addNode(v6, bb1);
+    v11->addNode(v15, bb5);
+
+    bb6->pushInstBack<ljit::Ret>(v11);
+    return func;
+  }
+
+  ljit::Module module;
+};
+
+TEST_F(TieredRuntimeTest, hotCalls)
+{
+  // Assign
+  auto *const fact = buildFact();
+  ljit::TieredRuntime runtime{ljit::TieringParams{3, 1000, {}}};
+
+  // Act
+  const auto first = runtime.run(*fact, {5});
+  runtime.waitForCompiles();
+
+  // Assert
+  EXPECT_EQ(first, 120);
+  EXPECT_EQ(runtime.getTier(*fact), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.run(*fact, {20}), 2432902008176640000);
+  EXPECT_EQ(runtime.getStats().numCompiled, 1);
+  EXPECT_EQ(runtime.getStats().numFailed, 0);
+}
+
+TEST_F(TieredRuntimeTest, hotLoop)
+{
+  // Assign
+  auto *const sumSq = buildSumSq();
+  const auto *const sq = module.findFunction("sq");
+  ljit::InlineParams noInline{};
+  noInline.callerBudget = 0;
+  ljit::TieredRuntime runtime{ljit::TieringParams{1000, 5, noInline}};
+
+  // Act
+  const auto first = runtime.run(*sumSq, {10});
+  runtime.waitForCompiles();
+  const auto executed = runtime.getInterpreter().getNumExecuted();
+  const auto second = runtime.run(*sumSq, {100});
+
+  // Assert
+  EXPECT_EQ(first, 285);
+  EXPECT_EQ(second, 328350);
+  EXPECT_EQ(runtime.getTier(*sumSq), ljit::Tier::kCompiled);
+  // Compiled loop calls the interpreted function through the stub
+  EXPECT_EQ(runtime.getTier(*sq), ljit::Tier::kInterpreter);
+  EXPECT_GT(runtime.getInterpreter().getNumExecuted(), executed);
+
+  const auto &stats = runtime.getStats();
+  EXPECT_EQ(stats.numCompiled, 1);
+  EXPECT_GT(stats.interpTime.count(), 0);
+  EXPECT_GT(stats.compiledTime.count(), 0);
+  EXPECT_GT(stats.compileTime.count(), 0);
+}
+
+TEST_F(TieredRuntimeTest, synchronous)
+{
+  // Assign
+  auto *const fact = buildFact();
+  ljit::TieredRuntime runtime{ljit::TieringParams{3, 1000, {}, 0}};
+
+  // Act
+  const auto res = runtime.run(*fact, {5});
+
+  // Assert
+  // Recursion reaches the compiled code after the third call
+  EXPECT_EQ(res, 120);
+  EXPECT_EQ(runtime.getTier(*fact), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.getBrokerStats().numSubmitted, 0);
+}
+
+TEST_F(TieredRuntimeTest, queueFull)
+{
+  // Assign
+  auto *const fact = buildFact();
+  ljit::TieredRuntime runtime{ljit::TieringParams{3, 1000, {}, 1, 0}};
+
+  // Act
+  const auto res = runtime.run(*fact, {10});
+  runtime.waitForCompiles();
+
+  // Assert
+  // Counter starts over after each rejected request
+  EXPECT_EQ(res, 3628800);
+  EXPECT_EQ(runtime.getTier(*fact), ljit::Tier::kInterpreter);
+  EXPECT_EQ(runtime.getBrokerStats().numRejected, 3);
+  EXPECT_EQ(runtime.getStats().numCompiled, 0);
+}
+
+TEST_F(TieredRuntimeTest, interpretedOnly)
+{
+  // Assign
+  auto *const sumSq = buildSumSq();
+  ljit::TieredRuntime runtime{ljit::TieringParams{1000, 1000, {}}};
+
+  // Act
+  const auto res = runtime.run(*sumSq, {10});
+
+  // Assert
+  EXPECT_EQ(res, 285);
+  EXPECT_EQ(runtime.getTier(*sumSq), ljit::Tier::kInterpreter);
+  EXPECT_EQ(runtime.getStats().numCompiled, 0);
+  EXPECT_EQ(runtime.getStats().compiledTime.count(), 0);
+  EXPECT_THROW(runtime.run(*sumSq, {}), std::runtime_error);
+}
+
+TEST_F(TieredRuntimeTest, traps)
+{
+  // Assign
+  auto *const div = module.createFunction(
+    "div", ljit::Type::I32, std::vector{ljit::Type::I32, ljit::Type::I32});
+  auto *const bb0 = div->appendBB();
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I32);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I32);
+  auto *v2 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v1);
+  bb0->pushInstBack<ljit::Ret>(v2);
+  // Compiled in the executing thread
+  ljit::TieredRuntime runtime{ljit::TieringParams{2, 1000, {}, 0}};
+
+  // Act & Assert
+  EXPECT_THROW(runtime.run(*div, {1, 0}), ljit::TrapError);
+  EXPECT_EQ(runtime.run(*div, {7, 2}), 3);
+  EXPECT_EQ(runtime.getTier(*div), ljit::Tier::kCompiled);
+  // Arguments are truncated to the parameter types
+  EXPECT_EQ(runtime.run(*div, {(std::int64_t{1} << 32) + 8, -2}), -4);
+  // Trap of the compiled code unwinds to the call
+  EXPECT_THROW(runtime.run(*div, {1, 0}), ljit::TrapError);
+  EXPECT_EQ(runtime.run(*div, {9, 3}), 3);
+}
+
+TEST_F(TieredRuntimeTest, foldedZeroCheck)
+{
+  // Assign
+  auto *const div = module.createFunction(
+    "div", ljit::Type::I64, std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *const bb0 = div->appendBB();
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 =
+    bb0->pushInstBack<ljit::UnaryOp>(ljit::UnaryOp::Oper::kZeroCheck, v1);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v0, v2);
+  bb0->pushInstBack<ljit::Ret>(v3);
+  ljit::TieredRuntime runtime{ljit::TieringParams{2, 1000, {}, 0}};
+
+  // Act
+  // Trap in the interpreter disables speculation
+  EXPECT_THROW(runtime.run(*div, {1, 0}), ljit::TrapError);
+  const auto res = runtime.run(*div, {7, 2});
+
+  // Assert
+  // Check is folded into the division, its fault unwinds to the call
+  EXPECT_EQ(res, 3);
+  EXPECT_EQ(runtime.getTier(*div), ljit::Tier::kCompiled);
+  EXPECT_THROW(runtime.run(*div, {1, 0}), ljit::TrapError);
+  EXPECT_EQ(runtime.getStats().numDeopts, 0);
+  EXPECT_EQ(runtime.run(*div, {-9, 3}), -3);
+}
+
+TEST_F(TieredRuntimeTest, osr)
+{
+  // Assign
+  auto *const sumTo = buildSumTo();
+  ljit::TieredRuntime runtime{
+    ljit::TieringParams{1000, ljit::Interpreter::kNoThreshold, {}, 0, 64, 100}};
+
+  // Act
+  const auto res = runtime.run(*sumTo, {100000});
+
+  // Assert
+  // Loop is left after 100 iterations, the function stays interpreted
+  EXPECT_EQ(res, 34999950000);
+  EXPECT_EQ(runtime.getTier(*sumTo), ljit::Tier::kInterpreter);
+  EXPECT_LT(runtime.getInterpreter().getNumExecuted(), 1000);
+
+  const auto &stats = runtime.getStats();
+  EXPECT_EQ(stats.numOsrCompiled, 1);
+  EXPECT_EQ(stats.numOsrEntries, 1);
+  EXPECT_GT(stats.compiledTime.count(), 0);
+  // Compiled entry is reused by the next run
+  EXPECT_EQ(runtime.run(*sumTo, {1000}), 3499500);
+  EXPECT_EQ(runtime.getStats().numOsrEntries, 2);
+}
+
+TEST_F(TieredRuntimeTest, osrBackground)
+{
+  // Assign
+  auto *const sumTo = buildSumTo();
+  ljit::TieredRuntime runtime{
+    ljit::TieringParams{1000, ljit::Interpreter::kNoThreshold, {}, 1, 64, 100}};
+
+  // Act
+  const auto first = runtime.run(*sumTo, {100000});
+  runtime.waitForCompiles();
+  const auto second = runtime.run(*sumTo, {100000});
+
+  // Assert
+  EXPECT_EQ(first, 34999950000);
+  EXPECT_EQ(second, 34999950000);
+  const auto &stats = runtime.getStats();
+  EXPECT_EQ(stats.numOsrCompiled, 1);
+  EXPECT_GE(stats.numOsrEntries, 1);
+}
+
+TEST_F(TieredRuntimeTest, deopt)
+{
+  // Assign
+  auto *const sumUntil = buildSumUntil();
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.maxDeopts = 2;
+  ljit::TieredRuntime runtime{params};
+  runtime.run(*sumUntil, {3, 10});
+  runtime.run(*sumUntil, {3, 10});
+
+  // Act
+  // Bounds check hoisted out of the loop fails on the limit
+  const auto res = runtime.run(*sumUntil, {100, 10});
+
+  // Assert
+  EXPECT_EQ(res, 10);
+  EXPECT_EQ(runtime.getTier(*sumUntil), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.run(*sumUntil, {4, 10}), 6);
+  EXPECT_EQ(runtime.getStats().numDeopts, 1);
+  // Deoptimized function traps in the interpreter called by the code
+  EXPECT_THROW(runtime.run(*sumUntil, {100, 3}), ljit::TrapError);
+  EXPECT_EQ(runtime.run(*sumUntil, {4, 10}), 6);
+}
+
+TEST_F(TieredRuntimeTest, deoptResume)
+{
+  // Assign
+  auto *const sumTwice = buildSumTwice();
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.osrThreshold = ljit::Interpreter::kNoThreshold;
+  ljit::TieredRuntime runtime{params};
+  runtime.run(*sumTwice, {3, 10});
+  runtime.run(*sumTwice, {3, 10});
+  const auto executed = runtime.getInterpreter().getNumExecuted();
+
+  // Act
+  // Hoisted check of the second loop fails
+  const auto res = runtime.run(*sumTwice, {10000, 10});
+
+  // Assert
+  // Interpreter continues from the second loop, the first one is not
+  // repeated
+  EXPECT_EQ(res, 49995010);
+  EXPECT_EQ(runtime.getStats().numDeopts, 1);
+  EXPECT_LT(runtime.getInterpreter().getNumExecuted() - executed, 1000);
+  EXPECT_EQ(runtime.getTier(*sumTwice), ljit::Tier::kCompiled);
+  EXPECT_THROW(runtime.run(*sumTwice, {10000, 3}), ljit::TrapError);
+  EXPECT_EQ(runtime.run(*sumTwice, {4, 10}), 12);
+}
+
+TEST_F(TieredRuntimeTest, trapInLoop)
+{
+  // Assign
+  // divSum(n, d) = 100 / (d - 0) + ... + 100 / (d - n + 1)
+  auto *const divSum =
+    module.createFunction("divSum", ljit::Type::I64,
+                          std::vector{ljit::Type::I64, ljit::Type::I64});
+  auto *const bb0 = divSum->appendBB();
+  auto *const bb1 = divSum->appendBB();
+  auto *const bb2 = divSum->appendBB();
+  auto *const bb3 = divSum->appendBB();
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::Param>(1U, ljit::Type::I64);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v3 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v4 = bb0->pushInstBack<ljit::ConstVal_I64>(100);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+  auto *v5 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v6 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v7 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v5, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v7, bb2, bb3);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v1, v5);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kDiv, v4, v8);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v6, v9);
+  auto *v11 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v3);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+  v5->addNode(v2, bb0);
+  v5->addNode(v11, bb2);
+  v6->addNode(v2, bb0);
+  v6->addNode(v10, bb2);
+  bb3->pushInstBack<ljit::Ret>(v6);
+
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.osrThreshold = ljit::Interpreter::kNoThreshold;
+  ljit::TieredRuntime runtime{params};
+  runtime.run(*divSum, {2, 100});
+  runtime.run(*divSum, {2, 100});
+  const auto executed = runtime.getInterpreter().getNumExecuted();
+
+  // Act & Assert
+  // Division in the loop is not speculative, it traps w/o deoptimization
+  EXPECT_THROW(runtime.run(*divSum, {10000, 5000}), ljit::TrapError);
+  EXPECT_EQ(runtime.getStats().numDeopts, 0);
+  EXPECT_EQ(runtime.getInterpreter().getNumExecuted(), executed);
+  EXPECT_EQ(runtime.run(*divSum, {2, 100}), 2);
+}
+
+TEST_F(TieredRuntimeTest, deoptRecompile)
+{
+  // Assign
+  auto *const sumUntil = buildSumUntil();
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.maxDeopts = 2;
+  ljit::TieredRuntime runtime{params};
+  runtime.run(*sumUntil, {3, 10});
+  runtime.run(*sumUntil, {3, 10});
+
+  // Act
+  runtime.run(*sumUntil, {100, 10});
+  const auto res = runtime.run(*sumUntil, {100, 10});
+  const auto tier = runtime.getTier(*sumUntil);
+  runtime.run(*sumUntil, {100, 10});
+  runtime.run(*sumUntil, {100, 10});
+
+  // Assert
+  // Code is dropped after two deoptimizations, the function is recompiled
+  // w/o speculation
+  EXPECT_EQ(res, 10);
+  EXPECT_EQ(tier, ljit::Tier::kInterpreter);
+  EXPECT_EQ(runtime.getTier(*sumUntil), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.run(*sumUntil, {100, 10}), 10);
+  EXPECT_EQ(runtime.getStats().numDeopts, 2);
+  EXPECT_EQ(runtime.getStats().numCompiled, 2);
+  EXPECT_THROW(runtime.run(*sumUntil, {100, 3}), ljit::TrapError);
+}
+
+TEST_F(TieredRuntimeTest, evictCold)
+{
+  // Assign
+  auto *const fact = buildFact();
+  ljit::TieringParams params{3, 1000, {}, 0};
+  params.codeCache.budget = 0;
+  ljit::TieredRuntime runtime{params};
+  runtime.run(*fact, {5});
+  const auto tier = runtime.getTier(*fact);
+
+  // Act
+  // Code over the budget is evicted before the call
+  const auto res = runtime.run(*fact, {5});
+
+  // Assert
+  // Function warms up and is compiled again
+  EXPECT_EQ(res, 120);
+  EXPECT_EQ(tier, ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.getTier(*fact), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.getStats().numCompiled, 2);
+  const auto stats = runtime.getCodeCacheStats();
+  EXPECT_EQ(stats.numEvicted, 1);
+  EXPECT_EQ(stats.numBlobs, 1);
+}
+
+TEST_F(TieredRuntimeTest, aotCache)
+{
+  // Assign
+  auto *const fact = buildFact();
+  auto *const sumUntil = buildSumUntil();
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.aotCache = ::testing::TempDir() + "ljit_tiered.code";
+  std::remove(params.aotCache.c_str());
+  {
+    ljit::TieredRuntime runtime{params};
+    runtime.run(*fact, {5});
+    runtime.run(*sumUntil, {3, 10});
+    runtime.run(*sumUntil, {3, 10});
+    runtime.saveAotCache();
+  }
+  ljit::TieredRuntime runtime{params};
+
+  // Act
+  const auto first = runtime.run(*fact, {5});
+  runtime.run(*sumUntil, {3, 10});
+  runtime.run(*sumUntil, {3, 10});
+  // Loaded speculative code deoptimizes as well
+  const auto res = runtime.run(*sumUntil, {100, 10});
+
+  // Assert
+  EXPECT_EQ(first, 120);
+  EXPECT_EQ(runtime.getTier(*fact), ljit::Tier::kCompiled);
+  EXPECT_EQ(runtime.run(*fact, {20}), 2432902008176640000);
+  EXPECT_EQ(res, 10);
+  const auto stats = runtime.getStats();
+  EXPECT_EQ(stats.numCompiled, 0);
+  EXPECT_EQ(stats.numAotLoaded, 2);
+  EXPECT_EQ(stats.numDeopts, 1);
+}
+
+TEST_F(TieredRuntimeTest, aotCacheSettings)
+{
+  // Assign
+  auto *const fact = buildFact();
+  ljit::TieringParams params{2, 1000, {}, 0};
+  params.aotCache = ::testing::TempDir() + "ljit_tiered_settings.code";
+  std::remove(params.aotCache.c_str());
+  {
+    ljit::TieredRuntime runtime{params};
+    runtime.run(*fact, {5});
+    runtime.saveAotCache();
+  }
+  params.inlineParams.baseThreshold += 1;
+  ljit::TieredRuntime runtime{params};
+
+  // Act
+  const auto res = runtime.run(*fact, {5});
+
+  // Assert
+  // Code of other inlining limits is not reused
+  EXPECT_EQ(res, 120);
+  const auto stats = runtime.getStats();
+  EXPECT_EQ(stats.numAotLoaded, 0);
+  EXPECT_EQ(stats.numCompiled, 1);
+}
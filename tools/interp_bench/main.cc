@@ -0,0 +1,114 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <CLI/CLI.hpp>
+
+#include "interp/interpreter.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+
+namespace
+{
+// loop(n) = sum of (i * i) >> 1 | i for i in [0, n)
+ljit::Function *makeLoop(ljit::Module &module)
+{
+  auto *const func = module.createFunction("loop", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  auto *const bb0 = func->appendBB();
+  auto *const bb1 = func->appendBB();
+  auto *const bb2 = func->appendBB();
+  auto *const bb3 = func->appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v3, v3);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v6, v2);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v7, v3);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v8);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v1, bb0);
+  v3->addNode(v10, bb2);
+  v4->addNode(v1, bb0);
+  v4->addNode(v9, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+  return func;
+}
+
+// fib(n) = n <= 1 ? n : fib(n - 1) + fib(n - 2)
+ljit::Function *makeFib(ljit::Module &module)
+{
+  auto *const func = module.createFunction("fib", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  auto *const bb0 = func->appendBB();
+  auto *const bb1 = func->appendBB();
+  auto *const bb2 = func->appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v2);
+  bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+  bb1->pushInstBack<ljit::Ret>(v0);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  auto *v5 = bb2->pushInstBack<ljit::Call>(func);
+  v5->appendArg(v4);
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+  auto *v7 = bb2->pushInstBack<ljit::Call>(func);
+  v7->appendArg(v6);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v7);
+  bb2->pushInstBack<ljit::Ret>(v8);
+  return func;
+}
+
+void measure(const char *name, ljit::Interpreter &interp,
+             const ljit::Function &func, std::int64_t arg)
+{
+  const auto before = interp.getNumExecuted();
+  const auto start = std::chrono::steady_clock::now();
+  const auto res = interp.run(func, {arg});
+  const auto end = std::chrono::steady_clock::now();
+
+  const auto numInsts = interp.getNumExecuted() - before;
+  const std::chrono::duration<double> secs = end - start;
+  std::cout << name << '(' << arg << ") = " << res << ": " << numInsts
+            << " insts in " << secs.count() << " s, "
+            << static_cast<double>(numInsts) / secs.count() / 1e6
+            << " M insts/s\n";
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+  std::int64_t loopN = 100'000'000;
+  std::int64_t fibN = 30;
+  {
+    CLI::App app{"interp_bench: interpreter throughput"};
+    app.add_option("--loop", loopN, "Number of loop iterations");
+    app.add_option("--fib", fibN, "Argument of recursive fib");
+
+    CLI11_PARSE(app, argc, argv);
+  }
+
+  ljit::Module module;
+  const auto *const loop = makeLoop(module);
+  const auto *const fib = makeFib(module);
+
+  ljit::Interpreter interp;
+  measure("loop", interp, *loop, loopN);
+  measure("fib", interp, *fib, fibN);
+}
@@ -1,12 +1,120 @@
+#include <exception>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <CLI/CLI.hpp>
 
+#include "codegen/elf_writer.hh"
+#include "ir/cloner.hh"
+#include "ir/inst.hh"
+#include "ir/module.hh"
+#include "runtime/tiered_runtime.hh"
+
+namespace
+{
+// loop(n) = sum of (i * i) >> 1 | i for i in [0, n)
+void makeLoop(ljit::Module &module)
+{
+  auto *const func = module.createFunction("loop", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  auto *const bb0 = func->appendBB();
+  auto *const bb1 = func->appendBB();
+  auto *const bb2 = func->appendBB();
+  auto *const bb3 = func->appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(0);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  bb0->pushInstBack<ljit::JumpInstr>(bb1);
+
+  auto *v3 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v4 = bb1->pushInstBack<ljit::Phi>(ljit::Type::I64);
+  auto *v5 = bb1->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v3, v0);
+  bb1->pushInstBack<ljit::IfInstr>(v5, bb2, bb3);
+
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kMul, v3, v3);
+  auto *v7 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kShr, v6, v2);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kOr, v7, v3);
+  auto *v9 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v4, v8);
+  auto *v10 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v3, v2);
+  bb2->pushInstBack<ljit::JumpInstr>(bb1);
+
+  v3->addNode(v1, bb0);
+  v3->addNode(v10, bb2);
+  v4->addNode(v1, bb0);
+  v4->addNode(v9, bb2);
+
+  bb3->pushInstBack<ljit::Ret>(v4);
+}
+
+// fib(n) = n <= 1 ? n : fib(n - 1) + fib(n - 2)
+void makeFib(ljit::Module &module)
+{
+  auto *const func = module.createFunction("fib", ljit::Type::I64,
+                                           std::vector{ljit::Type::I64});
+  auto *const bb0 = func->appendBB();
+  auto *const bb1 = func->appendBB();
+  auto *const bb2 = func->appendBB();
+
+  auto *v0 = bb0->pushInstBack<ljit::Param>(0U, ljit::Type::I64);
+  auto *v1 = bb0->pushInstBack<ljit::ConstVal_I64>(1);
+  auto *v2 = bb0->pushInstBack<ljit::ConstVal_I64>(2);
+  auto *v3 = bb0->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kLE, v0, v2);
+  bb0->pushInstBack<ljit::IfInstr>(v3, bb1, bb2);
+
+  bb1->pushInstBack<ljit::Ret>(v0);
+
+  auto *v4 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v1);
+  auto *v5 = bb2->pushInstBack<ljit::Call>(func);
+  v5->appendArg(v4);
+  auto *v6 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kSub, v0, v2);
+  auto *v7 = bb2->pushInstBack<ljit::Call>(func);
+  v7->appendArg(v6);
+  auto *v8 = bb2->pushInstBack<ljit::BinOp>(ljit::BinOp::Oper::kAdd, v5, v7);
+  bb2->pushInstBack<ljit::Ret>(v8);
+}
+
+// Functions are callable from C as int64_t name(int64_t)
+void compileAot(const std::string &path)
+{
+  ljit::Module module;
+  makeLoop(module);
+  makeFib(module);
+
+  ljit::ElfWriter writer;
+  for (const auto &func : module)
+  {
+    // No deoptimization in the object, so the code is not speculative
+    auto optimized = ljit::cloneFunction(*func);
+    ljit::optimizeFunction(*optimized);
+    writer.addFunction(*optimized);
+  }
+  writer.write(path);
+}
+} // namespace
+
 int main(int argc, char *argv[])
 {
+  std::string aotPath;
   {
     CLI::App app{"ljit: leech JIT"};
+    app.add_option("--aot", aotPath,
+                   "Compile the sample functions to ELF object file");
 
     CLI11_PARSE(app, argc, argv);
   }
+
+  if (aotPath.empty())
+    return 0;
+
+  try
+  {
+    compileAot(aotPath);
+  }
+  catch (const std::exception &ex)
+  {
+    std::cerr << ex.what() << '\n';
+    return 1;
+  }
 }